@@ -0,0 +1,252 @@
+//////////////////////////////////////////////////////////////////////////////////
+// End-to-end scaling of the subtraction and matrix building
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   SumPeakScaling [--threads=1,2,4] [--bins=1000,2000,4000,8000] [--indices=51]
+//                  [--formats=dense,sparse,triangular] [--events=1e5] [--seed=1]
+//                  [--workdir=scaling] [--csv=scaling.csv]
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "TFile.h"
+#include "TH2.h"
+#include "FileHandler.h"
+#include "BGUtils.h"
+#include "HistogramManager.h"
+#include "ShardMerger.h"
+#include "DatasetGenerator.h"
+
+/************************************************************//**
+ * Resources used by one configuration
+ ***************************************************************/
+struct RunUsage {
+    bool ok = false;
+    double cpu_seconds = 0.;
+    long max_rss_kb = 0; // largest single process
+    long long read_bytes = 0; // block I/O, page cache hits are not counted
+    long long written_bytes = 0;
+};
+
+/************************************************************//**
+ * Splits a comma separated option
+ *
+ * @param text e.g. "1,2,4"
+ ***************************************************************/
+std::vector<std::string> SplitList(std::string text)
+{
+    std::vector<std::string> item_vec;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) item_vec.push_back(item);
+    }
+
+    return item_vec;
+} // end SplitList()
+
+/************************************************************//**
+ * Size of a file on disk, 0 if missing
+ *
+ * @param filename name of the file
+ ***************************************************************/
+long long FileSize(std::string filename)
+{
+    struct stat file_stat;
+    if (stat(filename.c_str(), &file_stat) != 0) return 0;
+
+    return file_stat.st_size;
+} // end FileSize()
+
+/************************************************************//**
+ * Subtracts and builds the matrices of one configuration
+ *
+ * Runs in a forked process, so the resources of this process and
+ * its shard processes belong to the configuration alone. Threads
+ * are local shard processes, the parallel mode every storage format
+ * supports.
+ *
+ * @param src_filename source histograms
+ * @param bg_filename room background histograms
+ * @param output_filename subtracted and angle matrices
+ * @param threads number of shard processes
+ * @param indices number of angular indices
+ * @param format storage format of the subtraction
+ ***************************************************************/
+bool RunConfiguration(std::string src_filename, std::string bg_filename, std::string output_filename, int threads, int indices, std::string format)
+{
+    auto subtract = [&](ShardSpec spec) {
+        FileHandler inputs(src_filename, bg_filename);
+        BGUtils bg_utils(&inputs);
+        bg_utils.SetStorageFormat(format);
+        bg_utils.SetAngleIndices(indices);
+        bg_utils.SetOutputFile(output_filename);
+        bg_utils.SetShard(spec);
+        bg_utils.SubtractAllBackground();
+        return true;
+    };
+    auto subtract_file = [&](ShardSpec spec) {return spec.FileName(output_filename);};
+    if (!ShardMerger::RunLocal(threads, subtract, subtract_file, output_filename)) return false;
+
+    auto build = [&](ShardSpec spec) {
+        FileHandler inputs(output_filename);
+        HistogramManager hist_man(&inputs);
+        hist_man.SetAngleIndices(indices);
+        hist_man.SetShard(spec);
+        hist_man.BuildAllAngularMatrices();
+        return true;
+    };
+    auto build_file = [&](ShardSpec spec) {return HistogramManager::ShardFileName(output_filename, spec);};
+
+    return ShardMerger::RunLocal(threads, build, build_file, output_filename);
+} // end RunConfiguration()
+
+/************************************************************//**
+ * Measures one configuration in a child process
+ *
+ * @param work configuration to run
+ ***************************************************************/
+RunUsage MeasureConfiguration(std::function<bool()> work)
+{
+    RunUsage usage;
+    int result_pipe[2];
+    if (pipe(result_pipe) != 0) return usage;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        return usage;
+    }
+    if (pid == 0) {
+        close(result_pipe[0]);
+        usage.ok = work();
+        struct rusage self_usage, children_usage;
+        getrusage(RUSAGE_SELF, &self_usage);
+        getrusage(RUSAGE_CHILDREN, &children_usage);
+        usage.cpu_seconds = self_usage.ru_utime.tv_sec + self_usage.ru_stime.tv_sec + children_usage.ru_utime.tv_sec + children_usage.ru_stime.tv_sec
+                            + 1e-6 * (self_usage.ru_utime.tv_usec + self_usage.ru_stime.tv_usec + children_usage.ru_utime.tv_usec + children_usage.ru_stime.tv_usec);
+        usage.max_rss_kb = std::max(self_usage.ru_maxrss, children_usage.ru_maxrss);
+        usage.read_bytes = 512LL * (self_usage.ru_inblock + children_usage.ru_inblock);
+        usage.written_bytes = 512LL * (self_usage.ru_oublock + children_usage.ru_oublock);
+        if (write(result_pipe[1], &usage, sizeof(usage)) != sizeof(usage)) _exit(EXIT_FAILURE);
+        _exit(usage.ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(result_pipe[1]);
+    if (read(result_pipe[0], &usage, sizeof(usage)) != sizeof(usage)) usage.ok = false;
+    close(result_pipe[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) usage.ok = false;
+
+    return usage;
+} // end MeasureConfiguration()
+
+int main(int argc, char **argv)
+{
+    std::map<std::string, std::string> options;
+    for (auto i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t split = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || split == std::string::npos) {
+            std::cerr << "usage: " << argv[0] << " [--threads=1,2,4] [--bins=1000,2000,4000,8000] [--indices=51] [--formats=dense,sparse,triangular] [--events=1e5] [--seed=1] [--workdir=scaling] [--csv=scaling.csv]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        options[arg.substr(2, split - 2)] = arg.substr(split + 1);
+    }
+    std::vector<std::string> threads_vec = SplitList(options.count("threads") ? options["threads"] : "1,2,4");
+    std::vector<std::string> bins_vec = SplitList(options.count("bins") ? options["bins"] : "1000,2000,4000,8000");
+    std::vector<std::string> indices_vec = SplitList(options.count("indices") ? options["indices"] : "51");
+    std::vector<std::string> format_vec = SplitList(options.count("formats") ? options["formats"] : "dense,sparse,triangular");
+    const std::string events_text = options.count("events") ? options["events"] : "1e5";
+    const double events = std::atof(events_text.c_str());
+    const int seed = options.count("seed") ? std::atoi(options["seed"].c_str()) : 1;
+    const std::string workdir = options.count("workdir") ? options["workdir"] : "scaling";
+    const std::string csv_filename = options.count("csv") ? options["csv"] : "scaling.csv";
+
+    mkdir(workdir.c_str(), 0755);
+    {
+        // true room scaling of the generated source runs
+        std::string scale_filename = workdir + "/bg_index_scaling.csv";
+        std::ofstream scale_file(scale_filename, std::ios_base::trunc);
+        scale_file << "index,scale\n";
+        for (auto i = 0; i < 100; i++) {
+            scale_file << i << ",1.0\n";
+        }
+    }
+
+    bool new_csv = FileSize(csv_filename) == 0;
+    std::ofstream csv_file(csv_filename, std::ios_base::app);
+    if (!csv_file) {
+        std::cerr << "ERROR --- Could not open " << csv_filename << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (new_csv) csv_file << "threads,bins,indices,format,wall_s,cpu_s,max_rss_mb,read_mb,written_mb,input_mb,output_mb,ok\n";
+
+    for (auto &bins_text : bins_vec) {
+        for (auto &indices_text : indices_vec) {
+            const int bins = std::atoi(bins_text.c_str());
+            const int indices = std::atoi(indices_text.c_str());
+            // datasets are kept between runs of the harness
+            std::string dataset = "dataset_" + bins_text + "_" + indices_text + "_" + events_text + "_" + std::to_string(seed);
+            std::string src_filename = dataset + "_source.root";
+            std::string bg_filename = dataset + "_background.root";
+            if (FileSize(workdir + "/" + src_filename) == 0 || FileSize(workdir + "/" + bg_filename) == 0) {
+                DatasetGenerator generator(indices);
+                // same physics for every binning, only the bin width changes
+                generator.SetBinning(bins, 3000.);
+                generator.SetEvents(events, events, 0.1 * events);
+                generator.SetSeed(seed);
+                if (!generator.Generate(workdir + "/" + src_filename, workdir + "/" + bg_filename)) return EXIT_FAILURE;
+            }
+            const double input_mb = (FileSize(workdir + "/" + src_filename) + FileSize(workdir + "/" + bg_filename)) / 1048576.;
+
+            for (auto &threads_text : threads_vec) {
+                for (auto &format : format_vec) {
+                    const int threads = std::atoi(threads_text.c_str());
+                    const std::string output_filename = "scaling_outputs.root";
+                    std::cout << "Running " << threads << " threads, " << bins << " bins, " << indices << " indices, " << format << " ..." << std::endl;
+
+                    auto start = std::chrono::steady_clock::now();
+                    RunUsage usage = MeasureConfiguration([&]() {
+                        if (chdir(workdir.c_str()) != 0) return false;
+                        return RunConfiguration(src_filename, bg_filename, output_filename, threads, indices, format);
+                    });
+                    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                    const double output_mb = FileSize(workdir + "/" + output_filename) / 1048576.;
+                    std::remove((workdir + "/" + output_filename).c_str());
+                    for (auto k = 0; k < threads; k++) {
+                        ShardSpec spec;
+                        spec.index = k;
+                        spec.count = threads;
+                        std::remove((workdir + "/" + spec.FileName(output_filename) + ".checkpoint").c_str());
+                    }
+
+                    csv_file << threads << "," << bins << "," << indices << "," << format << "," << elapsed.count() << "," << usage.cpu_seconds << ","
+                             << usage.max_rss_kb / 1024. << "," << usage.read_bytes / 1048576. << "," << usage.written_bytes / 1048576. << ","
+                             << input_mb << "," << output_mb << "," << (usage.ok ? 1 : 0) << std::endl;
+                    if (!usage.ok) std::cerr << "WARNING --- Configuration failed, see the logs in " << workdir << std::endl;
+                }
+            }
+        }
+    }
+    std::cout << "Results written to: " << csv_filename << std::endl;
+
+    return 0;
+} // end main()
@@ -0,0 +1,187 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Micro-benchmarks of the matrix kernels on synthetic matrices
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   SumPeakBench [--bins=3000] [--density=0.05] [--repeats=10] [--seed=1] [--kernel=name]
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include "TH1.h"
+#include "TH2.h"
+#include "MatrixKernels.h"
+#include "SparseMatrix.h"
+#include "TriangularMatrix.h"
+#include "GainCorrection.h"
+#include "BGUtils.h"
+
+// every operator new of the process is counted
+static std::atomic<long long> num_allocations(0);
+
+void* operator new(size_t size)
+{
+    num_allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/************************************************************//**
+ * One benchmarked kernel
+ ***************************************************************/
+struct BenchKernel {
+    std::string name;
+    std::function<void()> run;
+    double bytes; // touched per call
+    double cells; // bins visited per call, including under/overflow
+};
+
+/************************************************************//**
+ * Fills a sum energy matrix with random counts
+ *
+ * Only gamma energies below the sum energy are filled, as in
+ * measured matrices, so packed formats see a realistic layout.
+ *
+ * @param h matrix to fill
+ * @param density fraction of the lower triangle that is filled
+ * @param generator random numbers
+ ***************************************************************/
+void FillSynthetic(TH2D *h, double density, std::mt19937_64 &generator)
+{
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::poisson_distribution<int> counts(20.);
+    const int row_length = h->GetNbinsX() + 2;
+    double *content = h->GetArray();
+    double *sumw2 = h->GetSumw2()->GetArray();
+    for (auto y_bin = 1; y_bin <= h->GetNbinsY(); y_bin++) {
+        for (auto x_bin = y_bin; x_bin <= h->GetNbinsX(); x_bin++) {
+            if (uniform(generator) >= density) continue;
+            double n = counts(generator);
+            content[x_bin + row_length * y_bin] = n;
+            sumw2[x_bin + row_length * y_bin] = n;
+        }
+    }
+    h->ResetStats();
+} // end FillSynthetic()
+
+/************************************************************//**
+ * Times repeated calls of a kernel
+ *
+ * @param kernel kernel to run
+ * @param repeats timed calls after one warm-up call
+ ***************************************************************/
+void RunKernel(BenchKernel &kernel, int repeats)
+{
+    kernel.run(); // warm-up, first touch of buffers
+    long long allocations = num_allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (auto r = 0; r < repeats; r++) {
+        kernel.run();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    allocations = num_allocations - allocations;
+
+    double seconds = elapsed.count() / repeats;
+    std::cout << std::left << std::setw(22) << kernel.name << std::right << std::fixed
+              << std::setw(12) << std::setprecision(3) << (kernel.cells > 0 ? seconds * 1e9 / kernel.cells : 0.)
+              << std::setw(12) << std::setprecision(2) << kernel.bytes / seconds / 1e9
+              << std::setw(14) << std::setprecision(1) << (double) allocations / repeats
+              << std::setw(14) << std::setprecision(3) << seconds * 1e3 << std::endl;
+} // end RunKernel()
+
+int main(int argc, char **argv)
+{
+    std::map<std::string, std::string> options;
+    for (auto i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t split = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || split == std::string::npos) {
+            std::cerr << "usage: " << argv[0] << " [--bins=3000] [--density=0.05] [--repeats=10] [--seed=1] [--kernel=name]" << std::endl;
+            return EXIT_FAILURE;
+        }
+        options[arg.substr(2, split - 2)] = arg.substr(split + 1);
+    }
+    const int bins = options.count("bins") ? std::atoi(options["bins"].c_str()) : 3000;
+    const double density = options.count("density") ? std::atof(options["density"].c_str()) : 0.05;
+    const int repeats = options.count("repeats") ? std::atoi(options["repeats"].c_str()) : 10;
+    const int seed = options.count("seed") ? std::atoi(options["seed"].c_str()) : 1;
+    const int gate_low = bins * 1759 / 3000;
+    const int gate_high = bins * 1765 / 3000;
+
+    TH1::AddDirectory(false);
+    std::mt19937_64 generator(seed);
+    TH2D src_h("src", "", bins, 0, bins, bins, 0, bins);
+    TH2D bg_h("bg", "", bins, 0, bins, bins, 0, bins);
+    TH2D result_h("result", "", bins, 0, bins, bins, 0, bins);
+    src_h.Sumw2();
+    bg_h.Sumw2();
+    result_h.Sumw2();
+    FillSynthetic(&src_h, density, generator);
+    FillSynthetic(&bg_h, density, generator);
+
+    SparseMatrix<double> sparse_src, sparse_bg, sparse_result;
+    sparse_src.FromHistogram(&src_h);
+    sparse_bg.FromHistogram(&bg_h);
+    TriangularMatrix<double> triangular_src, triangular_bg, triangular_result;
+    triangular_src.FromHistogram(&src_h);
+    triangular_bg.FromHistogram(&bg_h);
+    GainCorrection gain(0.5, 1.0005);
+    std::vector<double> scratch_vec;
+    BGUtils bg_utils(NULL);
+    std::vector<double> projection_vec, error2_vec;
+
+    // packed kernels only visit their stored bins
+    const double cells = (double) (bins + 2) * (bins + 2);
+    const double sparse_cells = sparse_src.GetNonZero();
+    const double triangular_cells = triangular_src.GetPackedSize();
+    const double gate_cells = (double) (gate_high - gate_low + 1) * (bins + 2);
+    const double gate_sparse_cells = sparse_src.GetNonZero(gate_low, gate_high);
+    const double gate_triangular_cells = triangular_src.GetPackedSize(gate_low, gate_high);
+    const double dense_bytes = cells * sizeof(double);
+    const double sparse_bytes = sparse_cells * (2 * sizeof(double) + sizeof(int));
+    const double triangular_bytes = triangular_cells * 2 * sizeof(double);
+
+    std::vector<BenchKernel> kernel_vec = {
+        {"subtract_dense", [&]() {result_h.Add(&src_h, &bg_h, 1., -0.8);}, 6 * dense_bytes, cells},
+        {"subtract_sparse", [&]() {sparse_result.Assign(sparse_src); sparse_result.Add(sparse_bg, -0.8);}, 3 * sparse_bytes, sparse_cells},
+        {"subtract_triangular", [&]() {triangular_result.Assign(triangular_src); triangular_result.Add(triangular_bg, -0.8);}, 3 * triangular_bytes, triangular_cells},
+        {"project_dense", [&]() {MatrixKernels::ProjectX(src_h.GetArray(), src_h.GetSumw2()->GetArray(), bins, bins, projection_vec, error2_vec);}, 2 * dense_bytes, cells},
+        {"project_sparse", [&]() {sparse_src.ProjectX(projection_vec, error2_vec);}, sparse_bytes, sparse_cells},
+        {"project_triangular", [&]() {triangular_src.ProjectX(projection_vec, error2_vec);}, triangular_bytes, triangular_cells},
+        {"gate_dense", [&]() {MatrixKernels::ProjectY(src_h.GetArray(), src_h.GetSumw2()->GetArray(), bins, bins, gate_low, gate_high, projection_vec, error2_vec);}, gate_cells * 2 * sizeof(double), gate_cells},
+        {"gate_sparse", [&]() {sparse_src.ProjectY(gate_low, gate_high, projection_vec, error2_vec);}, gate_sparse_cells * (2 * sizeof(double) + sizeof(int)), gate_sparse_cells},
+        {"gate_triangular", [&]() {triangular_src.ProjectY(gate_low, gate_high, projection_vec, error2_vec);}, gate_triangular_cells * 2 * sizeof(double), gate_triangular_cells},
+        {"gain_match", [&]() {result_h.Reset(); gain.AddTo(&result_h, &src_h, scratch_vec);}, 4 * dense_bytes, cells},
+        {"optimize_scale", [&]() {bg_utils.OptimizeBGScaleFactor(&src_h, &bg_h, bins * 1730 / 3000, 1.0, 0, 100);}, 4 * dense_bytes, cells},
+    };
+
+    std::cout << "Matrix " << bins << " x " << bins << ", density " << density << ", " << sparse_src.GetNonZero() << " filled bins, " << repeats << " repeats" << std::endl;
+    std::cout << std::left << std::setw(22) << "kernel" << std::right << std::setw(12) << "ns/bin" << std::setw(12) << "GB/s" << std::setw(14) << "allocs/call" << std::setw(14) << "ms/call" << std::endl;
+    for (auto &kernel : kernel_vec) {
+        if (options.count("kernel") && kernel.name.compare(options["kernel"]) != 0) continue;
+        RunKernel(kernel, repeats);
+    }
+
+    return 0;
+} // end main()
@@ -0,0 +1,90 @@
+#ifndef ANGULAR_CORRELATION_FITTER_H
+#define ANGULAR_CORRELATION_FITTER_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * Energy window defining one gate of an angle matrix
+ *
+ * Peak counts are summed over [peak_low, peak_high]. If a
+ * background window is given its counts are scaled to the peak
+ * width and subtracted.
+ ***************************************************************/
+struct PeakGate {
+    double peak_low;
+    double peak_high;
+    double bg_low = 0.;
+    double bg_high = 0.;
+};
+
+/************************************************************//**
+ * Per-gate angular correlation W(theta) fit result
+ ***************************************************************/
+struct AngularCorrelationResult {
+    std::vector<double> counts_vec;
+    std::vector<double> counts_error_vec;
+    double a0 = 0.;
+    double a0_err = 0.;
+    double a2 = 0.;
+    double a2_err = 0.;
+    double a4 = 0.;
+    double a4_err = 0.;
+    double chi2 = 0.;
+    int ndf = 0;
+    bool valid = false;
+};
+
+/************************************************************//**
+ * Fits W(theta) = a0 (1 + a2 P2 + a4 P4) to many gates at once
+ *
+ * The Legendre basis for every angular index is computed once, the
+ * peak counts of all gates come from cumulative sums over a single
+ * pass through the angle matrix and each fit is a closed form
+ * weighted linear least squares solve. Gates are split over threads.
+ ***************************************************************/
+class AngularCorrelationFitter
+{
+public:
+    AngularCorrelationFitter(std::vector<double> angles);
+    ~AngularCorrelationFitter(void);
+
+    bool ReadGates(std::string filename);
+    void AddGate(PeakGate gate) {gate_vec.push_back(gate);};
+    void SetThreads(int threads) {num_threads = threads;};
+
+    bool FitAngleMatrix(TH2D *angle_matrix);
+    void WriteTree(TFile *out_file, std::string tree_name);
+
+    void ExtractPeakCounts(TH2D *angle_matrix);
+    void ExtractGateCounts(const PeakGate &gate, std::vector<double> &counts, std::vector<double> &errors2);
+    void FitGate(const std::vector<double> &counts, const std::vector<double> &errors2, AngularCorrelationResult &result);
+
+    const std::vector<PeakGate>& GetGates() {return gate_vec;};
+    const std::vector<AngularCorrelationResult>& GetResults() {return result_vec;};
+
+private:
+    double Legendre2(double x) {return 0.5 * (3. * x * x - 1.);};
+    double Legendre4(double x) {return 0.125 * (35. * x * x * x * x - 30. * x * x + 3.);};
+    double WindowSum(const std::vector<double> &cumulative, int index, int bin_low, int bin_high);
+    int FindEnergyBin(double energy);
+
+    int num_indices;
+    int num_threads = 0;
+    std::vector<double> angle_vec;
+    std::vector<double> p2_vec;
+    std::vector<double> p4_vec;
+    std::vector<PeakGate> gate_vec;
+    std::vector<AngularCorrelationResult> result_vec;
+
+    // cumulative sums along energy, laid out as [energy bin][index]
+    int energy_bins = 0;
+    double energy_min = 0.;
+    double energy_max = 0.;
+    std::vector<double> cumulative_vec;
+    std::vector<double> cumulative_error2_vec;
+};
+
+#endif
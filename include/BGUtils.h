@@ -3,6 +3,11 @@
 
 #include <map>
 #include "FileHandler.h"
+#include "HistogramPool.h"
+#include "SparseMatrix.h"
+#include "TriangularMatrix.h"
+#include "ShardMerger.h"
+#include "Checkpoint.h"
 #include "TH2.h"
 
 class BGUtils
@@ -10,21 +15,73 @@ class BGUtils
 private:
     FileHandler *file_man;
     int angle_indices = 51; // number of GRIFFIN opening angles
-    bool optimize_values;
+    bool optimize_values = false;
     std::map<int, float> bg_scaling_factors_map;
+    std::string bg_scale_filename = "bg_index_scaling.csv";
+    bool bg_scale_required = false; // read only, concurrent jobs must not create it
+    HistogramPool hist_pool{2}; // reused matrices for per-index loops
+    std::string storage_format = "dense";
+    PrecisionPolicy precision;
+    SparseMatrix<double> sparse_src; // reused sparse matrices
+    SparseMatrix<double> sparse_bg;
+    SparseMatrix<float> sparse_float_src;
+    SparseMatrix<float> sparse_float_bg;
+    TriangularMatrix<double> triangular_src; // reused triangular matrices
+    TriangularMatrix<double> triangular_bg;
+    TriangularMatrix<float> triangular_float_src;
+    TriangularMatrix<float> triangular_float_bg;
+    TH2F *float_matrix = NULL; // reused single precision output matrix
+    std::string output_filename = "outputs.root";
+    std::string bg_products_filename; // shared time-random subtracted background
+    ShardSpec shard; // indices handled by this process
+    bool resume = false; // skip indices finished by an earlier run
+    bool resumed = false; // output of an earlier run was found
+    bool checkpointing = false; // journal finished indices without resuming
+    Checkpoint *checkpoint = NULL; // journal of the running subtraction
+    int bg_peak = 1730; // peak for background fitting
+    float bg_scaling_factor_init = 1.0; // initial guess of optimized factors
 
+    template <typename Matrix> void WritePacked(TH2D *h, Matrix &packed, TDirectory *target_dir);
+    template <typename Matrix, typename Final> float SubtractPacked(TFile *out_file, int i, Matrix &src, Matrix &bg, Final &result, TDirectory *target_dir, int bg_peak, float bg_scaling_factor);
+    void WriteDense(TH2D *h, TDirectory *target_dir, std::string name, bool single_precision);
+    TDirectory* OutputDirectory(TFile *out_file, std::string name);
+    void ReadScaleFile();
+    void WriteScaleFile();
 
 public:
     BGUtils(FileHandler *file_man);
     ~BGUtils(void);
     void SubtractAllBackground();
+    void WriteBackgroundProducts(std::string filename);
     void SubtractTimeRandomBg(std::string file_type, TFile *out_file);
     void SubtractAngleDependentBg(TFile *out_file);
+    void CopyBackgroundProducts(TFile *out_file);
+
+    // per-index steps of the loops above, also run by Pipeline and RunWatcher
+    void SubtractTimeRandomIndex(TH2D *prompt_matrix, TH2D *time_random_matrix);
+    void WriteIntermediate(TH2D *h, TDirectory *target_dir);
+    void LoadScaleFactors();
+    float ScaleFactor(int i) const {return bg_scaling_factors_map.count(i) ? bg_scaling_factors_map.at(i) : 0.0;};
+    float SubtractRoomIndex(int i, TH2D *src_h, TH2D *bg_h);
+    void RecordScaleFactor(int i, float bg_scaling_factor);
+    void WriteFinal(TH2D *h, TDirectory *target_dir, int i);
 
     void SubtractAngleDependentBg();
     float OptimizeBGScaleFactor(TH2D* src_h, TH2D* bg_h, int peak, float init_guess, int i, float steps = 100);
+    float OptimizeBGScaleFactor(TH1D* src_projection, TH1D* bg_projection, int peak, float init_guess, int i, float steps = 100);
     void OptimizeBGScaling(bool optimize);
+    void SetStorageFormat(std::string format);
+    void SetPrecision(std::string name);
+    void SetOutputFile(std::string filename) {output_filename = filename;};
+    void SetBackgroundProducts(std::string filename) {bg_products_filename = filename;};
+    void SetScaleFile(std::string filename) {bg_scale_filename = filename; bg_scale_required = true;};
+    void SetShard(ShardSpec spec) {shard = spec;};
+    void SetResume(bool resume_run) {resume = resume_run;};
+    void SetCheckpointing(bool enable) {checkpointing = enable;};
+    void SetAngleIndices(int indices) {angle_indices = indices;};
     std::map<int, float> GetBgScalingFactors() {return bg_scaling_factors_map;};
+    ShardSpec GetShard() {return shard;};
+    bool IsOptimizing() {return optimize_values;};
 
 };
 
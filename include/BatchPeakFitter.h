@@ -0,0 +1,73 @@
+#ifndef BATCH_PEAK_FITTER_H
+#define BATCH_PEAK_FITTER_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "GRSIComponent.h"
+
+/************************************************************//**
+ * Peak to fit in every index projection
+ ***************************************************************/
+struct PeakDefinition {
+    double centroid;
+    double range_low;
+    double range_high;
+};
+
+/************************************************************//**
+ * Result of one peak fit in one index projection
+ ***************************************************************/
+struct PeakFitResult {
+    int matrix = 0;
+    int peak = 0;
+    int index = 0;
+    double centroid = 0.;
+    double centroid_err = 0.;
+    double area = 0.;
+    double area_err = 0.;
+    double fwhm = 0.;
+    double chi2 = 0.;
+    int ndf = 0;
+    bool valid = false;
+};
+
+/************************************************************//**
+ * Fits configured peaks in every angular index of many matrices
+ *
+ * Each (matrix, peak) pair is a chain of fits over the angular
+ * indices. A chain is fitted by one thread, with its own
+ * projection histogram, and each fit starts from the centroid found
+ * in the neighbouring index. The fits use TPeakFitter/TRWPeak of
+ * the GRSISort component, which is loaded by the first fit.
+ ***************************************************************/
+class BatchPeakFitter
+{
+public:
+    BatchPeakFitter(int indices = 51);
+    ~BatchPeakFitter(void);
+
+    bool ReadPeaks(std::string filename);
+    void AddPeak(PeakDefinition peak) {peak_vec.push_back(peak);};
+    void SetThreads(int threads) {num_threads = threads;};
+
+    bool FitMatrices(std::vector<TH2D*> matrices);
+    void WriteTree(TFile *out_file, std::string tree_name, std::vector<double> angles);
+
+    const std::vector<PeakFitResult>& GetResults() {return result_vec;};
+
+private:
+    void FitChain(TH2D *matrix, int matrix_id, int peak_id, TH1D *projection, GRSIComponent::PeakFitFunction fit_peak);
+    void FillProjection(TH2D *matrix, int index, TH1D *projection);
+
+    int angle_indices;
+    int num_threads = 0;
+    std::vector<PeakDefinition> peak_vec;
+    std::vector<std::string> matrix_name_vec;
+    // results laid out as [matrix][peak][index]
+    std::vector<PeakFitResult> result_vec;
+};
+
+#endif
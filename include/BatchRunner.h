@@ -0,0 +1,52 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "FileHandler.h"
+#include "BGUtils.h"
+
+/************************************************************//**
+ * One source/background pair of a batch manifest
+ ***************************************************************/
+struct BatchJob {
+    std::string source;
+    std::string background;
+    std::string output;
+    std::string scaling; // background scaling factors of the job
+};
+
+/************************************************************//**
+ * Background subtraction of many source/background pairs
+ *
+ * Every distinct background is time-random subtracted once, the
+ * products are shared by all of its jobs. Jobs run in a pool of
+ * forked worker processes, so GRSISort and ROOT are initialized once
+ * in the parent and every job gets its own ROOT state. The output of
+ * a job is logged next to its output file. Scaling files are only
+ * read by the jobs, they must exist before the batch starts.
+ ***************************************************************/
+class BatchRunner
+{
+public:
+    BatchRunner(int jobs = 0);
+    ~BatchRunner(void);
+
+    bool ReadManifest(std::string filename);
+    void SetOptions(std::map<std::string, std::string> opts) {options = opts;};
+    bool Run();
+
+    static bool RunPool(std::vector<std::function<bool()>> &task_vec, std::vector<std::string> &log_vec, int workers);
+
+private:
+    bool Configure(FileHandler *inputs, BGUtils *bg_utils);
+    static std::string Directory(std::string filename);
+
+    int num_jobs;
+    std::vector<BatchJob> job_vec;
+    std::map<std::string, std::string> options;
+};
+
+#endif
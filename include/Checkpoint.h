@@ -0,0 +1,37 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "TFile.h"
+
+/************************************************************//**
+ * Journal of finished per-index work of a subtraction run
+ *
+ * Every finished stage of an index is appended as
+ * "stage,index,input_hash" once the output file has been saved and
+ * synced, so a record never points at data that is not on disk. A
+ * resumed run skips a stage only if the record exists, the hash of
+ * its inputs is unchanged and the product is found in the output.
+ ***************************************************************/
+class Checkpoint
+{
+public:
+    Checkpoint(std::string journal_filename);
+    ~Checkpoint(void);
+
+    bool Open(bool resume);
+    bool IsDone(std::string stage, int index, std::string input_hash, TFile *out_file, std::string key_name);
+    void MarkDone(TFile *out_file, std::string stage, int index, std::string input_hash);
+
+    static std::string JournalName(std::string output_filename) {return output_filename + ".checkpoint";};
+    static std::string KeyHash(std::vector<TFile*> files, std::vector<std::string> key_names, std::string extra = "");
+
+private:
+    std::string journal_filename;
+    int journal_fd = -1;
+    std::map<std::string, std::string> done_map; // "stage,index" -> input hash
+};
+
+#endif
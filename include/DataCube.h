@@ -0,0 +1,79 @@
+#ifndef DATA_CUBE_H
+#define DATA_CUBE_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH1.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * Angular index x sum energy x gamma energy data cube
+ *
+ * All per-index sum energy matrices are stored in one contiguous
+ * block with the angular index as the fastest running axis,
+ * followed by gamma energy and then sum energy. A sum energy gate
+ * therefore maps onto a single contiguous sweep that fills every
+ * angular index at once.
+ *
+ * Bin arguments always refer to the bins of the original matrices
+ * (ROOT convention, first bin is 1), even if only a window of the
+ * sum energy axis is held in memory. Cube files record the window
+ * and the key hash of the matrices they were built from.
+ ***************************************************************/
+class DataCube
+{
+public:
+    DataCube();
+    ~DataCube(void);
+
+    void SetSumRange(int sum_low, int sum_high);
+    bool LoadFromFile(TFile *in_file, std::string name_format, int indices = 51);
+    bool Write(std::string filename);
+    bool Read(std::string filename);
+    bool ReadHeader(std::string filename);
+    bool IsBuiltFrom(std::string hash);
+    static std::string SourceHash(TFile *in_file, std::string name_format, int indices);
+
+    TH2D* GetIndexSlice(int index, std::string name);
+    TH2D* GetSumSlice(int sum_bin, std::string name);
+    TH2D* GetGammaSlice(int gamma_bin, std::string name);
+    TH2D* GetSumAngularMatrix(std::string name);
+    TH2D* GetGatedAngularMatrix(int gate_low, int gate_high, std::string name);
+    void GetAngularDistribution(int sum_low, int sum_high, int gamma_low, int gamma_high, std::vector<double> &counts, std::vector<double> &errors2);
+
+    int GetNumIndices() {return num_indices;};
+    int GetSumLow() {return sum_first_bin;};
+    int GetSumHigh() {return sum_first_bin + sum_bins - 1;};
+    int GetGammaBins() {return gamma_bins;};
+    bool IsLoaded() {return !content_vec.empty();};
+
+private:
+    void Allocate();
+    bool SumWindow(int &sum_low, int &sum_high) const;
+    void ClampSumRange(int &sum_low, int &sum_high);
+    void ClampGammaRange(int &gamma_low, int &gamma_high);
+    size_t Offset(int index, int sum_bin, int gamma_bin) const {
+        return ((size_t)(sum_bin - sum_first_bin) * gamma_bins + (gamma_bin - 1)) * num_indices + index;
+    };
+
+    int num_indices = 0;
+    // sum energy axis of the original matrices and the window kept in memory
+    int sum_axis_bins = 0;
+    double sum_axis_min = 0.;
+    double sum_axis_max = 0.;
+    int sum_first_bin = 1;
+    int sum_bins = 0;
+    int requested_sum_low = -1;
+    int requested_sum_high = -1;
+    // gamma energy axis is always kept in full
+    int gamma_bins = 0;
+    double gamma_axis_min = 0.;
+    double gamma_axis_max = 0.;
+    std::string source_hash; // Checkpoint::KeyHash of the loaded matrices
+
+    std::vector<double> content_vec;
+    std::vector<double> error2_vec;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef DATASET_GENERATOR_H
+#define DATASET_GENERATOR_H
+
+#include <random>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * Gamma-gamma cascade of the simulated source
+ ***************************************************************/
+struct SyntheticCascade {
+    double e1; // keV
+    double e2; // keV
+    double intensity; // relative
+    double a2;
+    double a4;
+};
+
+/************************************************************//**
+ * Room background line
+ ***************************************************************/
+struct SyntheticLine {
+    double energy; // keV
+    double intensity; // relative
+};
+
+/************************************************************//**
+ * Known truth of one generated index
+ ***************************************************************/
+struct SyntheticTruth {
+    double w_theta = 0.; // intensity weighted W(theta) of all cascades
+    long long cascade_events = 0;
+    long long room_events = 0;
+    long long random_events = 0; // in the prompt matrix
+    long long time_random_events = 0; // in all time-random windows
+};
+
+/************************************************************//**
+ * Synthetic source and room background histogram files
+ *
+ * Writes prompt_angle/index_XX_sum and time_random/index_XX_sum_tr_avg
+ * matrices, sum energy (x) vs the energy of each gamma (y), as read
+ * by BGUtils. Per index the event numbers are Poisson sampled:
+ * - cascades with W(theta) = 1 + a2 P2(cos theta) + a4 P4(cos theta)
+ *   at the opening angle of the index, all pairs equally accepted,
+ * - uncorrelated pairs of room background lines, the source run
+ *   sees room_scale times the room rate of the background run,
+ * - time-random pairs of the singles spectrum, in the prompt matrix
+ *   and averaged over tr_windows windows in the time-random matrix.
+ * Each gamma deposits its full energy with photopeak_fraction,
+ * smeared with the detector resolution, otherwise a flat Compton
+ * continuum up to the Compton edge.
+ *
+ * Indices are generated in parallel, each from its own random
+ * stream of (seed, file, index), so the files are identical for any
+ * thread count. The previous batch is written while the next one is
+ * filled; memory is 4 * threads matrices.
+ ***************************************************************/
+class DatasetGenerator
+{
+public:
+    DatasetGenerator(int indices = 51);
+    ~DatasetGenerator(void);
+
+    bool ReadCascades(std::string filename);
+    bool ReadRoomLines(std::string filename);
+    void AddCascade(SyntheticCascade cascade) {cascade_vec.push_back(cascade);};
+    void AddRoomLine(SyntheticLine line) {line_vec.push_back(line);};
+    void SetBinning(int bins, double max_energy) {energy_bins = bins; energy_max = max_energy;};
+    void SetEvents(double cascades, double room, double randoms) {cascade_events = cascades; room_events = room; random_events = randoms;};
+    void SetRoomScale(double scale) {room_scale = scale;};
+    void SetSeed(unsigned int seed_value) {seed = seed_value;};
+    void SetThreads(int threads) {num_threads = threads;};
+
+    bool Generate(std::string src_filename, std::string bg_filename);
+
+private:
+    bool WriteFile(std::string filename, int file_id);
+    void FillIndex(int file_id, int index, TH2D *prompt_h, TH2D *random_h, SyntheticTruth &truth);
+    long long SampleCount(double mean, std::mt19937_64 &generator);
+    void FillPair(TH2D *h, double e1, double e2, double weight, std::mt19937_64 &generator);
+    double Deposit(double energy, std::mt19937_64 &generator);
+    double WTheta(const SyntheticCascade &cascade, double angle);
+    void WriteTruth(std::string filename, const std::vector<SyntheticTruth> &truth_vec);
+
+    int angle_indices;
+    int num_threads = 0;
+    unsigned int seed = 1;
+    int energy_bins = 3000;
+    double energy_max = 3000.; // keV, 1 keV bins as in the analysis gates
+    double cascade_events = 1e5; // per index at W(theta) = 1
+    double room_events = 1e5; // per index of the background run
+    double random_events = 1e4; // per index and time window
+    double room_scale = 1.; // true room background scaling of the source run
+    int tr_windows = 4;
+    double photopeak_fraction = 0.25;
+    double fwhm_offset = 1.0; // FWHM^2 = offset + slope * E [keV^2]
+    double fwhm_slope = 0.002;
+    std::vector<SyntheticCascade> cascade_vec;
+    std::vector<SyntheticLine> line_vec;
+};
+
+#endif
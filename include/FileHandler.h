@@ -1,25 +1,38 @@
 #ifndef FILE_HANDLER_H
 #define FILE_HANDLER_H
 
+#include <string>
+#include <thread>
+#include <vector>
 #include "TFile.h"
+#include "HistogramMerger.h"
 
 class FileHandler
 {
 public:
-    FileHandler(std::string source_filepath, std::string bg_filepath);
+    FileHandler(std::string source_filepath, std::string bg_filepath, bool merge_runs = false);
     FileHandler(std::string histogram_file);
     ~FileHandler(void);
     void CreateOutputFile(std::string filename);
     TFile * OpenOutputFile(std::string filename);
+    void Prefetch(TFile *file, std::vector<std::string> key_names);
+    void WaitForPrefetch();
 
     TFile *src_file;
     TFile *bg_file;
+    // set instead of the files when a list of runs is merged on the fly
+    HistogramMerger *src_merger = NULL;
+    HistogramMerger *bg_merger = NULL;
     std::string hist_file_name;
     TFile *output_file;
 
 private:
     void LoadFile(std::string filename, std::string type);
     bool FileIsValid(std::string filename);
+    bool merge_single_runs = false; // single runs are merged too, e.g. for gain matching
+    static void PrefetchRanges(std::string filename, std::vector<std::pair<long long, int>> range_vec);
+
+    std::thread prefetch_thread;
 
 };
 
@@ -0,0 +1,34 @@
+#ifndef GRSI_COMPONENT_H
+#define GRSI_COMPONENT_H
+
+#include <string>
+
+class TH1D;
+struct PeakFitResult;
+
+/************************************************************//**
+ * Lazily loaded GRSISort component
+ *
+ * The executable only links ROOT, histogram-only paths never touch
+ * GRSISort. Code needing the parser library, GRSIData dictionaries,
+ * TGriffin, the PPG or the peak fitter lives in libSumPeakGRSI,
+ * which is loaded on first use by the paths that need it, or at
+ * start with --grsi. It is searched next to the executable, then on
+ * the library path; SUMPEAK_GRSI_LIB overrides the location.
+ ***************************************************************/
+class GRSIComponent
+{
+public:
+    typedef bool (*PeakFitFunction)(TH1D *projection, double fit_low, double fit_high, double centroid_guess, PeakFitResult *result);
+
+    static bool Load();
+    static PeakFitFunction GetPeakFitter();
+    static bool IsLoaded() {return handle != NULL;};
+
+private:
+    static std::string ExecutableDirectory();
+
+    static void *handle;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef GAIN_CORRECTION_H
+#define GAIN_CORRECTION_H
+
+#include <utility>
+#include <vector>
+#include "TH2.h"
+
+/************************************************************//**
+ * Redistribution of one axis onto its own binning
+ *
+ * Target bin t (1..bins) receives weight[k * (bins + 2) + t] of
+ * source bin first[t] + k for k < width. Under- and overflow
+ * targets collect their (source bin, weight) lists separately.
+ ***************************************************************/
+struct AxisMap {
+    int bins = -1;
+    double min = 0.;
+    double max = 0.;
+    int width = 0;
+    std::vector<int> first;
+    std::vector<double> weight;
+    std::vector<std::pair<int, double>> underflow;
+    std::vector<std::pair<int, double>> overflow;
+};
+
+/************************************************************//**
+ * Linear energy correction E' = offset + gain * E of a matrix
+ *
+ * Both axes are corrected, counts and variances of every source bin
+ * are shared between the target bins it overlaps in proportion to
+ * the overlap. The correction is separable: rows are corrected along
+ * x first, the corrected rows are then added along y, so both passes
+ * are short, branch free loops over contiguous memory.
+ ***************************************************************/
+class GainCorrection
+{
+public:
+    GainCorrection(double offset_keV = 0., double gain_factor = 1.);
+    ~GainCorrection(void);
+
+    bool IsIdentity() const {return offset == 0. && gain == 1.;};
+    bool AddTo(TH2D *target, TH2D *source, std::vector<double> &scratch);
+
+private:
+    void BuildAxisMap(AxisMap &map, const TAxis *axis);
+    void Apply(double *target, const double *source, std::vector<double> &scratch);
+    void CorrectRow(double * __restrict__ target, const double * __restrict__ source);
+    static void AddScaled(double * __restrict__ target, const double * __restrict__ source, double scale, size_t n);
+
+    double offset;
+    double gain;
+    AxisMap x_map;
+    AxisMap y_map;
+};
+
+#endif
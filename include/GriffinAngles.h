@@ -0,0 +1,18 @@
+#ifndef GRIFFIN_ANGLES_H
+#define GRIFFIN_ANGLES_H
+
+#include <vector>
+
+/************************************************************//**
+ * Opening angles of the 51 GRIFFIN angular indices [deg]
+ *
+ * Crystal pair opening angles for the 145 mm array configuration,
+ * ordered by angular index.
+ ***************************************************************/
+inline const std::vector<double>& GetGriffinAngles145mm()
+{
+    static const std::vector<double> angle_combinations_vec = {15.442, 21.9054, 29.1432, 33.1433, 38.382, 44.57, 47.4453, 48.7411, 51.4734, 55.1704, 59.9782, 60.1024, 62.3396, 62.4924, 63.4231, 68.9567, 71.4314, 73.3582, 73.6291, 75.7736, 80.9423, 81.5464, 83.8936, 86.868, 88.9658, 91.0342, 93.132, 96.1064, 98.4536, 99.0577, 104.226, 106.371, 106.642, 108.569, 111.043, 116.577, 117.508, 117.66, 119.898, 120.022, 124.83, 128.527, 131.259, 132.555, 135.43, 141.618, 146.857, 150.857, 158.095, 164.558, 180.0};
+    return angle_combinations_vec;
+} // end GetGriffinAngles145mm
+
+#endif
@@ -4,10 +4,32 @@
 #include <map>
 #include "TH1.h"
 #include "TH2.h"
-#include "TGriffin.h"
-#include "TGriffinBgo.h"
 #include "TMath.h"
 #include "FileHandler.h"
+#include "HistogramPool.h"
+#include "SparseMatrix.h"
+#include "TriangularMatrix.h"
+#include "TiledMatrix.h"
+#include "MatrixCache.h"
+#include "ShardMerger.h"
+#include "GriffinAngles.h"
+
+/************************************************************//**
+ * Sum energy projections and gated rows of one angular index
+ *
+ * Everything the angle matrices take from an index, so they can be
+ * filled again without the matrices of the index.
+ ***************************************************************/
+struct AngleIndexProducts {
+    std::vector<double> src_projection_vec; // room background subtracted source
+    std::vector<double> src_projection_error2_vec;
+    std::vector<double> bg_projection_vec; // room background
+    std::vector<double> bg_projection_error2_vec;
+    std::vector<double> single_gamma_vec[3]; // gated rows of source, background, room_bg_subtracted
+    int x_bins = 0;
+    int y_bins = 0;
+    bool filled = false; // set once all products of the index are in
+};
 
 class HistogramManager
 {
@@ -18,26 +40,67 @@ public:
     void BuildGatedAngularMatrix(std::string selector, int gate_low, int gate_high);
     void BuildSingleGammaMatrices(std::string selector, int gate_low, int gate_high);
     void BuildAllAngularMatrices();
+    void SetTileFile(std::string tile_filename);
+    void BuildTileFile(std::string tile_filename);
+    void SetCacheFile(std::string cache_filename);
+    void BuildCacheFile(std::string cache_filename);
+    void ExportNumpy(std::string directory);
+    void SetShard(ShardSpec spec) {shard = spec;};
+    void SetAngleIndices(int indices) {angle_indices = indices;};
+    static std::string ShardFileName(std::string hist_file_name, ShardSpec spec);
+    static void FillSingleGammaBin(int index, int sum_energy_bin, int gamma_energy_bin, double val, TH2D *high_gamma_angle_matrix, TH2D *low_gamma_angle_matrix, TH2D *total_gamma_angle_matrix);
+    // per-index steps of the builds above, also run by Pipeline and RunWatcher
+    static void FillSingleGammaIndex(int index, const double *content, int row_length, int first_sum_bin, int sum_low, int sum_high, int gamma_bins, std::vector<TH2D*> &matrix_vec);
+    static void CopySingleGammaRows(TH2D *h, int gate_low, int gate_high, std::vector<double> &rows);
+    static void FillAngleIndex(TH2D *angle_matrix, int index, const std::vector<double> &projection, const std::vector<double> &error2, int bins);
+    static void ProjectSumEnergy(TH2D *h, std::vector<double> &projection, std::vector<double> &error2);
+    static TH2D* CreateAngleMatrix(std::string selector);
+    static std::vector<TH2D*> CreateSingleGammaMatrices(std::string selector, int gate_low, int gate_high);
+    static void ExtractIndexProducts(TH2D *h, int selector, int gate_low, int gate_high, AngleIndexProducts &products);
+    static void FillAngularMatrices(const std::vector<AngleIndexProducts> &product_vec, int gate_low, int gate_high, std::vector<TH2D*> &matrix_vec, std::vector<int> &loaded_bins_vec);
+    void BuildCubeAngularMatrices(std::string cube_filename, int sum_low = -1, int sum_high = -1);
+    void FitAngularCorrelations(std::string gates_filename, std::string matrix_name);
+    void FitPeakAreas(std::string peaks_filename, std::vector<std::string> matrix_names);
+    void ScanMixingRatios(std::string gates_filename, std::string template_filename, std::string coefficients_filename, std::string matrix_name);
 
 private:
-    void PreProcessData();
-    TH1D* GetGatedProjection(TH2D *h, Int_t gate_low, Int_t gate_high, Int_t index);
+    std::vector<std::string> GetSumEnergyKeys();
+    TH2D* ReadAsHistogram(TFile *in_file, std::string key_name);
+    void LoadSumEnergyMatrix(TFile *in_file, std::string key_name);
+    int GetLoadedBinsX();
+    int GetLoadedBinsY();
+    void ProjectSumEnergy();
+    void ProjectGatedEnergy(Int_t gate_low, Int_t gate_high);
+    void WriteAngleMatrix(TH2D *h, std::vector<int> loaded_bins_vec = {});
 
     FileHandler *file_man;
     int angle_indices = 51;
+    ShardSpec shard; // indices handled by this process
 
     std::vector<TH2D*> angle_matrix_vec;
     std::vector<TH1D*> gated_projection_vec;
     std::map<int, float> bg_scaling_factors_map;
+    HistogramPool hist_pool{1}; // reused matrix for per-index loops
+    SparseMatrix<> sparse_matrix; // reused matrix for sparse inputs
+    TriangularMatrix<> triangular_matrix; // reused matrix for triangular inputs
+    TiledMatrix tiled_matrix; // partial reads from an optional tile file
+    MatrixCache matrix_cache; // optional mapped native cache
+    MatrixView dense_view; // arrays of the pool matrix when input is dense
+    const MatrixView *loaded_view = NULL; // dense or cached arrays
+    TH2D *converted_matrix = NULL; // packed matrix expanded for conversion
+    std::string loaded_format = "dense";
+    std::vector<double> row_vec; // reused unpacked triangular row
+    std::vector<double> row_error2_vec;
+    bool matrix_loaded = false;
+    std::vector<double> projection_vec; // reused projection content
+    std::vector<double> projection_error2_vec; // reused projection errors squared
 
     double degree_to_rad = TMath::Pi() / 180.;
     double rad_to_degree = 180. / TMath::Pi();
-    TGriffin *fGrif = NULL;
-    TGriffinBgo *fGriffinBgo = NULL;
 
     int num_crystals = 64;
     // angles for 145mm
-    std::vector<double> angle_combinations_vec = {15.442, 21.9054, 29.1432, 33.1433, 38.382, 44.57, 47.4453, 48.7411, 51.4734, 55.1704, 59.9782, 60.1024, 62.3396, 62.4924, 63.4231, 68.9567, 71.4314, 73.3582, 73.6291, 75.7736, 80.9423, 81.5464, 83.8936, 86.868, 88.9658, 91.0342, 93.132, 96.1064, 98.4536, 99.0577, 104.226, 106.371, 106.642, 108.569, 111.043, 116.577, 117.508, 117.66, 119.898, 120.022, 124.83, 128.527, 131.259, 132.555, 135.43, 141.618, 146.857, 150.857, 158.095, 164.558, 180.0};
+    std::vector<double> angle_combinations_vec = GetGriffinAngles145mm();
 
 };
 
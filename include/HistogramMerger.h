@@ -0,0 +1,72 @@
+#ifndef HISTOGRAM_MERGER_H
+#define HISTOGRAM_MERGER_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+#include "HistogramPool.h"
+#include "GainCorrection.h"
+
+/************************************************************//**
+ * Merges matrices of many histogram files, key by key
+ *
+ * Every worker accumulates the files assigned to it, the partial
+ * sums are then combined pairwise in a parallel binary tree. Each
+ * worker holds up to three matrices per slot (read, partial sum and
+ * gain matched accumulator), so memory does not grow with the number
+ * of input files, only with the number of workers. Workers are
+ * limited by SetThreads and by SetMaxMemory, sized from the first
+ * merged matrix. Runs can be gain matched while they are accumulated.
+ *
+ * The tree adds files in an order that depends on the number of
+ * threads. In reproducible mode the files of a batch are read in
+ * parallel, then every worker adds its slab of bins for all files of
+ * the batch in file order, so each bin is summed exactly as in a
+ * serial merge, for any number of threads.
+ ***************************************************************/
+class HistogramMerger
+{
+public:
+    HistogramMerger(std::vector<std::string> filenames, int slots = 2, int threads = 0);
+    ~HistogramMerger(void);
+
+    bool Open();
+    bool ReadGainCorrections(std::string filename);
+    TH2D* Merge(std::string key_name, int slot = 0);
+    bool Write(TFile *out_file);
+    int GetNumFiles() {return file_name_vec.size();};
+    void SetReproducible(bool ordered) {reproducible = ordered;};
+    void SetThreads(int threads) {num_threads = threads;};
+    void SetMaxMemory(long long bytes) {max_memory = bytes;};
+    std::vector<TFile*> GetFiles() {return file_vec;};
+    std::string GetGainLabel() {return gain_label;};
+
+    static std::vector<std::string> ParseFileList(std::string arg);
+    static bool IsFileList(std::string arg);
+
+private:
+    void PrepareWorkers(std::string key_name);
+    bool AddMatrix(TH2D *target, TH2D *source);
+    TH2D* ZeroedAccumulator(int worker, int slot, TH2D *like);
+    TH2D* MergeOrdered(std::string key_name, int slot);
+    static void AddArrays(double * __restrict__ target, const double * __restrict__ source, size_t n);
+
+    std::vector<std::string> file_name_vec;
+    int num_slots;
+    int num_threads;
+    long long max_memory = 0; // bytes, 0 = no limit
+    bool reproducible = false; // thread count independent summation order
+    std::vector<TFile*> file_vec;
+    // one pool per worker, two pool slots per merge slot
+    std::vector<HistogramPool*> pool_vec;
+    // per file, identity unless read from a gain file
+    std::vector<GainCorrection> correction_vec;
+    std::string gain_label; // corrections as read, identifies the merged result
+    // per worker and slot, used when the first file of a worker is corrected,
+    // one more row holds the ordered sums of the reproducible mode
+    std::vector<TH2D*> accumulator_vec;
+    std::vector<std::vector<double>> scratch_vec;
+};
+
+#endif
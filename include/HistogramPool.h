@@ -0,0 +1,40 @@
+#ifndef HISTOGRAM_POOL_H
+#define HISTOGRAM_POOL_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TKey.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * Pool of preallocated matrices that keys are read into
+ *
+ * Every slot holds one TH2D that is reused for each read. The key
+ * payload is decompressed into a buffer owned by the pool and
+ * streamed straight into the slot, so once every slot and buffer
+ * has seen the largest matrix no further memory is allocated.
+ * Slots are owned by the pool and detached from any directory;
+ * callers must not delete them. Single precision matrices are
+ * returned widened to TH2D.
+ ***************************************************************/
+class HistogramPool
+{
+public:
+    HistogramPool(int slots = 2);
+    ~HistogramPool(void);
+    TH2D* Read(TFile *in_file, std::string key_name, int slot = 0);
+    void Release(int slot);
+    static TKey* FindKey(TFile *in_file, std::string key_name);
+    static long long SlotMemory(TFile *in_file, std::string key_name);
+
+private:
+    void Widen(TH2F *source, TH2D *target);
+
+    std::vector<TH2D*> hist_vec;
+    std::vector<TH2F*> float_hist_vec;
+    std::vector<char> compressed_buffer;
+    std::vector<char> object_buffer;
+};
+
+#endif
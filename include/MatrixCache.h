@@ -0,0 +1,87 @@
+#ifndef MATRIX_CACHE_H
+#define MATRIX_CACHE_H
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * Zero-copy view of one cached matrix
+ *
+ * Arrays use the TH2D layout, bin (x, y) at x + (x_bins + 2) * y,
+ * and point straight into the mapped cache file.
+ ***************************************************************/
+struct MatrixView {
+    int x_bins = 0;
+    double x_min = 0.;
+    double x_max = 0.;
+    int y_bins = 0;
+    double y_min = 0.;
+    double y_max = 0.;
+    const double *content = NULL;
+    const double *sumw2 = NULL;
+    // sum energy projection, x_bins + 2 entries
+    const double *projection_x = NULL;
+    const double *projection_x_error2 = NULL;
+};
+
+/************************************************************//**
+ * Writes matrices into a flat, uncompressed cache file
+ *
+ * Every array starts on a 64 byte boundary so mapped views are
+ * aligned for vector loads. The index is written at the end, the
+ * header holds the key hash of the matrices in the histogram file.
+ ***************************************************************/
+class MatrixCacheWriter
+{
+public:
+    MatrixCacheWriter();
+    ~MatrixCacheWriter(void);
+
+    bool Open(std::string filename);
+    void Add(TH2D *h, std::string name);
+    void SetSourceHash(std::string hash) {source_hash = hash;};
+    bool Close();
+
+private:
+    unsigned long long WriteAligned(const double *data, size_t n);
+
+    std::ofstream out;
+    std::string source_hash; // Checkpoint::KeyHash of the matrices read
+    std::vector<std::string> name_vec;
+    std::vector<MatrixView> view_vec;
+    // file offsets of content, sumw2 and projections per matrix
+    std::vector<unsigned long long> offset_vec;
+    std::vector<double> projection_vec;
+    std::vector<double> projection_error2_vec;
+};
+
+/************************************************************//**
+ * Memory-mapped matrix cache
+ *
+ * The file is mapped read only and shared, so concurrent processes
+ * share the page cache and nothing is decompressed, streamed or
+ * allocated per matrix. A cache of matrices that were rewritten in
+ * the histogram file since is rejected.
+ ***************************************************************/
+class MatrixCache
+{
+public:
+    MatrixCache();
+    ~MatrixCache(void);
+
+    bool Open(std::string filename, TFile *source_file);
+    void Close();
+    bool IsOpen() {return mapped != NULL;};
+    const MatrixView* Find(std::string name) const;
+
+private:
+    void *mapped = NULL;
+    size_t mapped_size = 0;
+    std::map<std::string, MatrixView> view_map;
+};
+
+#endif
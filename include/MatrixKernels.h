@@ -0,0 +1,20 @@
+#ifndef MATRIX_KERNELS_H
+#define MATRIX_KERNELS_H
+
+#include <vector>
+
+/************************************************************//**
+ * Projection loops over dense matrix arrays
+ *
+ * Arrays use the TH2 layout, bin (x, y) at x + (x_bins + 2) * y
+ * including under- and overflow. Kept free of ROOT so they can be
+ * benchmarked on plain arrays (see bench/SumPeakBench.cpp).
+ ***************************************************************/
+class MatrixKernels
+{
+public:
+    static void ProjectX(const double *content, const double *sumw2, int x_bins, int y_bins, std::vector<double> &projection, std::vector<double> &error2);
+    static void ProjectY(const double *content, const double *sumw2, int x_bins, int y_bins, int x_low, int x_high, std::vector<double> &projection, std::vector<double> &error2);
+};
+
+#endif
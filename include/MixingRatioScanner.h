@@ -0,0 +1,79 @@
+#ifndef MIXING_RATIO_SCANNER_H
+#define MIXING_RATIO_SCANNER_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+#include "AngularCorrelationFitter.h"
+
+/************************************************************//**
+ * Chi2 scan result of one gate
+ ***************************************************************/
+struct MixingRatioResult {
+    std::vector<double> chi2_vec;
+    double delta_min = 0.;
+    double delta_low = 0.;
+    double delta_high = 0.;
+    double atan_delta_min = 0.;
+    double chi2_min = 0.;
+    double scale = 0.;
+    int ndf = 0;
+    bool valid = false;
+};
+
+/************************************************************//**
+ * Scans the mixing ratio against simulated angular distributions
+ *
+ * The simulated response of every angular index is a linear
+ * combination of the basis templates Z0, Z2 and Z4 (isotropic, P2
+ * and P4 simulations in the angle matrix layout of
+ * HistogramManager):
+ *
+ *     T_i(delta) = Z0_i + a2(delta) Z2_i + a4(delta) Z4_i
+ *     a_k(delta) = (c0_k + c1_k delta + c2_k delta^2) / (1 + delta^2)
+ *
+ * With a free normalisation chi2(delta) only depends on weighted
+ * inner products of the data and the basis vectors, so these are
+ * computed once per gate and every delta step costs a handful of
+ * multiply-adds over contiguous coefficient arrays that the
+ * compiler vectorizes. Gates are spread over threads.
+ ***************************************************************/
+class MixingRatioScanner
+{
+public:
+    MixingRatioScanner(int indices = 51);
+    ~MixingRatioScanner(void);
+
+    bool ReadCoefficients(std::string filename);
+    void SetSteps(int steps) {num_steps = steps;};
+    void SetThreads(int threads) {num_threads = threads;};
+
+    bool Scan(TH2D *data_matrix, std::vector<TH2D*> templates, const std::vector<PeakGate> &gates);
+    void WriteTree(TFile *out_file, std::string tree_name);
+
+    const std::vector<MixingRatioResult>& GetResults() {return result_vec;};
+
+private:
+    void BuildDeltaGrid();
+    void ScanGate(const std::vector<double> &counts, const std::vector<double> &errors2, const std::vector<double> basis[3], MixingRatioResult &result);
+    int FindMinimum(MixingRatioResult &result);
+
+    int angle_indices;
+    int num_threads = 0;
+    int num_steps = 3601;
+    // a_k(delta) coefficients for k = 2, 4
+    double a2_coeff[3] = {0., 0., 0.};
+    double a4_coeff[3] = {0., 0., 0.};
+
+    // delta grid, uniform in arctan(delta), stored as contiguous arrays
+    std::vector<double> atan_delta_vec;
+    std::vector<double> delta_vec;
+    std::vector<double> a2_vec;
+    std::vector<double> a4_vec;
+
+    std::vector<PeakGate> gate_vec;
+    std::vector<MixingRatioResult> result_vec;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef NPY_EXPORTER_H
+#define NPY_EXPORTER_H
+
+#include <string>
+#include <vector>
+#include "TH1.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * One histogram queued for export
+ ***************************************************************/
+struct NpyExportItem {
+    std::string name;
+    const double *content = NULL;
+    const double *sumw2 = NULL;
+    // C order shape, (y_bins + 2, x_bins + 2) for matrices
+    std::vector<size_t> shape;
+    int x_bins = 0;
+    double x_min = 0.;
+    double x_max = 0.;
+    int y_bins = 0;
+    double y_min = 0.;
+    double y_max = 0.;
+};
+
+/************************************************************//**
+ * Exports histograms as NumPy .npy arrays
+ *
+ * ROOT keeps bin (x, y) at x + (x_bins + 2) * y, which is exactly a
+ * C order array of shape (y_bins + 2, x_bins + 2), so content and
+ * variance (sumw2) are written straight from the histogram buffers
+ * behind a .npy header. Under/overflow bins are kept. Every product
+ * NAME becomes NAME.content.npy and NAME.variance.npy, and its
+ * binning is listed in index.csv, so the Python stage can
+ * np.load(..., mmap_mode='r') everything. Open() starts a new
+ * index.csv, so it lists exactly the products of one export.
+ *
+ * Histograms are only referenced, they must stay alive until
+ * Flush() has written them. Files are written in parallel.
+ ***************************************************************/
+class NpyExporter
+{
+public:
+    NpyExporter(std::string directory, int threads = 0);
+    ~NpyExporter(void);
+
+    bool Open();
+    void Add(TH2D *h, std::string name);
+    void Add(TH1D *h, std::string name);
+    bool Flush();
+
+    static bool WriteArray(std::string filename, const double *data, const std::vector<size_t> &shape);
+
+private:
+    bool MakeDirectories(std::string path);
+
+    std::string output_dir;
+    int num_threads;
+    std::vector<NpyExportItem> item_vec;
+};
+
+#endif
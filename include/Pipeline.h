@@ -0,0 +1,85 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+#include "FileHandler.h"
+#include "BGUtils.h"
+#include "HistogramManager.h"
+#include "HistogramPool.h"
+#include "TaskGraph.h"
+
+/************************************************************//**
+ * Background subtraction and matrix building as one task graph
+ *
+ * Every angular index is split into tasks: time-random subtraction
+ * of source and background, the single gamma rows of the source,
+ * the sum energy projection of the background and the room
+ * background subtraction, which waits for both of its inputs. The
+ * angle matrices are filled by a last task in index order, so they
+ * are identical to the serial build. ROOT I/O is serialized per
+ * file; subtraction, projection and decompression of other indices
+ * run meanwhile.
+ *
+ * The tasks run the per-index steps of BGUtils and HistogramManager,
+ * so storage format, precision, optimized scaling factors, shards
+ * and merged, gain matched runs behave as in the serial subtraction.
+ *
+ * With a memory budget, index i only starts once the room background
+ * subtraction of index i - n has finished and freed its matrices,
+ * where n indices fit into the budget.
+ ***************************************************************/
+class Pipeline
+{
+public:
+    Pipeline(FileHandler *inputs, BGUtils *bg_utils, int threads = 0);
+    ~Pipeline(void);
+
+    bool Run(std::string output_filename = "outputs.root");
+    void SetMaxMemory(long long bytes) {max_memory = bytes;};
+    static bool ParseMemorySize(std::string text, long long &bytes);
+
+private:
+    // time-random subtracted matrices of one index in flight
+    struct IndexMatrices {
+        TH2D *src = NULL; // time-random, then room background subtracted
+        TH2D *bg = NULL;
+    };
+
+    TFile* InputFile(bool source);
+    long long EstimateIndexMemory(int index);
+    int IndicesInFlight(int indices);
+    TH2D* ReadInput(bool source, std::string key_name, int slot);
+    void ReleaseInput(bool source, int slot, TH2D *h);
+    void SubtractTimeRandom(int index, bool source);
+    void SubtractRoomBackground(int index);
+    void BuildAngularMatrices();
+
+    FileHandler *file_man;
+    BGUtils *bg_utils;
+    ShardSpec shard; // indices handled by this process
+    int num_threads;
+    int angle_indices = 51;
+    int gate_low = 1759; // same gate as HistogramManager::BuildAllAngularMatrices()
+    int gate_high = 1765;
+    long long max_memory = 0; // bytes of matrices held at once, 0 = no limit
+
+    TFile *out_file = NULL;
+    TDirectory *src_dir = NULL;
+    TDirectory *bg_dir = NULL;
+    TDirectory *room_dir = NULL;
+    std::mutex src_lock; // ROOT I/O of each file is serialized
+    std::mutex bg_lock;
+    std::mutex out_lock; // also guards the reused output matrices of BGUtils
+    std::mutex scale_lock; // optimized factors are fitted one at a time
+    HistogramPool src_pool{102}; // slot 2i prompt, 2i + 1 time-random of index i
+    HistogramPool bg_pool{102};
+    std::vector<IndexMatrices> matrix_vec;
+    std::vector<AngleIndexProducts> product_vec;
+};
+
+#endif
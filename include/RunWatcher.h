@@ -0,0 +1,78 @@
+#ifndef RUN_WATCHER_H
+#define RUN_WATCHER_H
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+#include "FileHandler.h"
+#include "BGUtils.h"
+#include "HistogramManager.h"
+#include "HistogramPool.h"
+
+/************************************************************//**
+ * Online analysis of source runs arriving in a directory
+ *
+ * Prompt and time-random totals of every index stay in memory and
+ * the matrices of a new run are added to them in place, so earlier
+ * runs are never read again. The room background is time-random
+ * subtracted once at start. After new runs, only the indices they
+ * added counts to are subtracted again, with the per-index steps of
+ * BGUtils; the angle matrices are filled from the kept projections
+ * of every index. Runs are found with inotify, finished files only
+ * (closed after writing or moved in).
+ *
+ * The totals, together with the list of their runs, are written in
+ * the background to a temporary file that replaces the previous
+ * snapshot in one rename, so a crash never leaves a run half added
+ * or counted twice. Runs missing from the snapshot are added again
+ * on the next start.
+ ***************************************************************/
+class RunWatcher
+{
+public:
+    RunWatcher(std::string directory, std::string bg_filename);
+    ~RunWatcher(void);
+
+    bool Start();
+    bool Watch();
+    void SetOutputFile(std::string filename) {output_filename = filename;};
+
+private:
+    bool LoadTotals();
+    bool AddRun(std::string run_filename);
+    void AddToTotal(TH2D *&total, TH2D *h, double scale = 1.0);
+    void Refresh();
+    TH2D* CopyTotal(TH2D *total);
+    void StartSnapshot();
+    void WriteSnapshot(std::string run_list, std::vector<std::string> new_run_vec);
+    void WaitForSnapshot();
+    bool IsRunFile(std::string filename);
+    std::string TempTotalsName() {return totals_filename + ".tmp.root";};
+
+    std::string watch_directory;
+    std::string bg_filename;
+    std::string output_filename = "outputs.root";
+    std::string totals_filename = "watch_totals.root";
+    std::string products_filename = "watch_background.root";
+    std::string runs_filename = "watch_runs.txt"; // log of the runs in the totals
+    std::string runs_key = "watch_runs"; // run list stored with the totals
+    int angle_indices = 51;
+    int gate_low = 1759; // same gate as HistogramManager::BuildAllAngularMatrices()
+    int gate_high = 1765;
+    std::set<std::string> run_set;
+    std::vector<std::string> unsaved_run_vec; // added since the last snapshot
+    std::vector<TH2D*> prompt_total_vec; // resident totals, one per index
+    std::vector<TH2D*> random_total_vec;
+    std::set<int> changed_set; // indices whose totals changed since the last refresh
+    std::vector<AngleIndexProducts> product_vec; // kept for the angle matrices
+    TH2D *scratch_matrix = NULL; // reused copy of a total being subtracted
+    FileHandler no_inputs{"", ""}; // totals are passed to BGUtils directly
+    BGUtils bg_utils{&no_inputs};
+    HistogramPool hist_pool{2}; // slot 0 prompt, slot 1 time-random or background
+    std::thread snapshot_thread;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef SHARD_MERGER_H
+#define SHARD_MERGER_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * Subset of the angular indices handled by one process
+ *
+ * Shard k of N owns indices k, k + N, k + 2N, ... so every shard
+ * gets a similar share of small and large opening angles.
+ ***************************************************************/
+struct ShardSpec {
+    int index = 0;
+    int count = 1;
+
+    bool IsSharded() const {return count > 1;};
+    bool Owns(int i) const {return i % count == index;};
+    std::string Label() const;
+    std::string FileName(std::string base_name) const;
+    static bool Parse(std::string text, ShardSpec &shard);
+};
+
+/************************************************************//**
+ * Assembles the partial outputs of all shards
+ *
+ * Per-index matrices live in sub-directories and are disjoint
+ * between shards, they are copied. Top level angle matrices hold one
+ * column per index and are summed. Sum energy and gamma 1 angle
+ * matrices set the error of column i while index i is processed, so
+ * the errors of the rows set are taken from the owning shard only.
+ * Each shard stores how many rows that was next to the matrix.
+ ***************************************************************/
+class ShardMerger
+{
+public:
+    ShardMerger(int indices = 51);
+    ~ShardMerger(void);
+
+    bool Merge(std::string target_filename, std::vector<std::string> shard_filenames);
+    static void CopyDirectory(TDirectory *source_dir, TDirectory *target_dir);
+    static bool HasOwnedErrors(std::string name);
+    static void WriteLoadedBins(TDirectory *shard_dir, std::string matrix_name, std::vector<int> loaded_bins_vec);
+    static bool RunLocal(int processes, std::function<bool(ShardSpec)> task, std::function<std::string(ShardSpec)> shard_file, std::string target_file);
+
+private:
+    bool ReadLoadedBins(std::vector<std::string> shard_filenames);
+    void AddAngleMatrix(TH2D *target, TH2D *source, const ShardSpec &shard);
+
+    int angle_indices;
+    std::map<std::string, std::vector<int>> loaded_bins_map;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "StoragePrecision.h"
+
+/************************************************************//**
+ * Compressed-row sum energy matrix
+ *
+ * Rows are sum energy (x) bins and columns are gamma energy (y)
+ * bins, both numbered like TH2D bins including under/overflow, so
+ * sum energy gates are contiguous row ranges. Only bins with content
+ * or error are stored, as T (float or double). Projections are
+ * always accumulated in double.
+ *
+ * On disk a matrix is a TTree with one entry per filled row, titled
+ * "sparse" so readers can tell it apart from a TH2D by its key. Any
+ * stored precision can be read into any T.
+ ***************************************************************/
+template <typename T = double>
+class SparseMatrix
+{
+public:
+    SparseMatrix();
+    ~SparseMatrix(void);
+
+    void FromHistogram(TH2D *h);
+    TH2D* ToHistogram(std::string name);
+    bool Read(TFile *in_file, std::string key_name);
+    void Write(TDirectory *dir, std::string name);
+
+    template <typename U> void Assign(const SparseMatrix<U> &other);
+    template <typename U> void Add(const SparseMatrix<U> &other, double scale);
+    void ProjectX(std::vector<double> &content, std::vector<double> &errors2) const;
+    void ProjectY(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2) const;
+    TH1D* ProjectionX(std::string name) const;
+
+    int GetNbinsX() const {return x_bins;};
+    int GetNbinsY() const {return y_bins;};
+    size_t GetNonZero() const {return col_vec.size();};
+    // stored bins of the sum energy rows x_low..x_high, bins as in ProjectY()
+    size_t GetNonZero(int x_low, int x_high) const {return row_ptr_vec[x_high + 1] - row_ptr_vec[x_low];};
+    int RowBegin(int x_bin) const {return row_ptr_vec[x_bin];};
+    int RowEnd(int x_bin) const {return row_ptr_vec[x_bin + 1];};
+    int Column(int entry) const {return col_vec[entry];};
+    double Content(int entry) const {return content_vec[entry];};
+    double Error2(int entry) const {return sumw2_vec[entry];};
+
+    static bool IsSparseKey(TFile *in_file, std::string key_name);
+
+private:
+    template <typename U> friend class SparseMatrix;
+    template <typename U> bool SameBinning(const SparseMatrix<U> &other) const;
+
+    int x_bins = 0;
+    double x_min = 0.;
+    double x_max = 0.;
+    int y_bins = 0;
+    double y_min = 0.;
+    double y_max = 0.;
+    std::string title;
+
+    // rows 0..x_bins + 1, row_ptr_vec has x_bins + 3 entries
+    std::vector<int> row_ptr_vec;
+    std::vector<int> col_vec;
+    std::vector<T> content_vec;
+    std::vector<T> sumw2_vec;
+
+    // scratch for Add, reused to avoid reallocating every call
+    std::vector<int> scratch_row_ptr_vec;
+    std::vector<int> scratch_col_vec;
+    std::vector<T> scratch_content_vec;
+    std::vector<T> scratch_sumw2_vec;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef STORAGE_PRECISION_H
+#define STORAGE_PRECISION_H
+
+#include <string>
+#include <vector>
+#include "TTree.h"
+
+/************************************************************//**
+ * Leaf type and conversion of every supported storage type
+ *
+ * Arithmetic is done in double, Store() converts the result back.
+ ***************************************************************/
+template <typename T> struct StorageTraits;
+template <> struct StorageTraits<float> {
+    static const char* Leaf() {return "F";};
+    static float Store(double v) {return (float) v;};
+};
+template <> struct StorageTraits<double> {
+    static const char* Leaf() {return "D";};
+    static double Store(double v) {return v;};
+};
+
+/************************************************************//**
+ * Storage type of the intermediate background subtraction products
+ *
+ * "double" keeps everything in double precision. "mixed" stores the
+ * time-random subtracted source and background matrices as float;
+ * the input matrices and the room background subtracted products are
+ * left in double.
+ ***************************************************************/
+struct PrecisionPolicy {
+    std::string intermediate = "double";
+
+    static bool FromName(std::string name, PrecisionPolicy &policy);
+};
+
+/************************************************************//**
+ * Row buffer for an array branch stored with any precision
+ *
+ * Binds to the branch with the type it was written with and
+ * converts into the storage type of the reader.
+ ***************************************************************/
+class LeafBuffer
+{
+public:
+    bool Bind(TTree *tree, std::string branch_name, size_t size);
+
+    template <typename T>
+    void CopyTo(T *target, int n) const
+    {
+        if (type == 'I') {
+            for (auto k = 0; k < n; k++) target[k] = static_cast<T>(int_vec[k]);
+        } else if (type == 'F') {
+            for (auto k = 0; k < n; k++) target[k] = static_cast<T>(float_vec[k]);
+        } else {
+            for (auto k = 0; k < n; k++) target[k] = static_cast<T>(double_vec[k]);
+        }
+    };
+
+    template <typename T>
+    void AppendTo(std::vector<T> &target, int n) const
+    {
+        size_t start = target.size();
+        target.resize(start + n);
+        CopyTo(target.data() + start, n);
+    };
+
+private:
+    char type = 'D';
+    std::vector<Int_t> int_vec;
+    std::vector<Float_t> float_vec;
+    std::vector<Double_t> double_vec;
+};
+
+#endif
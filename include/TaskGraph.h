@@ -0,0 +1,60 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/************************************************************//**
+ * Tasks with explicit dependencies run by a work-stealing pool
+ *
+ * A task becomes ready once all of its dependencies have finished.
+ * Every worker keeps its own deque of ready tasks: it takes new work
+ * from the back, so the successors it just released run next while
+ * their inputs are still in memory, and idle workers steal from the
+ * front of the other deques.
+ ***************************************************************/
+class TaskGraph
+{
+public:
+    TaskGraph(int threads = 0);
+    ~TaskGraph(void);
+
+    int AddTask(std::string name, std::function<void()> work, std::vector<int> dependencies = {});
+    int GetNumTasks() {return (int) task_vec.size();};
+    void Run();
+
+private:
+    struct Task {
+        std::string name;
+        std::function<void()> work;
+        std::vector<int> successor_vec;
+        std::atomic<int> remaining{0}; // unfinished dependencies
+    };
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<int> task_deque;
+    };
+
+    void Worker(int worker);
+    bool Pop(int worker, int &task);
+    bool Steal(int worker, int &task);
+    void Push(int worker, int task);
+    void Complete(int worker, int task);
+
+    int num_threads;
+    std::vector<std::unique_ptr<Task>> task_vec;
+    std::vector<std::unique_ptr<WorkerQueue>> queue_vec;
+    std::mutex idle_lock; // guards num_ready for sleeping workers
+    std::condition_variable idle_cv;
+    int num_ready = 0;
+    std::atomic<int> num_done{0};
+    std::mutex print_lock;
+};
+
+#endif
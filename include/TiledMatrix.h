@@ -0,0 +1,112 @@
+#ifndef TILED_MATRIX_H
+#define TILED_MATRIX_H
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH2.h"
+
+/************************************************************//**
+ * Position of one matrix in a tile file
+ ***************************************************************/
+struct TiledMatrixEntry {
+    int x_bins = 0;
+    double x_min = 0.;
+    double x_max = 0.;
+    int y_bins = 0;
+    double y_min = 0.;
+    double y_max = 0.;
+    int tile_x_bins = 0;
+    int tile_y_bins = 0;
+    int tiles_x = 0;
+    int tiles_y = 0;
+    // per tile: file offset, stored and raw size (0 for empty tiles)
+    std::vector<unsigned long long> offset_vec;
+    std::vector<int> stored_size_vec;
+    std::vector<int> raw_size_vec;
+};
+
+/************************************************************//**
+ * Writes sum energy matrices as independently compressed tiles
+ *
+ * Every matrix (including under/overflow bins) is cut into blocks of
+ * tile_x_bins sum energy bins by tile_y_bins gamma energy bins.
+ * Every block is compressed on its own and empty blocks, e.g. above
+ * the gamma <= sum diagonal, are not stored at all. The index of all
+ * matrices and tiles is written at the end of the file, the header
+ * holds the key hash of the matrices in the histogram file.
+ ***************************************************************/
+class TiledMatrixWriter
+{
+public:
+    TiledMatrixWriter(int tile_x = 16, int tile_y = 512);
+    ~TiledMatrixWriter(void);
+
+    bool Open(std::string filename);
+    void Add(TH2D *h, std::string name);
+    void SetSourceHash(std::string hash) {source_hash = hash;};
+    bool Close();
+
+private:
+    std::string source_hash; // Checkpoint::KeyHash of the matrices read
+    int tile_x_bins;
+    int tile_y_bins;
+    std::ofstream out;
+    std::vector<std::string> name_vec;
+    std::vector<TiledMatrixEntry> entry_vec;
+    std::vector<double> raw_buffer;
+    std::vector<char> compressed_buffer;
+};
+
+/************************************************************//**
+ * Reads regions of tiled matrices
+ *
+ * Only the tiles that cover a requested region are read. Their
+ * decompression is spread over threads and decompressed tiles are
+ * kept until another matrix is selected, so neighbouring queries on
+ * the same matrix cost nothing extra. A tile file of matrices that
+ * were rewritten in the histogram file since is rejected.
+ *
+ * Bin arguments follow the TH2D convention (under/overflow at 0 and
+ * n + 1), x is sum energy and y gamma energy.
+ ***************************************************************/
+class TiledMatrix
+{
+public:
+    TiledMatrix();
+    ~TiledMatrix(void);
+
+    bool Open(std::string filename, TFile *source_file);
+    void Close();
+    bool IsOpen() {return in.is_open();};
+    bool HasMatrix(std::string name) {return index_map.count(name) > 0;};
+    bool Select(std::string name);
+    void SetThreads(int threads) {num_threads = threads;};
+
+    void ProjectX(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2);
+    void ProjectY(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2);
+
+    int GetNbinsX() const {return current ? current->x_bins : 0;};
+    int GetNbinsY() const {return current ? current->y_bins : 0;};
+    unsigned long long GetBytesRead() const {return bytes_read;};
+
+private:
+    bool IsValidEntry(const TiledMatrixEntry &entry, unsigned long long data_end) const;
+    void LoadTiles(int x_low, int x_high);
+    bool ClampRows(int &x_low, int &x_high) const;
+
+    int num_threads = 0;
+    std::ifstream in;
+    std::map<std::string, TiledMatrixEntry> index_map;
+    const TiledMatrixEntry *current = NULL;
+    unsigned long long bytes_read = 0;
+
+    // decompressed tiles of the selected matrix, content then sumw2
+    std::vector<std::vector<double> > tile_vec;
+    std::vector<char> tile_loaded_vec;
+    std::vector<std::vector<char> > stored_vec;
+};
+
+#endif
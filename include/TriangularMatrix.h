@@ -0,0 +1,85 @@
+#ifndef TRIANGULAR_MATRIX_H
+#define TRIANGULAR_MATRIX_H
+
+#include <string>
+#include <vector>
+#include "TFile.h"
+#include "TH1.h"
+#include "TH2.h"
+#include "StoragePrecision.h"
+
+/************************************************************//**
+ * Packed lower triangular sum energy matrix
+ *
+ * A gamma ray can not carry more energy than the sum it belongs to,
+ * so every sum energy (x) row only stores the gamma energy (y) bins
+ * up to the sum energy. Rows are packed back to back, bins numbered
+ * like TH2D bins including under/overflow. Counts that end up above
+ * the diagonal (resolution, pile-up) are kept in a small spill list
+ * so nothing is lost. Bins are stored as T (float or double),
+ * projections are always accumulated in double.
+ *
+ * On disk a matrix is a TTree with one entry per row, titled
+ * "triangular" so readers can tell it apart from a TH2D by its key.
+ * Any stored precision can be read into any T.
+ ***************************************************************/
+template <typename T = double>
+class TriangularMatrix
+{
+public:
+    TriangularMatrix();
+    ~TriangularMatrix(void);
+
+    void FromHistogram(TH2D *h);
+    TH2D* ToHistogram(std::string name);
+    bool Read(TFile *in_file, std::string key_name);
+    void Write(TDirectory *dir, std::string name);
+
+    template <typename U> void Assign(const TriangularMatrix<U> &other);
+    template <typename U> void Add(const TriangularMatrix<U> &other, double scale);
+    void ProjectX(std::vector<double> &content, std::vector<double> &errors2) const;
+    void ProjectY(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2) const;
+    void GetRow(int x_bin, std::vector<double> &content, std::vector<double> &errors2) const;
+    TH1D* ProjectionX(std::string name) const;
+
+    int GetNbinsX() const {return x_bins;};
+    int GetNbinsY() const {return y_bins;};
+    size_t GetPackedSize() const {return content_vec.size();};
+    // packed bins of the sum energy rows x_low..x_high, bins as in ProjectY()
+    size_t GetPackedSize(int x_low, int x_high) const {return row_ptr_vec[x_high + 1] - row_ptr_vec[x_low];};
+    size_t GetSpillSize() const {return spill_col_vec.size();};
+
+    static bool IsTriangularKey(TFile *in_file, std::string key_name);
+
+private:
+    template <typename U> friend class TriangularMatrix;
+    void SetBinning(int nx, double xlow, double xhigh, int ny, double ylow, double yhigh);
+    template <typename U> bool SameBinning(const TriangularMatrix<U> &other) const;
+
+    int x_bins = 0;
+    double x_min = 0.;
+    double x_max = 0.;
+    int y_bins = 0;
+    double y_min = 0.;
+    double y_max = 0.;
+    std::string title;
+
+    // rows 0..x_bins + 1, row x holds y bins 0..row_length - 1
+    std::vector<int> row_ptr_vec;
+    std::vector<T> content_vec;
+    std::vector<T> sumw2_vec;
+
+    // bins above the diagonal, sorted by row then column
+    std::vector<int> spill_row_ptr_vec;
+    std::vector<int> spill_col_vec;
+    std::vector<T> spill_content_vec;
+    std::vector<T> spill_sumw2_vec;
+
+    // scratch for Add, reused to avoid reallocating every call
+    std::vector<int> scratch_row_ptr_vec;
+    std::vector<int> scratch_col_vec;
+    std::vector<T> scratch_content_vec;
+    std::vector<T> scratch_sumw2_vec;
+};
+
+#endif
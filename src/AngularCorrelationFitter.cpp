@@ -0,0 +1,341 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Fits Legendre angular correlations to gates of angle matrices
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   AngularCorrelationFitter fitter(GetGriffinAngles145mm());
+//   fitter.ReadGates("gates.csv");
+//   fitter.FitAngleMatrix(angle_matrix);
+//   fitter.WriteTree(out_file, "angular_correlation");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+#include "csv.h"
+#include "TMath.h"
+#include "TTree.h"
+#include "AngularCorrelationFitter.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param angles opening angle of every angular index [deg]
+ ***************************************************************/
+AngularCorrelationFitter::AngularCorrelationFitter(std::vector<double> angles) : angle_vec(angles)
+{
+    // Legendre basis is fixed by the detector geometry
+    num_indices = angles.size();
+    for (auto angle : angles) {
+        double x = std::cos(angle * TMath::Pi() / 180.);
+        p2_vec.push_back(Legendre2(x));
+        p4_vec.push_back(Legendre4(x));
+    }
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+AngularCorrelationFitter::~AngularCorrelationFitter(void)
+{
+    //std::cout << "AngularCorrelationFitter destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Reads gate definitions
+ *
+ * CSV columns: peak_low,peak_high,bg_low,bg_high (energies in keV,
+ * bg_low = bg_high = 0 disables background subtraction)
+ *
+ * @param filename gate file
+ ***************************************************************/
+bool AngularCorrelationFitter::ReadGates(std::string filename)
+{
+    std::ifstream gate_file(filename);
+    if (!gate_file.good()) {
+        std::cerr << "ERROR --- Could not open gate file: " << filename << std::endl;
+        return false;
+    }
+    gate_file.close();
+
+    io::CSVReader<4> in(filename);
+    in.read_header(io::ignore_extra_column, "peak_low", "peak_high", "bg_low", "bg_high");
+    PeakGate gate;
+    while (in.read_row(gate.peak_low, gate.peak_high, gate.bg_low, gate.bg_high)) {
+        gate_vec.push_back(gate);
+    }
+    std::cout << "Found " << gate_vec.size() << " gates in: " << filename << std::endl;
+
+    return true;
+} // end ReadGates()
+
+/************************************************************//**
+ * Extracts and fits all gates of an angle matrix
+ *
+ * @param angle_matrix angular index (x) vs energy (y) matrix
+ ***************************************************************/
+bool AngularCorrelationFitter::FitAngleMatrix(TH2D *angle_matrix)
+{
+    if (gate_vec.empty()) {
+        std::cerr << "ERROR --- No gates defined" << std::endl;
+        return false;
+    }
+
+    ExtractPeakCounts(angle_matrix);
+
+    result_vec.assign(gate_vec.size(), AngularCorrelationResult());
+    unsigned int threads = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    if (threads > gate_vec.size()) threads = gate_vec.size();
+
+    // workers only touch the cumulative tables and their own results
+    auto worker = [this, threads](unsigned int thread_id) {
+        std::vector<double> counts, errors2;
+        for (auto g = thread_id; g < gate_vec.size(); g += threads) {
+            ExtractGateCounts(gate_vec[g], counts, errors2);
+            FitGate(counts, errors2, result_vec[g]);
+        }
+    };
+
+    std::vector<std::thread> thread_vec;
+    for (unsigned int t = 1; t < threads; t++) {
+        thread_vec.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for (auto &t : thread_vec) {
+        t.join();
+    }
+
+    int n_valid = 0;
+    for (auto &result : result_vec) {
+        if (result.valid) n_valid++;
+    }
+    std::cout << "Fitted " << n_valid << " of " << result_vec.size() << " gates of " << angle_matrix->GetName() << std::endl;
+
+    return true;
+} // end FitAngleMatrix()
+
+/************************************************************//**
+ * Builds cumulative energy sums of every angular index
+ *
+ * One pass through the matrix makes every later gate window two
+ * lookups per index, regardless of its width.
+ *
+ * @param angle_matrix angular index (x) vs energy (y) matrix
+ ***************************************************************/
+void AngularCorrelationFitter::ExtractPeakCounts(TH2D *angle_matrix)
+{
+    energy_bins = angle_matrix->GetYaxis()->GetNbins();
+    energy_min = angle_matrix->GetYaxis()->GetXmin();
+    energy_max = angle_matrix->GetYaxis()->GetXmax();
+
+    const int row_length = angle_matrix->GetXaxis()->GetNbins() + 2;
+    const double *content = angle_matrix->GetArray();
+    const double *sumw2 = angle_matrix->GetSumw2N() > 0 ? angle_matrix->GetSumw2()->GetArray() : content;
+
+    // angle matrices are filled at x = index
+    std::vector<int> index_bin_vec;
+    for (auto i = 0; i < num_indices; i++) {
+        index_bin_vec.push_back(angle_matrix->GetXaxis()->FindBin(i));
+    }
+
+    cumulative_vec.assign((size_t)(energy_bins + 1) * num_indices, 0.);
+    cumulative_error2_vec.assign((size_t)(energy_bins + 1) * num_indices, 0.);
+    for (auto energy_bin = 1; energy_bin <= energy_bins; energy_bin++) {
+        const double *c = content + energy_bin * row_length;
+        const double *e = sumw2 + energy_bin * row_length;
+        double *cum = &cumulative_vec[(size_t) energy_bin * num_indices];
+        double *cum_e = &cumulative_error2_vec[(size_t) energy_bin * num_indices];
+        for (auto i = 0; i < num_indices; i++) {
+            cum[i] = cum[i - num_indices] + c[index_bin_vec[i]];
+            cum_e[i] = cum_e[i - num_indices] + e[index_bin_vec[i]];
+        }
+    }
+} // end ExtractPeakCounts()
+
+/************************************************************//**
+ * Background subtracted counts of one gate for every index
+ *
+ * Requires ExtractPeakCounts to have been called.
+ *
+ * @param gate energy windows
+ * @param counts net counts per index (output)
+ * @param errors2 squared errors per index (output)
+ ***************************************************************/
+void AngularCorrelationFitter::ExtractGateCounts(const PeakGate &gate, std::vector<double> &counts, std::vector<double> &errors2)
+{
+    counts.assign(num_indices, 0.);
+    errors2.assign(num_indices, 0.);
+
+    int peak_low = FindEnergyBin(gate.peak_low);
+    int peak_high = FindEnergyBin(gate.peak_high);
+    bool subtract_bg = gate.bg_high > gate.bg_low;
+    int bg_low = subtract_bg ? FindEnergyBin(gate.bg_low) : 0;
+    int bg_high = subtract_bg ? FindEnergyBin(gate.bg_high) : 0;
+    // scale background window to the width of the peak window
+    double bg_scale = subtract_bg ? double(peak_high - peak_low + 1) / double(bg_high - bg_low + 1) : 0.;
+
+    for (auto i = 0; i < num_indices; i++) {
+        counts[i] = WindowSum(cumulative_vec, i, peak_low, peak_high);
+        errors2[i] = WindowSum(cumulative_error2_vec, i, peak_low, peak_high);
+        if (subtract_bg) {
+            counts[i] -= bg_scale * WindowSum(cumulative_vec, i, bg_low, bg_high);
+            errors2[i] += bg_scale * bg_scale * WindowSum(cumulative_error2_vec, i, bg_low, bg_high);
+        }
+    }
+} // end ExtractGateCounts()
+
+/************************************************************//**
+ * Weighted linear least squares fit of a0 (1 + a2 P2 + a4 P4)
+ *
+ * Fits the linear parameters (a0, a0 a2, a0 a4) by solving the 3x3
+ * normal equations, then propagates the covariance to a2 and a4.
+ * Indices with zero error carry no information and are skipped.
+ *
+ * @param counts counts per index
+ * @param errors2 squared errors per index
+ * @param result fit result (output)
+ ***************************************************************/
+void AngularCorrelationFitter::FitGate(const std::vector<double> &counts, const std::vector<double> &errors2, AngularCorrelationResult &result)
+{
+    result.counts_vec = counts;
+    result.counts_error_vec.resize(num_indices);
+    result.valid = false;
+
+    // normal equations (symmetric, upper triangle)
+    double m00 = 0., m01 = 0., m02 = 0., m11 = 0., m12 = 0., m22 = 0.;
+    double v0 = 0., v1 = 0., v2 = 0.;
+    int n_points = 0;
+    for (auto i = 0; i < num_indices; i++) {
+        result.counts_error_vec[i] = std::sqrt(errors2[i]);
+        if (errors2[i] <= 0.) continue;
+        double w = 1. / errors2[i];
+        double p2 = p2_vec[i];
+        double p4 = p4_vec[i];
+        m00 += w;
+        m01 += w * p2;
+        m02 += w * p4;
+        m11 += w * p2 * p2;
+        m12 += w * p2 * p4;
+        m22 += w * p4 * p4;
+        v0 += w * counts[i];
+        v1 += w * p2 * counts[i];
+        v2 += w * p4 * counts[i];
+        n_points++;
+    }
+    if (n_points < 3) return;
+
+    // covariance is the inverse of the normal matrix
+    double c00 = m11 * m22 - m12 * m12;
+    double c01 = m02 * m12 - m01 * m22;
+    double c02 = m01 * m12 - m02 * m11;
+    double c11 = m00 * m22 - m02 * m02;
+    double c12 = m01 * m02 - m00 * m12;
+    double c22 = m00 * m11 - m01 * m01;
+    double det = m00 * c00 + m01 * c01 + m02 * c02;
+    if (det == 0.) return;
+    c00 /= det; c01 /= det; c02 /= det; c11 /= det; c12 /= det; c22 /= det;
+
+    double b0 = c00 * v0 + c01 * v1 + c02 * v2;
+    double b2 = c01 * v0 + c11 * v1 + c12 * v2;
+    double b4 = c02 * v0 + c12 * v1 + c22 * v2;
+    if (b0 == 0.) return;
+
+    result.a0 = b0;
+    result.a0_err = std::sqrt(c00);
+    result.a2 = b2 / b0;
+    result.a4 = b4 / b0;
+    result.a2_err = std::sqrt(std::abs(c11 - 2. * result.a2 * c01 + result.a2 * result.a2 * c00)) / std::abs(b0);
+    result.a4_err = std::sqrt(std::abs(c22 - 2. * result.a4 * c02 + result.a4 * result.a4 * c00)) / std::abs(b0);
+
+    result.chi2 = 0.;
+    for (auto i = 0; i < num_indices; i++) {
+        if (errors2[i] <= 0.) continue;
+        double residual = counts[i] - (b0 + b2 * p2_vec[i] + b4 * p4_vec[i]);
+        result.chi2 += residual * residual / errors2[i];
+    }
+    result.ndf = n_points - 3;
+    result.valid = true;
+} // end FitGate()
+
+/************************************************************//**
+ * Writes fit results of all gates to a tree
+ *
+ * @param out_file output file
+ * @param tree_name name of tree
+ ***************************************************************/
+void AngularCorrelationFitter::WriteTree(TFile *out_file, std::string tree_name)
+{
+    out_file->cd();
+    TTree *tree = new TTree(tree_name.c_str(), "Legendre angular correlation fits");
+
+    int gate_id, n_indices = num_indices, ndf, valid;
+    double peak_low, peak_high, bg_low, bg_high;
+    double a0, a0_err, a2, a2_err, a4, a4_err, chi2;
+    std::vector<double> angles(angle_vec), counts(num_indices), counts_err(num_indices);
+
+    tree->Branch("gate", &gate_id, "gate/I");
+    tree->Branch("peak_low", &peak_low, "peak_low/D");
+    tree->Branch("peak_high", &peak_high, "peak_high/D");
+    tree->Branch("bg_low", &bg_low, "bg_low/D");
+    tree->Branch("bg_high", &bg_high, "bg_high/D");
+    tree->Branch("a0", &a0, "a0/D");
+    tree->Branch("a0_err", &a0_err, "a0_err/D");
+    tree->Branch("a2", &a2, "a2/D");
+    tree->Branch("a2_err", &a2_err, "a2_err/D");
+    tree->Branch("a4", &a4, "a4/D");
+    tree->Branch("a4_err", &a4_err, "a4_err/D");
+    tree->Branch("chi2", &chi2, "chi2/D");
+    tree->Branch("ndf", &ndf, "ndf/I");
+    tree->Branch("valid", &valid, "valid/I");
+    tree->Branch("n_indices", &n_indices, "n_indices/I");
+    tree->Branch("angle", angles.data(), "angle[n_indices]/D");
+    tree->Branch("counts", counts.data(), "counts[n_indices]/D");
+    tree->Branch("counts_err", counts_err.data(), "counts_err[n_indices]/D");
+
+    for (size_t g = 0; g < gate_vec.size(); g++) {
+        const AngularCorrelationResult &result = result_vec[g];
+        gate_id = g;
+        peak_low = gate_vec[g].peak_low;
+        peak_high = gate_vec[g].peak_high;
+        bg_low = gate_vec[g].bg_low;
+        bg_high = gate_vec[g].bg_high;
+        a0 = result.a0;
+        a0_err = result.a0_err;
+        a2 = result.a2;
+        a2_err = result.a2_err;
+        a4 = result.a4;
+        a4_err = result.a4_err;
+        chi2 = result.chi2;
+        ndf = result.ndf;
+        valid = result.valid;
+        std::copy(result.counts_vec.begin(), result.counts_vec.end(), counts.begin());
+        std::copy(result.counts_error_vec.begin(), result.counts_error_vec.end(), counts_err.begin());
+        tree->Fill();
+    }
+
+    tree->Write("", TObject::kOverwrite);
+} // end WriteTree()
+
+/************************************************************//**
+ * Sum of a cumulative table over [bin_low, bin_high]
+ ***************************************************************/
+double AngularCorrelationFitter::WindowSum(const std::vector<double> &cumulative, int index, int bin_low, int bin_high)
+{
+    if (bin_high < bin_low) return 0.;
+    return cumulative[(size_t) bin_high * num_indices + index] - cumulative[(size_t)(bin_low - 1) * num_indices + index];
+} // end WindowSum()
+
+/************************************************************//**
+ * Energy bin of the extracted angle matrix, clamped to the axis
+ ***************************************************************/
+int AngularCorrelationFitter::FindEnergyBin(double energy)
+{
+    int bin = 1 + (int) std::floor((energy - energy_min) / (energy_max - energy_min) * energy_bins);
+    if (bin < 1) bin = 1;
+    if (bin > energy_bins) bin = energy_bins;
+    return bin;
+} // end FindEnergyBin()
@@ -13,9 +13,9 @@
 #include <iomanip>
 #include <string.h>
 #include <fstream>
+#include <cstdio>
 #include "csv.h"
-#include "TPeakFitter.h"
-#include "TRWPeak.h"
+#include "TF1.h"
 #include "TH1.h"
 #include "BGUtils.h"
 
@@ -33,6 +33,7 @@ BGUtils::BGUtils(FileHandler *file_man) : file_man(file_man)
  ***************************************************************/
 BGUtils::~BGUtils(void)
 {
+    delete float_matrix;
     //std::cout << "BGUtils destroyed" << std::endl;
 } // end Constructor
 
@@ -43,11 +44,41 @@ void BGUtils::SubtractAllBackground()
 {
 
     // subtract time-random coincidences
-    file_man->CreateOutputFile("outputs.root");
+    std::string out_filename = shard.FileName(output_filename);
+    bool resume_run = resume && std::ifstream(out_filename).good();
+    if (resume_run) {
+        // finished indices are kept, see Checkpoint
+        file_man->output_file = file_man->OpenOutputFile(out_filename);
+        std::cout << "Resuming into: " << out_filename << std::endl;
+    } else {
+        file_man->CreateOutputFile(out_filename);
+    }
     TFile* out_file = file_man->output_file;
+    if (!out_file->IsOpen()) {
+        std::cerr << "ERROR --- Could not open output file: " << out_filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    resumed = resume_run;
+    if (checkpointing || resume) {
+        // journal only when the run may be resumed, it costs a flush per stage
+        checkpoint = new Checkpoint(Checkpoint::JournalName(out_filename));
+        if (!checkpoint->Open(resume_run)) exit(EXIT_FAILURE);
+    } else {
+        // a journal of an earlier run no longer describes the output
+        std::remove(Checkpoint::JournalName(out_filename).c_str());
+    }
+    if (shard.IsSharded()) {
+        // partial output, assembled by ShardMerger
+        TNamed label("shard", shard.Label().c_str());
+        out_file->WriteTObject(&label, "shard", "WriteDelete");
+    }
 
     SubtractTimeRandomBg("source", out_file);
-    SubtractTimeRandomBg("background", out_file);
+    if (bg_products_filename.empty()) {
+        SubtractTimeRandomBg("background", out_file);
+    } else {
+        CopyBackgroundProducts(out_file);
+    }
 
     SubtractAngleDependentBg(out_file);
 
@@ -55,20 +86,76 @@ void BGUtils::SubtractAllBackground()
     out_file->Close();
 
     delete out_file;
+    delete checkpoint;
+    checkpoint = NULL;
 
 } // end SubtractBackground()
 
+/************************************************************//**
+ * Writes the time-random subtracted background to its own file
+ *
+ * Runs sharing a background file then copy these products instead
+ * of reading and subtracting the background again.
+ *
+ * @param filename products file
+ ***************************************************************/
+void BGUtils::WriteBackgroundProducts(std::string filename)
+{
+    TFile *products_file = new TFile(filename.c_str(), "RECREATE");
+    SubtractTimeRandomBg("background", products_file);
+    products_file->Close();
+
+    delete products_file;
+} // end WriteBackgroundProducts()
+
+/************************************************************//**
+ * Copies shared background products into the output file
+ *
+ * @param out_file output root file
+ ***************************************************************/
+void BGUtils::CopyBackgroundProducts(TFile *out_file)
+{
+    TFile products_file(bg_products_filename.c_str(), "READ");
+    TDirectory *source_dir = products_file.IsOpen() ? products_file.GetDirectory("background") : NULL;
+    if (!source_dir) {
+        std::cerr << "ERROR --- Could not read background products: " << bg_products_filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::cout << "Copying background products from: " << bg_products_filename << std::endl;
+    TDirectory *target_dir = OutputDirectory(out_file, "background");
+    ShardMerger::CopyDirectory(source_dir, target_dir);
+    products_file.Close();
+} // end CopyBackgroundProducts()
+
+/************************************************************//**
+ * Directory of the output file, created unless a resumed run has it
+ *
+ * @param out_file output root file
+ * @param name name of the directory
+ ***************************************************************/
+TDirectory* BGUtils::OutputDirectory(TFile *out_file, std::string name)
+{
+    TDirectory *target_dir = out_file->GetDirectory(name.c_str());
+    if (!target_dir) target_dir = out_file->mkdir(name.c_str());
+
+    return target_dir;
+} // end OutputDirectory()
+
 /************************************************************//**
  * Subtracts average time-random background
  ***************************************************************/
 void BGUtils::SubtractTimeRandomBg(std::string file_type, TFile *out_file)
 {
     TFile* hist_file;
+    HistogramMerger *merger;
 
     if (file_type.compare("source") == 0) {
         hist_file = file_man->src_file;
+        merger = file_man->src_merger;
     } else if (file_type.compare("background") == 0) {
         hist_file = file_man->bg_file;
+        merger = file_man->bg_merger;
     } else {
         std::cerr << "Unknown file designation: " << file_type << std::endl;
         std::cerr << "Exiting ..." << std::endl;
@@ -77,30 +164,50 @@ void BGUtils::SubtractTimeRandomBg(std::string file_type, TFile *out_file)
 
     // change into output file for writing matrices
     out_file->cd();
-    TDirectory *target_dir = out_file->mkdir(file_type.c_str());
+    TDirectory *target_dir = OutputDirectory(out_file, file_type);
     target_dir->cd();
-    // loop through each angular index
-    for (auto i = 0; i < angle_indices; i++) {
+    if (hist_file) file_man->Prefetch(hist_file, {Form("prompt_angle/index_%02i_sum", shard.index), Form("time_random/index_%02i_sum_tr_avg", shard.index)});
+    // loop through each angular index of this shard
+    for (auto i = shard.index; i < angle_indices; i += shard.count) {
         std::cout << "Subtracting time-random background of " << file_type << " file: " << i + 1 << " of " << angle_indices << "\r";
         std::cout.flush();
-        TH2D * prompt_matrix = (TH2D*) hist_file->Get(Form("prompt_angle/index_%02i_sum", i));
-        TH2D * time_random_matrix = (TH2D*) hist_file->Get(Form("time_random/index_%02i_sum_tr_avg", i));
-
-        // no scaling since time-random matrix was created identically to the prompt
-        prompt_matrix->Add(time_random_matrix, -1.0);
-        // write to output file
-        prompt_matrix->Write();
+        std::string input_hash;
+        if (checkpoint) {
+            std::vector<TFile*> input_files = merger ? merger->GetFiles() : std::vector<TFile*>(1, hist_file);
+            std::string options = storage_format + ":" + precision.intermediate + (merger ? ":" + merger->GetGainLabel() : "");
+            input_hash = Checkpoint::KeyHash(input_files, {Form("prompt_angle/index_%02i_sum", i), Form("time_random/index_%02i_sum_tr_avg", i)}, options);
+            if (checkpoint->IsDone(file_type, i, input_hash, out_file, Form("%s/index_%02i_sum", file_type.c_str(), i))) continue;
+        }
+        // matrices are owned by the pool and reused for every index
+        TH2D * prompt_matrix;
+        TH2D * time_random_matrix;
+        if (merger) {
+            // runs are merged per index, so only this index is held in memory
+            prompt_matrix = merger->Merge(Form("prompt_angle/index_%02i_sum", i), 0);
+            time_random_matrix = merger->Merge(Form("time_random/index_%02i_sum_tr_avg", i), 1);
+        } else {
+            prompt_matrix = hist_pool.Read(hist_file, Form("prompt_angle/index_%02i_sum", i), 0);
+            time_random_matrix = hist_pool.Read(hist_file, Form("time_random/index_%02i_sum_tr_avg", i), 1);
+        }
+        if (!prompt_matrix || !time_random_matrix) exit(EXIT_FAILURE);
+        // next index is read from storage while this one is subtracted and written
+        if (hist_file && i + shard.count < angle_indices) {
+            file_man->Prefetch(hist_file, {Form("prompt_angle/index_%02i_sum", i + shard.count), Form("time_random/index_%02i_sum_tr_avg", i + shard.count)});
+        }
 
-        // cleaning up
-        delete time_random_matrix;
-        delete prompt_matrix;
+        SubtractTimeRandomIndex(prompt_matrix, time_random_matrix);
+        WriteIntermediate(prompt_matrix, target_dir);
+        if (checkpoint) checkpoint->MarkDone(out_file, file_type, i, input_hash);
     } // end index loop
     std::cout << std::endl;
 
-    hist_file->Close();
+    file_man->WaitForPrefetch();
+    if (hist_file) {
+        hist_file->Close();
 
-    // cleaning up
-    delete hist_file;
+        // cleaning up
+        delete hist_file;
+    }
 
     return;
 
@@ -113,74 +220,345 @@ void BGUtils::SubtractTimeRandomBg(std::string file_type, TFile *out_file)
  ***************************************************************/
 void BGUtils::SubtractAngleDependentBg(TFile *out_file)
 {
-    // read in bg scale factors
-    std::string bg_scale_filename = "bg_index_scaling.csv";
-    std::fstream bg_scale_file;
-
-    bg_scale_file.open(bg_scale_filename, std::ios_base::in);
-    // if bg file doesn't exist, create it
-    if (!bg_scale_file || optimize_values) {
-        bg_scale_file.close();
-        std::cout << "Could not open " << bg_scale_filename << ", creating new file..." << std::endl;
-        bg_scale_file.open(bg_scale_filename, std::ios_base::out | std::ios_base::trunc);
-        bg_scale_file << "index,scale\n";
-    } else { // use existing file
-        std::cout << "Found background scaling file: " << bg_scale_filename << std::endl;
-        io::CSVReader<2> in(bg_scale_filename);
-        in.read_header(io::ignore_extra_column, "index", "scale");
-        int index; float scale;
-        while(in.read_row(index, scale)) {
-            bg_scaling_factors_map.insert(std::pair<int, float>(index, scale));
-        }
-        bg_scale_file.close();
-    }
-
-    // peak for background fitting
-    int bg_peak = 1730;
-    float bg_scaling_factor = 1.0;
-    float bg_scaling_factor_init = bg_scaling_factor;
+    LoadScaleFactors();
 
     // create directory for subtracted histograms
-    TDirectory* target_dir = (TDirectory*) out_file->mkdir("room_background_subtracted");
+    TDirectory* target_dir = OutputDirectory(out_file, "room_background_subtracted");
     target_dir->cd();
 
-    for (auto i=0; i < angle_indices; i++) {
-
-
-        TH2D *src_h = (TH2D*)out_file->Get(Form("source/index_%02i_sum", i));
-        TH2D* bg_h = (TH2D*)out_file->Get(Form("background/index_%02i_sum", i));
-
+    for (auto i = shard.index; i < angle_indices; i += shard.count) {
+        float bg_scaling_factor;
         if (optimize_values) {
             std::cout << "Optimizing background scaling factor for index: " << i + 1 << " of " << angle_indices << "\r";
-            std::cout.flush();
-            bg_scaling_factor = OptimizeBGScaleFactor(src_h, bg_h, bg_peak, bg_scaling_factor_init, static_cast<int>(i), 100);
-            if (bg_scaling_factor == bg_scaling_factor_init) {
-                std::cerr << "\n  Could not optimize index: " << i << std::endl;
-            }
-            // Subtract background angle by angle
-            src_h->Add(bg_h, -1.0 * bg_scaling_factor);
-            // write factors to file
-            bg_scale_file << i << "," << bg_scaling_factor << std::endl;
+            bg_scaling_factor = bg_scaling_factor_init;
         } else {
             std::cout << "Subtracting scaled room background for index: " << i + 1 << " of " << angle_indices << "\r";
-            std::cout.flush();
-            // Subtract background angle by angle
-            src_h->Add(bg_h, -1.0 * bg_scaling_factors_map[i]);
+            bg_scaling_factor = ScaleFactor(i);
+        }
+        std::cout.flush();
+        std::string input_hash;
+        if (checkpoint) {
+            std::string options = storage_format + ":" + precision.intermediate + ":" + (optimize_values ? std::string("optimized") : std::to_string(bg_scaling_factor));
+            input_hash = Checkpoint::KeyHash({out_file}, {Form("source/index_%02i_sum", i), Form("background/index_%02i_sum", i)}, options);
+            if (checkpoint->IsDone("room", i, input_hash, out_file, Form("room_background_subtracted/source_%02i", i))) continue;
         }
-        //total->Add(src_h, 1.0);
 
-        src_h->Write(Form("source_%02i", i));
+        bool single_precision = precision.intermediate.compare("float") == 0;
+        if (storage_format.compare("sparse") == 0) {
+            // subtract directly on the compressed rows
+            if (single_precision) {
+                bg_scaling_factor = SubtractPacked(out_file, i, sparse_float_src, sparse_float_bg, sparse_src, target_dir, bg_peak, bg_scaling_factor);
+            } else {
+                bg_scaling_factor = SubtractPacked(out_file, i, sparse_src, sparse_bg, sparse_src, target_dir, bg_peak, bg_scaling_factor);
+            }
+        } else if (storage_format.compare("triangular") == 0) {
+            // subtract directly on the packed rows
+            if (single_precision) {
+                bg_scaling_factor = SubtractPacked(out_file, i, triangular_float_src, triangular_float_bg, triangular_src, target_dir, bg_peak, bg_scaling_factor);
+            } else {
+                bg_scaling_factor = SubtractPacked(out_file, i, triangular_src, triangular_bg, triangular_src, target_dir, bg_peak, bg_scaling_factor);
+            }
+        } else {
+            TH2D *src_h = hist_pool.Read(out_file, Form("source/index_%02i_sum", i), 0);
+            TH2D* bg_h = hist_pool.Read(out_file, Form("background/index_%02i_sum", i), 1);
+            if (!src_h || !bg_h) exit(EXIT_FAILURE);
+            bg_scaling_factor = SubtractRoomIndex(i, src_h, bg_h);
+            WriteFinal(src_h, target_dir, i);
+        }
 
-        // cleaning up
-        delete src_h;
-        delete bg_h;
+        RecordScaleFactor(i, bg_scaling_factor);
+        if (checkpoint) checkpoint->MarkDone(out_file, "room", i, input_hash);
     }
     std::cout << std::endl;
-
-    if (optimize_values) bg_scale_file.close();
 }
 
+/************************************************************//**
+ * Subtracts the time-random matrix of one index in place
+ *
+ * With float intermediates the result is rounded like the stored
+ * matrix, so steps using it in memory see the values read back by
+ * the serial subtraction.
+ *
+ * @param prompt_matrix prompt matrix, time-random subtracted on return
+ * @param time_random_matrix time-random matrix of the same index
+ ***************************************************************/
+void BGUtils::SubtractTimeRandomIndex(TH2D *prompt_matrix, TH2D *time_random_matrix)
+{
+    // no scaling since time-random matrix was created identically to the prompt
+    prompt_matrix->Add(time_random_matrix, -1.0);
+    if (precision.intermediate.compare("float") != 0) return;
+
+    const int cells = (prompt_matrix->GetNbinsX() + 2) * (prompt_matrix->GetNbinsY() + 2);
+    double *content = prompt_matrix->GetArray();
+    // dense float matrices keep double errors, packed ones store them as float
+    double *sumw2 = prompt_matrix->GetSumw2N() > 0 && storage_format.compare("dense") != 0 ? prompt_matrix->GetSumw2()->GetArray() : NULL;
+    for (auto bin = 0; bin < cells; bin++) {
+        content[bin] = (float) content[bin];
+        if (sumw2) sumw2[bin] = (float) sumw2[bin];
+    }
+} // end SubtractTimeRandomIndex()
+
+/************************************************************//**
+ * Writes a time-random subtracted matrix with the intermediate
+ * storage format and precision
+ *
+ * Uses the reused output matrices, calls must not overlap.
+ *
+ * @param h time-random subtracted matrix, written under its name
+ * @param target_dir output directory
+ ***************************************************************/
+void BGUtils::WriteIntermediate(TH2D *h, TDirectory *target_dir)
+{
+    bool single_precision = precision.intermediate.compare("float") == 0;
+    if (storage_format.compare("sparse") == 0) {
+        if (single_precision) {
+            WritePacked(h, sparse_float_src, target_dir);
+        } else {
+            WritePacked(h, sparse_src, target_dir);
+        }
+    } else if (storage_format.compare("triangular") == 0) {
+        if (single_precision) {
+            WritePacked(h, triangular_float_src, target_dir);
+        } else {
+            WritePacked(h, triangular_src, target_dir);
+        }
+    } else {
+        WriteDense(h, target_dir, h->GetName(), single_precision);
+    }
+} // end WriteIntermediate()
+
+/************************************************************//**
+ * Subtracts the scaled room background of one index in place
+ *
+ * The factor is read from the scaling file or, when optimizing,
+ * fitted; either way it is returned for RecordScaleFactor().
+ *
+ * @param i angular index
+ * @param src_h time-random subtracted source, subtracted on return
+ * @param bg_h time-random subtracted background
+ ***************************************************************/
+float BGUtils::SubtractRoomIndex(int i, TH2D *src_h, TH2D *bg_h)
+{
+    float bg_scaling_factor = ScaleFactor(i);
+    if (optimize_values) {
+        bg_scaling_factor = OptimizeBGScaleFactor(src_h, bg_h, bg_peak, bg_scaling_factor_init, i, 100);
+    }
+    // Subtract background angle by angle
+    src_h->Add(bg_h, -1.0 * bg_scaling_factor);
+
+    return bg_scaling_factor;
+} // end SubtractRoomIndex()
+
+/************************************************************//**
+ * Keeps an optimized scaling factor in the scaling file
+ *
+ * @param i angular index
+ * @param bg_scaling_factor factor used for the index
+ ***************************************************************/
+void BGUtils::RecordScaleFactor(int i, float bg_scaling_factor)
+{
+    if (!optimize_values) return;
+    if (bg_scaling_factor == bg_scaling_factor_init) {
+        std::cerr << "\n  Could not optimize index: " << i << std::endl;
+    }
+    // write factors to file, replacing the row of a redone index
+    bg_scaling_factors_map[i] = bg_scaling_factor;
+    WriteScaleFile();
+} // end RecordScaleFactor()
+
+/************************************************************//**
+ * Writes a room background subtracted matrix in double precision
+ * with the storage format
+ *
+ * Uses the reused output matrices, calls must not overlap.
+ *
+ * @param h room background subtracted matrix
+ * @param target_dir output directory
+ * @param i angular index
+ ***************************************************************/
+void BGUtils::WriteFinal(TH2D *h, TDirectory *target_dir, int i)
+{
+    if (storage_format.compare("sparse") == 0) {
+        sparse_src.FromHistogram(h);
+        sparse_src.Write(target_dir, Form("source_%02i", i));
+    } else if (storage_format.compare("triangular") == 0) {
+        triangular_src.FromHistogram(h);
+        triangular_src.Write(target_dir, Form("source_%02i", i));
+    } else {
+        target_dir->cd();
+        h->Write(Form("source_%02i", i), TObject::kOverwrite);
+    }
+} // end WriteFinal()
+
+/************************************************************//**
+ * Reads or creates the background scaling factors
+ *
+ * Exits when the factors must be read but the file is missing, or
+ * when a sharded run would optimize them.
+ ***************************************************************/
+void BGUtils::LoadScaleFactors()
+{
+    // read in bg scale factors
+    bool found_scale_file = std::ifstream(bg_scale_filename).good();
+    if (shard.IsSharded() && optimize_values) {
+        // every shard would rewrite the file with its own indices only
+        std::cerr << "ERROR --- Background scaling factors can not be optimized in sharded runs" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    // concurrent shards must not race to create the file
+    if (!found_scale_file && (bg_scale_required || shard.IsSharded()) && !optimize_values) {
+        std::cerr << "ERROR --- Could not open background scaling file: " << bg_scale_filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    bg_scaling_factors_map.clear();
+    if (found_scale_file && (!optimize_values || resumed)) {
+        // a resumed optimization keeps the factors of its finished indices
+        std::cout << "Found background scaling file: " << bg_scale_filename << std::endl;
+        ReadScaleFile();
+    } else {
+        // if bg file doesn't exist or is optimized again, create it
+        std::cout << "Creating new background scaling file: " << bg_scale_filename << std::endl;
+        WriteScaleFile();
+    }
+} // end LoadScaleFactors()
+
+/************************************************************//**
+ * Reads the background scaling factors, later rows of an index win
+ ***************************************************************/
+void BGUtils::ReadScaleFile()
+{
+    io::CSVReader<2> in(bg_scale_filename);
+    in.read_header(io::ignore_extra_column, "index", "scale");
+    int index; float scale;
+    while(in.read_row(index, scale)) {
+        bg_scaling_factors_map[index] = scale;
+    }
+} // end ReadScaleFile()
+
+/************************************************************//**
+ * Rewrites the background scaling file from the factors map
+ *
+ * Written to a temporary file and renamed, an interrupted run
+ * leaves the previous complete file.
+ ***************************************************************/
+void BGUtils::WriteScaleFile()
+{
+    std::string temp_filename = bg_scale_filename + ".tmp";
+    std::ofstream scale_file(temp_filename, std::ios_base::out | std::ios_base::trunc);
+    scale_file << "index,scale\n";
+    for (auto &factor : bg_scaling_factors_map) {
+        scale_file << factor.first << "," << factor.second << "\n";
+    }
+    scale_file.close();
+    if (!scale_file || std::rename(temp_filename.c_str(), bg_scale_filename.c_str()) != 0) {
+        std::cerr << "ERROR --- Could not write background scaling file: " << bg_scale_filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+} // end WriteScaleFile()
+
+/************************************************************//**
+ * Packs a matrix and writes it
+ *
+ * @param h matrix to write, written under its own name
+ * @param packed packed matrix of the wanted format and precision
+ * @param target_dir output directory
+ ***************************************************************/
+template <typename Matrix>
+void BGUtils::WritePacked(TH2D *h, Matrix &packed, TDirectory *target_dir)
+{
+    packed.FromHistogram(h);
+    packed.Write(target_dir, h->GetName());
+} // end WritePacked()
+
+/************************************************************//**
+ * Subtracts scaled room background of one index on packed matrices
+ *
+ * Source and background are read with the intermediate precision,
+ * the subtracted matrix is built and written in double.
+ *
+ * @param out_file file holding the time-random subtracted matrices
+ * @param i angular index
+ * @param src source matrix
+ * @param bg background matrix
+ * @param result final matrix, may be src itself
+ * @param target_dir output directory
+ * @param bg_peak peak used to optimize the scaling
+ * @param bg_scaling_factor scaling of the background
+ ***************************************************************/
+template <typename Matrix, typename Final>
+float BGUtils::SubtractPacked(TFile *out_file, int i, Matrix &src, Matrix &bg, Final &result, TDirectory *target_dir, int bg_peak, float bg_scaling_factor)
+{
+    if (!src.Read(out_file, Form("source/index_%02i_sum", i)) || !bg.Read(out_file, Form("background/index_%02i_sum", i))) exit(EXIT_FAILURE);
+    if (optimize_values) {
+        TH1D *src_projection = src.ProjectionX("src_projection");
+        TH1D *bg_projection = bg.ProjectionX("bg_projection");
+        bg_scaling_factor = OptimizeBGScaleFactor(src_projection, bg_projection, bg_peak, bg_scaling_factor, i, 100);
+        delete src_projection;
+        delete bg_projection;
+    }
+    // Subtract background angle by angle
+    result.Assign(src);
+    result.Add(bg, -1.0 * bg_scaling_factor);
+    result.Write(target_dir, Form("source_%02i", i));
+
+    return bg_scaling_factor;
+} // end SubtractPacked()
+
+/************************************************************//**
+ * Writes a dense matrix, optionally in single precision
+ *
+ * @param h matrix to write
+ * @param target_dir output directory
+ * @param name key name
+ * @param single_precision write as TH2F
+ ***************************************************************/
+void BGUtils::WriteDense(TH2D *h, TDirectory *target_dir, std::string name, bool single_precision)
+{
+    target_dir->cd();
+    if (!single_precision) {
+        h->Write(name.c_str(), TObject::kOverwrite);
+        return;
+    }
+
+    const TAxis *x_axis = h->GetXaxis();
+    const TAxis *y_axis = h->GetYaxis();
+    if (!float_matrix) {
+        float_matrix = new TH2F();
+        float_matrix->SetDirectory(0);
+        float_matrix->Sumw2();
+    }
+    // only reallocates when the binning changes
+    float_matrix->SetBins(x_axis->GetNbins(), x_axis->GetXmin(), x_axis->GetXmax(), y_axis->GetNbins(), y_axis->GetXmin(), y_axis->GetXmax());
+    float_matrix->SetName(name.c_str());
+    float_matrix->SetTitle(h->GetTitle());
+
+    const int cells = (x_axis->GetNbins() + 2) * (y_axis->GetNbins() + 2);
+    const double *content = h->GetArray();
+    const double *sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : content;
+    float *float_content = float_matrix->GetArray();
+    double *float_sumw2 = float_matrix->GetSumw2()->GetArray();
+    for (auto bin = 0; bin < cells; bin++) {
+        float_content[bin] = (float) content[bin];
+        float_sumw2[bin] = sumw2[bin];
+    }
+    float_matrix->SetEntries(h->GetEntries());
+    float_matrix->Write(name.c_str(), TObject::kOverwrite);
+} // end WriteDense()
+
 float BGUtils::OptimizeBGScaleFactor(TH2D* src_h, TH2D* bg_h, int peak, float init_guess, int i, float steps){
+    TH1D * src_projection = (TH1D*)src_h->ProjectionX("src_projection");
+    TH1D * bg_projection = (TH1D*)bg_h->ProjectionX("bg_projection");
+
+    float best_guess = OptimizeBGScaleFactor(src_projection, bg_projection, peak, init_guess, i, steps);
+
+    // cleaning up
+    delete src_projection;
+    delete bg_projection;
+
+    return best_guess;
+}    // end OptimizeBGScaleFactor
+
+float BGUtils::OptimizeBGScaleFactor(TH1D* src_projection, TH1D* bg_projection, int peak, float init_guess, int i, float steps){
     // Attempt to optimize bg scale factors by fitting line to region to minimize Chi2
     float current_guess, best_guess;
     float current_chi2, best_chi2;
@@ -195,8 +573,11 @@ float BGUtils::OptimizeBGScaleFactor(TH2D* src_h, TH2D* bg_h, int peak, float in
     current_guess = range_low;
     best_chi2 = 10000.;
     TF1 *pol1 = new TF1("pol1", "pol1", peak - 20, peak + 20);
-    TH1D * src_projection = (TH1D*)src_h->ProjectionX("src_projection");
-    TH1D * bg_projection = (TH1D*)bg_h->ProjectionX("bg_projection");
+    if (src_projection->GetSumw2N() == 0) src_projection->Sumw2();
+    if (bg_projection->GetSumw2N() == 0) bg_projection->Sumw2();
+    // scratch histogram refilled for every guess instead of cloned
+    TH1D * src_clone = (TH1D*)src_projection->Clone("src_clone");
+    const int n_cells = src_projection->GetNcells();
 
     while (current_guess < range_high) {
 
@@ -208,10 +589,17 @@ float BGUtils::OptimizeBGScaleFactor(TH2D* src_h, TH2D* bg_h, int peak, float in
            std::cout.flush();
          */
 
-        TH1D * src_clone = (TH1D*)src_projection->Clone();
-
         // subtract background
-        src_clone->Add(bg_projection, -1. * current_guess);
+        const double *src_content = src_projection->GetArray();
+        const double *bg_content = bg_projection->GetArray();
+        const double *src_sumw2 = src_projection->GetSumw2()->GetArray();
+        const double *bg_sumw2 = bg_projection->GetSumw2()->GetArray();
+        double *clone_content = src_clone->GetArray();
+        double *clone_sumw2 = src_clone->GetSumw2()->GetArray();
+        for (auto bin = 0; bin < n_cells; bin++) {
+            clone_content[bin] = src_content[bin] - current_guess * bg_content[bin];
+            clone_sumw2[bin] = src_sumw2[bin] + current_guess * current_guess * bg_sumw2[bin];
+        }
 
         // fit line and extract goodness of fit
         src_clone->GetXaxis()->SetRangeUser(peak - 20, peak + 20);
@@ -225,7 +613,6 @@ float BGUtils::OptimizeBGScaleFactor(TH2D* src_h, TH2D* bg_h, int peak, float in
             best_chi2 = current_chi2;
         }
         current_guess += step;
-        delete src_clone;
 
     }
 
@@ -235,8 +622,7 @@ float BGUtils::OptimizeBGScaleFactor(TH2D* src_h, TH2D* bg_h, int peak, float in
     }
 
     // cleaing up
-    delete src_projection;
-    delete bg_projection;
+    delete src_clone;
     delete pol1;
 
     return best_guess;
@@ -245,3 +631,31 @@ float BGUtils::OptimizeBGScaleFactor(TH2D* src_h, TH2D* bg_h, int peak, float in
 void BGUtils::OptimizeBGScaling(bool optimize){
     optimize_values = optimize;
 }
+
+/************************************************************//**
+ * Sets storage of the written matrices
+ *
+ * @param format "dense" (TH2D), "sparse" (compressed rows) or
+ *               "triangular" (packed gamma <= sum rows)
+ ***************************************************************/
+void BGUtils::SetStorageFormat(std::string format){
+    if (format.compare("dense") != 0 && format.compare("sparse") != 0 && format.compare("triangular") != 0) {
+        std::cerr << "Unknown storage format: " << format << std::endl;
+        std::cerr << "Please pass either 'dense', 'sparse' or 'triangular'" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    storage_format = format;
+} // end SetStorageFormat
+
+/************************************************************//**
+ * Sets storage precision of the written matrices
+ *
+ * @param name "double" or "mixed" (float intermediates, double final)
+ ***************************************************************/
+void BGUtils::SetPrecision(std::string name){
+    if (!PrecisionPolicy::FromName(name, precision)) {
+        std::cerr << "Unknown storage precision: " << name << std::endl;
+        std::cerr << "Please pass either 'double' or 'mixed'" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+} // end SetPrecision
@@ -0,0 +1,248 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Parallel peak area extraction in every angular index
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   BatchPeakFitter fitter;
+//   fitter.ReadPeaks("peaks.csv");
+//   fitter.FitMatrices(matrices);
+//   fitter.WriteTree(out_file, "peak_fits", angles);
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include "csv.h"
+#include "TROOT.h"
+#include "TTree.h"
+#include "BatchPeakFitter.h"
+#include "GRSIComponent.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param indices number of angular indices
+ ***************************************************************/
+BatchPeakFitter::BatchPeakFitter(int indices) : angle_indices(indices)
+{
+    //std::cout << "BatchPeakFitter initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+BatchPeakFitter::~BatchPeakFitter(void)
+{
+    //std::cout << "BatchPeakFitter destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Reads peak definitions
+ *
+ * CSV columns: centroid,range_low,range_high (keV)
+ *
+ * @param filename peak file
+ ***************************************************************/
+bool BatchPeakFitter::ReadPeaks(std::string filename)
+{
+    std::ifstream peak_file(filename);
+    if (!peak_file.good()) {
+        std::cerr << "ERROR --- Could not open peak file: " << filename << std::endl;
+        return false;
+    }
+    peak_file.close();
+
+    io::CSVReader<3> in(filename);
+    in.read_header(io::ignore_extra_column, "centroid", "range_low", "range_high");
+    PeakDefinition peak;
+    while (in.read_row(peak.centroid, peak.range_low, peak.range_high)) {
+        peak_vec.push_back(peak);
+    }
+    std::cout << "Found " << peak_vec.size() << " peaks in: " << filename << std::endl;
+
+    return true;
+} // end ReadPeaks()
+
+/************************************************************//**
+ * Fits every peak in every angular index of every matrix
+ *
+ * @param matrices angular index (x) vs energy (y) matrices
+ ***************************************************************/
+bool BatchPeakFitter::FitMatrices(std::vector<TH2D*> matrices)
+{
+    matrix_name_vec.clear();
+    for (auto matrix : matrices) {
+        matrix_name_vec.push_back(matrix->GetName());
+    }
+
+    int num_chains = matrices.size() * peak_vec.size();
+    result_vec.assign((size_t) num_chains * angle_indices, PeakFitResult());
+    if (num_chains == 0) return true;
+
+    // the peak fitter is part of the GRSISort component
+    GRSIComponent::PeakFitFunction fit_peak = GRSIComponent::GetPeakFitter();
+    if (!fit_peak) return false;
+
+    // fitting creates TF1s in every thread
+    ROOT::EnableThreadSafety();
+
+    int threads = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    if (threads > num_chains) threads = num_chains;
+
+    std::atomic<int> next_chain(0);
+    std::atomic<int> chains_done(0);
+    auto worker = [&]() {
+        // per-thread projection, rebuilt when the matrix binning changes
+        TH1D *projection = NULL;
+        int projection_matrix = -1;
+        int chain;
+        while ((chain = next_chain++) < num_chains) {
+            int matrix_id = chain / peak_vec.size();
+            int peak_id = chain % peak_vec.size();
+            TH2D *matrix = matrices[matrix_id];
+
+            if (projection_matrix != matrix_id) {
+                delete projection;
+                projection = new TH1D(Form("projection_%i_%i", matrix_id, chain), "", matrix->GetYaxis()->GetNbins(), matrix->GetYaxis()->GetXmin(), matrix->GetYaxis()->GetXmax());
+                projection->SetDirectory(0);
+                projection->Sumw2();
+                projection_matrix = matrix_id;
+            }
+            FitChain(matrix, matrix_id, peak_id, projection, fit_peak);
+            chains_done++;
+        }
+        delete projection;
+    };
+
+    std::vector<std::thread> thread_vec;
+    for (auto t = 1; t < threads; t++) {
+        thread_vec.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &t : thread_vec) {
+        t.join();
+    }
+
+    int n_valid = 0;
+    for (auto &result : result_vec) {
+        if (result.valid) n_valid++;
+    }
+    std::cout << "Fitted " << n_valid << " of " << result_vec.size() << " peaks (" << chains_done << " chains, " << threads << " threads)" << std::endl;
+
+    return true;
+} // end FitMatrices()
+
+/************************************************************//**
+ * Fits one peak through all angular indices of one matrix
+ *
+ * Each index starts from the centroid of the last good fit, and the
+ * fit range follows the centroid, so slow drifts across the indices
+ * are tracked.
+ *
+ * @param matrix angle matrix
+ * @param matrix_id position of matrix in results
+ * @param peak_id position of peak in results
+ * @param projection thread-owned projection histogram
+ * @param fit_peak peak fit of the GRSISort component
+ ***************************************************************/
+void BatchPeakFitter::FitChain(TH2D *matrix, int matrix_id, int peak_id, TH1D *projection, GRSIComponent::PeakFitFunction fit_peak)
+{
+    const PeakDefinition &peak_def = peak_vec[peak_id];
+    double centroid_guess = peak_def.centroid;
+
+    for (auto i = 0; i < angle_indices; i++) {
+        PeakFitResult &result = result_vec[((size_t) matrix_id * peak_vec.size() + peak_id) * angle_indices + i];
+        result.matrix = matrix_id;
+        result.peak = peak_id;
+        result.index = i;
+
+        FillProjection(matrix, i, projection);
+        // the range follows the warm started centroid
+        double shift = centroid_guess - peak_def.centroid;
+        if (projection->Integral(projection->FindBin(peak_def.range_low + shift), projection->FindBin(peak_def.range_high + shift)) <= 0.) continue;
+
+        fit_peak(projection, peak_def.range_low + shift, peak_def.range_high + shift, centroid_guess, &result);
+
+        // warm start next index, ignoring fits that ran off the range
+        if (result.valid && result.centroid > peak_def.range_low + shift && result.centroid < peak_def.range_high + shift) {
+            centroid_guess = result.centroid;
+        }
+    }
+} // end FitChain()
+
+/************************************************************//**
+ * Copies one angular index column of a matrix into a projection
+ *
+ * @param matrix angle matrix, angular index on x
+ * @param index angular index
+ * @param projection histogram with the binning of the matrix y axis
+ ***************************************************************/
+void BatchPeakFitter::FillProjection(TH2D *matrix, int index, TH1D *projection)
+{
+    const int row_length = matrix->GetXaxis()->GetNbins() + 2;
+    const int bins = matrix->GetYaxis()->GetNbins() + 2;
+    const int x_bin = matrix->GetXaxis()->FindBin(index);
+    const double *content = matrix->GetArray();
+    const double *sumw2 = matrix->GetSumw2N() > 0 ? matrix->GetSumw2()->GetArray() : content;
+
+    double *p_content = projection->GetArray();
+    double *p_sumw2 = projection->GetSumw2()->GetArray();
+    for (auto bin = 0; bin < bins; bin++) {
+        p_content[bin] = content[x_bin + bin * row_length];
+        p_sumw2[bin] = sumw2[x_bin + bin * row_length];
+    }
+    projection->ResetStats();
+} // end FillProjection()
+
+/************************************************************//**
+ * Writes fit results to a tree
+ *
+ * @param out_file output file
+ * @param tree_name name of tree
+ * @param angles opening angle of every angular index [deg]
+ ***************************************************************/
+void BatchPeakFitter::WriteTree(TFile *out_file, std::string tree_name, std::vector<double> angles)
+{
+    out_file->cd();
+    TTree *tree = new TTree(tree_name.c_str(), "Peak fits per angular index");
+
+    std::string matrix_name;
+    int peak_id, index, ndf, valid;
+    double angle, peak_centroid, centroid, centroid_err, area, area_err, fwhm, chi2;
+    tree->Branch("matrix", &matrix_name);
+    tree->Branch("peak", &peak_id, "peak/I");
+    tree->Branch("peak_centroid", &peak_centroid, "peak_centroid/D");
+    tree->Branch("index", &index, "index/I");
+    tree->Branch("angle", &angle, "angle/D");
+    tree->Branch("centroid", &centroid, "centroid/D");
+    tree->Branch("centroid_err", &centroid_err, "centroid_err/D");
+    tree->Branch("area", &area, "area/D");
+    tree->Branch("area_err", &area_err, "area_err/D");
+    tree->Branch("fwhm", &fwhm, "fwhm/D");
+    tree->Branch("chi2", &chi2, "chi2/D");
+    tree->Branch("ndf", &ndf, "ndf/I");
+    tree->Branch("valid", &valid, "valid/I");
+
+    for (auto &result : result_vec) {
+        matrix_name = matrix_name_vec[result.matrix];
+        peak_id = result.peak;
+        peak_centroid = peak_vec[result.peak].centroid;
+        index = result.index;
+        angle = result.index < (int) angles.size() ? angles[result.index] : 0.;
+        centroid = result.centroid;
+        centroid_err = result.centroid_err;
+        area = result.area;
+        area_err = result.area_err;
+        fwhm = result.fwhm;
+        chi2 = result.chi2;
+        ndf = result.ndf;
+        valid = result.valid;
+        tree->Fill();
+    }
+
+    tree->Write("", TObject::kOverwrite);
+} // end WriteTree()
@@ -0,0 +1,249 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Background subtraction of many source/background pairs in one process
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   BatchRunner runner(8);
+//   runner.ReadManifest("campaign.csv");
+//   runner.Run();
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "csv.h"
+#include "BatchRunner.h"
+#include "Pipeline.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param jobs number of concurrent jobs (0 = all cores)
+ ***************************************************************/
+BatchRunner::BatchRunner(int jobs) : num_jobs(jobs)
+{
+    //std::cout << "BatchRunner initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+BatchRunner::~BatchRunner(void)
+{
+    //std::cout << "BatchRunner destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Reads the run pairs
+ *
+ * CSV columns: source,background,output and optionally scaling, the
+ * background scaling file of the job (default: bg_index_scaling.csv).
+ * Source and background may be lists of runs given as @runs.txt.
+ *
+ * @param filename manifest file
+ ***************************************************************/
+bool BatchRunner::ReadManifest(std::string filename)
+{
+    std::ifstream manifest_file(filename);
+    if (!manifest_file.good()) {
+        std::cerr << "ERROR --- Could not open manifest: " << filename << std::endl;
+        return false;
+    }
+    manifest_file.close();
+
+    io::CSVReader<4> in(filename);
+    in.read_header(io::ignore_extra_column | io::ignore_missing_column, "source", "background", "output", "scaling");
+    const bool has_scaling = in.has_column("scaling");
+    BatchJob job;
+    while (in.read_row(job.source, job.background, job.output, job.scaling)) {
+        if (!has_scaling || job.scaling.empty()) job.scaling = "bg_index_scaling.csv";
+        job_vec.push_back(job);
+    }
+    std::cout << "Found " << job_vec.size() << " jobs in: " << filename << std::endl;
+
+    return !job_vec.empty();
+} // end ReadManifest()
+
+/************************************************************//**
+ * Applies the command line options to a job
+ *
+ * @param inputs input files of the job
+ * @param bg_utils background subtraction of the job
+ ***************************************************************/
+bool BatchRunner::Configure(FileHandler *inputs, BGUtils *bg_utils)
+{
+    if (options.count("format")) bg_utils->SetStorageFormat(options["format"]);
+    if (options.count("precision")) bg_utils->SetPrecision(options["precision"]);
+    bg_utils->SetResume(options.count("resume") > 0);
+    bg_utils->SetCheckpointing(options.count("checkpoint") > 0);
+    if (options.count("gains")) {
+        if (inputs->src_merger && !inputs->src_merger->ReadGainCorrections(options["gains"])) return false;
+        if (inputs->bg_merger && !inputs->bg_merger->ReadGainCorrections(options["gains"])) return false;
+    }
+    long long max_memory = 0;
+    if (options.count("max-memory") && !Pipeline::ParseMemorySize(options["max-memory"], max_memory)) return false;
+    int num_mergers = (inputs->src_merger ? 1 : 0) + (inputs->bg_merger ? 1 : 0);
+    for (auto merger : {inputs->src_merger, inputs->bg_merger}) {
+        if (!merger) continue;
+        merger->SetReproducible(options.count("reproducible") > 0);
+        if (options.count("threads")) merger->SetThreads(std::atoi(options["threads"].c_str()));
+        merger->SetMaxMemory(max_memory / num_mergers);
+    }
+
+    return true;
+} // end Configure()
+
+/************************************************************//**
+ * Directory part of a path, "." for a bare file name
+ *
+ * @param filename path of a file
+ ***************************************************************/
+std::string BatchRunner::Directory(std::string filename)
+{
+    size_t split = filename.rfind('/');
+    if (split == std::string::npos) return ".";
+
+    return split == 0 ? "/" : filename.substr(0, split);
+} // end Directory()
+
+/************************************************************//**
+ * Runs all jobs
+ *
+ * Distinct backgrounds are processed first, then every source is
+ * subtracted against the shared products of its background.
+ ***************************************************************/
+bool BatchRunner::Run()
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // jobs running at once must not create or rewrite a shared scaling file
+    for (auto &job : job_vec) {
+        if (!std::ifstream(job.scaling).good()) {
+            std::cerr << "ERROR --- Could not open background scaling file " << job.scaling << " of: " << job.output << std::endl;
+            return false;
+        }
+    }
+
+    // time-random subtracted background, once per background, named
+    // after this batch so concurrent batches do not share products
+    std::map<std::string, std::string> products_map;
+    std::vector<std::function<bool()>> task_vec;
+    std::vector<std::string> log_vec;
+    for (auto &job : job_vec) {
+        if (products_map.count(job.background)) continue;
+        std::ostringstream products_name;
+        products_name << Directory(job.output) << "/batch_" << getpid() << "_background_" << std::setw(2) << std::setfill('0') << products_map.size() << ".root";
+        std::string products_filename = products_name.str();
+        products_map[job.background] = products_filename;
+
+        std::string background = job.background;
+        task_vec.push_back([this, background, products_filename]() {
+            FileHandler inputs("", background, options.count("gains") > 0);
+            BGUtils bg_utils(&inputs);
+            if (!Configure(&inputs, &bg_utils)) return false;
+            bg_utils.WriteBackgroundProducts(products_filename);
+            return true;
+        });
+        log_vec.push_back(products_filename + ".log");
+    }
+    std::cout << "Preparing " << task_vec.size() << " shared backgrounds" << std::endl;
+    bool good = RunPool(task_vec, log_vec, num_jobs);
+
+    // source subtraction against the shared products
+    if (good) {
+        task_vec.clear();
+        log_vec.clear();
+        for (auto &job : job_vec) {
+            std::string products_filename = products_map[job.background];
+            task_vec.push_back([this, job, products_filename]() {
+                FileHandler inputs(job.source, "", options.count("gains") > 0);
+                BGUtils bg_utils(&inputs);
+                if (!Configure(&inputs, &bg_utils)) return false;
+                bg_utils.SetOutputFile(job.output);
+                bg_utils.SetScaleFile(job.scaling);
+                bg_utils.SetBackgroundProducts(products_filename);
+                bg_utils.SubtractAllBackground();
+                return true;
+            });
+            log_vec.push_back(job.output + ".log");
+        }
+        std::cout << "Subtracting " << task_vec.size() << " runs" << std::endl;
+        good = RunPool(task_vec, log_vec, num_jobs);
+    }
+
+    // products are copied into every output
+    for (auto &products : products_map) {
+        std::remove(products.second.c_str());
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Batch " << (good ? "finished" : "FAILED") << " in " << elapsed.count() << " s" << std::endl;
+
+    return good;
+} // end Run()
+
+/************************************************************//**
+ * Runs tasks in a pool of forked worker processes
+ *
+ * @param task_vec tasks, run in the child
+ * @param log_vec log file of every task
+ * @param workers number of concurrent processes (0 = all cores)
+ ***************************************************************/
+bool BatchRunner::RunPool(std::vector<std::function<bool()>> &task_vec, std::vector<std::string> &log_vec, int workers)
+{
+    if (workers < 1) workers = std::thread::hardware_concurrency();
+    if (workers < 1) workers = 1;
+
+    std::map<pid_t, size_t> running_map;
+    size_t next = 0;
+    int failures = 0;
+    while (next < task_vec.size() || !running_map.empty()) {
+        while (next < task_vec.size() && (int) running_map.size() < workers) {
+            // nothing buffered may be written twice
+            std::cout.flush();
+            std::cerr.flush();
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid < 0) {
+                std::cerr << "ERROR --- Could not start job for: " << log_vec[next] << std::endl;
+                failures++;
+                next++;
+                continue;
+            }
+            if (pid == 0) {
+                if (!freopen(log_vec[next].c_str(), "w", stdout)) _exit(EXIT_FAILURE);
+                dup2(fileno(stdout), fileno(stderr));
+                bool ok = task_vec[next]();
+                std::cout.flush();
+                fflush(NULL);
+                _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+            running_map[pid] = next++;
+        }
+        if (running_map.empty()) break;
+
+        int status = 0;
+        pid_t pid = wait(&status);
+        if (pid < 0) break;
+        auto it = running_map.find(pid);
+        if (it == running_map.end()) continue;
+        size_t task = it->second;
+        running_map.erase(it);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+            std::cout << "  done: " << log_vec[task] << std::endl;
+        } else {
+            std::cerr << "  FAILED: see " << log_vec[task] << std::endl;
+            failures++;
+        }
+    }
+
+    return failures == 0;
+} // end RunPool()
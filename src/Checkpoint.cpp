@@ -0,0 +1,155 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Per-index checkpoints of long subtraction runs
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   Checkpoint checkpoint(Checkpoint::JournalName("outputs.root"));
+//   checkpoint.Open(resume);
+//   if (!checkpoint.IsDone("source", i, hash, out_file, key)) {...; checkpoint.MarkDone(out_file, "source", i, hash);}
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include "TKey.h"
+#include "HistogramPool.h"
+#include "Checkpoint.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param journal_filename journal next to the output file
+ ***************************************************************/
+Checkpoint::Checkpoint(std::string journal_filename) : journal_filename(journal_filename)
+{
+    //std::cout << "Checkpoint initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+Checkpoint::~Checkpoint(void)
+{
+    if (journal_fd >= 0) close(journal_fd);
+    //std::cout << "Checkpoint destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Opens the journal
+ *
+ * @param resume keep and read the records of an earlier run,
+ *               a new run starts an empty journal
+ ***************************************************************/
+bool Checkpoint::Open(bool resume)
+{
+    done_map.clear();
+    if (resume) {
+        std::ifstream journal_file(journal_filename);
+        std::string line;
+        while (std::getline(journal_file, line)) {
+            // a torn last line of a crashed run is ignored
+            size_t split = line.rfind(',');
+            if (split == std::string::npos || split + 1 >= line.size()) continue;
+            done_map[line.substr(0, split)] = line.substr(split + 1);
+        }
+        std::cout << "Resuming with " << done_map.size() << " finished steps from: " << journal_filename << std::endl;
+    }
+
+    journal_fd = open(journal_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | (resume ? 0 : O_TRUNC), 0644);
+    if (journal_fd < 0) {
+        std::cerr << "ERROR --- Could not open checkpoint journal: " << journal_filename << std::endl;
+        return false;
+    }
+
+    return true;
+} // end Open()
+
+/************************************************************//**
+ * Checks if a stage of an index can be skipped
+ *
+ * @param stage name of the stage, e.g. "source"
+ * @param index angular index
+ * @param input_hash hash of the current inputs of the stage
+ * @param out_file output file
+ * @param key_name product of the stage in the output file
+ ***************************************************************/
+bool Checkpoint::IsDone(std::string stage, int index, std::string input_hash, TFile *out_file, std::string key_name)
+{
+    std::ostringstream record;
+    record << stage << "," << index;
+    auto it = done_map.find(record.str());
+    if (it == done_map.end()) return false;
+    if (it->second.compare(input_hash) != 0) {
+        std::cout << "\nInputs of " << stage << " index " << index << " changed, redoing it" << std::endl;
+        return false;
+    }
+    if (!HistogramPool::FindKey(out_file, key_name)) {
+        std::cout << "\nMissing " << key_name << " in " << out_file->GetName() << ", redoing it" << std::endl;
+        return false;
+    }
+
+    return true;
+} // end IsDone()
+
+/************************************************************//**
+ * Records a finished stage once its products are on disk
+ *
+ * @param out_file output file the products were written to
+ * @param stage name of the stage
+ * @param index angular index
+ * @param input_hash hash of the inputs of the stage
+ ***************************************************************/
+void Checkpoint::MarkDone(TFile *out_file, std::string stage, int index, std::string input_hash)
+{
+    // key lists and file header, then the data itself reach the disk first
+    out_file->Write();
+    out_file->Flush();
+
+    std::ostringstream record;
+    record << stage << "," << index << "," << input_hash << "\n";
+    std::string line = record.str();
+    if (write(journal_fd, line.data(), line.size()) != (ssize_t) line.size() || fsync(journal_fd) != 0) {
+        std::cerr << "\nWARNING --- Could not record checkpoint of " << stage << " index " << index << std::endl;
+    }
+} // end MarkDone()
+
+/************************************************************//**
+ * Hash of the keys a stage reads
+ *
+ * Location, size and cycle of a key change whenever the matrix is
+ * rewritten, so they identify the input without reading it.
+ *
+ * @param files input files, all runs of a merged input
+ * @param key_names full paths of the keys read
+ * @param extra options changing the result, e.g. a scaling factor
+ ***************************************************************/
+std::string Checkpoint::KeyHash(std::vector<TFile*> files, std::vector<std::string> key_names, std::string extra)
+{
+    std::ostringstream description;
+    description << extra;
+    // the file name is left out, moving the inputs keeps the checkpoints
+    for (size_t f = 0; f < files.size(); f++) {
+        TFile *file = files.at(f);
+        description << ";" << f;
+        for (auto &key_name : key_names) {
+            TKey *key = HistogramPool::FindKey(file, key_name);
+            description << ";" << key_name;
+            if (key) description << ":" << key->GetCycle() << ":" << key->GetSeekKey() << ":" << key->GetNbytes() << ":" << key->GetObjlen();
+        }
+    }
+    // 64-bit FNV-1a, unlike std::hash it is the same for every build
+    uint64_t value = 14695981039346656037ULL;
+    for (unsigned char c : description.str()) {
+        value ^= c;
+        value *= 1099511628211ULL;
+    }
+    std::ostringstream hash;
+    hash << std::hex << std::setw(16) << std::setfill('0') << value;
+
+    return hash.str();
+} // end KeyHash()
@@ -0,0 +1,487 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Contiguous angle x sum energy x gamma energy data cube
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   DataCube cube;
+//   cube.SetSumRange(1700, 1800); // optional, keeps memory in check
+//   cube.LoadFromFile(file, "room_background_subtracted/source_%02i");
+//   cube.Write("outputs.cube");
+//
+//   if (cube.ReadHeader("outputs.cube") && cube.IsBuiltFrom(DataCube::SourceHash(file, format, 51))) cube.Read("outputs.cube");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <stdint.h>
+#include "Checkpoint.h"
+#include "DataCube.h"
+
+namespace {
+// on-disk format identifier, bump the version if the header changes
+const char cube_magic[8] = {'S', 'P', 'C', 'U', 'B', 'E', '0', '2'};
+
+struct CubeHeader {
+    char magic[8];
+    int32_t num_indices;
+    int32_t sum_axis_bins;
+    double sum_axis_min;
+    double sum_axis_max;
+    int32_t sum_first_bin;
+    int32_t sum_bins;
+    int32_t gamma_bins;
+    int32_t padding;
+    double gamma_axis_min;
+    double gamma_axis_max;
+    char source_hash[24]; // key hash of the matrices the cube was built from
+};
+} // end anonymous namespace
+
+/************************************************************//**
+ * Constructor
+ ***************************************************************/
+DataCube::DataCube()
+{
+    //std::cout << "DataCube initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+DataCube::~DataCube(void)
+{
+    //std::cout << "DataCube destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Restricts the sum energy window held in memory
+ *
+ * A full 51 x 3000 x 3000 cube needs ~7 GB (content and errors),
+ * so gate studies should only load the sum energies they use.
+ *
+ * @param sum_low first sum energy bin
+ * @param sum_high last sum energy bin
+ ***************************************************************/
+void DataCube::SetSumRange(int sum_low, int sum_high)
+{
+    requested_sum_low = sum_low;
+    requested_sum_high = sum_high;
+} // end SetSumRange()
+
+/************************************************************//**
+ * Reads all per-index matrices into the cube
+ *
+ * @param in_file file containing the sum energy matrices
+ * @param name_format printf style key, e.g. "source/index_%02i_sum"
+ * @param indices number of angular indices
+ ***************************************************************/
+bool DataCube::LoadFromFile(TFile *in_file, std::string name_format, int indices)
+{
+    source_hash = SourceHash(in_file, name_format, indices);
+    for (auto i = 0; i < indices; i++) {
+        std::cout << "Loading data cube: " << i + 1 << " of " << indices << "\r";
+        std::cout.flush();
+
+        TH2D *sum_energy_matrix = (TH2D*) in_file->Get(Form(name_format.c_str(), i));
+        if (!sum_energy_matrix) {
+            std::cerr << "\nERROR --- Could not find matrix: " << Form(name_format.c_str(), i) << std::endl;
+            return false;
+        }
+
+        // use the first matrix to define the cube binning
+        if (i == 0) {
+            num_indices = indices;
+            sum_axis_bins = sum_energy_matrix->GetXaxis()->GetNbins();
+            sum_axis_min = sum_energy_matrix->GetXaxis()->GetXmin();
+            sum_axis_max = sum_energy_matrix->GetXaxis()->GetXmax();
+            gamma_bins = sum_energy_matrix->GetYaxis()->GetNbins();
+            gamma_axis_min = sum_energy_matrix->GetYaxis()->GetXmin();
+            gamma_axis_max = sum_energy_matrix->GetYaxis()->GetXmax();
+
+            int sum_low, sum_high;
+            if (!SumWindow(sum_low, sum_high)) {
+                std::cerr << "\nERROR --- Empty sum energy window [" << requested_sum_low << "-" << requested_sum_high << "] of data cube, matrices have " << sum_axis_bins << " bins" << std::endl;
+                delete sum_energy_matrix;
+                return false;
+            }
+            sum_first_bin = sum_low;
+            sum_bins = sum_high - sum_low + 1;
+            Allocate();
+        } else if (sum_energy_matrix->GetXaxis()->GetNbins() != sum_axis_bins || sum_energy_matrix->GetYaxis()->GetNbins() != gamma_bins) {
+            std::cerr << "\nERROR --- Inconsistent binning in matrix: " << sum_energy_matrix->GetName() << std::endl;
+            delete sum_energy_matrix;
+            return false;
+        }
+
+        // TH2D stores bins as x + (nx + 2) * y, read straight from the buffers
+        const double *content = sum_energy_matrix->GetArray();
+        const double *sumw2 = sum_energy_matrix->GetSumw2N() > 0 ? sum_energy_matrix->GetSumw2()->GetArray() : content;
+        const int row_length = sum_axis_bins + 2;
+        for (auto sum_bin = sum_first_bin; sum_bin < sum_first_bin + sum_bins; sum_bin++) {
+            for (auto gamma_bin = 1; gamma_bin <= gamma_bins; gamma_bin++) {
+                int bin = sum_bin + row_length * gamma_bin;
+                size_t offset = Offset(i, sum_bin, gamma_bin);
+                content_vec[offset] = content[bin];
+                error2_vec[offset] = sumw2[bin];
+            }
+        }
+
+        // cleaning up
+        delete sum_energy_matrix;
+    } // end index loop
+    std::cout << std::endl;
+
+    return true;
+} // end LoadFromFile()
+
+/************************************************************//**
+ * Writes cube to a flat binary file
+ *
+ * @param filename name of output file
+ ***************************************************************/
+bool DataCube::Write(std::string filename)
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "ERROR --- Could not open file: " << filename << std::endl;
+        return false;
+    }
+
+    CubeHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cube_magic, sizeof(cube_magic));
+    header.num_indices = num_indices;
+    header.sum_axis_bins = sum_axis_bins;
+    header.sum_axis_min = sum_axis_min;
+    header.sum_axis_max = sum_axis_max;
+    header.sum_first_bin = sum_first_bin;
+    header.sum_bins = sum_bins;
+    header.gamma_bins = gamma_bins;
+    header.gamma_axis_min = gamma_axis_min;
+    header.gamma_axis_max = gamma_axis_max;
+    std::strncpy(header.source_hash, source_hash.c_str(), sizeof(header.source_hash) - 1);
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(content_vec.data()), content_vec.size() * sizeof(double));
+    out.write(reinterpret_cast<const char*>(error2_vec.data()), error2_vec.size() * sizeof(double));
+
+    return out.good();
+} // end Write()
+
+/************************************************************//**
+ * Reads cube from a flat binary file
+ *
+ * @param filename name of input file
+ ***************************************************************/
+bool DataCube::Read(std::string filename)
+{
+    if (!ReadHeader(filename)) return false;
+    std::ifstream in(filename, std::ios::binary);
+    in.seekg(sizeof(CubeHeader));
+    Allocate();
+
+    in.read(reinterpret_cast<char*>(content_vec.data()), content_vec.size() * sizeof(double));
+    in.read(reinterpret_cast<char*>(error2_vec.data()), error2_vec.size() * sizeof(double));
+    if (!in) {
+        std::cerr << "ERROR --- Truncated data cube file: " << filename << std::endl;
+        content_vec.clear();
+        error2_vec.clear();
+        return false;
+    }
+
+    return true;
+} // end Read()
+
+/************************************************************//**
+ * Reads binning, window and source of a cube file without its data
+ *
+ * @param filename name of input file
+ ***************************************************************/
+bool DataCube::ReadHeader(std::string filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        std::cerr << "ERROR --- Could not open file: " << filename << std::endl;
+        return false;
+    }
+
+    CubeHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, cube_magic, sizeof(cube_magic)) != 0) {
+        std::cerr << "ERROR --- Not a data cube file: " << filename << std::endl;
+        return false;
+    }
+    if (header.num_indices <= 0 || header.gamma_bins <= 0 || header.sum_bins <= 0 || header.sum_first_bin < 1 || header.sum_first_bin + header.sum_bins - 1 > header.sum_axis_bins) {
+        std::cerr << "ERROR --- Corrupt data cube header: " << filename << std::endl;
+        return false;
+    }
+
+    num_indices = header.num_indices;
+    sum_axis_bins = header.sum_axis_bins;
+    sum_axis_min = header.sum_axis_min;
+    sum_axis_max = header.sum_axis_max;
+    sum_first_bin = header.sum_first_bin;
+    sum_bins = header.sum_bins;
+    gamma_bins = header.gamma_bins;
+    gamma_axis_min = header.gamma_axis_min;
+    gamma_axis_max = header.gamma_axis_max;
+    header.source_hash[sizeof(header.source_hash) - 1] = '\0';
+    source_hash = header.source_hash;
+
+    return true;
+} // end ReadHeader()
+
+/************************************************************//**
+ * Checks a cube header against the matrices and window wanted
+ *
+ * @param hash SourceHash() of the matrices in the histogram file
+ ***************************************************************/
+bool DataCube::IsBuiltFrom(std::string hash)
+{
+    int sum_low, sum_high;
+    if (!SumWindow(sum_low, sum_high)) return false;
+
+    return hash.compare(source_hash) == 0 && sum_low == sum_first_bin && sum_high == sum_first_bin + sum_bins - 1;
+} // end IsBuiltFrom()
+
+/************************************************************//**
+ * Key hash of the per-index matrices of a cube
+ *
+ * @param in_file file containing the sum energy matrices
+ * @param name_format printf style key, e.g. "source/index_%02i_sum"
+ * @param indices number of angular indices
+ ***************************************************************/
+std::string DataCube::SourceHash(TFile *in_file, std::string name_format, int indices)
+{
+    std::vector<std::string> key_vec;
+    for (auto i = 0; i < indices; i++) {
+        key_vec.push_back(Form(name_format.c_str(), i));
+    }
+
+    return Checkpoint::KeyHash({in_file}, key_vec);
+} // end SourceHash()
+
+/************************************************************//**
+ * Returns the sum energy matrix of one angular index
+ *
+ * @param index angular index
+ * @param name name of returned histogram
+ ***************************************************************/
+TH2D* DataCube::GetIndexSlice(int index, std::string name)
+{
+    double bin_width = (sum_axis_max - sum_axis_min) / sum_axis_bins;
+    double low_edge = sum_axis_min + (sum_first_bin - 1) * bin_width;
+    TH2D *h = new TH2D(name.c_str(), Form("Index %02i;Sum Energy [keV];Energy [keV]", index), sum_bins, low_edge, low_edge + sum_bins * bin_width, gamma_bins, gamma_axis_min, gamma_axis_max);
+    h->Sumw2();
+
+    double *content = h->GetArray();
+    double *sumw2 = h->GetSumw2()->GetArray();
+    const int row_length = sum_bins + 2;
+    for (auto sum_bin = sum_first_bin; sum_bin < sum_first_bin + sum_bins; sum_bin++) {
+        for (auto gamma_bin = 1; gamma_bin <= gamma_bins; gamma_bin++) {
+            int bin = (sum_bin - sum_first_bin + 1) + row_length * gamma_bin;
+            size_t offset = Offset(index, sum_bin, gamma_bin);
+            content[bin] = content_vec[offset];
+            sumw2[bin] = error2_vec[offset];
+        }
+    }
+    h->ResetStats();
+
+    return h;
+} // end GetIndexSlice()
+
+/************************************************************//**
+ * Returns the angular index vs gamma energy slice at one sum energy
+ *
+ * @param sum_bin sum energy bin
+ * @param name name of returned histogram
+ ***************************************************************/
+TH2D* DataCube::GetSumSlice(int sum_bin, std::string name)
+{
+    return GetGatedAngularMatrix(sum_bin, sum_bin, name);
+} // end GetSumSlice()
+
+/************************************************************//**
+ * Returns the angular index vs sum energy slice at one gamma energy
+ *
+ * @param gamma_bin gamma energy bin
+ * @param name name of returned histogram
+ ***************************************************************/
+TH2D* DataCube::GetGammaSlice(int gamma_bin, std::string name)
+{
+    double bin_width = (sum_axis_max - sum_axis_min) / sum_axis_bins;
+    double low_edge = sum_axis_min + (sum_first_bin - 1) * bin_width;
+    TH2D *h = new TH2D(name.c_str(), ";Angular Index;Sum Energy [keV]", num_indices, 0, num_indices, sum_bins, low_edge, low_edge + sum_bins * bin_width);
+    h->Sumw2();
+
+    double *content = h->GetArray();
+    double *sumw2 = h->GetSumw2()->GetArray();
+    const int row_length = num_indices + 2;
+    for (auto sum_bin = sum_first_bin; sum_bin < sum_first_bin + sum_bins; sum_bin++) {
+        // contiguous run over all angular indices
+        size_t offset = Offset(0, sum_bin, gamma_bin);
+        int bin = 1 + row_length * (sum_bin - sum_first_bin + 1);
+        for (auto i = 0; i < num_indices; i++) {
+            content[bin + i] = content_vec[offset + i];
+            sumw2[bin + i] = error2_vec[offset + i];
+        }
+    }
+    h->ResetStats();
+
+    return h;
+} // end GetGammaSlice()
+
+/************************************************************//**
+ * Projects out gamma energy for every angular index
+ *
+ * Equivalent to HistogramManager::BuildAngularMatrix over the
+ * sum energy window held in memory.
+ *
+ * @param name name of returned histogram
+ ***************************************************************/
+TH2D* DataCube::GetSumAngularMatrix(std::string name)
+{
+    double bin_width = (sum_axis_max - sum_axis_min) / sum_axis_bins;
+    double low_edge = sum_axis_min + (sum_first_bin - 1) * bin_width;
+    TH2D *h = new TH2D(name.c_str(), ";Angular Index [arb.];Energy [keV]", num_indices, 0, num_indices, sum_bins, low_edge, low_edge + sum_bins * bin_width);
+    h->Sumw2();
+
+    double *content = h->GetArray();
+    double *sumw2 = h->GetSumw2()->GetArray();
+    const int row_length = num_indices + 2;
+    for (auto sum_bin = sum_first_bin; sum_bin < sum_first_bin + sum_bins; sum_bin++) {
+        int bin = 1 + row_length * (sum_bin - sum_first_bin + 1);
+        // whole gamma axis for this sum energy is one contiguous block
+        const double *c = &content_vec[Offset(0, sum_bin, 1)];
+        const double *e = &error2_vec[Offset(0, sum_bin, 1)];
+        for (auto gamma_bin = 0; gamma_bin < gamma_bins; gamma_bin++) {
+            for (auto i = 0; i < num_indices; i++) {
+                content[bin + i] += c[i];
+                sumw2[bin + i] += e[i];
+            }
+            c += num_indices;
+            e += num_indices;
+        }
+    }
+    h->ResetStats();
+
+    return h;
+} // end GetSumAngularMatrix()
+
+/************************************************************//**
+ * Gates on sum energy and projects gamma energy for every index
+ *
+ * Equivalent to HistogramManager::BuildGatedAngularMatrix but done
+ * in a single sweep through memory.
+ *
+ * @param gate_low first sum energy bin of gate
+ * @param gate_high last sum energy bin of gate
+ * @param name name of returned histogram
+ ***************************************************************/
+TH2D* DataCube::GetGatedAngularMatrix(int gate_low, int gate_high, std::string name)
+{
+    TH2D *h = new TH2D(name.c_str(), Form("#gamma_{1} Sum Gated [%i-%i];Angular Index;Energy [keV]", gate_low, gate_high), num_indices, 0, num_indices, gamma_bins, gamma_axis_min, gamma_axis_max);
+    h->Sumw2();
+
+    ClampSumRange(gate_low, gate_high);
+    double *content = h->GetArray();
+    double *sumw2 = h->GetSumw2()->GetArray();
+    const int row_length = num_indices + 2;
+    for (auto sum_bin = gate_low; sum_bin <= gate_high; sum_bin++) {
+        const double *c = &content_vec[Offset(0, sum_bin, 1)];
+        const double *e = &error2_vec[Offset(0, sum_bin, 1)];
+        for (auto gamma_bin = 1; gamma_bin <= gamma_bins; gamma_bin++) {
+            int bin = 1 + row_length * gamma_bin;
+            for (auto i = 0; i < num_indices; i++) {
+                content[bin + i] += c[i];
+                sumw2[bin + i] += e[i];
+            }
+            c += num_indices;
+            e += num_indices;
+        }
+    }
+    h->ResetStats();
+
+    return h;
+} // end GetGatedAngularMatrix()
+
+/************************************************************//**
+ * Integrates a sum x gamma energy window for every angular index
+ *
+ * @param sum_low first sum energy bin
+ * @param sum_high last sum energy bin
+ * @param gamma_low first gamma energy bin
+ * @param gamma_high last gamma energy bin
+ * @param counts integrated counts per index (output)
+ * @param errors2 squared errors per index (output)
+ ***************************************************************/
+void DataCube::GetAngularDistribution(int sum_low, int sum_high, int gamma_low, int gamma_high, std::vector<double> &counts, std::vector<double> &errors2)
+{
+    counts.assign(num_indices, 0.);
+    errors2.assign(num_indices, 0.);
+    if (!IsLoaded()) return;
+
+    ClampSumRange(sum_low, sum_high);
+    ClampGammaRange(gamma_low, gamma_high);
+    if (gamma_low > gamma_high) return;
+    for (auto sum_bin = sum_low; sum_bin <= sum_high; sum_bin++) {
+        // gamma window of one sum energy is a single contiguous block
+        const double *c = &content_vec[Offset(0, sum_bin, gamma_low)];
+        const double *e = &error2_vec[Offset(0, sum_bin, gamma_low)];
+        for (auto gamma_bin = gamma_low; gamma_bin <= gamma_high; gamma_bin++) {
+            for (auto i = 0; i < num_indices; i++) {
+                counts[i] += c[i];
+                errors2[i] += e[i];
+            }
+            c += num_indices;
+            e += num_indices;
+        }
+    }
+} // end GetAngularDistribution()
+
+/************************************************************//**
+ * Allocates storage for the current binning
+ ***************************************************************/
+void DataCube::Allocate()
+{
+    size_t size = (size_t) num_indices * sum_bins * gamma_bins;
+    content_vec.assign(size, 0.);
+    error2_vec.assign(size, 0.);
+} // end Allocate()
+
+/************************************************************//**
+ * Sum energy window of the requested range on the matrix axis
+ *
+ * @param sum_low first sum energy bin (output)
+ * @param sum_high last sum energy bin (output)
+ ***************************************************************/
+bool DataCube::SumWindow(int &sum_low, int &sum_high) const
+{
+    sum_low = requested_sum_low < 1 ? 1 : requested_sum_low;
+    sum_high = (requested_sum_high < 1 || requested_sum_high > sum_axis_bins) ? sum_axis_bins : requested_sum_high;
+
+    return sum_low <= sum_high;
+} // end SumWindow()
+
+/************************************************************//**
+ * Restricts a sum energy range to the window held in memory
+ ***************************************************************/
+void DataCube::ClampSumRange(int &sum_low, int &sum_high)
+{
+    if (sum_low < sum_first_bin || sum_high > sum_first_bin + sum_bins - 1) {
+        std::cerr << "WARNING --- Sum energy range [" << sum_low << "-" << sum_high << "] exceeds data cube window [" << sum_first_bin << "-" << sum_first_bin + sum_bins - 1 << "], truncating" << std::endl;
+    }
+    if (sum_low < sum_first_bin) sum_low = sum_first_bin;
+    if (sum_high > sum_first_bin + sum_bins - 1) sum_high = sum_first_bin + sum_bins - 1;
+} // end ClampSumRange()
+
+/************************************************************//**
+ * Restricts a gamma energy range to the cube binning
+ ***************************************************************/
+void DataCube::ClampGammaRange(int &gamma_low, int &gamma_high)
+{
+    if (gamma_low < 1) gamma_low = 1;
+    if (gamma_high > gamma_bins) gamma_high = gamma_bins;
+} // end ClampGammaRange()
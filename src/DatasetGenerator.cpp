@@ -0,0 +1,387 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Synthetic sum peak datasets with known truth
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   DatasetGenerator generator;
+//   generator.ReadCascades("cascades.csv");
+//   generator.Generate("synthetic_source.root", "synthetic_background.root");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include "csv.h"
+#include "TROOT.h"
+#include "GriffinAngles.h"
+#include "DatasetGenerator.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param indices number of angular indices
+ ***************************************************************/
+DatasetGenerator::DatasetGenerator(int indices) : angle_indices(indices)
+{
+    //std::cout << "DatasetGenerator initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+DatasetGenerator::~DatasetGenerator(void)
+{
+    //std::cout << "DatasetGenerator destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Reads the cascades of the source
+ *
+ * CSV columns: e1,e2,intensity,a2,a4 (keV)
+ *
+ * @param filename cascade file
+ ***************************************************************/
+bool DatasetGenerator::ReadCascades(std::string filename)
+{
+    std::ifstream cascade_file(filename);
+    if (!cascade_file.good()) {
+        std::cerr << "ERROR --- Could not open cascade file: " << filename << std::endl;
+        return false;
+    }
+    cascade_file.close();
+
+    io::CSVReader<5> in(filename);
+    in.read_header(io::ignore_extra_column, "e1", "e2", "intensity", "a2", "a4");
+    SyntheticCascade cascade;
+    while (in.read_row(cascade.e1, cascade.e2, cascade.intensity, cascade.a2, cascade.a4)) {
+        cascade_vec.push_back(cascade);
+    }
+    std::cout << "Found " << cascade_vec.size() << " cascades in: " << filename << std::endl;
+
+    return true;
+} // end ReadCascades()
+
+/************************************************************//**
+ * Reads the room background lines
+ *
+ * CSV columns: energy,intensity (keV)
+ *
+ * @param filename line file
+ ***************************************************************/
+bool DatasetGenerator::ReadRoomLines(std::string filename)
+{
+    std::ifstream line_file(filename);
+    if (!line_file.good()) {
+        std::cerr << "ERROR --- Could not open room line file: " << filename << std::endl;
+        return false;
+    }
+    line_file.close();
+
+    io::CSVReader<2> in(filename);
+    in.read_header(io::ignore_extra_column, "energy", "intensity");
+    SyntheticLine line;
+    while (in.read_row(line.energy, line.intensity)) {
+        line_vec.push_back(line);
+    }
+    std::cout << "Found " << line_vec.size() << " room lines in: " << filename << std::endl;
+
+    return true;
+} // end ReadRoomLines()
+
+/************************************************************//**
+ * Writes the source and room background files
+ *
+ * Without configured cascades and lines a 60Co source and common
+ * room lines (40K, 214Bi, 208Tl) are used. The truth of every index
+ * is written next to each file as FILE.truth.csv.
+ *
+ * @param src_filename source histogram file
+ * @param bg_filename room background histogram file
+ ***************************************************************/
+bool DatasetGenerator::Generate(std::string src_filename, std::string bg_filename)
+{
+    if (cascade_vec.empty()) {
+        cascade_vec.push_back({1173.228, 1332.492, 1.0, 0.1020, 0.0091});
+    }
+    if (line_vec.empty()) {
+        line_vec.push_back({609.312, 0.46});
+        line_vec.push_back({1460.820, 1.00});
+        line_vec.push_back({1729.595, 0.03});
+        line_vec.push_back({1764.494, 0.15});
+        line_vec.push_back({2614.511, 0.36});
+    }
+    for (auto &cascade : cascade_vec) {
+        if (cascade.intensity < 0.) {
+            std::cerr << "ERROR --- Negative intensity of cascade " << cascade.e1 << "-" << cascade.e2 << " keV" << std::endl;
+            return false;
+        }
+    }
+    for (auto &line : line_vec) {
+        if (line.intensity < 0.) {
+            std::cerr << "ERROR --- Negative intensity of room line " << line.energy << " keV" << std::endl;
+            return false;
+        }
+    }
+
+    // histograms are created and filled in every thread
+    ROOT::EnableThreadSafety();
+
+    if (!WriteFile(src_filename, 0)) return false;
+    if (!WriteFile(bg_filename, 1)) return false;
+    std::cout << "True room background scaling of the source: " << room_scale << std::endl;
+
+    return true;
+} // end Generate()
+
+/************************************************************//**
+ * Generates and writes all indices of one file
+ *
+ * @param filename histogram file
+ * @param file_id 0 source, 1 room background
+ ***************************************************************/
+bool DatasetGenerator::WriteFile(std::string filename, int file_id)
+{
+    TFile out_file(filename.c_str(), "RECREATE");
+    if (!out_file.IsOpen() || out_file.IsZombie()) {
+        std::cerr << "ERROR --- Could not create dataset file: " << filename << std::endl;
+        return false;
+    }
+    TDirectory *prompt_dir = out_file.mkdir("prompt_angle");
+    TDirectory *random_dir = out_file.mkdir("time_random");
+
+    int threads = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    if (threads > angle_indices) threads = angle_indices;
+
+    // two sets of matrices, one filled while the other is written
+    std::vector<TH2D*> prompt_vec, random_vec;
+    for (auto slot = 0; slot < 2 * threads; slot++) {
+        prompt_vec.push_back(new TH2D(Form("prompt_%i", slot), "", energy_bins, 0, energy_max, energy_bins, 0, energy_max));
+        random_vec.push_back(new TH2D(Form("random_%i", slot), "", energy_bins, 0, energy_max, energy_bins, 0, energy_max));
+        prompt_vec.back()->SetDirectory(0);
+        random_vec.back()->SetDirectory(0);
+        prompt_vec.back()->Sumw2();
+        random_vec.back()->Sumw2();
+    }
+    std::vector<SyntheticTruth> truth_vec(angle_indices);
+
+    auto write_batch = [&](int first_index, int first_slot) {
+        for (auto i = first_index; i < std::min(first_index + threads, angle_indices); i++) {
+            std::cout << "Writing " << filename << ": index " << i + 1 << " of " << angle_indices << "\r";
+            std::cout.flush();
+            int slot = first_slot + i - first_index;
+            prompt_dir->WriteTObject(prompt_vec[slot], Form("index_%02i_sum", i));
+            random_dir->WriteTObject(random_vec[slot], Form("index_%02i_sum_tr_avg", i));
+        }
+    };
+
+    int previous_index = -1;
+    for (auto first_index = 0; first_index < angle_indices; first_index += threads) {
+        int first_slot = (first_index / threads) % 2 * threads;
+        std::vector<std::thread> thread_vec;
+        for (auto i = first_index; i < std::min(first_index + threads, angle_indices); i++) {
+            int slot = first_slot + i - first_index;
+            prompt_vec[slot]->Reset();
+            random_vec[slot]->Reset();
+            prompt_vec[slot]->SetName(Form("index_%02i_sum", i));
+            random_vec[slot]->SetName(Form("index_%02i_sum_tr_avg", i));
+            thread_vec.push_back(std::thread(&DatasetGenerator::FillIndex, this, file_id, i, prompt_vec[slot], random_vec[slot], std::ref(truth_vec[i])));
+        }
+        // file writes stay on this thread
+        if (previous_index >= 0) write_batch(previous_index, threads - first_slot);
+        for (auto &t : thread_vec) {
+            t.join();
+        }
+        previous_index = first_index;
+    }
+    if (previous_index >= 0) write_batch(previous_index, (previous_index / threads) % 2 * threads);
+    std::cout << std::endl;
+    out_file.Close();
+
+    for (auto slot = 0; slot < 2 * threads; slot++) {
+        delete prompt_vec[slot];
+        delete random_vec[slot];
+    }
+    WriteTruth(filename + ".truth.csv", truth_vec);
+
+    return true;
+} // end WriteFile()
+
+/************************************************************//**
+ * Samples all events of one index
+ *
+ * @param file_id 0 source, 1 room background
+ * @param index angular index
+ * @param prompt_h prompt matrix
+ * @param random_h averaged time-random matrix
+ * @param truth sampled event numbers
+ ***************************************************************/
+void DatasetGenerator::FillIndex(int file_id, int index, TH2D *prompt_h, TH2D *random_h, SyntheticTruth &truth)
+{
+    std::seed_seq seed_sequence{seed, (unsigned int) file_id, (unsigned int) index};
+    std::mt19937_64 generator(seed_sequence);
+    const std::vector<double> &angle_vec = GetGriffinAngles145mm();
+    const double angle = angle_vec[index % angle_vec.size()];
+
+    // singles spectrum of the time-random pairs
+    std::vector<double> singles_energy_vec, singles_rate_vec, line_intensity_vec;
+    double total_intensity = 0.;
+    for (auto &cascade : cascade_vec) {
+        total_intensity += cascade.intensity;
+    }
+    const double room_rate = file_id == 0 ? room_events * room_scale : room_events;
+    for (auto &line : line_vec) {
+        line_intensity_vec.push_back(line.intensity);
+        singles_energy_vec.push_back(line.energy);
+        singles_rate_vec.push_back(line.intensity * room_rate);
+    }
+    if (file_id == 0 && total_intensity > 0.) {
+        for (auto &cascade : cascade_vec) {
+            singles_energy_vec.push_back(cascade.e1);
+            singles_rate_vec.push_back(cascade.intensity / total_intensity * cascade_events);
+            singles_energy_vec.push_back(cascade.e2);
+            singles_rate_vec.push_back(cascade.intensity / total_intensity * cascade_events);
+        }
+    }
+
+    // correlated cascades, source only
+    truth = SyntheticTruth();
+    if (file_id == 0 && total_intensity > 0.) {
+        for (auto &cascade : cascade_vec) {
+            double w_theta = WTheta(cascade, angle);
+            truth.w_theta += cascade.intensity / total_intensity * w_theta;
+            long long n = SampleCount(cascade.intensity / total_intensity * cascade_events * w_theta, generator);
+            for (long long e = 0; e < n; e++) {
+                FillPair(prompt_h, cascade.e1, cascade.e2, 1., generator);
+            }
+            truth.cascade_events += n;
+        }
+    }
+
+    // isotropic room background pairs
+    double line_total = 0.;
+    for (auto intensity : line_intensity_vec) line_total += intensity;
+    if (line_total > 0.) {
+        std::discrete_distribution<int> pick_line(line_intensity_vec.begin(), line_intensity_vec.end());
+        truth.room_events = SampleCount(room_rate, generator);
+        for (long long e = 0; e < truth.room_events; e++) {
+            int first = pick_line(generator);
+            int second = pick_line(generator);
+            FillPair(prompt_h, line_vec[first].energy, line_vec[second].energy, 1., generator);
+        }
+    }
+
+    // uncorrelated pairs of the prompt window and of all time-random windows
+    double singles_total = 0.;
+    for (auto rate : singles_rate_vec) singles_total += rate;
+    if (singles_total > 0.) {
+        std::discrete_distribution<int> pick_single(singles_rate_vec.begin(), singles_rate_vec.end());
+        truth.random_events = SampleCount(random_events, generator);
+        for (long long e = 0; e < truth.random_events; e++) {
+            int first = pick_single(generator);
+            int second = pick_single(generator);
+            FillPair(prompt_h, singles_energy_vec[first], singles_energy_vec[second], 1., generator);
+        }
+        truth.time_random_events = SampleCount(random_events * tr_windows, generator);
+        for (long long e = 0; e < truth.time_random_events; e++) {
+            int first = pick_single(generator);
+            int second = pick_single(generator);
+            FillPair(random_h, singles_energy_vec[first], singles_energy_vec[second], 1. / tr_windows, generator);
+        }
+    }
+} // end FillIndex()
+
+/************************************************************//**
+ * Samples a Poisson distributed number of events
+ *
+ * Poisson distributions need a positive mean, e.g. no room lines or
+ * W(theta) = 0 give no events.
+ *
+ * @param mean expected number of events
+ * @param generator random stream of the index
+ ***************************************************************/
+long long DatasetGenerator::SampleCount(double mean, std::mt19937_64 &generator)
+{
+    if (!(mean > 0.)) return 0;
+    std::poisson_distribution<long long> events(mean);
+
+    return events(generator);
+} // end SampleCount()
+
+/************************************************************//**
+ * Fills the detected energies of a gamma pair
+ *
+ * The sum energy is filled once with each gamma energy.
+ *
+ * @param h sum energy matrix
+ * @param e1 energy of the first gamma
+ * @param e2 energy of the second gamma
+ * @param weight weight of the pair
+ * @param generator random stream of the index
+ ***************************************************************/
+void DatasetGenerator::FillPair(TH2D *h, double e1, double e2, double weight, std::mt19937_64 &generator)
+{
+    double deposit1 = Deposit(e1, generator);
+    double deposit2 = Deposit(e2, generator);
+    h->Fill(deposit1 + deposit2, deposit1, weight);
+    h->Fill(deposit1 + deposit2, deposit2, weight);
+} // end FillPair()
+
+/************************************************************//**
+ * Energy deposited by one gamma
+ *
+ * @param energy gamma energy [keV]
+ * @param generator random stream of the index
+ ***************************************************************/
+double DatasetGenerator::Deposit(double energy, std::mt19937_64 &generator)
+{
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    if (uniform(generator) < photopeak_fraction) {
+        std::normal_distribution<double> resolution(energy, std::sqrt(fwhm_offset + fwhm_slope * energy) / 2.3548);
+        return resolution(generator);
+    }
+    // flat continuum up to the Compton edge
+    const double electron_mass = 510.999;
+    double compton_edge = energy * 2. * energy / (electron_mass + 2. * energy);
+
+    return uniform(generator) * compton_edge;
+} // end Deposit()
+
+/************************************************************//**
+ * Angular correlation of a cascade
+ *
+ * @param cascade cascade with a2 and a4 coefficients
+ * @param angle opening angle [deg]
+ ***************************************************************/
+double DatasetGenerator::WTheta(const SyntheticCascade &cascade, double angle)
+{
+    double x = std::cos(angle * M_PI / 180.);
+    double p2 = 0.5 * (3. * x * x - 1.);
+    double p4 = 0.125 * (35. * x * x * x * x - 30. * x * x + 3.);
+
+    return 1. + cascade.a2 * p2 + cascade.a4 * p4;
+} // end WTheta()
+
+/************************************************************//**
+ * Writes the sampled truth of every index
+ *
+ * @param filename truth CSV
+ * @param truth_vec truth of every index
+ ***************************************************************/
+void DatasetGenerator::WriteTruth(std::string filename, const std::vector<SyntheticTruth> &truth_vec)
+{
+    const std::vector<double> &angle_vec = GetGriffinAngles145mm();
+    std::ofstream truth_file(filename, std::ios_base::trunc);
+    truth_file << "index,angle,w_theta,cascade_events,room_events,random_events,time_random_events,room_scale\n";
+    truth_file.precision(10);
+    for (size_t i = 0; i < truth_vec.size(); i++) {
+        const SyntheticTruth &truth = truth_vec[i];
+        truth_file << i << "," << angle_vec[i % angle_vec.size()] << "," << truth.w_theta << "," << truth.cascade_events << "," << truth.room_events << ","
+                   << truth.random_events << "," << truth.time_random_events << "," << room_scale << "\n";
+    }
+    std::cout << "Truth written to: " << filename << std::endl;
+} // end WriteTruth()
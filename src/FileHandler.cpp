@@ -6,16 +6,32 @@
 // Last Update:   08-09-2021
 //////////////////////////////////////////////////////////////////////////////////
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "FileHandler.h"
+#include "HistogramPool.h"
 
 /************************************************************//**
  * Constructor
+ *
+ * An empty path skips that file, batch jobs share background
+ * products instead of reading the background file again.
+ *
+ * @param source_filepath source file or list of runs
+ * @param bg_filepath background file or list of runs
+ * @param merge_runs read single files through a merger as well, so
+ *        gain corrections apply to them
  ***************************************************************/
-FileHandler::FileHandler(std::string source_filepath, std::string bg_filepath)
+FileHandler::FileHandler(std::string source_filepath, std::string bg_filepath, bool merge_runs) : merge_single_runs(merge_runs)
 {
-    LoadFile(source_filepath, "source");
-    LoadFile(bg_filepath, "background");
+    src_file = NULL;
+    bg_file = NULL;
+    if (!source_filepath.empty()) LoadFile(source_filepath, "source");
+    if (!bg_filepath.empty()) LoadFile(bg_filepath, "background");
     //std::cout << "FileHandler initialized" << std::endl;
 } // end Constructor
 
@@ -33,6 +49,9 @@ FileHandler::FileHandler(std::string histogram_file)
  ***************************************************************/
 FileHandler::~FileHandler(void)
 {
+    WaitForPrefetch();
+    delete src_merger;
+    delete bg_merger;
     //std::cout << "FileHandler destroyed" << std::endl;
 } // end destructor
 
@@ -44,10 +63,25 @@ FileHandler::~FileHandler(void)
  ***************************************************************/
 void FileHandler::LoadFile(std::string filename, std::string type)
 {
-    if (type.compare("source") == 0) {
+    bool is_list = HistogramMerger::IsFileList(filename);
+    if ((type.compare("source") == 0 || type.compare("background") == 0) && (is_list || merge_single_runs)) {
+        // runs are merged key by key while subtracting, nothing is written in between
+        HistogramMerger *merger = new HistogramMerger(is_list ? HistogramMerger::ParseFileList(filename) : std::vector<std::string>(1, filename));
+        if (!merger->Open()) exit(EXIT_FAILURE);
+        if (type.compare("source") == 0) {
+            src_merger = merger;
+            src_file = NULL;
+        } else {
+            bg_merger = merger;
+            bg_file = NULL;
+        }
+        std::cout << "Found " << merger->GetNumFiles() << " " << type << " files" << std::endl;
+    } else if (type.compare("source") == 0) {
+        if (!FileIsValid(filename)) exit(EXIT_FAILURE);
         src_file = new TFile(filename.c_str());
         std::cout << "Found source file: " << src_file->GetName() << std::endl;
     } else if (type.compare("background") == 0) {
+        if (!FileIsValid(filename)) exit(EXIT_FAILURE);
         bg_file = new TFile(filename.c_str());
         std::cout << "Found background file: " << bg_file->GetName() << std::endl;
     } else if (type.compare("histograms") == 0) {
@@ -65,20 +99,101 @@ void FileHandler::LoadFile(std::string filename, std::string type)
 /************************************************************//**
  * Check root file exists
  *
+ * Local files are checked from the "root" magic of the header only,
+ * so they are not fully opened twice. Remote files are opened.
+ *
  * @param filename name of ROOT file
  ***************************************************************/
 bool FileHandler::FileIsValid(std::string filename)
 {
-    TFile f(filename.c_str());
-    if (f.IsOpen()) {
-        f.Close();
-        return true;
-    } else {
+    if (filename.find("://") != std::string::npos) {
+        TFile f(filename.c_str());
+        if (f.IsOpen()) {
+            f.Close();
+            return true;
+        }
+        std::cerr << "ERROR --- Could not open file: " << filename << std::endl;
+        return false;
+    }
+
+    std::ifstream f(filename, std::ios::binary);
+    if (!f.good()) {
         std::cerr << "ERROR --- Could not open file: " << filename << std::endl;
         return false;
     }
+    char magic[4] = {0};
+    f.read(magic, sizeof(magic));
+    if (!f.good() || std::memcmp(magic, "root", sizeof(magic)) != 0) {
+        std::cerr << "ERROR --- Not a ROOT file: " << filename << std::endl;
+        return false;
+    }
+
+    return true;
 } // end FileIsValid()
 
+/************************************************************//**
+ * Starts reading upcoming keys in the background
+ *
+ * Byte ranges of the keys are looked up here, a helper thread then
+ * pulls them into the page cache through its own descriptor while
+ * the caller keeps computing, so the following TFile reads are
+ * served from memory. Only one prefetch runs at a time, missing keys
+ * and remote files are skipped.
+ *
+ * @param file file containing the keys
+ * @param key_names full paths of the keys, e.g. "prompt_angle/index_01_sum"
+ ***************************************************************/
+void FileHandler::Prefetch(TFile *file, std::vector<std::string> key_names)
+{
+    WaitForPrefetch();
+
+    std::vector<std::pair<long long, int>> range_vec;
+    for (auto &key_name : key_names) {
+        TKey *key = HistogramPool::FindKey(file, key_name);
+        if (key) range_vec.push_back(std::make_pair((long long) key->GetSeekKey(), (int) key->GetNbytes()));
+    }
+    if (range_vec.empty()) return;
+
+    prefetch_thread = std::thread(PrefetchRanges, std::string(file->GetName()), range_vec);
+} // end Prefetch()
+
+/************************************************************//**
+ * Waits for a running prefetch
+ ***************************************************************/
+void FileHandler::WaitForPrefetch()
+{
+    if (prefetch_thread.joinable()) prefetch_thread.join();
+} // end WaitForPrefetch()
+
+/************************************************************//**
+ * Reads byte ranges of a file into the page cache
+ *
+ * @param filename local file
+ * @param range_vec offset and length of every range
+ ***************************************************************/
+void FileHandler::PrefetchRanges(std::string filename, std::vector<std::pair<long long, int>> range_vec)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    // hint every range first so the reads below are queued together
+    for (auto &range : range_vec) {
+        posix_fadvise(fd, range.first, range.second, POSIX_FADV_WILLNEED);
+    }
+    // network file systems may ignore the hint, reading is what guarantees it
+    std::vector<char> buffer(1 << 20);
+    for (auto &range : range_vec) {
+        long long offset = range.first;
+        long long end = range.first + range.second;
+        while (offset < end) {
+            ssize_t n = pread(fd, buffer.data(), std::min<long long>(buffer.size(), end - offset), offset);
+            if (n <= 0) break;
+            offset += n;
+        }
+    }
+    close(fd);
+} // end PrefetchRanges()
+
 /************************************************************//**
  * Created new root file for outputs
  *
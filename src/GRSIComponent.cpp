@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Loads the GRSISort component on first use
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   if (!GRSIComponent::Load()) exit(EXIT_FAILURE);
+//   GRSIComponent::PeakFitFunction fit_peak = GRSIComponent::GetPeakFitter();
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include "GRSIComponent.h"
+
+void *GRSIComponent::handle = NULL;
+
+/************************************************************//**
+ * Directory of the running executable
+ ***************************************************************/
+std::string GRSIComponent::ExecutableDirectory()
+{
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) return "";
+    std::string executable(path, length);
+    size_t split = executable.rfind('/');
+
+    return split == std::string::npos ? "" : executable.substr(0, split + 1);
+} // end ExecutableDirectory()
+
+/************************************************************//**
+ * Loads GRSISort, reads .grsirc and the parser library
+ *
+ * Only the first call does any work.
+ ***************************************************************/
+bool GRSIComponent::Load()
+{
+    if (handle) return true;
+
+    std::string library_name = "libSumPeakGRSI.so";
+    std::vector<std::string> candidate_vec;
+    if (getenv("SUMPEAK_GRSI_LIB")) candidate_vec.push_back(getenv("SUMPEAK_GRSI_LIB"));
+    candidate_vec.push_back(ExecutableDirectory() + library_name);
+    candidate_vec.push_back(library_name);
+    for (auto &candidate : candidate_vec) {
+        // global, so dictionaries of GRSIData are visible to ROOT
+        handle = dlopen(candidate.c_str(), RTLD_NOW | RTLD_GLOBAL);
+        if (handle) break;
+    }
+    if (!handle) {
+        std::cerr << "ERROR --- Could not load " << library_name << ": " << dlerror() << std::endl;
+        return false;
+    }
+
+    typedef bool (*InitFunction)();
+    InitFunction init = (InitFunction) dlsym(handle, "SumPeakGRSI_Init");
+    if (!init || !init()) {
+        std::cerr << "ERROR --- Could not initialize GRSISort" << std::endl;
+        dlclose(handle);
+        handle = NULL;
+        return false;
+    }
+
+    return true;
+} // end Load()
+
+/************************************************************//**
+ * Peak fit of the component, loads it if needed
+ ***************************************************************/
+GRSIComponent::PeakFitFunction GRSIComponent::GetPeakFitter()
+{
+    if (!Load()) return NULL;
+    PeakFitFunction fit_peak = (PeakFitFunction) dlsym(handle, "SumPeakGRSI_FitPeak");
+    if (!fit_peak) std::cerr << "ERROR --- No peak fitter in the GRSISort component: " << dlerror() << std::endl;
+
+    return fit_peak;
+} // end GetPeakFitter()
@@ -0,0 +1,202 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Linear energy correction of sum energy matrices
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   GainCorrection correction(0.4, 1.0007);
+//   correction.AddTo(merged, run_matrix, scratch);
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include "GainCorrection.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param offset_keV offset of the correction
+ * @param gain_factor gain of the correction
+ ***************************************************************/
+GainCorrection::GainCorrection(double offset_keV, double gain_factor) : offset(offset_keV), gain(gain_factor)
+{
+    //std::cout << "GainCorrection initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+GainCorrection::~GainCorrection(void)
+{
+    //std::cout << "GainCorrection destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Adds a corrected matrix to another
+ *
+ * Variances are shared with the same weights as counts, so an
+ * unweighted matrix keeps sumw2 equal to its content and any gate
+ * wider than a bin keeps its variance.
+ *
+ * @param target matrix added to
+ * @param source matrix to correct, binning must match the target
+ * @param scratch work buffer, reused between calls
+ ***************************************************************/
+bool GainCorrection::AddTo(TH2D *target, TH2D *source, std::vector<double> &scratch)
+{
+    if (target->GetNbinsX() != source->GetNbinsX() || target->GetNbinsY() != source->GetNbinsY()) {
+        std::cerr << "\nERROR --- Binning of " << source->GetName() << " differs between files" << std::endl;
+        return false;
+    }
+    if (gain <= 0.) {
+        std::cerr << "\nERROR --- Gain must be positive, found: " << gain << std::endl;
+        return false;
+    }
+    BuildAxisMap(x_map, source->GetXaxis());
+    BuildAxisMap(y_map, source->GetYaxis());
+
+    if (target->GetSumw2N() == 0) target->Sumw2();
+    // unweighted histograms carry Poisson variances
+    const double *source_sumw2 = source->GetSumw2N() > 0 ? source->GetSumw2()->GetArray() : source->GetArray();
+    Apply(target->GetArray(), source->GetArray(), scratch);
+    Apply(target->GetSumw2()->GetArray(), source_sumw2, scratch);
+    target->SetEntries(target->GetEntries() + source->GetEntries());
+
+    return true;
+} // end AddTo()
+
+/************************************************************//**
+ * Builds the redistribution of one axis, unless it is unchanged
+ *
+ * Source bin s covers [offset + gain * low(s), offset + gain * up(s))
+ * after the correction and is shared between the target bins it
+ * overlaps. Axes are expected to have fixed bin widths.
+ *
+ * @param map map to build
+ * @param axis axis of the matrix
+ ***************************************************************/
+void GainCorrection::BuildAxisMap(AxisMap &map, const TAxis *axis)
+{
+    const int n = axis->GetNbins();
+    const double axis_min = axis->GetXmin();
+    const double axis_max = axis->GetXmax();
+    if (map.bins == n && map.min == axis_min && map.max == axis_max) return;
+    const double bin_width = (axis_max - axis_min) / n;
+
+    // contributions to every target bin, scattered from the source bins
+    std::vector<std::vector<std::pair<int, double>>> contribution_vec(n + 2);
+    contribution_vec[0].push_back(std::make_pair(0, 1.));
+    contribution_vec[n + 1].push_back(std::make_pair(n + 1, 1.));
+    for (auto s = 1; s <= n; s++) {
+        // corrected edges in units of target bins, target bin j covers [j - 1, j)
+        double low = (offset + gain * (axis_min + (s - 1) * bin_width) - axis_min) / bin_width;
+        double high = (offset + gain * (axis_min + s * bin_width) - axis_min) / bin_width;
+        double span = high - low;
+        int j_low = std::max((int) std::floor(low) + 1, 1);
+        int j_high = std::min((int) std::ceil(high), n);
+        // everything outside the axis ends in under- or overflow
+        if (low < 0.) contribution_vec[0].push_back(std::make_pair(s, (std::min(high, 0.) - low) / span));
+        if (high > n) contribution_vec[n + 1].push_back(std::make_pair(s, (high - std::max(low, (double) n)) / span));
+        for (auto j = j_low; j <= j_high; j++) {
+            double overlap = std::min(high, (double) j) - std::max(low, (double) (j - 1));
+            if (overlap > 0.) contribution_vec[j].push_back(std::make_pair(s, overlap / span));
+        }
+    }
+
+    // gather form for the regular bins, padded to a common width
+    map.width = 1;
+    for (auto t = 1; t <= n; t++) {
+        if (contribution_vec[t].empty()) continue;
+        int span = contribution_vec[t].back().first - contribution_vec[t].front().first + 1;
+        map.width = std::max(map.width, span);
+    }
+    map.first.assign(n + 2, 0);
+    map.weight.assign((size_t) map.width * (n + 2), 0.);
+    for (auto t = 1; t <= n; t++) {
+        if (contribution_vec[t].empty()) continue;
+        // keep first + width inside the row
+        int first = std::min(contribution_vec[t].front().first, n + 2 - map.width);
+        map.first[t] = first;
+        for (auto &c : contribution_vec[t]) {
+            map.weight[(size_t) (c.first - first) * (n + 2) + t] = c.second;
+        }
+    }
+    map.underflow = contribution_vec[0];
+    map.overflow = contribution_vec[n + 1];
+    map.bins = n;
+    map.min = axis_min;
+    map.max = axis_max;
+} // end BuildAxisMap()
+
+/************************************************************//**
+ * Adds a corrected array to another
+ *
+ * @param target array added to, TH2D layout
+ * @param source array to correct, TH2D layout
+ * @param scratch work buffer holding the x corrected source
+ ***************************************************************/
+void GainCorrection::Apply(double *target, const double *source, std::vector<double> &scratch)
+{
+    const int row_length = x_map.bins + 2;
+    const int rows = y_map.bins + 2;
+    scratch.assign((size_t) row_length * rows, 0.);
+
+    for (auto y_bin = 0; y_bin < rows; y_bin++) {
+        CorrectRow(&scratch[(size_t) y_bin * row_length], &source[(size_t) y_bin * row_length]);
+    }
+
+    // whole corrected rows are added along y
+    for (auto k = 0; k < y_map.width; k++) {
+        for (auto y_bin = 1; y_bin < rows - 1; y_bin++) {
+            double w = y_map.weight[(size_t) k * rows + y_bin];
+            if (w == 0.) continue;
+            AddScaled(&target[(size_t) y_bin * row_length], &scratch[(size_t) (y_map.first[y_bin] + k) * row_length], w, row_length);
+        }
+    }
+    for (auto &c : y_map.underflow) {
+        AddScaled(&target[0], &scratch[(size_t) c.first * row_length], c.second, row_length);
+    }
+    for (auto &c : y_map.overflow) {
+        AddScaled(&target[(size_t) (rows - 1) * row_length], &scratch[(size_t) c.first * row_length], c.second, row_length);
+    }
+} // end Apply()
+
+/************************************************************//**
+ * Corrects one row along x
+ *
+ * @param target corrected row, added to
+ * @param source row to correct
+ ***************************************************************/
+void GainCorrection::CorrectRow(double * __restrict__ target, const double * __restrict__ source)
+{
+    const int row_length = x_map.bins + 2;
+    const int *first = x_map.first.data();
+    for (auto k = 0; k < x_map.width; k++) {
+        const double *w = &x_map.weight[(size_t) k * row_length];
+        for (auto t = 1; t < row_length - 1; t++) {
+            target[t] += w[t] * source[first[t] + k];
+        }
+    }
+    for (auto &c : x_map.underflow) {
+        target[0] += c.second * source[c.first];
+    }
+    for (auto &c : x_map.overflow) {
+        target[row_length - 1] += c.second * source[c.first];
+    }
+} // end CorrectRow()
+
+/************************************************************//**
+ * Adds a scaled array to another
+ *
+ * @param target array added to
+ * @param source array to add
+ * @param scale factor of the source
+ * @param n number of elements
+ ***************************************************************/
+void GainCorrection::AddScaled(double * __restrict__ target, const double * __restrict__ source, double scale, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        target[i] += scale * source[i];
+    }
+} // end AddScaled()
@@ -8,10 +8,20 @@
 //
 //////////////////////////////////////////////////////////////////////////////////
 #include <iostream>
+#include <fstream>
 #include <map>
+#include <cmath>
+#include <algorithm>
 #include "HistogramManager.h"
 #include "progress_bar.h"
 #include "LoadingMessenger.h"
+#include "DataCube.h"
+#include "AngularCorrelationFitter.h"
+#include "BatchPeakFitter.h"
+#include "MixingRatioScanner.h"
+#include "NpyExporter.h"
+#include "MatrixKernels.h"
+#include "Checkpoint.h"
 #include "TFile.h"
 
 /************************************************************//**
@@ -26,6 +36,7 @@ HistogramManager::HistogramManager(FileHandler * file_man) : file_man(file_man)
  * Destructor
  ***************************************************************/
 HistogramManager::~HistogramManager(void){
+    delete converted_matrix;
     // std::cout << "Histogram manager deleted" << std::endl;
 }
 
@@ -64,7 +75,8 @@ void HistogramManager::BuildAllAngularMatrices()
  ***************************************************************/
 void HistogramManager::BuildAngularMatrix(std::string selector){
 
-    TFile in_file(file_man->hist_file_name.c_str(), "UPDATE");
+    // shards only read, their matrices go to the shard file
+    TFile in_file(file_man->hist_file_name.c_str(), shard.IsSharded() ? "READ" : "UPDATE");
 
     if (selector.compare("source") == 0) {
         std::cout << "Building source matrix ..." << std::endl;
@@ -76,41 +88,28 @@ void HistogramManager::BuildAngularMatrix(std::string selector){
         exit(EXIT_FAILURE);
     }
 
-    TH2D * angle_matrix = new TH2D("angle_matrix", "", 55, 0, 55, 3000, 0, 3000);
-    angle_matrix->Sumw2();
+    TH2D * angle_matrix = CreateAngleMatrix(selector);
+    // rows each index sets the error of, merging shards needs them
+    std::vector<int> loaded_bins_vec(angle_indices, -1);
 
-    for (auto i = 0; i < angle_indices; i++) {
+    for (auto i = shard.index; i < angle_indices; i += shard.count) {
         std::cout << "Processing angular index: " << i + 1 << " of " << angle_indices << "\r";
         std::cout.flush();
 
-        TH2D * sum_energy_matrix = NULL;
         // Make sure we get the correct matrix
         if (selector.compare("source") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("room_background_subtracted/source_%02i", i));
-            angle_matrix->SetName("angle_matrix_src");
-            angle_matrix->SetTitle("Sum Energy (Room Bg Subtracted);Angular Index [arb.];Energy [keV]");
+            LoadSumEnergyMatrix(&in_file, Form("room_background_subtracted/source_%02i", i));
         } else {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("background/index_%02i_sum", i));
-            angle_matrix->SetName("angle_matrix_bg");
-            angle_matrix->SetTitle("Sum Energy (Room Bg);Angular Index [arb.];Energy [keV]");
+            LoadSumEnergyMatrix(&in_file, Form("background/index_%02i_sum", i));
         }
+        if (!matrix_loaded) exit(EXIT_FAILURE);
 
-        TH1D *projected_hist = sum_energy_matrix->ProjectionX();
-
-        for (auto my_bin = 0; my_bin < projected_hist->GetXaxis()->GetNbins() + 1; my_bin++) {
-            double val = projected_hist->GetBinContent(my_bin);
-            double val_error = projected_hist->GetBinError(my_bin);
-            // Fill TH2D
-            angle_matrix->Fill(i, my_bin, val);
-            angle_matrix->SetBinError(i, my_bin, val_error);
-        } // end bin loop
-
-        // cleaning up
-        delete sum_energy_matrix;
-        delete projected_hist;
+        ProjectSumEnergy();
+        loaded_bins_vec[i] = GetLoadedBinsX();
+        FillAngleIndex(angle_matrix, i, projection_vec, projection_error2_vec, GetLoadedBinsX());
     } // end angle index loop
     std::cout << std::endl;
-    angle_matrix->Write("", TObject::kOverwrite);
+    WriteAngleMatrix(angle_matrix, loaded_bins_vec);
     in_file.Close();
 
 } // end BuildAngularMatrix
@@ -123,148 +122,871 @@ void HistogramManager::BuildAngularMatrix(std::string selector){
 
 void HistogramManager::BuildGatedAngularMatrix(std::string selector, int gate_low, int gate_high){
 
-    TFile in_file(file_man->hist_file_name.c_str(), "UPDATE");
+    // shards only read, their matrices go to the shard file
+    TFile in_file(file_man->hist_file_name.c_str(), shard.IsSharded() ? "READ" : "UPDATE");
     TH2D * gated_angle_matrix = new TH2D("gated_angle_matrix", Form("#gamma_{1} Sum Gated [%i-%i];Angular Index; Energy [keV]", gate_low, gate_high), 55, 0.0, 55, gate_high + 10, 0, gate_high + 10);
     // make sure errors are properly calculated
     gated_angle_matrix->Sumw2();
+    // rows each index sets the error of, merging shards needs them
+    std::vector<int> loaded_bins_vec(angle_indices, -1);
 
-    TH2D * sum_energy_matrix = NULL;
     std::cout << "Building " << selector << " energy gated angular matrix ... \r";
-    for (auto i = 0; i < angle_indices; i++) {
+    for (auto i = shard.index; i < angle_indices; i += shard.count) {
         //std::cout << "Processing angular index: " << i + 1 << " of " << angle_indices << "\r";
         std::cout << "Building " << selector << " energy gated angular matrix (" << i + 1 << " of " << angle_indices << ")\r";
         std::cout.flush();
 
         if (selector.compare("source") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("source/index_%02i_sum", i));
+            LoadSumEnergyMatrix(&in_file, Form("source/index_%02i_sum", i));
             gated_angle_matrix->SetName("gamma1_matrix_src");
             gated_angle_matrix->SetTitle("Sum Energy (Source);Angular Index;Energy [keV]");
         } else if (selector.compare("background") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("background/index_%02i_sum", i));
+            LoadSumEnergyMatrix(&in_file, Form("background/index_%02i_sum", i));
             gated_angle_matrix->SetName("gamma1_matrix_bg");
             gated_angle_matrix->SetTitle("Sum Energy (Background);Angular Index;Energy [keV]");
         } else if (selector.compare("room_bg_subtracted") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("room_background_subtracted/source_%02i", i));
+            LoadSumEnergyMatrix(&in_file, Form("room_background_subtracted/source_%02i", i));
             gated_angle_matrix->SetName("gamma1_matrix_src_bg_subtracted");
             gated_angle_matrix->SetTitle("Sum Energy (Source, Background Subtracted);Angular Index;Energy [keV]");
         } else if (selector.compare("compton") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("room_background_subtracted/source_%02i", i));
+            LoadSumEnergyMatrix(&in_file, Form("room_background_subtracted/source_%02i", i));
             gated_angle_matrix->SetName("gamma1_matrix_compton_bg_subtracted");
             gated_angle_matrix->SetTitle("Sum Energy (Compton, Background Subtracted);Angular Index;Energy [keV]");
         } else {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("room_background_subtracted/source_%02i", i));
+            LoadSumEnergyMatrix(&in_file, Form("room_background_subtracted/source_%02i", i));
             gated_angle_matrix->SetName("other");
             gated_angle_matrix->SetTitle("Sum Energy (Source, Background Subtracted);Angular Index;Energy [keV]");
         }
 
 
-        TH1D *projected_hist = GetGatedProjection(sum_energy_matrix, gate_low, gate_high, i);
-
-        for (auto my_bin = 0; my_bin < projected_hist->GetXaxis()->GetNbins() + 1; my_bin++) {
-            double val = projected_hist->GetBinContent(my_bin);
-            double val_error = projected_hist->GetBinError(my_bin);
-            // Fill TH2D
-            gated_angle_matrix->Fill(i, my_bin, val);
-            gated_angle_matrix->SetBinError(i, my_bin, val_error);
-        } // end bin loop
+        if (!matrix_loaded) exit(EXIT_FAILURE);
 
-        // cleaning up
-        delete sum_energy_matrix;
-        delete projected_hist;
+        ProjectGatedEnergy(gate_low, gate_high);
+        loaded_bins_vec[i] = GetLoadedBinsY();
+        FillAngleIndex(gated_angle_matrix, i, projection_vec, projection_error2_vec, GetLoadedBinsY());
     } // end angle index loop
     std::cout << std::endl;
-    gated_angle_matrix->Write("", TObject::kOverwrite);
+    WriteAngleMatrix(gated_angle_matrix, loaded_bins_vec);
     in_file.Close();
 
 } // end BuildGatedAngularMatrix()
 
 /************************************************************//**
- * Gates on given sum energy and projects out Y axis
+ * Partial output of a shard, next to the histogram file
+ *
+ * @param hist_file_name histogram file
+ * @param spec shard
  ***************************************************************/
-TH1D* HistogramManager::GetGatedProjection(TH2D *h, Int_t gate_low, Int_t gate_high, Int_t index)
+std::string HistogramManager::ShardFileName(std::string hist_file_name, ShardSpec spec)
 {
-    TH1D* p = h->ProjectionY("p", gate_low, gate_high);
-    p->SetName(Form("index_%02i_gated_%i_%i", index, gate_low, gate_high));
-    p->SetTitle(";#gamma_1 energy [keV]");
+    size_t split = hist_file_name.rfind(".root");
+    if (split != std::string::npos) hist_file_name = hist_file_name.substr(0, split);
 
-    return p;
-} // end GetProjection
+    return spec.FileName(hist_file_name + "_angles.root");
+} // end ShardFileName()
 
 /************************************************************//**
- * Builds gamma 2 matrices
+ * Writes an angle matrix to the histogram file or the shard file
+ *
+ * @param h angle matrix
+ * @param loaded_bins_vec last row whose error index i set, -1 if not processed
  ***************************************************************/
-void HistogramManager::BuildSingleGammaMatrices(std::string selector, int gate_low, int gate_high){
+void HistogramManager::WriteAngleMatrix(TH2D *h, std::vector<int> loaded_bins_vec)
+{
+    if (!shard.IsSharded()) {
+        h->Write("", TObject::kOverwrite);
+        return;
+    }
 
-    TFile in_file(file_man->hist_file_name.c_str(), "UPDATE");
-    TH2D * high_gamma_angle_matrix = new TH2D("high_gamma_angle_matrix", Form("E_high Single #gamma Sum Gated [%i-%i];Angular Index; Energy [keV]", gate_low, gate_high), 55, 0.0, 55, gate_high + 10, 0, gate_high + 10);
-    TH2D * low_gamma_angle_matrix = new TH2D("low_gamma_angle_matrix", Form("E_low Single #gamma Sum Gated [%i-%i];Angular Index; Energy [keV]", gate_low, gate_high), 55, 0.0, 55, gate_high + 10, 0, gate_high + 10);
-    TH2D * total_gamma_angle_matrix = new TH2D("total_gamma_angle_matrix", Form("E_high and E_low Gated [%i-%i];Angular Index; Energy [keV]", gate_low, gate_high), 55, 0.0, 55, gate_high + 10, 0, gate_high + 10);
+    TFile shard_file(ShardFileName(file_man->hist_file_name, shard).c_str(), "UPDATE");
+    if (!shard_file.Get("shard")) {
+        TNamed label("shard", shard.Label().c_str());
+        shard_file.WriteTObject(&label);
+    }
+    shard_file.WriteTObject(h, h->GetName(), "WriteDelete");
+    if (!loaded_bins_vec.empty()) ShardMerger::WriteLoadedBins(&shard_file, h->GetName(), loaded_bins_vec);
+    shard_file.Close();
+} // end WriteAngleMatrix()
+
+/************************************************************//**
+ * Reads tiled matrices from a tile file where available
+ *
+ * Matrices found in the tile file are not read from the histogram
+ * file; gates then only read the tiles they cover.
+ *
+ * @param tile_filename tile file written by BuildTileFile()
+ ***************************************************************/
+void HistogramManager::SetTileFile(std::string tile_filename)
+{
+    TFile source_file(file_man->hist_file_name.c_str(), "READ");
+    if (!tiled_matrix.Open(tile_filename, &source_file)) exit(EXIT_FAILURE);
+    source_file.Close();
+} // end SetTileFile
+
+/************************************************************//**
+ * Selects one sum energy matrix, reading it unless it is cached or tiled
+ *
+ * The storage format is taken from the key, so files written with
+ * any BGUtils format can be used.
+ *
+ * @param in_file histogram file
+ * @param key_name matrix key
+ ***************************************************************/
+void HistogramManager::LoadSumEnergyMatrix(TFile *in_file, std::string key_name)
+{
+    loaded_view = NULL;
+    if (matrix_cache.IsOpen() && matrix_cache.Find(key_name)) {
+        loaded_format = "cached";
+        loaded_view = matrix_cache.Find(key_name);
+        matrix_loaded = true;
+    } else if (tiled_matrix.IsOpen() && tiled_matrix.HasMatrix(key_name)) {
+        loaded_format = "tiled";
+        matrix_loaded = tiled_matrix.Select(key_name);
+    } else if (SparseMatrix<>::IsSparseKey(in_file, key_name)) {
+        loaded_format = "sparse";
+        matrix_loaded = sparse_matrix.Read(in_file, key_name);
+    } else if (TriangularMatrix<>::IsTriangularKey(in_file, key_name)) {
+        loaded_format = "triangular";
+        matrix_loaded = triangular_matrix.Read(in_file, key_name);
+    } else {
+        loaded_format = "dense";
+        TH2D *h = hist_pool.Read(in_file, key_name);
+        matrix_loaded = h != NULL;
+        if (h) {
+            // dense matrices are handled like cached ones, without projections
+            dense_view.x_bins = h->GetXaxis()->GetNbins();
+            dense_view.y_bins = h->GetYaxis()->GetNbins();
+            dense_view.content = h->GetArray();
+            dense_view.sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : h->GetArray();
+            loaded_view = &dense_view;
+        }
+    }
+} // end LoadSumEnergyMatrix
+
+/************************************************************//**
+ * Number of sum energy (x) bins of the loaded matrix
+ ***************************************************************/
+int HistogramManager::GetLoadedBinsX()
+{
+    if (loaded_format.compare("tiled") == 0) return tiled_matrix.GetNbinsX();
+    if (loaded_format.compare("sparse") == 0) return sparse_matrix.GetNbinsX();
+    if (loaded_format.compare("triangular") == 0) return triangular_matrix.GetNbinsX();
+    return loaded_view->x_bins;
+} // end GetLoadedBinsX
+
+/************************************************************//**
+ * Number of gamma energy (y) bins of the loaded matrix
+ ***************************************************************/
+int HistogramManager::GetLoadedBinsY()
+{
+    if (loaded_format.compare("tiled") == 0) return tiled_matrix.GetNbinsY();
+    if (loaded_format.compare("sparse") == 0) return sparse_matrix.GetNbinsY();
+    if (loaded_format.compare("triangular") == 0) return triangular_matrix.GetNbinsY();
+    return loaded_view->y_bins;
+} // end GetLoadedBinsY
+
+/************************************************************//**
+ * Projects out X axis (sum energy) of the loaded matrix into the
+ * projection buffers
+ *
+ * Same bins as TH2::ProjectionX, including under/overflow of the
+ * gamma axis, but written into reused vectors.
+ ***************************************************************/
+void HistogramManager::ProjectSumEnergy()
+{
+    if (loaded_format.compare("tiled") == 0) {
+        tiled_matrix.ProjectX(0, tiled_matrix.GetNbinsX() + 1, projection_vec, projection_error2_vec);
+        return;
+    }
+    if (loaded_format.compare("sparse") == 0) {
+        sparse_matrix.ProjectX(projection_vec, projection_error2_vec);
+        return;
+    }
+    if (loaded_format.compare("triangular") == 0) {
+        triangular_matrix.ProjectX(projection_vec, projection_error2_vec);
+        return;
+    }
+    const int row_length = loaded_view->x_bins + 2;
+    if (loaded_view->projection_x) {
+        // cached at conversion
+        projection_vec.assign(loaded_view->projection_x, loaded_view->projection_x + row_length);
+        projection_error2_vec.assign(loaded_view->projection_x_error2, loaded_view->projection_x_error2 + row_length);
+        return;
+    }
+    MatrixKernels::ProjectX(loaded_view->content, loaded_view->sumw2, loaded_view->x_bins, loaded_view->y_bins, projection_vec, projection_error2_vec);
+} // end ProjectSumEnergy
+
+/************************************************************//**
+ * Gates the loaded matrix on given sum energy and projects out Y axis
+ *
+ * Same bins as TH2::ProjectionY(name, gate_low, gate_high) but
+ * written into reused vectors. Both ends of the gate are clamped to
+ * the under and overflow bins of the matrix, a gate outside of the
+ * matrix projects nothing.
+ ***************************************************************/
+void HistogramManager::ProjectGatedEnergy(Int_t gate_low, Int_t gate_high)
+{
+    gate_low = std::min(std::max(gate_low, 0), GetLoadedBinsX() + 1);
+    gate_high = std::min(std::max(gate_high, 0), GetLoadedBinsX() + 1);
+    if (gate_low > gate_high) {
+        // gate outside of the matrix
+        projection_vec.assign(GetLoadedBinsY() + 2, 0.);
+        projection_error2_vec.assign(GetLoadedBinsY() + 2, 0.);
+        return;
+    }
+    if (loaded_format.compare("tiled") == 0) {
+        tiled_matrix.ProjectY(gate_low, gate_high, projection_vec, projection_error2_vec);
+        return;
+    }
+    if (loaded_format.compare("sparse") == 0) {
+        sparse_matrix.ProjectY(gate_low, gate_high, projection_vec, projection_error2_vec);
+        return;
+    }
+    if (loaded_format.compare("triangular") == 0) {
+        triangular_matrix.ProjectY(gate_low, gate_high, projection_vec, projection_error2_vec);
+        return;
+    }
+    MatrixKernels::ProjectY(loaded_view->content, loaded_view->sumw2, loaded_view->x_bins, loaded_view->y_bins, gate_low, gate_high, projection_vec, projection_error2_vec);
+} // end ProjectGatedEnergy
+
+/************************************************************//**
+ * Fills one sum energy bin into the single gamma matrices
+ *
+ * @param index angular index
+ * @param sum_energy_bin sum energy bin
+ * @param gamma_energy_bin gamma energy bin
+ * @param val counts in bin
+ ***************************************************************/
+void HistogramManager::FillSingleGammaBin(int index, int sum_energy_bin, int gamma_energy_bin, double val, TH2D *high_gamma_angle_matrix, TH2D *low_gamma_angle_matrix, TH2D *total_gamma_angle_matrix)
+{
+    high_gamma_angle_matrix->Fill(index, gamma_energy_bin, val);
+    low_gamma_angle_matrix->Fill(index, sum_energy_bin - gamma_energy_bin, val);
+    total_gamma_angle_matrix->Fill(index, gamma_energy_bin, val);
+    total_gamma_angle_matrix->Fill(index, sum_energy_bin - gamma_energy_bin, val);
+} // end FillSingleGammaBin
+
+/************************************************************//**
+ * Fills the gated rows of one index into the single gamma matrices
+ *
+ * Row s, column g of the rows is content[(s - first_sum_bin) +
+ * row_length * g], so a whole matrix and rows copied out of it by
+ * CopySingleGammaRows() are filled the same way.
+ *
+ * @param index angular index
+ * @param content gated rows
+ * @param row_length distance between gamma energy bins in content
+ * @param first_sum_bin sum energy bin of the first content entry
+ * @param sum_low first sum energy bin filled
+ * @param sum_high last sum energy bin filled
+ * @param gamma_bins gamma energy bins, without overflow
+ * @param matrix_vec high, low and total gamma matrices
+ ***************************************************************/
+void HistogramManager::FillSingleGammaIndex(int index, const double *content, int row_length, int first_sum_bin, int sum_low, int sum_high, int gamma_bins, std::vector<TH2D*> &matrix_vec)
+{
+    for (auto sum_energy_bin = sum_low; sum_energy_bin < sum_high + 1; sum_energy_bin++) {
+        const double *row = content + (sum_energy_bin - first_sum_bin);
+        for (auto gamma_energy_bin = 0; gamma_energy_bin < gamma_bins + 1; gamma_energy_bin++) {
+            FillSingleGammaBin(index, sum_energy_bin, gamma_energy_bin, row[row_length * gamma_energy_bin], matrix_vec[0], matrix_vec[1], matrix_vec[2]);
+        }
+    }
+} // end FillSingleGammaIndex()
+
+/************************************************************//**
+ * Copies the gated rows of a matrix for FillSingleGammaIndex()
+ *
+ * @param h sum energy matrix
+ * @param gate_low first gated sum energy bin
+ * @param gate_high last gated sum energy bin
+ * @param rows gated rows, row_length is the number of rows copied
+ ***************************************************************/
+void HistogramManager::CopySingleGammaRows(TH2D *h, int gate_low, int gate_high, std::vector<double> &rows)
+{
+    const int row_length = h->GetNbinsX() + 2;
+    const int gamma_bins = h->GetNbinsY();
+    const int last_sum_bin = std::min(gate_high, h->GetNbinsX() + 1);
+    const int width = last_sum_bin - gate_low + 1;
+    const double *content = h->GetArray();
+    rows.clear();
+    if (width <= 0) return;
+    rows.resize(width * (gamma_bins + 1));
+    for (auto gamma_energy_bin = 0; gamma_energy_bin < gamma_bins + 1; gamma_energy_bin++) {
+        std::copy(content + gate_low + row_length * gamma_energy_bin, content + last_sum_bin + 1 + row_length * gamma_energy_bin, rows.begin() + width * gamma_energy_bin);
+    }
+} // end CopySingleGammaRows()
+
+/************************************************************//**
+ * Fills the projection of one index into a column of an angle matrix
+ *
+ * Index i fills x = i and sets the error of bin i, see ShardMerger
+ * for what that means for merged shards.
+ *
+ * @param angle_matrix angle matrix
+ * @param index angular index
+ * @param projection projected content
+ * @param error2 projected squared errors
+ * @param bins projected bins, without overflow
+ ***************************************************************/
+void HistogramManager::FillAngleIndex(TH2D *angle_matrix, int index, const std::vector<double> &projection, const std::vector<double> &error2, int bins)
+{
+    for (auto my_bin = 0; my_bin < bins + 1; my_bin++) {
+        double val = projection[my_bin];
+        double val_error = std::sqrt(error2[my_bin]);
+        // Fill TH2D
+        angle_matrix->Fill(index, my_bin, val);
+        angle_matrix->SetBinError(index, my_bin, val_error);
+    } // end bin loop
+} // end FillAngleIndex()
+
+/************************************************************//**
+ * Projects out X axis (sum energy) of a dense matrix
+ *
+ * @param h matrix to project
+ * @param projection projected content
+ * @param error2 projected squared errors
+ ***************************************************************/
+void HistogramManager::ProjectSumEnergy(TH2D *h, std::vector<double> &projection, std::vector<double> &error2)
+{
+    const double *content = h->GetArray();
+    const double *sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : content;
+    MatrixKernels::ProjectX(content, sumw2, h->GetNbinsX(), h->GetNbinsY(), projection, error2);
+} // end ProjectSumEnergy()
+
+/************************************************************//**
+ * Sum energy angle matrix of room background subtracted source or
+ * room background
+ *
+ * @param selector "source" or "background"
+ ***************************************************************/
+TH2D* HistogramManager::CreateAngleMatrix(std::string selector)
+{
+    TH2D *angle_matrix;
+    if (selector.compare("source") == 0) {
+        angle_matrix = new TH2D("angle_matrix_src", "Sum Energy (Room Bg Subtracted);Angular Index [arb.];Energy [keV]", 55, 0, 55, 3000, 0, 3000);
+    } else {
+        angle_matrix = new TH2D("angle_matrix_bg", "Sum Energy (Room Bg);Angular Index [arb.];Energy [keV]", 55, 0, 55, 3000, 0, 3000);
+    }
+    angle_matrix->Sumw2();
+
+    return angle_matrix;
+} // end CreateAngleMatrix()
+
+/************************************************************//**
+ * High, low and total single gamma angle matrices
+ *
+ * @param selector matrices gated, e.g. "source"
+ * @param gate_low first gated sum energy bin
+ * @param gate_high last gated sum energy bin
+ ***************************************************************/
+std::vector<TH2D*> HistogramManager::CreateSingleGammaMatrices(std::string selector, int gate_low, int gate_high)
+{
+    TH2D * high_gamma_angle_matrix = new TH2D(Form("high_gamma_angle_matrix_%s", selector.c_str()), Form("E_high Single #gamma Sum Gated [%i-%i];Angular Index; Energy [keV]", gate_low, gate_high), 55, 0.0, 55, gate_high + 10, 0, gate_high + 10);
+    TH2D * low_gamma_angle_matrix = new TH2D(Form("low_gamma_angle_matrix_%s", selector.c_str()), Form("E_low Single #gamma Sum Gated [%i-%i];Angular Index; Energy [keV]", gate_low, gate_high), 55, 0.0, 55, gate_high + 10, 0, gate_high + 10);
+    TH2D * total_gamma_angle_matrix = new TH2D(Form("total_gamma_angle_matrix_%s", selector.c_str()), Form("E_high and E_low Gated [%i-%i];Angular Index; Energy [keV]", gate_low, gate_high), 55, 0.0, 55, gate_high + 10, 0, gate_high + 10);
     // make sure errors are properly calculated
     high_gamma_angle_matrix->Sumw2();
     low_gamma_angle_matrix->Sumw2();
     total_gamma_angle_matrix->Sumw2();
 
-    TH2D * sum_energy_matrix = NULL;
+    return {high_gamma_angle_matrix, low_gamma_angle_matrix, total_gamma_angle_matrix};
+} // end CreateSingleGammaMatrices()
+
+/************************************************************//**
+ * Keeps what the angle matrices need from one index
+ *
+ * @param h room background subtracted source or room background
+ * @param selector 0 source, 1 background, 2 room_bg_subtracted
+ * @param gate_low first gated sum energy bin
+ * @param gate_high last gated sum energy bin
+ * @param products products of the index
+ ***************************************************************/
+void HistogramManager::ExtractIndexProducts(TH2D *h, int selector, int gate_low, int gate_high, AngleIndexProducts &products)
+{
+    products.x_bins = h->GetNbinsX();
+    products.y_bins = h->GetNbinsY();
+    CopySingleGammaRows(h, gate_low, gate_high, products.single_gamma_vec[selector]);
+    if (selector == 1) {
+        ProjectSumEnergy(h, products.bg_projection_vec, products.bg_projection_error2_vec);
+    } else if (selector == 2) {
+        ProjectSumEnergy(h, products.src_projection_vec, products.src_projection_error2_vec);
+    }
+} // end ExtractIndexProducts()
+
+/************************************************************//**
+ * Fills all angle matrices from the kept products of every index
+ *
+ * Indices are filled in order with the same calls as the serial
+ * build, so the matrices do not depend on the order the products
+ * were made in.
+ *
+ * @param product_vec products of every index, unfilled ones are skipped
+ * @param gate_low first gated sum energy bin
+ * @param gate_high last gated sum energy bin
+ * @param matrix_vec new angle matrices (output, owned by the caller)
+ * @param loaded_bins_vec bins each index filled, -1 if skipped (output)
+ ***************************************************************/
+void HistogramManager::FillAngularMatrices(const std::vector<AngleIndexProducts> &product_vec, int gate_low, int gate_high, std::vector<TH2D*> &matrix_vec, std::vector<int> &loaded_bins_vec)
+{
+    const int indices = product_vec.size();
+    matrix_vec.clear();
+    loaded_bins_vec.assign(indices, -1);
+
+    // sum energy angular matrices
+    TH2D *src_angle_matrix = CreateAngleMatrix("source");
+    TH2D *bg_angle_matrix = CreateAngleMatrix("background");
+    for (auto i = 0; i < indices; i++) {
+        const AngleIndexProducts &products = product_vec[i];
+        if (!products.filled) continue;
+        FillAngleIndex(src_angle_matrix, i, products.src_projection_vec, products.src_projection_error2_vec, products.x_bins);
+        loaded_bins_vec[i] = products.x_bins;
+    }
+    for (auto i = 0; i < indices; i++) {
+        const AngleIndexProducts &products = product_vec[i];
+        if (!products.filled) continue;
+        FillAngleIndex(bg_angle_matrix, i, products.bg_projection_vec, products.bg_projection_error2_vec, products.x_bins);
+    }
+    matrix_vec.push_back(src_angle_matrix);
+    matrix_vec.push_back(bg_angle_matrix);
+
+    // single gamma angular matrices
+    const char *selector_names[3] = {"source", "background", "room_bg_subtracted"};
+    for (auto selector = 0; selector < 3; selector++) {
+        std::vector<TH2D*> gamma_matrix_vec = CreateSingleGammaMatrices(selector_names[selector], gate_low, gate_high);
+        for (auto i = 0; i < indices; i++) {
+            const AngleIndexProducts &products = product_vec[i];
+            const int last_sum_bin = std::min(gate_high, products.x_bins + 1);
+            if (!products.filled || last_sum_bin < gate_low) continue;
+            FillSingleGammaIndex(i, products.single_gamma_vec[selector].data(), last_sum_bin - gate_low + 1, gate_low, gate_low, last_sum_bin, products.y_bins, gamma_matrix_vec);
+        }
+        matrix_vec.insert(matrix_vec.end(), gamma_matrix_vec.begin(), gamma_matrix_vec.end());
+    }
+} // end FillAngularMatrices()
+
+/************************************************************//**
+ * Builds gamma 2 matrices
+ ***************************************************************/
+void HistogramManager::BuildSingleGammaMatrices(std::string selector, int gate_low, int gate_high){
+
+    // shards only read, their matrices go to the shard file
+    TFile in_file(file_man->hist_file_name.c_str(), shard.IsSharded() ? "READ" : "UPDATE");
+    // high, low and total gamma energy
+    std::vector<TH2D*> gamma_matrix_vec = CreateSingleGammaMatrices(selector, gate_low, gate_high);
+
     //std::cout << "Building " << selector << " single gamma angular matrices - " << std::endl;
-    for (auto i = 0; i < angle_indices; i++) {
+    for (auto i = shard.index; i < angle_indices; i += shard.count) {
         std::cout << "Building " << selector << " single gamma angular matrices - index: " << i + 1 << " of " << angle_indices << "\r";
         std::cout.flush();
 
         if (selector.compare("source") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("source/index_%02i_sum", i));
+            LoadSumEnergyMatrix(&in_file, Form("source/index_%02i_sum", i));
         } else if (selector.compare("background") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("background/index_%02i_sum", i));
+            LoadSumEnergyMatrix(&in_file, Form("background/index_%02i_sum", i));
         } else if (selector.compare("room_bg_subtracted") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("room_background_subtracted/source_%02i", i));
+            LoadSumEnergyMatrix(&in_file, Form("room_background_subtracted/source_%02i", i));
         } else if (selector.compare("compton") == 0) {
-            sum_energy_matrix = (TH2D*)in_file.Get(Form("room_background_subtracted/source_%02i", i));
+            LoadSumEnergyMatrix(&in_file, Form("room_background_subtracted/source_%02i", i));
         } else {
             std::cerr << "\n\nUnknown single gamma selector, exiting" << std::endl;
             exit(EXIT_FAILURE);
         }
-
-        // Set histogram names
-        high_gamma_angle_matrix->SetName(Form("high_gamma_angle_matrix_%s", selector.c_str()));
-        low_gamma_angle_matrix->SetName(Form("low_gamma_angle_matrix_%s", selector.c_str()));
-        total_gamma_angle_matrix->SetName(Form("total_gamma_angle_matrix_%s", selector.c_str()));
-
-        // restrict range to gated region along sum energy axis (x)
-        for (auto sum_energy_bin = gate_low; sum_energy_bin < gate_high + 1; sum_energy_bin++) {
-            for (auto gamma_energy_bin = 0; gamma_energy_bin < sum_energy_matrix->GetYaxis()->GetNbins() + 1; gamma_energy_bin++) {
-                // get counts in bins
-                double val = sum_energy_matrix->GetBinContent(sum_energy_bin, gamma_energy_bin);
-                //double val_error = sum_energy_matrix->GetBinError(gamma_energy_bin, sum_energy_bin);
-
-                // fill single gamma matrices
-                high_gamma_angle_matrix->Fill(i, gamma_energy_bin, val);
-                low_gamma_angle_matrix->Fill(i, sum_energy_bin - gamma_energy_bin, val);
-                total_gamma_angle_matrix->Fill(i, gamma_energy_bin, val);
-                total_gamma_angle_matrix->Fill(i, sum_energy_bin - gamma_energy_bin, val);
-
-                // I don't think I need to explicity set the error
-                //high_gamma_angle_matrix->SetBinError(i, sum_energy_bin, val_error);
-                //low_gamma_angle_matrix->SetBinError(i, gamma_energy_bin - sum_energy_bin, val_error);
+        if (!matrix_loaded) exit(EXIT_FAILURE);
+        // next index is read from storage while this one is projected
+        if (i + shard.count < angle_indices && loaded_format.compare("dense") == 0) {
+            if (selector.compare("source") == 0 || selector.compare("background") == 0) {
+                file_man->Prefetch(&in_file, {Form("%s/index_%02i_sum", selector.c_str(), i + shard.count)});
+            } else {
+                file_man->Prefetch(&in_file, {Form("room_background_subtracted/source_%02i", i + shard.count)});
             }
         }
 
-        // cleaning up
-        delete sum_energy_matrix;
+        // restrict range to gated region along sum energy axis (x), coarse matrices may end below the gate
+        const int last_sum_bin = std::min(gate_high, GetLoadedBinsX() + 1);
+        if (loaded_format.compare("dense") == 0 || loaded_format.compare("cached") == 0) {
+            FillSingleGammaIndex(i, loaded_view->content, loaded_view->x_bins + 2, 0, gate_low, last_sum_bin, loaded_view->y_bins, gamma_matrix_vec);
+            continue;
+        }
+        for (auto sum_energy_bin = gate_low; sum_energy_bin < last_sum_bin + 1; sum_energy_bin++) {
+            if (loaded_format.compare("sparse") == 0) {
+                // only filled gamma bins are stored, empty ones add nothing
+                for (auto entry = sparse_matrix.RowBegin(sum_energy_bin); entry < sparse_matrix.RowEnd(sum_energy_bin); entry++) {
+                    int gamma_energy_bin = sparse_matrix.Column(entry);
+                    if (gamma_energy_bin > sparse_matrix.GetNbinsY()) continue;
+                    FillSingleGammaBin(i, sum_energy_bin, gamma_energy_bin, sparse_matrix.Content(entry), gamma_matrix_vec[0], gamma_matrix_vec[1], gamma_matrix_vec[2]);
+                }
+                continue;
+            }
+            // unpacks the row, tiles are only read once for the whole gate
+            if (loaded_format.compare("triangular") == 0) {
+                triangular_matrix.GetRow(sum_energy_bin, row_vec, row_error2_vec);
+            } else {
+                tiled_matrix.ProjectY(sum_energy_bin, sum_energy_bin, row_vec, row_error2_vec);
+            }
+            FillSingleGammaIndex(i, row_vec.data(), 1, sum_energy_bin, sum_energy_bin, sum_energy_bin, GetLoadedBinsY(), gamma_matrix_vec);
+        }
     } // end angle index loop
     std::cout << std::endl;
-    high_gamma_angle_matrix->Write("", TObject::kOverwrite);
-    low_gamma_angle_matrix->Write("", TObject::kOverwrite);
-    total_gamma_angle_matrix->Write("", TObject::kOverwrite);
+    for (auto h : gamma_matrix_vec) {
+        WriteAngleMatrix(h);
+    }
+    file_man->WaitForPrefetch();
     in_file.Close();
 
 } // end BuildSingleGammaMatrices
 
 /************************************************************//**
- * Keep this function in. linking libraries breaks when it is removed; don't know why
- * Hours wasted trying to fix: 1.5
+ * Keys of every per-index sum energy matrix
+ ***************************************************************/
+std::vector<std::string> HistogramManager::GetSumEnergyKeys()
+{
+    std::vector<std::string> key_vec;
+    std::vector<std::string> name_formats = {"source/index_%02i_sum", "background/index_%02i_sum", "room_background_subtracted/source_%02i"};
+    for (auto &name_format : name_formats) {
+        for (auto i = 0; i < angle_indices; i++) {
+            key_vec.push_back(Form(name_format.c_str(), i));
+        }
+    }
+
+    return key_vec;
+} // end GetSumEnergyKeys
+
+/************************************************************//**
+ * Reads a matrix of any storage format as a TH2D
+ *
+ * The histogram is owned by the manager and valid until the next
+ * call.
+ *
+ * @param in_file histogram file
+ * @param key_name matrix key
+ ***************************************************************/
+TH2D* HistogramManager::ReadAsHistogram(TFile *in_file, std::string key_name)
+{
+    delete converted_matrix;
+    converted_matrix = NULL;
+
+    if (SparseMatrix<>::IsSparseKey(in_file, key_name)) {
+        if (!sparse_matrix.Read(in_file, key_name)) return NULL;
+        converted_matrix = sparse_matrix.ToHistogram("converted_matrix");
+    } else if (TriangularMatrix<>::IsTriangularKey(in_file, key_name)) {
+        if (!triangular_matrix.Read(in_file, key_name)) return NULL;
+        converted_matrix = triangular_matrix.ToHistogram("converted_matrix");
+    } else {
+        return hist_pool.Read(in_file, key_name);
+    }
+    converted_matrix->SetDirectory(0);
+
+    return converted_matrix;
+} // end ReadAsHistogram
+
+/************************************************************//**
+ * Writes every per-index sum energy matrix to a tile file
+ *
+ * Matrices in any storage format are converted, so later passes can
+ * read single gates instead of whole matrices.
+ *
+ * @param tile_filename tile file
+ ***************************************************************/
+void HistogramManager::BuildTileFile(std::string tile_filename)
+{
+    TFile in_file(file_man->hist_file_name.c_str(), "READ");
+    TiledMatrixWriter writer;
+    if (!writer.Open(tile_filename)) exit(EXIT_FAILURE);
+
+    std::vector<std::string> key_vec = GetSumEnergyKeys();
+    for (size_t k = 0; k < key_vec.size(); k++) {
+        std::cout << "Tiling matrix " << k + 1 << " of " << key_vec.size() << "\r";
+        std::cout.flush();
+
+        TH2D *h = ReadAsHistogram(&in_file, key_vec[k]);
+        if (!h) exit(EXIT_FAILURE);
+        writer.Add(h, key_vec[k]);
+    }
+    std::cout << std::endl;
+    writer.SetSourceHash(Checkpoint::KeyHash({&in_file}, key_vec));
+    in_file.Close();
+
+    if (!writer.Close()) exit(EXIT_FAILURE);
+} // end BuildTileFile
+
+/************************************************************//**
+ * Writes every per-index sum energy matrix to a native cache
+ *
+ * The cache holds uncompressed arrays and sum energy projections,
+ * so later passes map them instead of reading the histogram file.
+ *
+ * @param cache_filename cache file
+ ***************************************************************/
+void HistogramManager::BuildCacheFile(std::string cache_filename)
+{
+    TFile in_file(file_man->hist_file_name.c_str(), "READ");
+    MatrixCacheWriter writer;
+    if (!writer.Open(cache_filename)) exit(EXIT_FAILURE);
+
+    std::vector<std::string> key_vec = GetSumEnergyKeys();
+    for (size_t k = 0; k < key_vec.size(); k++) {
+        std::cout << "Caching matrix " << k + 1 << " of " << key_vec.size() << "\r";
+        std::cout.flush();
+
+        TH2D *h = ReadAsHistogram(&in_file, key_vec[k]);
+        if (!h) exit(EXIT_FAILURE);
+        writer.Add(h, key_vec[k]);
+    }
+    std::cout << std::endl;
+    writer.SetSourceHash(Checkpoint::KeyHash({&in_file}, key_vec));
+    in_file.Close();
+
+    if (!writer.Close()) exit(EXIT_FAILURE);
+} // end BuildCacheFile
+
+/************************************************************//**
+ * Exports matrices of the histogram file as NumPy arrays
+ *
+ * Per-index matrices are read in batches and every batch is written
+ * in parallel, followed by all top level angle and single gamma
+ * matrices.
+ *
+ * @param directory output directory
+ ***************************************************************/
+void HistogramManager::ExportNumpy(std::string directory)
+{
+    const int batch_size = 8;
+    TFile in_file(file_man->hist_file_name.c_str(), "READ");
+    NpyExporter exporter(directory);
+    if (!exporter.Open()) exit(EXIT_FAILURE);
+
+    HistogramPool batch_pool(batch_size);
+    std::vector<TH2D*> owned_vec;
+    int num_exported = 0;
+    std::vector<std::string> key_vec = GetSumEnergyKeys();
+    for (size_t k = 0; k < key_vec.size(); k++) {
+        std::cout << "Exporting matrix " << k + 1 << " of " << key_vec.size() << "\r";
+        std::cout.flush();
+
+        const std::string &key_name = key_vec[k];
+        TH2D *h = NULL;
+        if (!HistogramPool::FindKey(&in_file, key_name)) {
+            // e.g. intermediates of another storage format or stage
+            std::cerr << "\nWARNING --- Skipping missing matrix: " << key_name << std::endl;
+        } else if (SparseMatrix<>::IsSparseKey(&in_file, key_name)) {
+            if (sparse_matrix.Read(&in_file, key_name)) h = sparse_matrix.ToHistogram(Form("export_%zu", k));
+            if (h) {
+                h->SetDirectory(0);
+                owned_vec.push_back(h);
+            }
+        } else if (TriangularMatrix<>::IsTriangularKey(&in_file, key_name)) {
+            if (triangular_matrix.Read(&in_file, key_name)) h = triangular_matrix.ToHistogram(Form("export_%zu", k));
+            if (h) {
+                h->SetDirectory(0);
+                owned_vec.push_back(h);
+            }
+        } else {
+            h = batch_pool.Read(&in_file, key_name, k % batch_size);
+        }
+        if (h) {
+            exporter.Add(h, key_name);
+            num_exported++;
+        } else if (HistogramPool::FindKey(&in_file, key_name)) {
+            std::cerr << "\nWARNING --- Skipping matrix that could not be read: " << key_name << std::endl;
+        }
+
+        // pool slots are reused, so write before the batch wraps around
+        if ((k + 1) % batch_size == 0 || k + 1 == key_vec.size()) {
+            if (!exporter.Flush()) exit(EXIT_FAILURE);
+            for (auto owned : owned_vec) delete owned;
+            owned_vec.clear();
+        }
+    }
+    std::cout << std::endl;
+
+    // angle and single gamma matrices live at the top level
+    TList *key_list = in_file.GetListOfKeys();
+    for (auto k = 0; k < key_list->GetSize(); k++) {
+        TKey *key = (TKey*) key_list->At(k);
+        if (std::string(key->GetClassName()).compare("TH2D") != 0) continue;
+        // older cycles of a rewritten matrix are listed as well
+        if (in_file.GetKey(key->GetName()) != key) continue;
+        TH2D *h = (TH2D*) key->ReadObj();
+        h->SetDirectory(0);
+        owned_vec.push_back(h);
+        exporter.Add(h, h->GetName());
+        num_exported++;
+    }
+    if (!exporter.Flush()) exit(EXIT_FAILURE);
+    for (auto owned : owned_vec) delete owned;
+    in_file.Close();
+
+    std::cout << "Exported " << num_exported << " matrices as NumPy arrays to: " << directory << std::endl;
+} // end ExportNumpy
+
+/************************************************************//**
+ * Maps a native cache, matrices found there are not read again
+ *
+ * @param cache_filename cache file written by BuildCacheFile()
+ ***************************************************************/
+void HistogramManager::SetCacheFile(std::string cache_filename)
+{
+    TFile source_file(file_man->hist_file_name.c_str(), "READ");
+    if (!matrix_cache.Open(cache_filename, &source_file)) exit(EXIT_FAILURE);
+    source_file.Close();
+} // end SetCacheFile
+
+/************************************************************//**
+ * Builds angular matrices from the angle x sum x gamma data cube
+ *
+ * The cube is read from cube_filename if it was built from the
+ * current matrices and the same sum energy window, otherwise it is
+ * rebuilt from the room background subtracted matrices and saved.
+ *
+ * @param cube_filename binary data cube file
+ * @param sum_low first sum energy bin kept in the cube (-1 for all)
+ * @param sum_high last sum energy bin kept in the cube (-1 for all)
+ ***************************************************************/
+void HistogramManager::BuildCubeAngularMatrices(std::string cube_filename, int sum_low, int sum_high)
+{
+    int gate_low = 1759;
+    int gate_high = 1765;
+
+    const std::string key_format = "room_background_subtracted/source_%02i";
+    DataCube cube;
+    cube.SetSumRange(sum_low, sum_high);
+    TFile in_file(file_man->hist_file_name.c_str(), "READ");
+    std::string source_hash = DataCube::SourceHash(&in_file, key_format, angle_indices);
+    std::ifstream cube_file(cube_filename);
+    bool found_cube = cube_file.good();
+    cube_file.close();
+    if (found_cube && cube.ReadHeader(cube_filename) && cube.IsBuiltFrom(source_hash)) {
+        in_file.Close();
+        std::cout << "Found data cube: " << cube_filename << std::endl;
+        if (!cube.Read(cube_filename)) exit(EXIT_FAILURE);
+    } else {
+        if (found_cube) {
+            std::cerr << "WARNING --- Data cube " << cube_filename << " holds other matrices or another sum energy window, rebuilding" << std::endl;
+        }
+        if (!cube.LoadFromFile(&in_file, key_format, angle_indices)) exit(EXIT_FAILURE);
+        in_file.Close();
+        std::cout << "Writing data cube: " << cube_filename << std::endl;
+        if (!cube.Write(cube_filename)) {
+            std::cerr << "ERROR --- Could not write data cube: " << cube_filename << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    TFile out_file(file_man->hist_file_name.c_str(), "UPDATE");
+    TH2D *angle_matrix = cube.GetSumAngularMatrix("angle_matrix_cube");
+    angle_matrix->SetTitle("Sum Energy (Room Bg Subtracted);Angular Index [arb.];Energy [keV]");
+    TH2D *gated_angle_matrix = cube.GetGatedAngularMatrix(gate_low, gate_high, "gamma1_matrix_cube");
+    angle_matrix->Write("", TObject::kOverwrite);
+    gated_angle_matrix->Write("", TObject::kOverwrite);
+    out_file.Close();
+
+} // end BuildCubeAngularMatrices
+
+/************************************************************//**
+ * Fits Legendre angular correlations to every gate of a matrix
+ *
+ * Results are written to the tree "angular_correlation_<matrix>".
+ *
+ * @param gates_filename CSV file of gate windows
+ * @param matrix_name angle matrix to fit, e.g. "total_gamma_angle_matrix_room_bg_subtracted"
+ ***************************************************************/
+void HistogramManager::FitAngularCorrelations(std::string gates_filename, std::string matrix_name)
+{
+    AngularCorrelationFitter fitter(angle_combinations_vec);
+    if (!fitter.ReadGates(gates_filename)) exit(EXIT_FAILURE);
+
+    TFile in_file(file_man->hist_file_name.c_str(), "UPDATE");
+    TH2D *angle_matrix = (TH2D*)in_file.Get(matrix_name.c_str());
+    if (!angle_matrix) {
+        std::cerr << "ERROR --- Could not find angle matrix: " << matrix_name << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::cout << "Fitting angular correlations of " << matrix_name << " ..." << std::endl;
+    if (fitter.FitAngleMatrix(angle_matrix)) {
+        fitter.WriteTree(&in_file, Form("angular_correlation_%s", matrix_name.c_str()));
+    }
+    in_file.Close();
+
+} // end FitAngularCorrelations
+
+/************************************************************//**
+ * Fits peak areas in every angular index of the given matrices
+ *
+ * Results are written to the tree "peak_fits".
+ *
+ * @param peaks_filename CSV file of peak definitions
+ * @param matrix_names angle matrices to fit
  ***************************************************************/
-void HistogramManager::PreProcessData()
+void HistogramManager::FitPeakAreas(std::string peaks_filename, std::vector<std::string> matrix_names)
 {
-    for (auto j = 0; j < fGrif->GetSuppressedMultiplicity(fGriffinBgo); ++j) {
-        continue;
+    BatchPeakFitter fitter(angle_indices);
+    if (!fitter.ReadPeaks(peaks_filename)) exit(EXIT_FAILURE);
+
+    TFile in_file(file_man->hist_file_name.c_str(), "UPDATE");
+    std::vector<TH2D*> matrices;
+    for (auto name : matrix_names) {
+        TH2D *angle_matrix = (TH2D*)in_file.Get(name.c_str());
+        if (!angle_matrix) {
+            std::cerr << "ERROR --- Could not find angle matrix: " << name << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        matrices.push_back(angle_matrix);
     }
-} // PreProcessData
+
+    std::cout << "Fitting peaks in " << matrices.size() << " matrices ..." << std::endl;
+    if (!fitter.FitMatrices(matrices)) {
+        in_file.Close();
+        exit(EXIT_FAILURE);
+    }
+    fitter.WriteTree(&in_file, "peak_fits", angle_combinations_vec);
+    in_file.Close();
+
+} // end FitPeakAreas
+
+/************************************************************//**
+ * Scans mixing ratios of every gate against simulated templates
+ *
+ * The template file holds the simulated angle matrices
+ * "template_p0", "template_p2" and "template_p4". Results are written
+ * to the tree "mixing_ratio_scan_<matrix>".
+ *
+ * @param gates_filename CSV file of gate windows
+ * @param template_filename ROOT file of simulated templates
+ * @param coefficients_filename CSV file of a_k(delta) coefficients
+ * @param matrix_name measured angle matrix
+ ***************************************************************/
+void HistogramManager::ScanMixingRatios(std::string gates_filename, std::string template_filename, std::string coefficients_filename, std::string matrix_name)
+{
+    AngularCorrelationFitter gates(angle_combinations_vec);
+    if (!gates.ReadGates(gates_filename)) exit(EXIT_FAILURE);
+    MixingRatioScanner scanner(angle_indices);
+    if (!scanner.ReadCoefficients(coefficients_filename)) exit(EXIT_FAILURE);
+
+    TFile template_file(template_filename.c_str(), "READ");
+    if (!template_file.IsOpen()) {
+        std::cerr << "ERROR --- Could not open template file: " << template_filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::vector<TH2D*> templates;
+    for (auto name : {"template_p0", "template_p2", "template_p4"}) {
+        TH2D *template_matrix = (TH2D*)template_file.Get(name);
+        if (!template_matrix) {
+            std::cerr << "ERROR --- Could not find template: " << name << " in " << template_filename << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        templates.push_back(template_matrix);
+    }
+
+    TFile in_file(file_man->hist_file_name.c_str(), "UPDATE");
+    TH2D *angle_matrix = (TH2D*)in_file.Get(matrix_name.c_str());
+    if (!angle_matrix) {
+        std::cerr << "ERROR --- Could not find angle matrix: " << matrix_name << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    std::cout << "Scanning mixing ratios of " << matrix_name << " ..." << std::endl;
+    if (scanner.Scan(angle_matrix, templates, gates.GetGates())) {
+        scanner.WriteTree(&in_file, Form("mixing_ratio_scan_%s", matrix_name.c_str()));
+    }
+    in_file.Close();
+    template_file.Close();
+
+} // end ScanMixingRatios
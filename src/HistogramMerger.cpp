@@ -0,0 +1,486 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Parallel merging of per-run histogram files
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   HistogramMerger merger(HistogramMerger::ParseFileList("@source_runs.txt"));
+//   merger.Open();
+//   TH2D *h = merger.Merge("prompt_angle/index_00_sum", 0);
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include "csv.h"
+#include "TROOT.h"
+#include "TKey.h"
+#include "TList.h"
+#include "HistogramMerger.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param filenames histogram files to merge
+ * @param slots number of merged matrices held at once
+ * @param threads number of worker threads (0 = all cores)
+ ***************************************************************/
+HistogramMerger::HistogramMerger(std::vector<std::string> filenames, int slots, int threads) : file_name_vec(filenames), num_slots(slots), num_threads(threads), correction_vec(filenames.size())
+{
+    //std::cout << "HistogramMerger initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+HistogramMerger::~HistogramMerger(void)
+{
+    for (auto pool : pool_vec) {
+        delete pool;
+    }
+    for (auto h : accumulator_vec) {
+        delete h;
+    }
+    for (auto file : file_vec) {
+        file->Close();
+        delete file;
+    }
+    //std::cout << "HistogramMerger destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Checks whether an argument names several files
+ *
+ * @param arg command line argument
+ ***************************************************************/
+bool HistogramMerger::IsFileList(std::string arg)
+{
+    if (!arg.empty() && arg[0] == '@') return true;
+
+    // an existing file with a comma in its name is a single file
+    return arg.find(',') != std::string::npos && !std::ifstream(arg).good();
+} // end IsFileList()
+
+/************************************************************//**
+ * Expands a file list argument
+ *
+ * "@runs.txt" reads one file per line (blank lines and lines
+ * starting with '#' are skipped), "a.root,b.root" is split on commas.
+ *
+ * @param arg command line argument
+ ***************************************************************/
+std::vector<std::string> HistogramMerger::ParseFileList(std::string arg)
+{
+    std::vector<std::string> filenames;
+    std::string line;
+    if (!arg.empty() && arg[0] == '@') {
+        std::ifstream list_file(arg.substr(1));
+        if (!list_file.good()) {
+            std::cerr << "ERROR --- Could not open file list: " << arg.substr(1) << std::endl;
+            return filenames;
+        }
+        while (std::getline(list_file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            filenames.push_back(line);
+        }
+    } else {
+        std::istringstream list(arg);
+        while (std::getline(list, line, ',')) {
+            if (!line.empty()) filenames.push_back(line);
+        }
+    }
+
+    return filenames;
+} // end ParseFileList()
+
+/************************************************************//**
+ * Opens every input file and prepares the workers
+ ***************************************************************/
+bool HistogramMerger::Open()
+{
+    if (file_name_vec.empty()) {
+        std::cerr << "ERROR --- No files to merge" << std::endl;
+        return false;
+    }
+    // workers read from separate files concurrently
+    ROOT::EnableThreadSafety();
+
+    for (auto &filename : file_name_vec) {
+        TFile *file = new TFile(filename.c_str(), "READ");
+        if (!file->IsOpen()) {
+            std::cerr << "ERROR --- Could not open file: " << filename << std::endl;
+            delete file;
+            return false;
+        }
+        file_vec.push_back(file);
+    }
+
+    return true;
+} // end Open()
+
+/************************************************************//**
+ * Starts the workers before the first merge
+ *
+ * A worker holds two pool slots and one accumulator per merge slot,
+ * the reproducible mode one more accumulator per slot in total.
+ *
+ * @param key_name first merged matrix, sets the memory per matrix
+ ***************************************************************/
+void HistogramMerger::PrepareWorkers(std::string key_name)
+{
+    int threads = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    if (threads > (int) file_vec.size()) threads = file_vec.size();
+    if (max_memory > 0) {
+        long long matrix_memory = HistogramPool::SlotMemory(file_vec[0], key_name);
+        long long worker_memory = 3 * num_slots * matrix_memory;
+        long long shared_memory = reproducible ? num_slots * matrix_memory : 0;
+        int fitting = worker_memory > 0 ? (max_memory - shared_memory) / worker_memory : threads;
+        if (fitting < 1) {
+            std::cerr << "WARNING --- Merging needs " << (worker_memory + shared_memory) / (1024 * 1024) << " MB, more than the memory limit" << std::endl;
+            fitting = 1;
+        }
+        threads = std::min(threads, fitting);
+    }
+
+    for (auto t = 0; t < threads; t++) {
+        pool_vec.push_back(new HistogramPool(2 * num_slots));
+    }
+    accumulator_vec.assign((threads + 1) * num_slots, NULL);
+    scratch_vec.resize(threads);
+    std::cout << "Merging " << file_vec.size() << " files with " << threads << " threads" << std::endl;
+} // end PrepareWorkers()
+
+/************************************************************//**
+ * Reads linear energy corrections of the runs
+ *
+ * CSV columns: file,offset,gain with E' = offset + gain * E applied
+ * to both axes. Files are matched by path or by file name, files not
+ * listed are merged as they are.
+ *
+ * @param filename gain file
+ ***************************************************************/
+bool HistogramMerger::ReadGainCorrections(std::string filename)
+{
+    std::ifstream gain_file(filename);
+    if (!gain_file.good()) {
+        std::cerr << "ERROR --- Could not open gain file: " << filename << std::endl;
+        return false;
+    }
+    gain_file.close();
+
+    io::CSVReader<3> in(filename);
+    in.read_header(io::ignore_extra_column, "file", "offset", "gain");
+    std::string run_file; double offset, gain;
+    int num_matched = 0;
+    while (in.read_row(run_file, offset, gain)) {
+        for (size_t f = 0; f < file_name_vec.size(); f++) {
+            const std::string &name = file_name_vec[f];
+            size_t split = name.rfind('/');
+            std::string base_name = split == std::string::npos ? name : name.substr(split + 1);
+            if (run_file.compare(name) == 0 || run_file.compare(base_name) == 0) {
+                correction_vec[f] = GainCorrection(offset, gain);
+                std::ostringstream label;
+                label.precision(17);
+                label << name << ":" << offset << ":" << gain << ";";
+                gain_label += label.str();
+                num_matched++;
+            }
+        }
+    }
+    std::cout << "Found gain corrections for " << num_matched << " of " << file_name_vec.size() << " files in: " << filename << std::endl;
+
+    return true;
+} // end ReadGainCorrections()
+
+/************************************************************//**
+ * Merges one matrix of all input files
+ *
+ * Worker t sums files t, t + T, t + 2T, ... into its partial sum,
+ * partial sums are then added pairwise, halving their number every
+ * level. The result stays valid until the next merge into the slot.
+ *
+ * @param key_name full path of the matrix, e.g. "prompt_angle/index_00_sum"
+ * @param slot merge slot
+ ***************************************************************/
+TH2D* HistogramMerger::Merge(std::string key_name, int slot)
+{
+    if (pool_vec.empty()) PrepareWorkers(key_name);
+    if (reproducible) return MergeOrdered(key_name, slot);
+
+    const int workers = pool_vec.size();
+    std::vector<TH2D*> partial_vec(workers, NULL);
+    std::atomic<bool> good(true);
+
+    auto worker = [&](int t) {
+        for (size_t f = t; f < file_vec.size() && good; f += workers) {
+            GainCorrection &correction = correction_vec[f];
+            if (!partial_vec[t] && correction.IsIdentity()) {
+                // first uncorrected file is summed into in place
+                partial_vec[t] = pool_vec[t]->Read(file_vec[f], key_name, 2 * slot);
+                if (!partial_vec[t]) good = false;
+                continue;
+            }
+            TH2D *h = pool_vec[t]->Read(file_vec[f], key_name, 2 * slot + 1);
+            if (!h) {
+                good = false;
+                continue;
+            }
+            if (!partial_vec[t]) partial_vec[t] = ZeroedAccumulator(t, slot, h);
+            if (correction.IsIdentity()) {
+                if (!AddMatrix(partial_vec[t], h)) good = false;
+            } else {
+                if (!correction.AddTo(partial_vec[t], h, scratch_vec[t])) good = false;
+            }
+        }
+    };
+    std::vector<std::thread> thread_vec;
+    for (auto t = 1; t < workers; t++) {
+        thread_vec.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for (auto &t : thread_vec) {
+        t.join();
+    }
+
+    // binary reduction tree, pairs of a level are disjoint
+    for (auto stride = 1; stride < workers && good; stride *= 2) {
+        thread_vec.clear();
+        for (auto t = 0; t + stride < workers; t += 2 * stride) {
+            thread_vec.push_back(std::thread([&, t, stride]() {
+                if (!AddMatrix(partial_vec[t], partial_vec[t + stride])) good = false;
+            }));
+        }
+        for (auto &t : thread_vec) {
+            t.join();
+        }
+    }
+    if (!good) {
+        std::cerr << "\nERROR --- Could not merge: " << key_name << std::endl;
+        return NULL;
+    }
+
+    // bin contents were added directly, statistics are rebuilt once
+    double entries = partial_vec[0]->GetEntries();
+    partial_vec[0]->ResetStats();
+    partial_vec[0]->SetEntries(entries);
+
+    return partial_vec[0];
+} // end Merge()
+
+/************************************************************//**
+ * Merges one matrix of all input files in file order
+ *
+ * Workers read (and gain match) one file each, then add a disjoint
+ * slab of bins of all files of the batch into the sum. Every bin is
+ * summed file by file, bit-identical to a serial merge.
+ *
+ * @param key_name full path of the matrix, e.g. "prompt_angle/index_00_sum"
+ * @param slot merge slot
+ ***************************************************************/
+TH2D* HistogramMerger::MergeOrdered(std::string key_name, int slot)
+{
+    const int workers = pool_vec.size();
+    std::vector<TH2D*> batch_vec(workers, NULL);
+    TH2D *sum = NULL;
+    double entries = 0.;
+    std::atomic<bool> good(true);
+    std::vector<std::thread> thread_vec;
+
+    for (size_t first = 0; first < file_vec.size() && good; first += workers) {
+        const int batch = std::min((size_t) workers, file_vec.size() - first);
+
+        // files of the batch are read concurrently
+        auto reader = [&](int t) {
+            size_t f = first + t;
+            TH2D *h = pool_vec[t]->Read(file_vec[f], key_name, 2 * slot + 1);
+            if (h && !correction_vec[f].IsIdentity()) {
+                TH2D *corrected = ZeroedAccumulator(t, slot, h);
+                if (!correction_vec[f].AddTo(corrected, h, scratch_vec[t])) good = false;
+                h = corrected;
+            }
+            if (!h) good = false;
+            batch_vec[t] = h;
+        };
+        thread_vec.clear();
+        for (auto t = 1; t < batch; t++) {
+            thread_vec.push_back(std::thread(reader, t));
+        }
+        reader(0);
+        for (auto &t : thread_vec) {
+            t.join();
+        }
+        if (!good) break;
+
+        if (!sum) sum = ZeroedAccumulator(workers, slot, batch_vec[0]);
+        for (auto t = 0; t < batch; t++) {
+            if (batch_vec[t]->GetNbinsX() != sum->GetNbinsX() || batch_vec[t]->GetNbinsY() != sum->GetNbinsY()) {
+                std::cerr << "\nERROR --- Binning of " << key_name << " differs between files" << std::endl;
+                good = false;
+            }
+            entries += batch_vec[t]->GetEntries();
+        }
+        if (!good) break;
+
+        // slabs of bins are disjoint, files are added in order within a slab
+        const size_t cells = (size_t) (sum->GetNbinsX() + 2) * (sum->GetNbinsY() + 2);
+        auto adder = [&](int t) {
+            const size_t low = cells * t / workers;
+            const size_t high = cells * (t + 1) / workers;
+            for (auto b = 0; b < batch; b++) {
+                TH2D *h = batch_vec[b];
+                const double *source_sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : h->GetArray();
+                AddArrays(sum->GetSumw2()->GetArray() + low, source_sumw2 + low, high - low);
+                AddArrays(sum->GetArray() + low, h->GetArray() + low, high - low);
+            }
+        };
+        thread_vec.clear();
+        for (auto t = 1; t < workers; t++) {
+            thread_vec.push_back(std::thread(adder, t));
+        }
+        adder(0);
+        for (auto &t : thread_vec) {
+            t.join();
+        }
+    }
+    if (!good || !sum) {
+        std::cerr << "\nERROR --- Could not merge: " << key_name << std::endl;
+        return NULL;
+    }
+
+    sum->ResetStats();
+    sum->SetEntries(entries);
+
+    return sum;
+} // end MergeOrdered()
+
+/************************************************************//**
+ * Empty matrix to sum corrected runs into
+ *
+ * @param worker worker thread
+ * @param slot merge slot
+ * @param like matrix whose binning and name are taken
+ ***************************************************************/
+TH2D* HistogramMerger::ZeroedAccumulator(int worker, int slot, TH2D *like)
+{
+    TH2D *&h = accumulator_vec[worker * num_slots + slot];
+    if (!h) {
+        h = new TH2D();
+        h->SetDirectory(0);
+    }
+    const TAxis *x_axis = like->GetXaxis();
+    const TAxis *y_axis = like->GetYaxis();
+    h->SetBins(x_axis->GetNbins(), x_axis->GetXmin(), x_axis->GetXmax(), y_axis->GetNbins(), y_axis->GetXmin(), y_axis->GetXmax());
+    h->SetName(like->GetName());
+    h->SetTitle(like->GetTitle());
+    h->Reset();
+    if (h->GetSumw2N() == 0) h->Sumw2();
+
+    return h;
+} // end ZeroedAccumulator()
+
+/************************************************************//**
+ * Adds one matrix to another, bin by bin
+ *
+ * @param target matrix added to
+ * @param source matrix to add, binning must match
+ ***************************************************************/
+bool HistogramMerger::AddMatrix(TH2D *target, TH2D *source)
+{
+    if (target->GetNbinsX() != source->GetNbinsX() || target->GetNbinsY() != source->GetNbinsY()) {
+        std::cerr << "\nERROR --- Binning of " << source->GetName() << " differs between files" << std::endl;
+        return false;
+    }
+    const size_t cells = (size_t) (target->GetNbinsX() + 2) * (target->GetNbinsY() + 2);
+
+    if (target->GetSumw2N() == 0 && source->GetSumw2N() > 0) target->Sumw2();
+    if (target->GetSumw2N() > 0) {
+        // unweighted histograms carry Poisson variances
+        const double *source_sumw2 = source->GetSumw2N() > 0 ? source->GetSumw2()->GetArray() : source->GetArray();
+        AddArrays(target->GetSumw2()->GetArray(), source_sumw2, cells);
+    }
+    AddArrays(target->GetArray(), source->GetArray(), cells);
+    target->SetEntries(target->GetEntries() + source->GetEntries());
+
+    return true;
+} // end AddMatrix()
+
+/************************************************************//**
+ * Adds two arrays
+ *
+ * The arrays never alias, so the loop is vectorized by the compiler
+ * at -O3 with the widest instruction set enabled for the build.
+ *
+ * @param target array added to
+ * @param source array to add
+ * @param n number of elements
+ ***************************************************************/
+void HistogramMerger::AddArrays(double * __restrict__ target, const double * __restrict__ source, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        target[i] += source[i];
+    }
+} // end AddArrays()
+
+/************************************************************//**
+ * Merges every matrix of the input files into an output file
+ *
+ * The keys of the first file are merged one at a time, top level
+ * matrices and matrices one directory deep (e.g. prompt_angle/) are
+ * included. Other objects are skipped with a warning.
+ *
+ * @param out_file output file
+ ***************************************************************/
+bool HistogramMerger::Write(TFile *out_file)
+{
+    std::vector<std::string> key_name_vec;
+    std::set<std::string> seen, skipped;
+    TList *key_list = file_vec.at(0)->GetListOfKeys();
+    for (auto k = 0; k < key_list->GetSize(); k++) {
+        TKey *key = (TKey*) key_list->At(k);
+        std::string class_name = key->GetClassName();
+        if (class_name.compare("TH2D") == 0 || class_name.compare("TH2F") == 0) {
+            if (seen.insert(key->GetName()).second) key_name_vec.push_back(key->GetName());
+        } else if (class_name.compare("TDirectoryFile") == 0) {
+            TDirectory *dir = file_vec[0]->GetDirectory(key->GetName());
+            TList *dir_key_list = dir->GetListOfKeys();
+            for (auto d = 0; d < dir_key_list->GetSize(); d++) {
+                TKey *dir_key = (TKey*) dir_key_list->At(d);
+                std::string dir_class_name = dir_key->GetClassName();
+                std::string key_name = std::string(key->GetName()) + "/" + dir_key->GetName();
+                if (dir_class_name.compare("TH2D") == 0 || dir_class_name.compare("TH2F") == 0) {
+                    if (seen.insert(key_name).second) key_name_vec.push_back(key_name);
+                } else if (skipped.insert(key_name).second) {
+                    std::cerr << "WARNING --- Not merged, only matrices are: " << key_name << " (" << dir_class_name << ")" << std::endl;
+                }
+            }
+        } else if (skipped.insert(key->GetName()).second) {
+            std::cerr << "WARNING --- Not merged, only matrices are: " << key->GetName() << " (" << class_name << ")" << std::endl;
+        }
+    }
+
+    for (size_t k = 0; k < key_name_vec.size(); k++) {
+        std::cout << "Merging matrix " << k + 1 << " of " << key_name_vec.size() << "\r";
+        std::cout.flush();
+
+        const std::string &key_name = key_name_vec[k];
+        TH2D *h = Merge(key_name, 0);
+        if (!h) return false;
+
+        size_t split = key_name.rfind('/');
+        TDirectory *target_dir = out_file;
+        if (split != std::string::npos) {
+            std::string dir_name = key_name.substr(0, split);
+            target_dir = out_file->GetDirectory(dir_name.c_str());
+            if (!target_dir) target_dir = out_file->mkdir(dir_name.c_str());
+        }
+        target_dir->WriteTObject(h, key_name.substr(split + 1).c_str());
+    }
+    std::cout << std::endl;
+
+    return true;
+} // end Write()
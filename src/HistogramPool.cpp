@@ -0,0 +1,202 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Reads matrices into preallocated histograms
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   HistogramPool pool(2);
+//   TH2D *h = pool.Read(file, "prompt_angle/index_00_sum", 0);
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include "TBufferFile.h"
+#include "RZip.h"
+#include "HistogramPool.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param slots number of matrices held at once
+ ***************************************************************/
+HistogramPool::HistogramPool(int slots) : hist_vec(slots, NULL), float_hist_vec(slots, NULL)
+{
+    //std::cout << "HistogramPool initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+HistogramPool::~HistogramPool(void)
+{
+    for (auto h : hist_vec) {
+        delete h;
+    }
+    for (auto h : float_hist_vec) {
+        delete h;
+    }
+} // end Destructor
+
+/************************************************************//**
+ * Reads a matrix into a pool slot
+ *
+ * The returned histogram stays valid until the next read into the
+ * same slot. Single precision (TH2F) matrices are streamed into a
+ * TH2F of the slot and widened into its TH2D.
+ *
+ * @param in_file file containing the matrix
+ * @param key_name full path of the matrix, e.g. "prompt_angle/index_00_sum"
+ * @param slot pool slot to read into
+ ***************************************************************/
+TH2D* HistogramPool::Read(TFile *in_file, std::string key_name, int slot)
+{
+    TKey *key = FindKey(in_file, key_name);
+    if (!key) {
+        std::cerr << "\nERROR --- Could not find key: " << key_name << " in " << in_file->GetName() << std::endl;
+        return NULL;
+    }
+
+    if (!hist_vec.at(slot)) {
+        hist_vec[slot] = new TH2D();
+        hist_vec[slot]->SetDirectory(0);
+    }
+    bool single_precision = std::string(key->GetClassName()).compare("TH2F") == 0;
+    if (single_precision && !float_hist_vec[slot]) {
+        float_hist_vec[slot] = new TH2F();
+        float_hist_vec[slot]->SetDirectory(0);
+    }
+
+    Int_t key_length = key->GetKeylen();
+    Int_t data_length = key->GetNbytes() - key_length;
+    Int_t object_length = key->GetObjlen();
+
+    // buffers only ever grow, steady state reads allocate nothing
+    if ((Int_t) object_buffer.size() < key_length + object_length) object_buffer.resize(key_length + object_length);
+    if ((Int_t) compressed_buffer.size() < key->GetNbytes()) compressed_buffer.resize(key->GetNbytes());
+
+    // TFile::ReadBuffer returns true on failure
+    if (in_file->ReadBuffer(compressed_buffer.data(), key->GetSeekKey(), key->GetNbytes())) {
+        std::cerr << "\nERROR --- Could not read key: " << key_name << std::endl;
+        return NULL;
+    }
+
+    if (object_length > data_length) {
+        // payload is split into compressed blocks of at most 16 MB each
+        unsigned char *block = (unsigned char*) &compressed_buffer[key_length];
+        unsigned char *target = (unsigned char*) &object_buffer[key_length];
+        int total_out = 0;
+        while (total_out < object_length) {
+            int block_in, block_out;
+            if (R__unzip_header(&block_in, block, &block_out) != 0) break;
+            int n_out = 0;
+            R__unzip(&block_in, block, &block_out, target, &n_out);
+            if (!n_out) break;
+            total_out += n_out;
+            block += block_in;
+            target += n_out;
+        }
+        if (total_out != object_length) {
+            std::cerr << "\nERROR --- Could not decompress key: " << key_name << std::endl;
+            return NULL;
+        }
+    } else {
+        std::copy(compressed_buffer.begin() + key_length, compressed_buffer.begin() + key_length + object_length, object_buffer.begin() + key_length);
+    }
+
+    // stream the object into the existing histogram, the buffer is not adopted
+    TBufferFile buffer(TBuffer::kRead, key_length + object_length, object_buffer.data(), kFALSE);
+    buffer.SetParent(in_file);
+    buffer.SetBufferOffset(key_length);
+    if (single_precision) {
+        float_hist_vec[slot]->Streamer(buffer);
+        float_hist_vec[slot]->SetDirectory(0);
+        Widen(float_hist_vec[slot], hist_vec[slot]);
+    } else {
+        hist_vec[slot]->Streamer(buffer);
+        hist_vec[slot]->SetDirectory(0);
+    }
+
+    return hist_vec[slot];
+} // end Read()
+
+/************************************************************//**
+ * Frees the matrices of a slot, the next read reallocates them
+ *
+ * @param slot pool slot to free
+ ***************************************************************/
+void HistogramPool::Release(int slot)
+{
+    delete hist_vec.at(slot);
+    delete float_hist_vec.at(slot);
+    hist_vec[slot] = NULL;
+    float_hist_vec[slot] = NULL;
+} // end Release()
+
+/************************************************************//**
+ * Copies a single precision matrix into a double precision one
+ *
+ * @param source single precision matrix
+ * @param target double precision matrix, rebinned if needed
+ ***************************************************************/
+void HistogramPool::Widen(TH2F *source, TH2D *target)
+{
+    const TAxis *x_axis = source->GetXaxis();
+    const TAxis *y_axis = source->GetYaxis();
+    target->SetBins(x_axis->GetNbins(), x_axis->GetXmin(), x_axis->GetXmax(), y_axis->GetNbins(), y_axis->GetXmin(), y_axis->GetXmax());
+    target->SetName(source->GetName());
+    target->SetTitle(source->GetTitle());
+    if (target->GetSumw2N() == 0) target->Sumw2();
+
+    const int cells = (x_axis->GetNbins() + 2) * (y_axis->GetNbins() + 2);
+    const float *content = source->GetArray();
+    const bool has_errors = source->GetSumw2N() > 0;
+    double *target_content = target->GetArray();
+    double *target_sumw2 = target->GetSumw2()->GetArray();
+    for (auto bin = 0; bin < cells; bin++) {
+        target_content[bin] = content[bin];
+        target_sumw2[bin] = has_errors ? source->GetSumw2()->GetArray()[bin] : content[bin];
+    }
+    target->SetEntries(source->GetEntries());
+} // end Widen()
+
+/************************************************************//**
+ * Looks up key of a matrix, following sub-directories
+ *
+ * @param in_file file containing the matrix
+ * @param key_name full path of the matrix
+ ***************************************************************/
+TKey* HistogramPool::FindKey(TFile *in_file, std::string key_name)
+{
+    size_t split = key_name.rfind('/');
+    if (split == std::string::npos) {
+        return in_file->GetKey(key_name.c_str());
+    }
+
+    TDirectory *dir = in_file->GetDirectory(key_name.substr(0, split).c_str());
+    if (!dir) return NULL;
+
+    return dir->GetKey(key_name.substr(split + 1).c_str());
+} // end FindKey()
+
+/************************************************************//**
+ * Memory a matrix takes once read into a pool slot
+ *
+ * The streamed size of a histogram is dominated by its content and
+ * sumw2 arrays, so it is taken from the key without reading it.
+ * Single precision matrices are held as TH2F and widened TH2D.
+ *
+ * @param in_file file containing the matrix
+ * @param key_name full path of the matrix
+ ***************************************************************/
+long long HistogramPool::SlotMemory(TFile *in_file, std::string key_name)
+{
+    TKey *key = FindKey(in_file, key_name);
+    if (!key) return 0;
+    long long object_length = key->GetObjlen();
+    std::string class_name = key->GetClassName();
+    if (class_name.compare("TH2F") == 0) {
+        // 4 + 8 bytes per cell streamed, another 16 once widened
+        return object_length + object_length * 16 / 12;
+    }
+
+    return object_length;
+} // end SlotMemory()
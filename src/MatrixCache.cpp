@@ -0,0 +1,311 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Memory-mapped native cache of sum energy matrices
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   MatrixCacheWriter writer;
+//   writer.Open("matrices.cache");
+//   writer.Add(h, "room_background_subtracted/source_00");
+//   writer.SetSourceHash(Checkpoint::KeyHash({hist_file}, key_vec));
+//   writer.Close();
+//
+//   MatrixCache cache;
+//   cache.Open("matrices.cache", hist_file);
+//   const MatrixView *view = cache.Find("room_background_subtracted/source_00");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Checkpoint.h"
+#include "MatrixCache.h"
+
+const char cache_magic[8] = {'S', 'P', 'C', 'A', 'C', 'H', 'E', '2'};
+const size_t cache_alignment = 64;
+
+struct CacheFileHeader {
+    char magic[8];
+    unsigned long long index_offset;
+    int num_matrices;
+    int reserved;
+    char source_hash[24]; // key hash of the matrices in the histogram file
+};
+
+/************************************************************//**
+ * Constructor
+ ***************************************************************/
+MatrixCacheWriter::MatrixCacheWriter()
+{
+    //std::cout << "MatrixCacheWriter initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+MatrixCacheWriter::~MatrixCacheWriter(void)
+{
+    if (out.is_open()) Close();
+    //std::cout << "MatrixCacheWriter destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Creates a cache file
+ *
+ * @param filename cache file
+ ***************************************************************/
+bool MatrixCacheWriter::Open(std::string filename)
+{
+    out.open(filename, std::ios::binary | std::ios::trunc);
+    if (!out.good()) {
+        std::cerr << "ERROR --- Could not open cache file: " << filename << std::endl;
+        return false;
+    }
+
+    // header is rewritten with the index position on Close()
+    CacheFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    name_vec.clear();
+    view_vec.clear();
+    offset_vec.clear();
+
+    return out.good();
+} // end Open()
+
+/************************************************************//**
+ * Pads the file to the next boundary and writes an array
+ *
+ * @param data array
+ * @param n number of elements
+ ***************************************************************/
+unsigned long long MatrixCacheWriter::WriteAligned(const double *data, size_t n)
+{
+    unsigned long long position = out.tellp();
+    static const char padding[cache_alignment] = {0};
+    size_t pad = (cache_alignment - position % cache_alignment) % cache_alignment;
+    out.write(padding, pad);
+    out.write(reinterpret_cast<const char*>(data), n * sizeof(double));
+
+    return position + pad;
+} // end WriteAligned()
+
+/************************************************************//**
+ * Appends a matrix and its sum energy projection
+ *
+ * @param h sum energy (x) vs gamma energy (y) matrix
+ * @param name key of the matrix in the cache
+ ***************************************************************/
+void MatrixCacheWriter::Add(TH2D *h, std::string name)
+{
+    MatrixView view;
+    view.x_bins = h->GetXaxis()->GetNbins();
+    view.x_min = h->GetXaxis()->GetXmin();
+    view.x_max = h->GetXaxis()->GetXmax();
+    view.y_bins = h->GetYaxis()->GetNbins();
+    view.y_min = h->GetYaxis()->GetXmin();
+    view.y_max = h->GetYaxis()->GetXmax();
+
+    const int row_length = view.x_bins + 2;
+    const int rows = view.y_bins + 2;
+    const double *content = h->GetArray();
+    const double *sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : content;
+
+    projection_vec.assign(row_length, 0.);
+    projection_error2_vec.assign(row_length, 0.);
+    for (auto y_bin = 0; y_bin < rows; y_bin++) {
+        for (auto x_bin = 0; x_bin < row_length; x_bin++) {
+            projection_vec[x_bin] += content[x_bin + y_bin * row_length];
+            projection_error2_vec[x_bin] += sumw2[x_bin + y_bin * row_length];
+        }
+    }
+
+    offset_vec.push_back(WriteAligned(content, (size_t) row_length * rows));
+    offset_vec.push_back(WriteAligned(sumw2, (size_t) row_length * rows));
+    offset_vec.push_back(WriteAligned(projection_vec.data(), row_length));
+    offset_vec.push_back(WriteAligned(projection_error2_vec.data(), row_length));
+    name_vec.push_back(name);
+    view_vec.push_back(view);
+} // end Add()
+
+/************************************************************//**
+ * Writes the index and closes the file
+ ***************************************************************/
+bool MatrixCacheWriter::Close()
+{
+    CacheFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.index_offset = out.tellp();
+    header.num_matrices = view_vec.size();
+    std::strncpy(header.source_hash, source_hash.c_str(), sizeof(header.source_hash) - 1);
+
+    for (size_t m = 0; m < view_vec.size(); m++) {
+        const MatrixView &view = view_vec[m];
+        int name_length = name_vec[m].size();
+        out.write(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
+        out.write(name_vec[m].c_str(), name_length);
+        out.write(reinterpret_cast<const char*>(&view.x_bins), sizeof(view.x_bins));
+        out.write(reinterpret_cast<const char*>(&view.x_min), sizeof(view.x_min));
+        out.write(reinterpret_cast<const char*>(&view.x_max), sizeof(view.x_max));
+        out.write(reinterpret_cast<const char*>(&view.y_bins), sizeof(view.y_bins));
+        out.write(reinterpret_cast<const char*>(&view.y_min), sizeof(view.y_min));
+        out.write(reinterpret_cast<const char*>(&view.y_max), sizeof(view.y_max));
+        out.write(reinterpret_cast<const char*>(&offset_vec[4 * m]), 4 * sizeof(unsigned long long));
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    bool good = out.good();
+    out.close();
+    if (!good) {
+        std::cerr << "ERROR --- Could not write cache file" << std::endl;
+    }
+
+    return good;
+} // end Close()
+
+/************************************************************//**
+ * Constructor
+ ***************************************************************/
+MatrixCache::MatrixCache()
+{
+    //std::cout << "MatrixCache initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+MatrixCache::~MatrixCache(void)
+{
+    Close();
+    //std::cout << "MatrixCache destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Maps a cache file and reads its index
+ *
+ * Every array of the index must lie inside the file, and the
+ * cached matrices must be unchanged in the histogram file.
+ *
+ * @param filename cache file
+ * @param source_file histogram file the cache stands in for
+ ***************************************************************/
+bool MatrixCache::Open(std::string filename, TFile *source_file)
+{
+    Close();
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "ERROR --- Could not open cache file: " << filename << std::endl;
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t) file_stat.st_size < sizeof(CacheFileHeader)) {
+        std::cerr << "ERROR --- Not a cache file: " << filename << std::endl;
+        close(fd);
+        return false;
+    }
+    mapped_size = file_stat.st_size;
+    mapped = mmap(NULL, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "ERROR --- Could not map cache file: " << filename << std::endl;
+        mapped = NULL;
+        return false;
+    }
+
+    const char *base = static_cast<const char*>(mapped);
+    CacheFileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.index_offset > mapped_size || header.num_matrices < 0) {
+        std::cerr << "ERROR --- Not a cache file: " << filename << std::endl;
+        Close();
+        return false;
+    }
+    header.source_hash[sizeof(header.source_hash) - 1] = '\0';
+
+    // an array of n doubles at offset lies inside the mapped file
+    auto in_file = [&](unsigned long long offset, unsigned long long n) {
+        return offset % sizeof(double) == 0 && offset <= mapped_size && n <= (mapped_size - offset) / sizeof(double);
+    };
+
+    const char *index = base + header.index_offset;
+    const char *end = base + mapped_size;
+    std::vector<std::string> name_vec;
+    for (auto m = 0; m < header.num_matrices; m++) {
+        int name_length = 0;
+        if (index + sizeof(int) > end) break;
+        std::memcpy(&name_length, index, sizeof(int));
+        index += sizeof(int);
+        if (name_length < 0 || name_length > end - index) break;
+        std::string name(index, name_length);
+        index += name_length;
+
+        MatrixView view;
+        unsigned long long offsets[4];
+        const size_t record = 2 * sizeof(int) + 4 * sizeof(double) + sizeof(offsets);
+        if (index + record > end) break;
+        std::memcpy(&view.x_bins, index, sizeof(int)); index += sizeof(int);
+        std::memcpy(&view.x_min, index, sizeof(double)); index += sizeof(double);
+        std::memcpy(&view.x_max, index, sizeof(double)); index += sizeof(double);
+        std::memcpy(&view.y_bins, index, sizeof(int)); index += sizeof(int);
+        std::memcpy(&view.y_min, index, sizeof(double)); index += sizeof(double);
+        std::memcpy(&view.y_max, index, sizeof(double)); index += sizeof(double);
+        std::memcpy(offsets, index, sizeof(offsets)); index += sizeof(offsets);
+
+        if (view.x_bins <= 0 || view.y_bins <= 0) break;
+        const unsigned long long row_length = view.x_bins + 2ULL;
+        const unsigned long long rows = view.y_bins + 2ULL;
+        if (rows > mapped_size / row_length) break;
+        if (!in_file(offsets[0], row_length * rows) || !in_file(offsets[1], row_length * rows)) break;
+        if (!in_file(offsets[2], row_length) || !in_file(offsets[3], row_length)) break;
+
+        view.content = reinterpret_cast<const double*>(base + offsets[0]);
+        view.sumw2 = reinterpret_cast<const double*>(base + offsets[1]);
+        view.projection_x = reinterpret_cast<const double*>(base + offsets[2]);
+        view.projection_x_error2 = reinterpret_cast<const double*>(base + offsets[3]);
+        view_map[name] = view;
+        name_vec.push_back(name);
+    }
+    if ((int) view_map.size() != header.num_matrices) {
+        std::cerr << "ERROR --- Truncated or corrupt cache file index: " << filename << std::endl;
+        Close();
+        return false;
+    }
+    if (Checkpoint::KeyHash({source_file}, name_vec).compare(header.source_hash) != 0) {
+        std::cerr << "ERROR --- Matrices of " << source_file->GetName() << " changed since " << filename << " was built, rebuild the cache" << std::endl;
+        Close();
+        return false;
+    }
+    std::cout << "Mapped " << view_map.size() << " cached matrices from: " << filename << std::endl;
+
+    return true;
+} // end Open()
+
+/************************************************************//**
+ * Unmaps the cache file, invalidating every view
+ ***************************************************************/
+void MatrixCache::Close()
+{
+    if (mapped) munmap(mapped, mapped_size);
+    mapped = NULL;
+    mapped_size = 0;
+    view_map.clear();
+} // end Close()
+
+/************************************************************//**
+ * Looks up a matrix
+ *
+ * @param name key of the matrix
+ ***************************************************************/
+const MatrixView* MatrixCache::Find(std::string name) const
+{
+    auto it = view_map.find(name);
+    if (it == view_map.end()) return NULL;
+
+    return &it->second;
+} // end Find()
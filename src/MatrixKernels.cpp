@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Projection loops over dense matrix arrays
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   MatrixKernels::ProjectX(h->GetArray(), h->GetSumw2()->GetArray(), nx, ny, proj, err2);
+//////////////////////////////////////////////////////////////////////////////////
+#include "MatrixKernels.h"
+
+/************************************************************//**
+ * Projects out X axis (sum energy)
+ *
+ * Same bins as TH2::ProjectionX, including under/overflow of the
+ * gamma axis. Rows are summed in order, y = 0 first.
+ *
+ * @param content bin contents
+ * @param sumw2 squared bin errors
+ * @param x_bins number of x bins, without under/overflow
+ * @param y_bins number of y bins, without under/overflow
+ * @param projection projected content per x bin (output)
+ * @param error2 projected squared errors per x bin (output)
+ ***************************************************************/
+void MatrixKernels::ProjectX(const double *content, const double *sumw2, int x_bins, int y_bins, std::vector<double> &projection, std::vector<double> &error2)
+{
+    const int row_length = x_bins + 2;
+    const int rows = y_bins + 2;
+
+    projection.assign(row_length, 0.);
+    error2.assign(row_length, 0.);
+    for (auto y_bin = 0; y_bin < rows; y_bin++) {
+        const double *c = content + y_bin * row_length;
+        const double *e = sumw2 + y_bin * row_length;
+        for (auto x_bin = 0; x_bin < row_length; x_bin++) {
+            projection[x_bin] += c[x_bin];
+            error2[x_bin] += e[x_bin];
+        }
+    }
+} // end ProjectX()
+
+/************************************************************//**
+ * Gates on sum energy and projects out Y axis
+ *
+ * Same bins as TH2::ProjectionY(name, x_low, x_high).
+ *
+ * @param content bin contents
+ * @param sumw2 squared bin errors
+ * @param x_bins number of x bins, without under/overflow
+ * @param y_bins number of y bins, without under/overflow
+ * @param x_low first sum energy bin of gate
+ * @param x_high last sum energy bin of gate
+ * @param projection projected content per y bin (output)
+ * @param error2 projected squared errors per y bin (output)
+ ***************************************************************/
+void MatrixKernels::ProjectY(const double *content, const double *sumw2, int x_bins, int y_bins, int x_low, int x_high, std::vector<double> &projection, std::vector<double> &error2)
+{
+    const int row_length = x_bins + 2;
+    const int rows = y_bins + 2;
+
+    projection.assign(rows, 0.);
+    error2.assign(rows, 0.);
+    for (auto y_bin = 0; y_bin < rows; y_bin++) {
+        const double *c = content + y_bin * row_length;
+        const double *e = sumw2 + y_bin * row_length;
+        for (auto x_bin = x_low; x_bin <= x_high; x_bin++) {
+            projection[y_bin] += c[x_bin];
+            error2[y_bin] += e[x_bin];
+        }
+    }
+} // end ProjectY()
+
@@ -0,0 +1,318 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Mixing ratio chi2 scan against simulated angular distributions
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   MixingRatioScanner scanner;
+//   scanner.ReadCoefficients("mixing_coefficients.csv");
+//   scanner.Scan(data_matrix, {z0, z2, z4}, gates);
+//   scanner.WriteTree(out_file, "mixing_ratio_scan");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <thread>
+#include "csv.h"
+#include "TMath.h"
+#include "TTree.h"
+#include "MixingRatioScanner.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param indices number of angular indices
+ ***************************************************************/
+MixingRatioScanner::MixingRatioScanner(int indices) : angle_indices(indices)
+{
+    //std::cout << "MixingRatioScanner initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+MixingRatioScanner::~MixingRatioScanner(void)
+{
+    //std::cout << "MixingRatioScanner destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Reads a_k(delta) coefficients of the cascade
+ *
+ * CSV columns: k,c0,c1,c2 with one row each for k = 2 and k = 4,
+ * a_k(delta) = (c0 + c1 delta + c2 delta^2) / (1 + delta^2)
+ *
+ * @param filename coefficient file
+ ***************************************************************/
+bool MixingRatioScanner::ReadCoefficients(std::string filename)
+{
+    std::ifstream coeff_file(filename);
+    if (!coeff_file.good()) {
+        std::cerr << "ERROR --- Could not open coefficient file: " << filename << std::endl;
+        return false;
+    }
+    coeff_file.close();
+
+    io::CSVReader<4> in(filename);
+    in.read_header(io::ignore_extra_column, "k", "c0", "c1", "c2");
+    int k; double c0, c1, c2;
+    bool found_a2 = false, found_a4 = false;
+    while (in.read_row(k, c0, c1, c2)) {
+        if (k == 2) {
+            a2_coeff[0] = c0; a2_coeff[1] = c1; a2_coeff[2] = c2;
+            found_a2 = true;
+        } else if (k == 4) {
+            a4_coeff[0] = c0; a4_coeff[1] = c1; a4_coeff[2] = c2;
+            found_a4 = true;
+        }
+    }
+    if (!found_a2 || !found_a4) {
+        std::cerr << "ERROR --- Coefficient file needs rows for k = 2 and k = 4: " << filename << std::endl;
+        return false;
+    }
+
+    return true;
+} // end ReadCoefficients()
+
+/************************************************************//**
+ * Scans every gate of a measured angle matrix
+ *
+ * @param data_matrix measured angle matrix
+ * @param templates simulated Z0, Z2 and Z4 angle matrices
+ * @param gates energy windows
+ ***************************************************************/
+bool MixingRatioScanner::Scan(TH2D *data_matrix, std::vector<TH2D*> templates, const std::vector<PeakGate> &gates)
+{
+    if (templates.size() != 3) {
+        std::cerr << "ERROR --- Expected Z0, Z2 and Z4 templates, found " << templates.size() << std::endl;
+        return false;
+    }
+    if (gates.empty()) {
+        std::cerr << "ERROR --- No gates defined" << std::endl;
+        return false;
+    }
+    gate_vec = gates;
+    BuildDeltaGrid();
+
+    // one pass through each matrix, gate windows are lookups afterwards
+    std::vector<double> no_angles(angle_indices, 0.);
+    AngularCorrelationFitter data_counts(no_angles);
+    data_counts.ExtractPeakCounts(data_matrix);
+    std::vector<AngularCorrelationFitter> template_counts(3, AngularCorrelationFitter(no_angles));
+    for (auto k = 0; k < 3; k++) {
+        template_counts[k].ExtractPeakCounts(templates[k]);
+    }
+
+    result_vec.assign(gate_vec.size(), MixingRatioResult());
+    unsigned int threads = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    if (threads > gate_vec.size()) threads = gate_vec.size();
+
+    auto worker = [&](unsigned int thread_id) {
+        std::vector<double> counts, errors2, basis[3], basis_errors2;
+        for (auto g = thread_id; g < gate_vec.size(); g += threads) {
+            data_counts.ExtractGateCounts(gate_vec[g], counts, errors2);
+            for (auto k = 0; k < 3; k++) {
+                template_counts[k].ExtractGateCounts(gate_vec[g], basis[k], basis_errors2);
+            }
+            ScanGate(counts, errors2, basis, result_vec[g]);
+        }
+    };
+
+    std::vector<std::thread> thread_vec;
+    for (unsigned int t = 1; t < threads; t++) {
+        thread_vec.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for (auto &t : thread_vec) {
+        t.join();
+    }
+
+    int n_valid = 0;
+    for (auto &result : result_vec) {
+        if (result.valid) n_valid++;
+    }
+    std::cout << "Scanned " << n_valid << " of " << result_vec.size() << " gates over " << num_steps << " mixing ratios" << std::endl;
+
+    return true;
+} // end Scan()
+
+/************************************************************//**
+ * Builds the delta grid and a_k(delta) tables
+ *
+ * The grid is uniform in arctan(delta) over [-90, 90] degrees.
+ ***************************************************************/
+void MixingRatioScanner::BuildDeltaGrid()
+{
+    if (num_steps < 2) num_steps = 2;
+    atan_delta_vec.resize(num_steps);
+    delta_vec.resize(num_steps);
+    a2_vec.resize(num_steps);
+    a4_vec.resize(num_steps);
+
+    for (auto s = 0; s < num_steps; s++) {
+        double atan_delta = -90. + 180. * s / (num_steps - 1);
+        // tan(+-90 deg) is only reached as a limit, 1e10 is pure L+1
+        double delta = std::abs(atan_delta) >= 90. ? (atan_delta > 0 ? 1e10 : -1e10) : std::tan(atan_delta * TMath::Pi() / 180.);
+        double norm = 1. / (1. + delta * delta);
+        atan_delta_vec[s] = atan_delta;
+        delta_vec[s] = delta;
+        a2_vec[s] = (a2_coeff[0] + a2_coeff[1] * delta + a2_coeff[2] * delta * delta) * norm;
+        a4_vec[s] = (a4_coeff[0] + a4_coeff[1] * delta + a4_coeff[2] * delta * delta) * norm;
+    }
+} // end BuildDeltaGrid()
+
+/************************************************************//**
+ * Chi2 of every delta step for one gate
+ *
+ * chi2(delta) = S_yy - (y.T)^2 / (T.T) with the normalisation of
+ * T(delta) profiled out analytically.
+ *
+ * @param counts measured counts per index
+ * @param errors2 measured squared errors per index
+ * @param basis simulated Z0, Z2 and Z4 counts per index
+ * @param result scan result (output)
+ ***************************************************************/
+void MixingRatioScanner::ScanGate(const std::vector<double> &counts, const std::vector<double> &errors2, const std::vector<double> basis[3], MixingRatioResult &result)
+{
+    // weighted inner products, the only place the indices are visited
+    double s_yy = 0.;
+    double y_z[3] = {0., 0., 0.};
+    double z_z[3][3] = {{0., 0., 0.}, {0., 0., 0.}, {0., 0., 0.}};
+    int n_points = 0;
+    for (auto i = 0; i < angle_indices; i++) {
+        if (errors2[i] <= 0.) continue;
+        double w = 1. / errors2[i];
+        s_yy += w * counts[i] * counts[i];
+        for (auto k = 0; k < 3; k++) {
+            y_z[k] += w * counts[i] * basis[k][i];
+            for (auto l = k; l < 3; l++) {
+                z_z[k][l] += w * basis[k][i] * basis[l][i];
+            }
+        }
+        n_points++;
+    }
+    result.valid = false;
+    result.chi2_vec.resize(num_steps);
+    if (n_points < 2) return;
+
+    const double *a2 = a2_vec.data();
+    const double *a4 = a4_vec.data();
+    double *chi2 = result.chi2_vec.data();
+    const double yz0 = y_z[0], yz2 = y_z[1], yz4 = y_z[2];
+    const double zz00 = z_z[0][0], zz02 = z_z[0][1], zz04 = z_z[0][2];
+    const double zz22 = z_z[1][1], zz24 = z_z[1][2], zz44 = z_z[2][2];
+    const int steps = num_steps;
+
+    // branch free so the loop vectorizes
+    for (auto s = 0; s < steps; s++) {
+        double yt = yz0 + a2[s] * yz2 + a4[s] * yz4;
+        double tt = zz00 + a2[s] * a2[s] * zz22 + a4[s] * a4[s] * zz44 + 2. * (a2[s] * zz02 + a4[s] * zz04 + a2[s] * a4[s] * zz24);
+        chi2[s] = s_yy - yt * yt / tt;
+    }
+
+    result.ndf = n_points - 2;
+    int s = FindMinimum(result);
+    if (s < 0) return;
+
+    // normalisation at the minimum
+    double yt = yz0 + a2[s] * yz2 + a4[s] * yz4;
+    double tt = zz00 + a2[s] * a2[s] * zz22 + a4[s] * a4[s] * zz44 + 2. * (a2[s] * zz02 + a4[s] * zz04 + a2[s] * a4[s] * zz24);
+    result.scale = tt > 0. ? yt / tt : 0.;
+} // end ScanGate()
+
+/************************************************************//**
+ * Global minimum and 1 sigma (chi2_min + 1) interval of a scan
+ *
+ * The interval edges are interpolated linearly between grid points.
+ * Returns the grid step of the minimum, -1 if the scan is empty.
+ ***************************************************************/
+int MixingRatioScanner::FindMinimum(MixingRatioResult &result)
+{
+    const std::vector<double> &chi2 = result.chi2_vec;
+    int best = -1;
+    for (auto s = 0; s < num_steps; s++) {
+        if (!std::isfinite(chi2[s])) continue;
+        if (best < 0 || chi2[s] < chi2[best]) best = s;
+    }
+    if (best < 0) return best;
+
+    double limit = chi2[best] + 1.;
+    int low = best;
+    while (low > 0 && std::isfinite(chi2[low - 1]) && chi2[low - 1] <= limit) low--;
+    int high = best;
+    while (high < num_steps - 1 && std::isfinite(chi2[high + 1]) && chi2[high + 1] <= limit) high++;
+
+    double atan_low = atan_delta_vec[low];
+    if (low > 0 && std::isfinite(chi2[low - 1])) {
+        double f = (limit - chi2[low]) / (chi2[low - 1] - chi2[low]);
+        atan_low -= f * (atan_delta_vec[low] - atan_delta_vec[low - 1]);
+    }
+    double atan_high = atan_delta_vec[high];
+    if (high < num_steps - 1 && std::isfinite(chi2[high + 1])) {
+        double f = (limit - chi2[high]) / (chi2[high + 1] - chi2[high]);
+        atan_high += f * (atan_delta_vec[high + 1] - atan_delta_vec[high]);
+    }
+
+    result.atan_delta_min = atan_delta_vec[best];
+    result.delta_min = delta_vec[best];
+    result.delta_low = std::tan(atan_low * TMath::Pi() / 180.);
+    result.delta_high = std::tan(atan_high * TMath::Pi() / 180.);
+    result.chi2_min = chi2[best];
+    result.valid = true;
+
+    return best;
+} // end FindMinimum()
+
+/************************************************************//**
+ * Writes scan results of all gates to a tree
+ *
+ * The chi2 curve of every gate is stored on the arctan(delta) grid
+ * running from -90 to 90 degrees in n_steps points.
+ *
+ * @param out_file output file
+ * @param tree_name name of tree
+ ***************************************************************/
+void MixingRatioScanner::WriteTree(TFile *out_file, std::string tree_name)
+{
+    out_file->cd();
+    TTree *tree = new TTree(tree_name.c_str(), "Mixing ratio chi2 scans, atan(delta) grid [-90, 90] deg");
+
+    int gate_id, n_steps = num_steps, ndf, valid;
+    double peak_low, peak_high, delta_min, delta_low, delta_high, atan_delta_min, chi2_min, scale;
+    std::vector<double> chi2(num_steps);
+
+    tree->Branch("gate", &gate_id, "gate/I");
+    tree->Branch("peak_low", &peak_low, "peak_low/D");
+    tree->Branch("peak_high", &peak_high, "peak_high/D");
+    tree->Branch("delta_min", &delta_min, "delta_min/D");
+    tree->Branch("delta_low", &delta_low, "delta_low/D");
+    tree->Branch("delta_high", &delta_high, "delta_high/D");
+    tree->Branch("atan_delta_min", &atan_delta_min, "atan_delta_min/D");
+    tree->Branch("chi2_min", &chi2_min, "chi2_min/D");
+    tree->Branch("scale", &scale, "scale/D");
+    tree->Branch("ndf", &ndf, "ndf/I");
+    tree->Branch("valid", &valid, "valid/I");
+    tree->Branch("n_steps", &n_steps, "n_steps/I");
+    tree->Branch("chi2", chi2.data(), "chi2[n_steps]/D");
+
+    for (size_t g = 0; g < gate_vec.size(); g++) {
+        const MixingRatioResult &result = result_vec[g];
+        gate_id = g;
+        peak_low = gate_vec[g].peak_low;
+        peak_high = gate_vec[g].peak_high;
+        delta_min = result.delta_min;
+        delta_low = result.delta_low;
+        delta_high = result.delta_high;
+        atan_delta_min = result.atan_delta_min;
+        chi2_min = result.chi2_min;
+        scale = result.scale;
+        ndf = result.ndf;
+        valid = result.valid;
+        std::copy(result.chi2_vec.begin(), result.chi2_vec.end(), chi2.begin());
+        tree->Fill();
+    }
+
+    tree->Write("", TObject::kOverwrite);
+} // end WriteTree()
@@ -0,0 +1,227 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Exports histograms as NumPy .npy arrays
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   NpyExporter exporter("npy");
+//   exporter.Open();
+//   exporter.Add(h, "room_background_subtracted/source_00");
+//   exporter.Flush();
+//
+//   # python
+//   content = np.load("npy/room_background_subtracted/source_00.content.npy", mmap_mode='r')
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <errno.h>
+#include <sys/stat.h>
+#include "NpyExporter.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param directory output directory, created if needed
+ * @param threads number of writer threads (0 = all cores)
+ ***************************************************************/
+NpyExporter::NpyExporter(std::string directory, int threads) : output_dir(directory), num_threads(threads)
+{
+    //std::cout << "NpyExporter initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+NpyExporter::~NpyExporter(void)
+{
+    //std::cout << "NpyExporter destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Creates the output directory and a new binning index
+ *
+ * An index of an earlier export is replaced, Flush() appends the
+ * rows of this export.
+ ***************************************************************/
+bool NpyExporter::Open()
+{
+    if (!MakeDirectories(output_dir)) return false;
+
+    std::string index_filename = output_dir + "/index.csv";
+    std::ofstream index_file(index_filename, std::ios::trunc);
+    if (!index_file.good()) {
+        std::cerr << "ERROR --- Could not create export index: " << index_filename << std::endl;
+        return false;
+    }
+    index_file << "name,x_bins,x_min,x_max,y_bins,y_min,y_max\n";
+
+    return index_file.good();
+} // end Open()
+
+/************************************************************//**
+ * Creates a directory and its parents
+ *
+ * @param path directory
+ ***************************************************************/
+bool NpyExporter::MakeDirectories(std::string path)
+{
+    size_t position = 0;
+    while (position != std::string::npos) {
+        position = path.find('/', position + 1);
+        std::string partial = path.substr(0, position);
+        if (partial.empty()) continue;
+        if (mkdir(partial.c_str(), 0755) != 0 && errno != EEXIST) {
+            std::cerr << "ERROR --- Could not create directory: " << partial << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+} // end MakeDirectories()
+
+/************************************************************//**
+ * Queues a matrix
+ *
+ * @param h matrix, must stay alive until Flush()
+ * @param name product name, may contain sub-directories
+ ***************************************************************/
+void NpyExporter::Add(TH2D *h, std::string name)
+{
+    NpyExportItem item;
+    item.name = name;
+    item.content = h->GetArray();
+    item.sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : NULL;
+    item.x_bins = h->GetXaxis()->GetNbins();
+    item.x_min = h->GetXaxis()->GetXmin();
+    item.x_max = h->GetXaxis()->GetXmax();
+    item.y_bins = h->GetYaxis()->GetNbins();
+    item.y_min = h->GetYaxis()->GetXmin();
+    item.y_max = h->GetYaxis()->GetXmax();
+    item.shape = {(size_t) item.y_bins + 2, (size_t) item.x_bins + 2};
+    item_vec.push_back(item);
+} // end Add()
+
+/************************************************************//**
+ * Queues a projection
+ *
+ * @param h histogram, must stay alive until Flush()
+ * @param name product name, may contain sub-directories
+ ***************************************************************/
+void NpyExporter::Add(TH1D *h, std::string name)
+{
+    NpyExportItem item;
+    item.name = name;
+    item.content = h->GetArray();
+    item.sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : NULL;
+    item.x_bins = h->GetXaxis()->GetNbins();
+    item.x_min = h->GetXaxis()->GetXmin();
+    item.x_max = h->GetXaxis()->GetXmax();
+    item.shape = {(size_t) item.x_bins + 2};
+    item_vec.push_back(item);
+} // end Add()
+
+/************************************************************//**
+ * Writes every queued histogram and clears the queue
+ ***************************************************************/
+bool NpyExporter::Flush()
+{
+    if (item_vec.empty()) return true;
+
+    // directories are created up front, files are written in parallel
+    for (auto &item : item_vec) {
+        size_t split = item.name.rfind('/');
+        if (split != std::string::npos && !MakeDirectories(output_dir + "/" + item.name.substr(0, split))) return false;
+    }
+
+    // every item is two independent files
+    const int num_files = 2 * item_vec.size();
+    std::atomic<int> next(0);
+    std::atomic<bool> good(true);
+    auto worker = [&]() {
+        std::vector<double> poisson_vec;
+        int k;
+        while ((k = next++) < num_files) {
+            const NpyExportItem &item = item_vec[k / 2];
+            std::string filename = output_dir + "/" + item.name;
+            bool ok;
+            if (k % 2 == 0) {
+                ok = WriteArray(filename + ".content.npy", item.content, item.shape);
+            } else if (item.sumw2) {
+                ok = WriteArray(filename + ".variance.npy", item.sumw2, item.shape);
+            } else {
+                // unweighted histograms carry Poisson variances
+                size_t size = 1;
+                for (auto n : item.shape) size *= n;
+                poisson_vec.assign(item.content, item.content + size);
+                ok = WriteArray(filename + ".variance.npy", poisson_vec.data(), item.shape);
+            }
+            if (!ok) good = false;
+        }
+    };
+
+    int threads = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    if (threads > num_files) threads = num_files;
+    std::vector<std::thread> thread_vec;
+    for (auto t = 1; t < threads; t++) {
+        thread_vec.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &t : thread_vec) {
+        t.join();
+    }
+
+    std::ofstream index_file(output_dir + "/index.csv", std::ios::app);
+    index_file.precision(17);
+    for (auto &item : item_vec) {
+        index_file << item.name << "," << item.x_bins << "," << item.x_min << "," << item.x_max << "," << item.y_bins << "," << item.y_min << "," << item.y_max << "\n";
+    }
+    item_vec.clear();
+
+    return good && index_file.good();
+} // end Flush()
+
+/************************************************************//**
+ * Writes a little-endian double array as a version 1.0 .npy file
+ *
+ * @param filename output file
+ * @param data C order array
+ * @param shape array shape
+ ***************************************************************/
+bool NpyExporter::WriteArray(std::string filename, const double *data, const std::vector<size_t> &shape)
+{
+    std::ostringstream header;
+    header << "{'descr': '<f8', 'fortran_order': False, 'shape': (";
+    size_t size = 1;
+    for (size_t d = 0; d < shape.size(); d++) {
+        header << shape[d] << (shape.size() == 1 || d + 1 < shape.size() ? "," : "");
+        if (d + 1 < shape.size()) header << " ";
+        size *= shape[d];
+    }
+    header << "), }";
+
+    // magic, version and header length take 10 bytes, data starts 64 byte aligned
+    std::string dict = header.str();
+    size_t total = 10 + dict.size() + 1;
+    dict.append((64 - total % 64) % 64, ' ');
+    dict.push_back('\n');
+    unsigned short header_length = dict.size();
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out.good()) {
+        std::cerr << "ERROR --- Could not open: " << filename << std::endl;
+        return false;
+    }
+    const char magic[8] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0};
+    const char length_bytes[2] = {(char) (header_length & 0xff), (char) (header_length >> 8)};
+    out.write(magic, sizeof(magic));
+    out.write(length_bytes, sizeof(length_bytes));
+    out.write(dict.c_str(), dict.size());
+    out.write(reinterpret_cast<const char*>(data), size * sizeof(double));
+
+    return out.good();
+} // end WriteArray()
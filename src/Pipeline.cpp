@@ -0,0 +1,328 @@
+//////////////////////////////////////////////////////////////////////////////////
+// End-to-end background subtraction and matrix building on a task graph
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   FileHandler inputs("source.root", "background.root");
+//   BGUtils bg_utils(&inputs);
+//   Pipeline pipeline(&inputs, &bg_utils, 8);
+//   pipeline.Run("outputs.root");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+#include "TROOT.h"
+#include "Pipeline.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param inputs source and background histograms, files or merged runs
+ * @param bg_utils configured background subtraction, runs the index steps
+ * @param threads number of worker threads (0 = all cores)
+ ***************************************************************/
+Pipeline::Pipeline(FileHandler *inputs, BGUtils *bg_utils, int threads) : file_man(inputs), bg_utils(bg_utils), num_threads(threads)
+{
+    //std::cout << "Pipeline initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+Pipeline::~Pipeline(void)
+{
+    delete out_file;
+    //std::cout << "Pipeline destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Parses a memory size such as "16G", "800M" or "800" (MB)
+ *
+ * @param text size with optional K, M, G or T suffix
+ * @param bytes parsed size
+ ***************************************************************/
+bool Pipeline::ParseMemorySize(std::string text, long long &bytes)
+{
+    char *end = NULL;
+    double size = std::strtod(text.c_str(), &end);
+    std::string suffix = end ? end : "";
+    long long unit;
+    if (suffix.empty() || suffix == "M" || suffix == "MB") {
+        unit = 1LL << 20;
+    } else if (suffix == "G" || suffix == "GB") {
+        unit = 1LL << 30;
+    } else if (suffix == "K" || suffix == "KB") {
+        unit = 1LL << 10;
+    } else if (suffix == "T" || suffix == "TB") {
+        unit = 1LL << 40;
+    } else {
+        unit = 0;
+    }
+    if (unit == 0 || !(size > 0)) {
+        std::cerr << "ERROR --- Memory size must be given as e.g. 16G or 800M, found: " << text << std::endl;
+        return false;
+    }
+    bytes = (long long) (size * unit);
+
+    return true;
+} // end ParseMemorySize()
+
+/************************************************************//**
+ * Histogram file of the source or background, the first run when
+ * runs are merged
+ *
+ * @param source source if true, background otherwise
+ ***************************************************************/
+TFile* Pipeline::InputFile(bool source)
+{
+    HistogramMerger *merger = source ? file_man->src_merger : file_man->bg_merger;
+    if (merger) return merger->GetFiles().empty() ? NULL : merger->GetFiles().front();
+
+    return source ? file_man->src_file : file_man->bg_file;
+} // end InputFile()
+
+/************************************************************//**
+ * Peak memory of one index in flight
+ *
+ * Prompt and time-random matrices of source and background are held
+ * together until the time-random subtractions have finished.
+ *
+ * @param index angular index
+ ***************************************************************/
+long long Pipeline::EstimateIndexMemory(int index)
+{
+    long long bytes = 0;
+    for (auto in_file : {InputFile(true), InputFile(false)}) {
+        if (!in_file) continue;
+        bytes += HistogramPool::SlotMemory(in_file, Form("prompt_angle/index_%02i_sum", index));
+        bytes += HistogramPool::SlotMemory(in_file, Form("time_random/index_%02i_sum_tr_avg", index));
+    }
+
+    return bytes;
+} // end EstimateIndexMemory()
+
+/************************************************************//**
+ * Number of indices whose matrices fit into the memory budget
+ *
+ * @param indices number of indices of this shard
+ ***************************************************************/
+int Pipeline::IndicesInFlight(int indices)
+{
+    if (max_memory <= 0) return indices;
+
+    long long index_memory = 0;
+    for (auto i = shard.index; i < angle_indices; i += shard.count) {
+        index_memory = std::max(index_memory, EstimateIndexMemory(i));
+    }
+    // compressed and object buffers of both pools, about one matrix each
+    long long buffer_memory = index_memory;
+    int in_flight = index_memory > 0 ? (int) ((max_memory - buffer_memory) / index_memory) : indices;
+    if (in_flight < 1) {
+        std::cerr << "WARNING --- One index needs about " << (index_memory + buffer_memory) / (1 << 20) << " MB, more than the memory budget, running one index at a time" << std::endl;
+        in_flight = 1;
+    }
+    in_flight = std::min(in_flight, indices);
+    std::cout << "Memory budget of " << max_memory / (1 << 20) << " MB allows " << in_flight << " indices in flight (about " << index_memory / (1 << 20) << " MB each)" << std::endl;
+
+    return in_flight;
+} // end IndicesInFlight()
+
+/************************************************************//**
+ * Runs subtraction and matrix building of all indices
+ *
+ * @param output_filename file receiving the subtracted and angle matrices
+ ***************************************************************/
+bool Pipeline::Run(std::string output_filename)
+{
+    shard = bg_utils->GetShard();
+    // same checks and scaling file as the serial subtraction
+    bg_utils->LoadScaleFactors();
+
+    ROOT::EnableThreadSafety();
+    for (auto source : {true, false}) {
+        HistogramMerger *merger = source ? file_man->src_merger : file_man->bg_merger;
+        TFile *in_file = source ? file_man->src_file : file_man->bg_file;
+        if (!merger && (!in_file || in_file->IsZombie())) {
+            std::cerr << "ERROR --- Could not open " << (source ? "source" : "background") << " histograms" << std::endl;
+            return false;
+        }
+    }
+    std::string out_filename = shard.FileName(output_filename);
+    out_file = new TFile(out_filename.c_str(), "RECREATE");
+    if (!out_file->IsOpen()) {
+        std::cerr << "ERROR --- Could not create: " << out_filename << std::endl;
+        return false;
+    }
+    if (shard.IsSharded()) {
+        // partial output, assembled by ShardMerger
+        TNamed label("shard", shard.Label().c_str());
+        out_file->WriteTObject(&label, "shard", "WriteDelete");
+    }
+    src_dir = out_file->mkdir("source");
+    bg_dir = out_file->mkdir("background");
+    room_dir = out_file->mkdir("room_background_subtracted");
+    matrix_vec.assign(angle_indices, IndexMatrices());
+    product_vec.assign(angle_indices, AngleIndexProducts());
+
+    std::vector<int> index_vec;
+    for (auto i = shard.index; i < angle_indices; i += shard.count) {
+        index_vec.push_back(i);
+    }
+    const int in_flight = IndicesInFlight(index_vec.size());
+    TaskGraph graph(num_threads);
+    std::vector<int> room_task_vec;
+    for (size_t k = 0; k < index_vec.size(); k++) {
+        const int i = index_vec[k];
+        // reads wait until an earlier index has freed its matrices
+        std::vector<int> admission;
+        if ((int) k >= in_flight) admission.push_back(room_task_vec[k - in_flight]);
+        int src_task = graph.AddTask(Form("source %02i", i), [this, i]() {SubtractTimeRandom(i, true);}, admission);
+        int bg_task = graph.AddTask(Form("background %02i", i), [this, i]() {SubtractTimeRandom(i, false);}, admission);
+        // source rows are taken before the room background is subtracted in place
+        int single_task = graph.AddTask(Form("source gamma %02i", i), [this, i]() {
+            HistogramManager::CopySingleGammaRows(matrix_vec[i].src, gate_low, gate_high, product_vec[i].single_gamma_vec[0]);
+        }, {src_task});
+        int project_task = graph.AddTask(Form("background projection %02i", i), [this, i]() {
+            HistogramManager::ExtractIndexProducts(matrix_vec[i].bg, 1, gate_low, gate_high, product_vec[i]);
+        }, {bg_task});
+        room_task_vec.push_back(graph.AddTask(Form("room background %02i", i), [this, i]() {SubtractRoomBackground(i);}, {single_task, project_task}));
+    }
+    graph.AddTask("angle matrices", [this]() {BuildAngularMatrices();}, room_task_vec);
+
+    std::cout << "Running " << graph.GetNumTasks() << " tasks on " << (num_threads > 0 ? num_threads : (int) std::thread::hardware_concurrency()) << " threads" << std::endl;
+    graph.Run();
+
+    out_file->Close();
+    // cleaning up, as the serial subtraction does
+    for (auto in_file : {&file_man->src_file, &file_man->bg_file}) {
+        if (!*in_file) continue;
+        (*in_file)->Close();
+        delete *in_file;
+        *in_file = NULL;
+    }
+    std::cout << "Subtracted and angle matrices written to: " << out_filename << std::endl;
+
+    return true;
+} // end Run()
+
+/************************************************************//**
+ * Reads an input matrix of one index
+ *
+ * @param source source if true, background otherwise
+ * @param key_name full path of the matrix
+ * @param slot pool slot of a single file
+ ***************************************************************/
+TH2D* Pipeline::ReadInput(bool source, std::string key_name, int slot)
+{
+    HistogramMerger *merger = source ? file_man->src_merger : file_man->bg_merger;
+    std::lock_guard<std::mutex> lock(source ? src_lock : bg_lock);
+    if (!merger) return (source ? src_pool : bg_pool).Read(source ? file_man->src_file : file_man->bg_file, key_name, slot);
+
+    // the merged matrix is reused by the next merge, other indices are still in flight
+    TH2D *merged = merger->Merge(key_name, 0);
+    if (!merged) return NULL;
+    TH2D *h = (TH2D*) merged->Clone();
+    h->SetDirectory(0);
+
+    return h;
+} // end ReadInput()
+
+/************************************************************//**
+ * Frees an input matrix read by ReadInput()
+ *
+ * @param source source if true, background otherwise
+ * @param slot pool slot of a single file
+ * @param h matrix
+ ***************************************************************/
+void Pipeline::ReleaseInput(bool source, int slot, TH2D *h)
+{
+    HistogramMerger *merger = source ? file_man->src_merger : file_man->bg_merger;
+    if (merger) {
+        delete h;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(source ? src_lock : bg_lock);
+    (source ? src_pool : bg_pool).Release(slot);
+} // end ReleaseInput()
+
+/************************************************************//**
+ * Subtracts the time-random matrix of one index
+ *
+ * @param index angular index
+ * @param source source file if true, background file otherwise
+ ***************************************************************/
+void Pipeline::SubtractTimeRandom(int index, bool source)
+{
+    TH2D *prompt_matrix = ReadInput(source, Form("prompt_angle/index_%02i_sum", index), 2 * index);
+    TH2D *time_random_matrix = ReadInput(source, Form("time_random/index_%02i_sum_tr_avg", index), 2 * index + 1);
+    if (!prompt_matrix || !time_random_matrix) exit(EXIT_FAILURE);
+
+    bg_utils->SubtractTimeRandomIndex(prompt_matrix, time_random_matrix);
+    ReleaseInput(source, 2 * index + 1, time_random_matrix);
+    {
+        std::lock_guard<std::mutex> lock(out_lock);
+        bg_utils->WriteIntermediate(prompt_matrix, source ? src_dir : bg_dir);
+    }
+
+    if (source) {
+        matrix_vec[index].src = prompt_matrix;
+    } else {
+        matrix_vec[index].bg = prompt_matrix;
+    }
+} // end SubtractTimeRandom()
+
+/************************************************************//**
+ * Subtracts the scaled room background of one index
+ *
+ * Projections of the result are kept and both matrices are freed.
+ *
+ * @param index angular index
+ ***************************************************************/
+void Pipeline::SubtractRoomBackground(int index)
+{
+    IndexMatrices &matrices = matrix_vec[index];
+    if (bg_utils->IsOptimizing()) {
+        // fits share ROOT's function list and the factors are written back
+        std::lock_guard<std::mutex> lock(scale_lock);
+        bg_utils->RecordScaleFactor(index, bg_utils->SubtractRoomIndex(index, matrices.src, matrices.bg));
+    } else {
+        // read only, tasks of other indices look up their factors concurrently
+        bg_utils->SubtractRoomIndex(index, matrices.src, matrices.bg);
+    }
+    {
+        std::lock_guard<std::mutex> lock(out_lock);
+        bg_utils->WriteFinal(matrices.src, room_dir, index);
+    }
+    HistogramManager::ExtractIndexProducts(matrices.src, 2, gate_low, gate_high, product_vec[index]);
+    product_vec[index].filled = true;
+
+    ReleaseInput(true, 2 * index, matrices.src);
+    ReleaseInput(false, 2 * index, matrices.bg);
+    matrices.src = NULL;
+    matrices.bg = NULL;
+} // end SubtractRoomBackground()
+
+/************************************************************//**
+ * Fills and writes all angle matrices
+ *
+ * Sharded outputs also keep the bins each index filled, see
+ * ShardMerger.
+ ***************************************************************/
+void Pipeline::BuildAngularMatrices()
+{
+    std::vector<TH2D*> angle_matrix_vec;
+    std::vector<int> loaded_bins_vec;
+    HistogramManager::FillAngularMatrices(product_vec, gate_low, gate_high, angle_matrix_vec, loaded_bins_vec);
+
+    std::lock_guard<std::mutex> lock(out_lock);
+    for (auto h : angle_matrix_vec) {
+        h->SetDirectory(0);
+        if (shard.IsSharded() && ShardMerger::HasOwnedErrors(h->GetName())) ShardMerger::WriteLoadedBins(out_file, h->GetName(), loaded_bins_vec);
+        out_file->WriteTObject(h, h->GetName(), "WriteDelete");
+        delete h;
+    }
+} // end BuildAngularMatrices()
@@ -0,0 +1,427 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Incremental analysis of source runs as they arrive during beamtime
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   RunWatcher watcher("/data/runs", "background.root");
+//   watcher.Start();
+//   watcher.Watch();
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "TROOT.h"
+#include "RunWatcher.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param directory directory new source runs are written to
+ * @param bg_filename room background histograms
+ ***************************************************************/
+RunWatcher::RunWatcher(std::string directory, std::string bg_filename) : watch_directory(directory), bg_filename(bg_filename)
+{
+    //std::cout << "RunWatcher initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+RunWatcher::~RunWatcher(void)
+{
+    WaitForSnapshot();
+    for (auto h : prompt_total_vec) delete h;
+    for (auto h : random_total_vec) delete h;
+    delete scratch_matrix;
+    //std::cout << "RunWatcher destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Checks if a file in the directory is a histogram file of a run
+ *
+ * Files written by the watcher itself are never runs, the totals
+ * would otherwise be added to themselves when the working directory
+ * is watched.
+ *
+ * @param filename name of the file
+ ***************************************************************/
+bool RunWatcher::IsRunFile(std::string filename)
+{
+    if (filename.size() <= 5 || filename.compare(filename.size() - 5, 5, ".root") != 0 || filename[0] == '.') return false;
+    for (auto own_filename : {totals_filename, products_filename, output_filename, TempTotalsName()}) {
+        size_t split = own_filename.rfind('/');
+        if (filename.compare(split == std::string::npos ? own_filename : own_filename.substr(split + 1)) == 0) return false;
+    }
+
+    return true;
+} // end IsRunFile()
+
+/************************************************************//**
+ * Prepares the background and adds runs already in the directory
+ *
+ * Runs listed in the totals file are part of the totals from an
+ * earlier session and are not added again.
+ ***************************************************************/
+bool RunWatcher::Start()
+{
+    // snapshots are written while the next results are computed
+    ROOT::EnableThreadSafety();
+    prompt_total_vec.assign(angle_indices, NULL);
+    random_total_vec.assign(angle_indices, NULL);
+    product_vec.assign(angle_indices, AngleIndexProducts());
+    if (std::ifstream(totals_filename).good()) {
+        if (!LoadTotals()) return false;
+    } else {
+        std::ofstream(runs_filename, std::ios_base::trunc);
+    }
+    std::remove(TempTotalsName().c_str());
+
+    if (!std::ifstream(products_filename).good()) {
+        // room background does not change during the experiment
+        FileHandler inputs("", bg_filename);
+        BGUtils products(&inputs);
+        products.WriteBackgroundProducts(products_filename);
+    }
+    bg_utils.LoadScaleFactors();
+    bg_utils.SetBackgroundProducts(products_filename);
+    TFile out_file(output_filename.c_str(), "RECREATE");
+    if (!out_file.IsOpen()) {
+        std::cerr << "ERROR --- Could not create: " << output_filename << std::endl;
+        return false;
+    }
+    bg_utils.CopyBackgroundProducts(&out_file);
+    out_file.Close();
+
+    DIR *dir = opendir(watch_directory.c_str());
+    if (!dir) {
+        std::cerr << "ERROR --- Could not open directory: " << watch_directory << std::endl;
+        return false;
+    }
+    std::vector<std::string> run_vec;
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (IsRunFile(name) && !run_set.count(watch_directory + "/" + name)) run_vec.push_back(watch_directory + "/" + name);
+    }
+    closedir(dir);
+    std::sort(run_vec.begin(), run_vec.end());
+
+    for (auto &run : run_vec) {
+        AddRun(run);
+    }
+    // totals of an earlier session are subtracted once as well
+    if (!changed_set.empty()) Refresh();
+
+    return true;
+} // end Start()
+
+/************************************************************//**
+ * Reads the totals and their run list from an earlier session
+ ***************************************************************/
+bool RunWatcher::LoadTotals()
+{
+    // the run list is part of the totals, both change in one rename
+    TFile totals_file(totals_filename.c_str(), "READ");
+    TObject *runs = totals_file.IsOpen() ? totals_file.Get(runs_key.c_str()) : NULL;
+    if (!runs) {
+        std::cerr << "ERROR --- No run list in totals: " << totals_filename << std::endl;
+        return false;
+    }
+    std::istringstream run_list(runs->GetTitle());
+    std::string run;
+    while (std::getline(run_list, run)) {
+        if (!run.empty()) run_set.insert(run);
+    }
+
+    for (auto i = 0; i < angle_indices; i++) {
+        std::cout << "Reading totals: " << i + 1 << " of " << angle_indices << "\r";
+        std::cout.flush();
+        TH2D *prompt_matrix = (TH2D*) totals_file.Get(Form("prompt_angle/index_%02i_sum", i));
+        TH2D *time_random_matrix = (TH2D*) totals_file.Get(Form("time_random/index_%02i_sum_tr_avg", i));
+        if (!prompt_matrix || !time_random_matrix) {
+            std::cerr << "\nERROR --- Missing index " << i << " in totals: " << totals_filename << std::endl;
+            return false;
+        }
+        // totals outlive the file
+        prompt_matrix->SetDirectory(0);
+        time_random_matrix->SetDirectory(0);
+        prompt_total_vec[i] = prompt_matrix;
+        random_total_vec[i] = time_random_matrix;
+        changed_set.insert(i);
+    }
+    std::cout << std::endl;
+    totals_file.Close();
+    std::cout << "Continuing totals of " << run_set.size() << " runs in: " << totals_filename << std::endl;
+
+    return true;
+} // end LoadTotals()
+
+/************************************************************//**
+ * Waits for new runs and refreshes the results after each of them
+ *
+ * Runs until interrupted.
+ ***************************************************************/
+bool RunWatcher::Watch()
+{
+    int watch_fd = inotify_init();
+    if (watch_fd < 0 || inotify_add_watch(watch_fd, watch_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cerr << "ERROR --- Could not watch directory: " << watch_directory << std::endl;
+        if (watch_fd >= 0) close(watch_fd);
+        return false;
+    }
+    std::cout << "Watching " << watch_directory << " for new runs, Ctrl-C to stop" << std::endl;
+
+    std::vector<char> event_buffer(64 * 1024);
+    while (true) {
+        ssize_t length = read(watch_fd, event_buffer.data(), event_buffer.size());
+        if (length <= 0) break;
+
+        // runs finished together are refreshed once
+        for (ssize_t offset = 0; offset < length;) {
+            const struct inotify_event *event = (const struct inotify_event*) (event_buffer.data() + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0 || !IsRunFile(event->name)) continue;
+            std::string run = watch_directory + "/" + event->name;
+            if (run_set.count(run)) continue;
+            AddRun(run);
+        }
+        if (!changed_set.empty()) Refresh();
+    }
+    close(watch_fd);
+    WaitForSnapshot();
+
+    std::cerr << "ERROR --- Lost watch of directory: " << watch_directory << std::endl;
+    return false;
+} // end Watch()
+
+/************************************************************//**
+ * Adds the matrices of one run to the running totals
+ *
+ * Totals are changed in place; a matrix that can not be read takes
+ * the matrices of the run added so far out again.
+ *
+ * @param run_filename histogram file of the run
+ ***************************************************************/
+bool RunWatcher::AddRun(std::string run_filename)
+{
+    TFile run_file(run_filename.c_str(), "READ");
+    if (!run_file.IsOpen() || run_file.IsZombie()) {
+        std::cerr << "WARNING --- Skipping unreadable run: " << run_filename << std::endl;
+        return false;
+    }
+    // a run missing a matrix must not leave the totals half updated
+    for (auto i = 0; i < angle_indices; i++) {
+        for (auto key_name : {Form("prompt_angle/index_%02i_sum", i), Form("time_random/index_%02i_sum_tr_avg", i)}) {
+            if (!HistogramPool::FindKey(&run_file, key_name)) {
+                std::cerr << "WARNING --- Skipping run without " << key_name << ": " << run_filename << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // the snapshot being written still reads the totals
+    WaitForSnapshot();
+    std::vector<int> added_vec;
+    for (auto i = 0; i < angle_indices; i++) {
+        std::cout << "Adding " << run_filename << " to totals: " << i + 1 << " of " << angle_indices << "\r";
+        std::cout.flush();
+        TH2D *prompt_matrix = hist_pool.Read(&run_file, Form("prompt_angle/index_%02i_sum", i), 0);
+        TH2D *time_random_matrix = hist_pool.Read(&run_file, Form("time_random/index_%02i_sum_tr_avg", i), 1);
+        if (!prompt_matrix || !time_random_matrix) {
+            std::cerr << "\nERROR --- Could not add " << run_filename << ", index " << i << " is unreadable" << std::endl;
+            for (auto j : added_vec) {
+                AddToTotal(prompt_total_vec[j], hist_pool.Read(&run_file, Form("prompt_angle/index_%02i_sum", j), 0), -1.0);
+                AddToTotal(random_total_vec[j], hist_pool.Read(&run_file, Form("time_random/index_%02i_sum_tr_avg", j), 1), -1.0);
+            }
+            return false;
+        }
+        // indices without counts in this run keep their products
+        if (prompt_matrix->GetEntries() == 0 && time_random_matrix->GetEntries() == 0) continue;
+        AddToTotal(prompt_total_vec[i], prompt_matrix);
+        AddToTotal(random_total_vec[i], time_random_matrix);
+        added_vec.push_back(i);
+    }
+    std::cout << std::endl;
+    run_file.Close();
+
+    changed_set.insert(added_vec.begin(), added_vec.end());
+    run_set.insert(run_filename);
+    unsaved_run_vec.push_back(run_filename);
+
+    return true;
+} // end AddRun()
+
+/************************************************************//**
+ * Adds a matrix to a resident total
+ *
+ * @param total total, created from the first matrix added
+ * @param h matrix, owned by the pool
+ * @param scale factor applied to the matrix (-1 takes it out)
+ ***************************************************************/
+void RunWatcher::AddToTotal(TH2D *&total, TH2D *h, double scale)
+{
+    if (!h) return;
+    if (total) {
+        total->Add(h, scale);
+        return;
+    }
+    total = (TH2D*) h->Clone(h->GetName());
+    total->SetDirectory(0);
+    if (scale != 1.0) total->Scale(scale);
+} // end AddToTotal()
+
+/************************************************************//**
+ * Copies a total into the reused scratch matrix
+ *
+ * @param total resident total, left unchanged
+ ***************************************************************/
+TH2D* RunWatcher::CopyTotal(TH2D *total)
+{
+    const int cells = (total->GetNbinsX() + 2) * (total->GetNbinsY() + 2);
+    if (!scratch_matrix || scratch_matrix->GetNcells() != cells) {
+        delete scratch_matrix;
+        scratch_matrix = (TH2D*) total->Clone();
+        scratch_matrix->SetDirectory(0);
+    } else {
+        // same binning, only the arrays are copied
+        std::copy(total->GetArray(), total->GetArray() + cells, scratch_matrix->GetArray());
+        if (total->GetSumw2N() > 0) {
+            if (scratch_matrix->GetSumw2N() == 0) scratch_matrix->Sumw2();
+            std::copy(total->GetSumw2()->GetArray(), total->GetSumw2()->GetArray() + cells, scratch_matrix->GetSumw2()->GetArray());
+        }
+        scratch_matrix->SetEntries(total->GetEntries());
+    }
+    scratch_matrix->SetName(total->GetName());
+
+    return scratch_matrix;
+} // end CopyTotal()
+
+/************************************************************//**
+ * Subtracts the changed indices and refills the angle matrices
+ *
+ * The snapshot of the totals is written meanwhile.
+ ***************************************************************/
+void RunWatcher::Refresh()
+{
+    auto start = std::chrono::steady_clock::now();
+    if (!unsaved_run_vec.empty()) StartSnapshot();
+
+    TFile out_file(output_filename.c_str(), "UPDATE");
+    TFile products_file(products_filename.c_str(), "READ");
+    if (!out_file.IsOpen() || !products_file.IsOpen()) {
+        std::cerr << "ERROR --- Could not refresh: " << (out_file.IsOpen() ? products_filename : output_filename) << std::endl;
+        return;
+    }
+    TDirectory *src_dir = out_file.GetDirectory("source");
+    if (!src_dir) src_dir = out_file.mkdir("source");
+    TDirectory *room_dir = out_file.GetDirectory("room_background_subtracted");
+    if (!room_dir) room_dir = out_file.mkdir("room_background_subtracted");
+
+    int refreshed = 0;
+    for (auto i : changed_set) {
+        std::cout << "Refreshing index " << i + 1 << " of " << angle_indices << " (" << ++refreshed << " of " << changed_set.size() << " changed)\r";
+        std::cout.flush();
+        TH2D *bg_h = hist_pool.Read(&products_file, Form("background/index_%02i_sum", i), 1);
+        if (!bg_h || !prompt_total_vec[i] || !random_total_vec[i]) {
+            std::cerr << "\nERROR --- Could not refresh index: " << i << std::endl;
+            continue;
+        }
+        TH2D *src_h = CopyTotal(prompt_total_vec[i]);
+        bg_utils.SubtractTimeRandomIndex(src_h, random_total_vec[i]);
+        bg_utils.WriteIntermediate(src_h, src_dir);
+
+        AngleIndexProducts &products = product_vec[i];
+        HistogramManager::CopySingleGammaRows(src_h, gate_low, gate_high, products.single_gamma_vec[0]);
+        HistogramManager::ExtractIndexProducts(bg_h, 1, gate_low, gate_high, products);
+        bg_utils.RecordScaleFactor(i, bg_utils.SubtractRoomIndex(i, src_h, bg_h));
+        bg_utils.WriteFinal(src_h, room_dir, i);
+        HistogramManager::ExtractIndexProducts(src_h, 2, gate_low, gate_high, products);
+        products.filled = true;
+    }
+    std::cout << std::endl;
+    changed_set.clear();
+    products_file.Close();
+
+    std::vector<TH2D*> angle_matrix_vec;
+    std::vector<int> loaded_bins_vec;
+    HistogramManager::FillAngularMatrices(product_vec, gate_low, gate_high, angle_matrix_vec, loaded_bins_vec);
+    for (auto h : angle_matrix_vec) {
+        h->SetDirectory(0);
+        out_file.WriteTObject(h, h->GetName(), "WriteDelete");
+        delete h;
+    }
+    out_file.Close();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Results of " << run_set.size() << " runs refreshed in " << elapsed.count() << " s: " << output_filename << std::endl;
+} // end Refresh()
+
+/************************************************************//**
+ * Writes the totals in the background
+ *
+ * Totals are only read until WaitForSnapshot() returns.
+ ***************************************************************/
+void RunWatcher::StartSnapshot()
+{
+    WaitForSnapshot();
+    std::string run_list;
+    for (auto &run : run_set) {
+        run_list += run + "\n";
+    }
+    snapshot_thread = std::thread(&RunWatcher::WriteSnapshot, this, run_list, unsaved_run_vec);
+    unsaved_run_vec.clear();
+} // end StartSnapshot()
+
+/************************************************************//**
+ * Writes the totals and their run list, replacing the last snapshot
+ *
+ * @param run_list runs in the totals, one per line
+ * @param new_run_vec runs added since the last snapshot
+ ***************************************************************/
+void RunWatcher::WriteSnapshot(std::string run_list, std::vector<std::string> new_run_vec)
+{
+    // new totals are built next to the old ones and replace them in one rename
+    std::string temp_filename = TempTotalsName();
+    TFile temp_file(temp_filename.c_str(), "RECREATE");
+    if (!temp_file.IsOpen()) {
+        std::cerr << "ERROR --- Could not write snapshot: " << temp_filename << std::endl;
+        return;
+    }
+    TDirectory *prompt_dir = temp_file.mkdir("prompt_angle");
+    TDirectory *random_dir = temp_file.mkdir("time_random");
+    for (auto i = 0; i < angle_indices; i++) {
+        if (prompt_total_vec[i]) prompt_dir->WriteTObject(prompt_total_vec[i], Form("index_%02i_sum", i));
+        if (random_total_vec[i]) random_dir->WriteTObject(random_total_vec[i], Form("index_%02i_sum_tr_avg", i));
+    }
+    TNamed runs(runs_key.c_str(), run_list.c_str());
+    temp_file.WriteTObject(&runs);
+    temp_file.Close();
+
+    if (std::rename(temp_filename.c_str(), totals_filename.c_str()) != 0) {
+        std::cerr << "ERROR --- Could not replace totals: " << totals_filename << std::endl;
+        std::remove(temp_filename.c_str());
+        return;
+    }
+
+    // readable log of the runs in the totals
+    std::ofstream runs_file(runs_filename, std::ios_base::app);
+    for (auto &run : new_run_vec) {
+        runs_file << run << std::endl;
+    }
+} // end WriteSnapshot()
+
+/************************************************************//**
+ * Waits until the snapshot being written is complete
+ ***************************************************************/
+void RunWatcher::WaitForSnapshot()
+{
+    if (snapshot_thread.joinable()) snapshot_thread.join();
+} // end WaitForSnapshot()
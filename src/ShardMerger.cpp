@@ -0,0 +1,336 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Index sharded execution and merging of partial outputs
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   SumPeakAnalysis source.root background.root --shard=0/4   (one per process)
+//   SumPeakAnalysis shard-merge outputs.root outputs.shard_*_of_4.root
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <set>
+#include <cstdio>
+#include <algorithm>
+#include "TKey.h"
+#include "TList.h"
+#include "TTree.h"
+#include "TVectorD.h"
+#include "ShardMerger.h"
+#include "BatchRunner.h"
+
+/************************************************************//**
+ * Shard as "k/N"
+ ***************************************************************/
+std::string ShardSpec::Label() const
+{
+    std::ostringstream label;
+    label << index << "/" << count;
+
+    return label.str();
+} // end Label()
+
+/************************************************************//**
+ * Name of the partial output of this shard
+ *
+ * @param base_name output file of an unsharded run, e.g. "outputs.root"
+ ***************************************************************/
+std::string ShardSpec::FileName(std::string base_name) const
+{
+    if (!IsSharded()) return base_name;
+    size_t split = base_name.rfind(".root");
+    std::string stem = split == std::string::npos ? base_name : base_name.substr(0, split);
+    std::ostringstream name;
+    name << stem << ".shard_" << index << "_of_" << count << ".root";
+
+    return name.str();
+} // end FileName()
+
+/************************************************************//**
+ * Parses "k/N"
+ *
+ * @param text shard argument
+ * @param shard parsed shard
+ ***************************************************************/
+bool ShardSpec::Parse(std::string text, ShardSpec &shard)
+{
+    int k, n;
+    char separator;
+    std::istringstream in(text);
+    if (!(in >> k >> separator >> n) || separator != '/' || n < 1 || k < 0 || k >= n) {
+        std::cerr << "ERROR --- Shard must be given as k/N with 0 <= k < N, found: " << text << std::endl;
+        return false;
+    }
+    shard.index = k;
+    shard.count = n;
+
+    return true;
+} // end Parse()
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param indices number of angular indices
+ ***************************************************************/
+ShardMerger::ShardMerger(int indices) : angle_indices(indices)
+{
+    //std::cout << "ShardMerger initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+ShardMerger::~ShardMerger(void)
+{
+    //std::cout << "ShardMerger destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Copies every key of a directory, following sub-directories
+ *
+ * @param source_dir directory to copy
+ * @param target_dir directory copied into, existing keys are replaced
+ ***************************************************************/
+void ShardMerger::CopyDirectory(TDirectory *source_dir, TDirectory *target_dir)
+{
+    std::set<std::string> seen;
+    TList *key_list = source_dir->GetListOfKeys();
+    for (auto k = 0; k < key_list->GetSize(); k++) {
+        TKey *key = (TKey*) key_list->At(k);
+        // only the newest cycle is copied
+        if (!seen.insert(key->GetName()).second) continue;
+        std::string class_name = key->GetClassName();
+        if (class_name.compare("TDirectoryFile") == 0) {
+            TDirectory *sub_dir = target_dir->GetDirectory(key->GetName());
+            if (!sub_dir) sub_dir = target_dir->mkdir(key->GetName());
+            CopyDirectory(source_dir->GetDirectory(key->GetName()), sub_dir);
+        } else if (class_name.compare("TTree") == 0) {
+            // packed formats, baskets are copied without unpacking
+            target_dir->cd();
+            TTree *tree = (TTree*) key->ReadObj();
+            TTree *copy = tree->CloneTree(-1, "fast");
+            copy->Write(key->GetName(), TObject::kOverwrite);
+            delete copy;
+            delete tree;
+        } else {
+            TObject *obj = key->ReadObj();
+            target_dir->WriteTObject(obj, key->GetName(), "WriteDelete");
+            delete obj;
+        }
+    }
+} // end CopyDirectory()
+
+/************************************************************//**
+ * Merges shard outputs into one file
+ *
+ * @param target_filename merged file, created or updated
+ * @param shard_filenames partial outputs of all shards
+ ***************************************************************/
+bool ShardMerger::Merge(std::string target_filename, std::vector<std::string> shard_filenames)
+{
+    TFile target_file(target_filename.c_str(), "UPDATE");
+    if (!target_file.IsOpen()) {
+        std::cerr << "ERROR --- Could not open: " << target_filename << std::endl;
+        return false;
+    }
+
+    if (!ReadLoadedBins(shard_filenames)) return false;
+
+    std::map<std::string, TH2D*> sum_map;
+    std::vector<std::string> sum_name_vec;
+    for (size_t f = 0; f < shard_filenames.size(); f++) {
+        std::cout << "Merging shard " << f + 1 << " of " << shard_filenames.size() << "\r";
+        std::cout.flush();
+
+        TFile shard_file(shard_filenames[f].c_str(), "READ");
+        TNamed *label = shard_file.IsOpen() ? (TNamed*) shard_file.Get("shard") : NULL;
+        ShardSpec shard;
+        if (!label || !ShardSpec::Parse(label->GetTitle(), shard)) {
+            std::cerr << "\nERROR --- Not a shard output: " << shard_filenames[f] << std::endl;
+            return false;
+        }
+
+        std::set<std::string> seen;
+        TList *key_list = shard_file.GetListOfKeys();
+        for (auto k = 0; k < key_list->GetSize(); k++) {
+            TKey *key = (TKey*) key_list->At(k);
+            if (!seen.insert(key->GetName()).second) continue;
+            std::string class_name = key->GetClassName();
+            if (class_name.compare("TDirectoryFile") == 0) {
+                // per-index matrices, disjoint between shards
+                TDirectory *target_dir = target_file.GetDirectory(key->GetName());
+                if (!target_dir) target_dir = target_file.mkdir(key->GetName());
+                CopyDirectory(shard_file.GetDirectory(key->GetName()), target_dir);
+            } else if (class_name.compare("TH2D") == 0) {
+                std::string name = key->GetName();
+                if (HasOwnedErrors(name) && !loaded_bins_map.count(name)) {
+                    std::cerr << "\nERROR --- Missing loaded bins of " << name << " in: " << shard_filenames[f] << std::endl;
+                    return false;
+                }
+                TH2D *h = (TH2D*) key->ReadObj();
+                h->SetDirectory(0);
+                if (!sum_map.count(key->GetName())) {
+                    TH2D *sum = (TH2D*) h->Clone();
+                    sum->SetDirectory(0);
+                    sum->Reset();
+                    if (sum->GetSumw2N() == 0) sum->Sumw2();
+                    sum_map[key->GetName()] = sum;
+                    sum_name_vec.push_back(key->GetName());
+                }
+                AddAngleMatrix(sum_map[key->GetName()], h, shard);
+                delete h;
+            }
+        }
+        shard_file.Close();
+    }
+    std::cout << std::endl;
+
+    target_file.cd();
+    for (auto &name : sum_name_vec) {
+        target_file.WriteTObject(sum_map[name], name.c_str(), "WriteDelete");
+        delete sum_map[name];
+    }
+    target_file.Close();
+    std::cout << "Merged " << shard_filenames.size() << " shards into: " << target_filename << std::endl;
+
+    return true;
+} // end Merge()
+
+/************************************************************//**
+ * Stores the rows each index set the error of next to an angle matrix
+ *
+ * @param shard_dir top directory of the shard output
+ * @param matrix_name angle matrix
+ * @param loaded_bins_vec last row whose error index i set, -1 if not processed
+ ***************************************************************/
+void ShardMerger::WriteLoadedBins(TDirectory *shard_dir, std::string matrix_name, std::vector<int> loaded_bins_vec)
+{
+    TVectorD loaded_bins(loaded_bins_vec.size());
+    for (size_t i = 0; i < loaded_bins_vec.size(); i++) {
+        loaded_bins.GetMatrixArray()[i] = loaded_bins_vec[i];
+    }
+    shard_dir->WriteTObject(&loaded_bins, ("loaded_bins_" + matrix_name).c_str(), "WriteDelete");
+} // end WriteLoadedBins()
+
+/************************************************************//**
+ * Angle matrices calling SetBinError() on column i for index i
+ *
+ * @param name matrix name
+ ***************************************************************/
+bool ShardMerger::HasOwnedErrors(std::string name)
+{
+    return name.compare(0, 13, "angle_matrix_") == 0 || name.compare(0, 14, "gamma1_matrix_") == 0;
+} // end HasOwnedErrors()
+
+/************************************************************//**
+ * Reads the rows every index set the error of
+ *
+ * Every shard only knows the indices it owns, all are read before
+ * the first matrix is added.
+ *
+ * @param shard_filenames partial outputs of all shards
+ ***************************************************************/
+bool ShardMerger::ReadLoadedBins(std::vector<std::string> shard_filenames)
+{
+    const std::string prefix = "loaded_bins_";
+    loaded_bins_map.clear();
+    for (auto &filename : shard_filenames) {
+        TFile shard_file(filename.c_str(), "READ");
+        if (!shard_file.IsOpen()) {
+            std::cerr << "ERROR --- Could not open: " << filename << std::endl;
+            return false;
+        }
+        TList *key_list = shard_file.GetListOfKeys();
+        for (auto k = 0; k < key_list->GetSize(); k++) {
+            std::string key_name = key_list->At(k)->GetName();
+            if (key_name.compare(0, prefix.size(), prefix) != 0) continue;
+            TVectorD *loaded_bins = (TVectorD*) shard_file.Get(key_name.c_str());
+            if (!loaded_bins) continue;
+            std::vector<int> &bins_vec = loaded_bins_map[key_name.substr(prefix.size())];
+            bins_vec.resize(angle_indices, -1);
+            for (auto i = 0; i < std::min(angle_indices, loaded_bins->GetNoElements()); i++) {
+                int bins = (int) loaded_bins->GetMatrixArray()[i];
+                if (bins >= 0) bins_vec[i] = bins;
+            }
+            delete loaded_bins;
+        }
+        shard_file.Close();
+    }
+
+    return true;
+} // end ReadLoadedBins()
+
+/************************************************************//**
+ * Adds the columns of one shard to an angle matrix
+ *
+ * Index i fills x = i, which is bin i + 1, and sets the error of bin
+ * i for rows 0 to the number of loaded bins; rows past the last one
+ * end up in the overflow row. The sumw2 of those rows of column i
+ * comes from the shard owning index i. Every other row only holds
+ * fills, e.g. of index i - 1, and is summed.
+ *
+ * @param target merged matrix
+ * @param source matrix of one shard
+ * @param shard shard the source belongs to
+ ***************************************************************/
+void ShardMerger::AddAngleMatrix(TH2D *target, TH2D *source, const ShardSpec &shard)
+{
+    std::vector<int> owned_rows_vec(angle_indices, -1);
+    if (HasOwnedErrors(target->GetName())) owned_rows_vec = loaded_bins_map[target->GetName()];
+
+    const int row_length = target->GetNbinsX() + 2;
+    const int rows = target->GetNbinsY() + 2;
+    double *content = target->GetArray();
+    double *sumw2 = target->GetSumw2()->GetArray();
+    const double *source_content = source->GetArray();
+    const double *source_sumw2 = source->GetSumw2N() > 0 ? source->GetSumw2()->GetArray() : source->GetArray();
+    for (auto y_bin = 0; y_bin < rows; y_bin++) {
+        for (auto x_bin = 0; x_bin < row_length; x_bin++) {
+            int bin = x_bin + row_length * y_bin;
+            content[bin] += source_content[bin];
+            if (x_bin < angle_indices && y_bin <= std::min(owned_rows_vec[x_bin], rows - 1)) {
+                if (shard.Owns(x_bin)) sumw2[bin] = source_sumw2[bin];
+            } else {
+                sumw2[bin] += source_sumw2[bin];
+            }
+        }
+    }
+    target->SetEntries(target->GetEntries() + source->GetEntries());
+} // end AddAngleMatrix()
+
+/************************************************************//**
+ * Runs every shard of a task in its own local process and merges them
+ *
+ * @param processes number of shards and processes
+ * @param task work of one shard
+ * @param shard_file partial output of a shard
+ * @param target_file merged output
+ ***************************************************************/
+bool ShardMerger::RunLocal(int processes, std::function<bool(ShardSpec)> task, std::function<std::string(ShardSpec)> shard_file, std::string target_file)
+{
+    if (processes < 1) processes = 1;
+    std::vector<std::function<bool()>> task_vec;
+    std::vector<std::string> log_vec;
+    std::vector<std::string> shard_file_vec;
+    for (auto k = 0; k < processes; k++) {
+        ShardSpec spec;
+        spec.index = k;
+        spec.count = processes;
+        task_vec.push_back([task, spec]() {return task(spec);});
+        shard_file_vec.push_back(shard_file(spec));
+        log_vec.push_back(shard_file_vec.back() + ".log");
+    }
+    std::cout << "Running " << processes << " shards, logs in " << log_vec[0] << " ..." << std::endl;
+    if (!BatchRunner::RunPool(task_vec, log_vec, processes)) return false;
+    if (processes == 1) return true;
+
+    ShardMerger merger;
+    if (!merger.Merge(target_file, shard_file_vec)) return false;
+    for (auto &name : shard_file_vec) {
+        std::remove(name.c_str());
+    }
+
+    return true;
+} // end RunLocal()
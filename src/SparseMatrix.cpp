@@ -0,0 +1,407 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Compressed-row storage for sum energy matrices
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   SparseMatrix<float> m;
+//   m.FromHistogram(h);
+//   m.Write(dir, "index_00_sum");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include "TTree.h"
+#include "TKey.h"
+#include "TParameter.h"
+#include "SparseMatrix.h"
+
+/************************************************************//**
+ * Constructor
+ ***************************************************************/
+template <typename T>
+SparseMatrix<T>::SparseMatrix()
+{
+    //std::cout << "SparseMatrix initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+template <typename T>
+SparseMatrix<T>::~SparseMatrix(void)
+{
+    //std::cout << "SparseMatrix destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Compresses a dense matrix
+ *
+ * @param h sum energy (x) vs gamma energy (y) matrix
+ ***************************************************************/
+template <typename T>
+void SparseMatrix<T>::FromHistogram(TH2D *h)
+{
+    x_bins = h->GetXaxis()->GetNbins();
+    x_min = h->GetXaxis()->GetXmin();
+    x_max = h->GetXaxis()->GetXmax();
+    y_bins = h->GetYaxis()->GetNbins();
+    y_min = h->GetYaxis()->GetXmin();
+    y_max = h->GetYaxis()->GetXmax();
+    title = h->GetTitle();
+
+    const int row_length = x_bins + 2;
+    const double *content = h->GetArray();
+    const double *sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : content;
+
+    row_ptr_vec.assign(x_bins + 3, 0);
+    col_vec.clear();
+    content_vec.clear();
+    sumw2_vec.clear();
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        for (auto y_bin = 0; y_bin < y_bins + 2; y_bin++) {
+            int bin = x_bin + row_length * y_bin;
+            if (content[bin] == 0. && sumw2[bin] == 0.) continue;
+            col_vec.push_back(y_bin);
+            content_vec.push_back(StorageTraits<T>::Store(content[bin]));
+            sumw2_vec.push_back(StorageTraits<T>::Store(sumw2[bin]));
+        }
+        row_ptr_vec[x_bin + 1] = col_vec.size();
+    }
+} // end FromHistogram()
+
+/************************************************************//**
+ * Expands to a dense matrix
+ *
+ * @param name name of returned histogram
+ ***************************************************************/
+template <typename T>
+TH2D* SparseMatrix<T>::ToHistogram(std::string name)
+{
+    TH2D *h = new TH2D(name.c_str(), title.c_str(), x_bins, x_min, x_max, y_bins, y_min, y_max);
+    h->Sumw2();
+
+    const int row_length = x_bins + 2;
+    double *content = h->GetArray();
+    double *sumw2 = h->GetSumw2()->GetArray();
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        for (auto entry = row_ptr_vec[x_bin]; entry < row_ptr_vec[x_bin + 1]; entry++) {
+            int bin = x_bin + row_length * col_vec[entry];
+            content[bin] = content_vec[entry];
+            sumw2[bin] = sumw2_vec[entry];
+        }
+    }
+    h->ResetStats();
+
+    return h;
+} // end ToHistogram()
+
+/************************************************************//**
+ * Reads a matrix written by Write()
+ *
+ * @param in_file input file
+ * @param key_name full path of the matrix
+ ***************************************************************/
+template <typename T>
+bool SparseMatrix<T>::Read(TFile *in_file, std::string key_name)
+{
+    TTree *tree = (TTree*) in_file->Get(key_name.c_str());
+    if (!tree) {
+        std::cerr << "\nERROR --- Could not find sparse matrix: " << key_name << std::endl;
+        return false;
+    }
+
+    TList *info = tree->GetUserInfo();
+    TParameter<int> *x_bins_par = (TParameter<int>*) info->FindObject("x_bins");
+    TParameter<double> *x_min_par = (TParameter<double>*) info->FindObject("x_min");
+    TParameter<double> *x_max_par = (TParameter<double>*) info->FindObject("x_max");
+    TParameter<int> *y_bins_par = (TParameter<int>*) info->FindObject("y_bins");
+    TParameter<double> *y_min_par = (TParameter<double>*) info->FindObject("y_min");
+    TParameter<double> *y_max_par = (TParameter<double>*) info->FindObject("y_max");
+    if (!x_bins_par || !x_min_par || !x_max_par || !y_bins_par || !y_min_par || !y_max_par || x_bins_par->GetVal() <= 0 || y_bins_par->GetVal() <= 0) {
+        std::cerr << "\nERROR --- Missing binning of sparse matrix: " << key_name << std::endl;
+        delete tree;
+        return false;
+    }
+    x_bins = x_bins_par->GetVal();
+    x_min = x_min_par->GetVal();
+    x_max = x_max_par->GetVal();
+    y_bins = y_bins_par->GetVal();
+    y_min = y_min_par->GetVal();
+    y_max = y_max_par->GetVal();
+    TNamed *title_obj = (TNamed*) info->FindObject("title");
+    title = title_obj ? title_obj->GetTitle() : "";
+
+    int row, n;
+    std::vector<int> cols(y_bins + 2);
+    LeafBuffer content, sumw2;
+    tree->SetBranchAddress("row", &row);
+    tree->SetBranchAddress("n", &n);
+    tree->SetBranchAddress("col", cols.data());
+    if (!content.Bind(tree, "content", y_bins + 2) || !sumw2.Bind(tree, "sumw2", y_bins + 2)) {
+        delete tree;
+        return false;
+    }
+
+    row_ptr_vec.assign(x_bins + 3, 0);
+    col_vec.clear();
+    content_vec.clear();
+    sumw2_vec.clear();
+    int last_row = -1;
+    for (Long64_t entry = 0; entry < tree->GetEntries(); entry++) {
+        tree->GetEntry(entry);
+        if (row <= last_row || row > x_bins + 1 || n < 0 || n > y_bins + 2) {
+            std::cerr << "\nERROR --- Corrupt row " << row << " of sparse matrix: " << key_name << std::endl;
+            delete tree;
+            return false;
+        }
+        // rows without entries are not stored
+        for (auto r = last_row + 1; r < row; r++) {
+            row_ptr_vec[r + 1] = col_vec.size();
+        }
+        col_vec.insert(col_vec.end(), cols.begin(), cols.begin() + n);
+        content.AppendTo(content_vec, n);
+        sumw2.AppendTo(sumw2_vec, n);
+        row_ptr_vec[row + 1] = col_vec.size();
+        last_row = row;
+    }
+    for (auto r = last_row + 1; r < x_bins + 2; r++) {
+        row_ptr_vec[r + 1] = col_vec.size();
+    }
+
+    delete tree;
+    return true;
+} // end Read()
+
+/************************************************************//**
+ * Writes matrix as a tree of filled rows
+ *
+ * @param dir output directory
+ * @param name key name
+ ***************************************************************/
+template <typename T>
+void SparseMatrix<T>::Write(TDirectory *dir, std::string name)
+{
+    dir->cd();
+    TTree *tree = new TTree(name.c_str(), "sparse");
+
+    TList *info = tree->GetUserInfo();
+    info->Add(new TParameter<int>("x_bins", x_bins));
+    info->Add(new TParameter<double>("x_min", x_min));
+    info->Add(new TParameter<double>("x_max", x_max));
+    info->Add(new TParameter<int>("y_bins", y_bins));
+    info->Add(new TParameter<double>("y_min", y_min));
+    info->Add(new TParameter<double>("y_max", y_max));
+    info->Add(new TNamed("title", title.c_str()));
+
+    int row, n;
+    std::vector<int> cols(y_bins + 2);
+    std::vector<T> content(y_bins + 2), sumw2(y_bins + 2);
+    tree->Branch("row", &row, "row/I");
+    tree->Branch("n", &n, "n/I");
+    tree->Branch("col", cols.data(), "col[n]/I");
+    tree->Branch("content", content.data(), Form("content[n]/%s", StorageTraits<T>::Leaf()));
+    tree->Branch("sumw2", sumw2.data(), Form("sumw2[n]/%s", StorageTraits<T>::Leaf()));
+
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        n = row_ptr_vec[x_bin + 1] - row_ptr_vec[x_bin];
+        if (n == 0) continue;
+        row = x_bin;
+        std::copy(col_vec.begin() + row_ptr_vec[x_bin], col_vec.begin() + row_ptr_vec[x_bin + 1], cols.begin());
+        std::copy(content_vec.begin() + row_ptr_vec[x_bin], content_vec.begin() + row_ptr_vec[x_bin + 1], content.begin());
+        std::copy(sumw2_vec.begin() + row_ptr_vec[x_bin], sumw2_vec.begin() + row_ptr_vec[x_bin + 1], sumw2.begin());
+        tree->Fill();
+    }
+
+    tree->Write("", TObject::kOverwrite);
+    delete tree;
+} // end Write()
+
+/************************************************************//**
+ * Copies a matrix of any storage type
+ *
+ * @param other matrix to copy
+ ***************************************************************/
+template <typename T>
+template <typename U>
+void SparseMatrix<T>::Assign(const SparseMatrix<U> &other)
+{
+    // the matrix itself, nothing to convert
+    if ((const void*) &other == (const void*) this) return;
+
+    x_bins = other.x_bins;
+    x_min = other.x_min;
+    x_max = other.x_max;
+    y_bins = other.y_bins;
+    y_min = other.y_min;
+    y_max = other.y_max;
+    title = other.title;
+
+    row_ptr_vec = other.row_ptr_vec;
+    col_vec = other.col_vec;
+    content_vec.resize(other.content_vec.size());
+    sumw2_vec.resize(other.sumw2_vec.size());
+    for (size_t k = 0; k < content_vec.size(); k++) {
+        content_vec[k] = StorageTraits<T>::Store(other.content_vec[k]);
+        sumw2_vec[k] = StorageTraits<T>::Store(other.sumw2_vec[k]);
+    }
+} // end Assign()
+
+/************************************************************//**
+ * Adds a scaled matrix, this += scale * other
+ *
+ * Rows are merged on their sorted columns, so the cost scales with
+ * the number of filled bins of both matrices.
+ *
+ * @param other matrix with identical binning, any storage type
+ * @param scale factor applied to other (-1 subtracts)
+ ***************************************************************/
+template <typename T>
+template <typename U>
+void SparseMatrix<T>::Add(const SparseMatrix<U> &other, double scale)
+{
+    if (!SameBinning(other)) {
+        std::cerr << "ERROR --- Cannot add sparse matrices with different binning" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    scratch_row_ptr_vec.assign(x_bins + 3, 0);
+    scratch_col_vec.clear();
+    scratch_content_vec.clear();
+    scratch_sumw2_vec.clear();
+    const double scale2 = scale * scale;
+
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        int a = row_ptr_vec[x_bin], a_end = row_ptr_vec[x_bin + 1];
+        int b = other.row_ptr_vec[x_bin], b_end = other.row_ptr_vec[x_bin + 1];
+        while (a < a_end || b < b_end) {
+            int col;
+            double content = 0., sumw2 = 0.;
+            if (b >= b_end || (a < a_end && col_vec[a] < other.col_vec[b])) {
+                col = col_vec[a];
+                content = content_vec[a];
+                sumw2 = sumw2_vec[a];
+                a++;
+            } else if (a >= a_end || other.col_vec[b] < col_vec[a]) {
+                col = other.col_vec[b];
+                content = scale * other.content_vec[b];
+                sumw2 = scale2 * other.sumw2_vec[b];
+                b++;
+            } else {
+                col = col_vec[a];
+                content = content_vec[a] + scale * other.content_vec[b];
+                sumw2 = sumw2_vec[a] + scale2 * other.sumw2_vec[b];
+                a++;
+                b++;
+            }
+            scratch_col_vec.push_back(col);
+            scratch_content_vec.push_back(StorageTraits<T>::Store(content));
+            scratch_sumw2_vec.push_back(StorageTraits<T>::Store(sumw2));
+        }
+        scratch_row_ptr_vec[x_bin + 1] = scratch_col_vec.size();
+    }
+
+    row_ptr_vec.swap(scratch_row_ptr_vec);
+    col_vec.swap(scratch_col_vec);
+    content_vec.swap(scratch_content_vec);
+    sumw2_vec.swap(scratch_sumw2_vec);
+} // end Add()
+
+/************************************************************//**
+ * Projects out X axis (sum energy), including gamma under/overflow
+ *
+ * @param content projected content per x bin (output)
+ * @param errors2 projected squared errors per x bin (output)
+ ***************************************************************/
+template <typename T>
+void SparseMatrix<T>::ProjectX(std::vector<double> &content, std::vector<double> &errors2) const
+{
+    content.assign(x_bins + 2, 0.);
+    errors2.assign(x_bins + 2, 0.);
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        for (auto entry = row_ptr_vec[x_bin]; entry < row_ptr_vec[x_bin + 1]; entry++) {
+            content[x_bin] += content_vec[entry];
+            errors2[x_bin] += sumw2_vec[entry];
+        }
+    }
+} // end ProjectX()
+
+/************************************************************//**
+ * Gates on sum energy and projects out Y axis (gamma energy)
+ *
+ * @param x_low first sum energy bin of gate
+ * @param x_high last sum energy bin of gate
+ * @param content projected content per y bin (output)
+ * @param errors2 projected squared errors per y bin (output)
+ ***************************************************************/
+template <typename T>
+void SparseMatrix<T>::ProjectY(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2) const
+{
+    content.assign(y_bins + 2, 0.);
+    errors2.assign(y_bins + 2, 0.);
+    x_low = std::min(std::max(x_low, 0), x_bins + 1);
+    x_high = std::min(std::max(x_high, 0), x_bins + 1);
+    if (x_low > x_high) return;
+    for (auto entry = row_ptr_vec[x_low]; entry < row_ptr_vec[x_high + 1]; entry++) {
+        content[col_vec[entry]] += content_vec[entry];
+        errors2[col_vec[entry]] += sumw2_vec[entry];
+    }
+} // end ProjectY()
+
+/************************************************************//**
+ * Projects out X axis into a new histogram
+ *
+ * @param name name of returned histogram
+ ***************************************************************/
+template <typename T>
+TH1D* SparseMatrix<T>::ProjectionX(std::string name) const
+{
+    std::vector<double> content, errors2;
+    ProjectX(content, errors2);
+
+    TH1D *h = new TH1D(name.c_str(), title.c_str(), x_bins, x_min, x_max);
+    h->Sumw2();
+    std::copy(content.begin(), content.end(), h->GetArray());
+    std::copy(errors2.begin(), errors2.end(), h->GetSumw2()->GetArray());
+    h->ResetStats();
+
+    return h;
+} // end ProjectionX()
+
+/************************************************************//**
+ * Checks whether a key holds a sparse matrix, without reading it
+ *
+ * @param in_file input file
+ * @param key_name full path of the matrix
+ ***************************************************************/
+template <typename T>
+bool SparseMatrix<T>::IsSparseKey(TFile *in_file, std::string key_name)
+{
+    size_t split = key_name.rfind('/');
+    TDirectory *dir = split == std::string::npos ? in_file : in_file->GetDirectory(key_name.substr(0, split).c_str());
+    if (!dir) return false;
+    TKey *key = dir->GetKey(split == std::string::npos ? key_name.c_str() : key_name.substr(split + 1).c_str());
+
+    return key && std::string(key->GetClassName()).compare("TTree") == 0 && std::string(key->GetTitle()).compare("sparse") == 0;
+} // end IsSparseKey()
+
+/************************************************************//**
+ * Checks two matrices share the same binning
+ ***************************************************************/
+template <typename T>
+template <typename U>
+bool SparseMatrix<T>::SameBinning(const SparseMatrix<U> &other) const
+{
+    return x_bins == other.x_bins && y_bins == other.y_bins && x_min == other.x_min && x_max == other.x_max && y_min == other.y_min && y_max == other.y_max;
+} // end SameBinning()
+
+// storage types of intermediate and final products
+template class SparseMatrix<float>;
+template class SparseMatrix<double>;
+#define INSTANTIATE_SPARSE_MIXED(T, U) \
+    template void SparseMatrix<T>::Assign<U>(const SparseMatrix<U> &other); \
+    template void SparseMatrix<T>::Add<U>(const SparseMatrix<U> &other, double scale);
+INSTANTIATE_SPARSE_MIXED(float, float)
+INSTANTIATE_SPARSE_MIXED(double, float)
+INSTANTIATE_SPARSE_MIXED(double, double)
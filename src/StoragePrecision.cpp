@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Storage precision of matrix products
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   PrecisionPolicy policy;
+//   PrecisionPolicy::FromName("mixed", policy);
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include "TLeaf.h"
+#include "StoragePrecision.h"
+
+/************************************************************//**
+ * Looks up a named precision policy
+ *
+ * @param name "double" or "mixed"
+ * @param policy policy (output)
+ ***************************************************************/
+bool PrecisionPolicy::FromName(std::string name, PrecisionPolicy &policy)
+{
+    if (name.compare("double") == 0) {
+        policy.intermediate = "double";
+    } else if (name.compare("mixed") == 0) {
+        policy.intermediate = "float";
+    } else {
+        return false;
+    }
+
+    return true;
+} // end FromName()
+
+/************************************************************//**
+ * Binds the buffer to an array branch
+ *
+ * @param tree tree holding the branch
+ * @param branch_name name of the branch
+ * @param size largest number of elements in one entry
+ ***************************************************************/
+bool LeafBuffer::Bind(TTree *tree, std::string branch_name, size_t size)
+{
+    TLeaf *leaf = tree->GetLeaf(branch_name.c_str());
+    if (!leaf) {
+        std::cerr << "\nERROR --- Could not find branch: " << branch_name << std::endl;
+        return false;
+    }
+
+    std::string type_name = leaf->GetTypeName();
+    if (type_name.compare("Int_t") == 0) {
+        type = 'I';
+        int_vec.resize(size);
+        tree->SetBranchAddress(branch_name.c_str(), int_vec.data());
+    } else if (type_name.compare("Float_t") == 0) {
+        type = 'F';
+        float_vec.resize(size);
+        tree->SetBranchAddress(branch_name.c_str(), float_vec.data());
+    } else {
+        type = 'D';
+        double_vec.resize(size);
+        tree->SetBranchAddress(branch_name.c_str(), double_vec.data());
+    }
+
+    return true;
+} // end Bind()
@@ -9,77 +9,474 @@
 //////////////////////////////////////////////////////////////////////////////////
 #include <iostream>
 #include <map>
-#include "TGRSIUtilities.h"
-#include "TParserLibrary.h"
-#include "TEnv.h"
+#include <cstdio>
+#include <stdlib.h>
 
 #include "SumPeakAnalysis.h"
 #include "FileHandler.h"
 #include "BGUtils.h"
 #include "HistogramManager.h"
+#include "HistogramMerger.h"
+#include "BatchRunner.h"
+#include "ShardMerger.h"
+#include "Pipeline.h"
+#include "RunWatcher.h"
+#include "DatasetGenerator.h"
+#include "GRSIComponent.h"
 
 
 int main(int argc, char **argv)
 {
-    if (argc == 1) { // no inputs given
+    // split "--key=value" options from positional arguments
+    std::vector<std::string> args;
+    std::map<std::string, std::string> options;
+    ParseArguments(argc, argv, args, options);
+    // histogram-only paths start without GRSISort
+    if (options.count("grsi") && !GRSIComponent::Load()) exit(EXIT_FAILURE);
+
+    if (args.empty()) { // no inputs given
         PrintUsage(argv);
         return 0;
     }
-    else if (argc == 2) {
-        FileHandler * inputs = new FileHandler(argv[1]);
+    else if (args[0].compare("cube") == 0) {
+        if (args.size() != 3 && args.size() != 5) {
+            PrintUsage(argv);
+            return 0;
+        }
+        FileHandler * inputs = new FileHandler(args[1]);
 
-        // Create basic angular histograms
+        // Angular matrices from the contiguous data cube
         HistogramManager * hist_man = new HistogramManager(inputs);
-        hist_man->BuildAllAngularMatrices();
+        if (args.size() == 5) {
+            hist_man->BuildCubeAngularMatrices(args[2], atoi(args[3].c_str()), atoi(args[4].c_str()));
+        } else {
+            hist_man->BuildCubeAngularMatrices(args[2]);
+        }
 
-        std::cout << "Histograms written to: " << argv[1] << std::endl;
+        std::cout << "Histograms written to: " << args[1] << std::endl;
 
         delete inputs;
         delete hist_man;
     }
-    else if (argc == 3) {
-        InitGRSISort();
-        // makes output look nicer
-        std::cout << std::endl;
-        // read in data files
-        FileHandler * inputs = new FileHandler(argv[1], argv[2]);
+    else if (args[0].compare("fit") == 0) {
+        if (args.size() != 3 && args.size() != 4) {
+            PrintUsage(argv);
+            return 0;
+        }
+        FileHandler * inputs = new FileHandler(args[1]);
+
+        // Legendre fits of every gate in one pass
+        HistogramManager * hist_man = new HistogramManager(inputs);
+        hist_man->FitAngularCorrelations(args[2], args.size() == 4 ? args[3] : "total_gamma_angle_matrix_room_bg_subtracted");
+
+        std::cout << "Fit results written to: " << args[1] << std::endl;
+
+        delete inputs;
+        delete hist_man;
+    }
+    else if (args[0].compare("peaks") == 0) {
+        if (args.size() < 3) {
+            PrintUsage(argv);
+            return 0;
+        }
+        FileHandler * inputs = new FileHandler(args[1]);
 
-        // Background subtraction
-        BGUtils *bg_utils = new BGUtils(inputs);
-        //bg_utils->OptimizeBGScaling(true);
-        bg_utils->SubtractAllBackground();
+        std::vector<std::string> matrix_names(args.begin() + 3, args.end());
+        if (matrix_names.empty()) {
+            matrix_names = {"high_gamma_angle_matrix_room_bg_subtracted", "low_gamma_angle_matrix_room_bg_subtracted", "total_gamma_angle_matrix_room_bg_subtracted"};
+        }
+
+        // Peak areas of every index and gate
+        HistogramManager * hist_man = new HistogramManager(inputs);
+        hist_man->FitPeakAreas(args[2], matrix_names);
+
+        std::cout << "Peak fits written to: " << args[1] << std::endl;
 
-        // cleaning up
         delete inputs;
+        delete hist_man;
+    }
+    else if (args[0].compare("mixing") == 0) {
+        if (args.size() != 5 && args.size() != 6) {
+            PrintUsage(argv);
+            return 0;
+        }
+        FileHandler * inputs = new FileHandler(args[1]);
+
+        // Chi2 scan of the mixing ratio for every gate
+        HistogramManager * hist_man = new HistogramManager(inputs);
+        hist_man->ScanMixingRatios(args[2], args[3], args[4], args.size() == 6 ? args[5] : "total_gamma_angle_matrix_room_bg_subtracted");
+
+        std::cout << "Mixing ratio scans written to: " << args[1] << std::endl;
+
+        delete inputs;
+        delete hist_man;
+    }
+    else if (args.size() == 3 && args[0].compare("tile") == 0) {
+        FileHandler * inputs = new FileHandler(args[1]);
+
+        // Write per-index matrices as independently compressed tiles
+        HistogramManager * hist_man = new HistogramManager(inputs);
+        hist_man->BuildTileFile(args[2]);
+
+        std::cout << "Tiled matrices written to: " << args[2] << std::endl;
+
+        delete inputs;
+        delete hist_man;
+    }
+    else if (args.size() == 3 && args[0].compare("cache") == 0) {
+        FileHandler * inputs = new FileHandler(args[1]);
+
+        // Write per-index matrices to a native memory-mapped cache
+        HistogramManager * hist_man = new HistogramManager(inputs);
+        hist_man->BuildCacheFile(args[2]);
+
+        std::cout << "Matrix cache written to: " << args[2] << std::endl;
+
+        delete inputs;
+        delete hist_man;
+    }
+    else if (args.size() == 2 && args[0].compare("batch") == 0) {
+        std::cout << std::endl;
+
+        // Background subtraction of every run pair in the manifest
+        BatchRunner * runner = new BatchRunner(options.count("jobs") ? std::atoi(options["jobs"].c_str()) : 0);
+        if (!runner->ReadManifest(args[1])) exit(EXIT_FAILURE);
+        runner->SetOptions(options);
+        bool good = runner->Run();
+
+        delete runner;
+        if (!good) return EXIT_FAILURE;
+    }
+    else if (args.size() == 3 && args[0].compare("run") == 0) {
+        std::cout << std::endl;
+
+        // Subtraction and angle matrices of all indices as one task graph
+        ShardSpec shard;
+        if (options.count("shard") && !ShardSpec::Parse(options["shard"], shard)) exit(EXIT_FAILURE);
+        FileHandler * inputs = new FileHandler(args[1], args[2], options.count("gains") > 0);
+        if (options.count("gains")) {
+            if (inputs->src_merger && !inputs->src_merger->ReadGainCorrections(options["gains"])) exit(EXIT_FAILURE);
+            if (inputs->bg_merger && !inputs->bg_merger->ReadGainCorrections(options["gains"])) exit(EXIT_FAILURE);
+        }
+        for (auto merger : {inputs->src_merger, inputs->bg_merger}) {
+            if (merger) merger->SetReproducible(options.count("reproducible") > 0);
+        }
+        BGUtils * bg_utils = new BGUtils(inputs);
+        if (options.count("format")) bg_utils->SetStorageFormat(options["format"]);
+        if (options.count("precision")) bg_utils->SetPrecision(options["precision"]);
+        // factors are never created here, optimize them with a serial subtraction
+        bg_utils->SetScaleFile("bg_index_scaling.csv");
+        bg_utils->SetShard(shard);
+
+        Pipeline * pipeline = new Pipeline(inputs, bg_utils, options.count("threads") ? std::atoi(options["threads"].c_str()) : 0);
+        if (options.count("max-memory")) {
+            long long max_memory;
+            if (!Pipeline::ParseMemorySize(options["max-memory"], max_memory)) exit(EXIT_FAILURE);
+            pipeline->SetMaxMemory(max_memory);
+        }
+        bool good = pipeline->Run("outputs.root");
+
+        delete pipeline;
         delete bg_utils;
+        delete inputs;
+        if (!good) return EXIT_FAILURE;
+    }
+    else if (args.size() == 3 && args[0].compare("watch") == 0) {
+        std::cout << std::endl;
+
+        // Online results, runs are added to running totals as they arrive
+        RunWatcher * watcher = new RunWatcher(args[1], args[2]);
+        if (!watcher->Start() || !watcher->Watch()) exit(EXIT_FAILURE);
+
+        delete watcher;
+    }
+    else if (args.size() == 3 && args[0].compare("generate") == 0) {
+        // Synthetic source and room background with known truth
+        DatasetGenerator * generator = new DatasetGenerator(options.count("indices") ? std::atoi(options["indices"].c_str()) : 51);
+        if (options.count("cascades") && !generator->ReadCascades(options["cascades"])) exit(EXIT_FAILURE);
+        if (options.count("lines") && !generator->ReadRoomLines(options["lines"])) exit(EXIT_FAILURE);
+        if (options.count("bins")) generator->SetBinning(std::atoi(options["bins"].c_str()), std::atof(options["bins"].c_str()));
+        generator->SetEvents(options.count("events") ? std::atof(options["events"].c_str()) : 1e5,
+                             options.count("room-events") ? std::atof(options["room-events"].c_str()) : 1e5,
+                             options.count("random-events") ? std::atof(options["random-events"].c_str()) : 1e4);
+        if (options.count("room-scale")) generator->SetRoomScale(std::atof(options["room-scale"].c_str()));
+        if (options.count("seed")) generator->SetSeed(std::atoi(options["seed"].c_str()));
+        if (options.count("threads")) generator->SetThreads(std::atoi(options["threads"].c_str()));
+        bool good = generator->Generate(args[1], args[2]);
+
+        delete generator;
+        if (!good) return EXIT_FAILURE;
+        std::cout << "Datasets written to: " << args[1] << " and " << args[2] << std::endl;
+    }
+    else if (args.size() >= 3 && args[0].compare("shard-merge") == 0) {
+        // Assemble partial outputs of --shard runs
+        ShardMerger merger;
+        if (!merger.Merge(args[1], std::vector<std::string>(args.begin() + 2, args.end()))) exit(EXIT_FAILURE);
+    }
+    else if (args.size() >= 3 && args[0].compare("merge") == 0) {
+        // Merge per-run histogram files, replaces a serial hadd
+        std::vector<std::string> input_files;
+        for (size_t a = 2; a < args.size(); a++) {
+            std::vector<std::string> expanded = HistogramMerger::IsFileList(args[a]) ? HistogramMerger::ParseFileList(args[a]) : std::vector<std::string>(1, args[a]);
+            input_files.insert(input_files.end(), expanded.begin(), expanded.end());
+        }
+        HistogramMerger * merger = new HistogramMerger(input_files, 1);
+        if (!merger->Open()) exit(EXIT_FAILURE);
+        if (options.count("gains") && !merger->ReadGainCorrections(options["gains"])) exit(EXIT_FAILURE);
+        merger->SetReproducible(options.count("reproducible") > 0);
+        if (options.count("threads")) merger->SetThreads(std::atoi(options["threads"].c_str()));
+        if (options.count("max-memory")) {
+            long long max_memory;
+            if (!Pipeline::ParseMemorySize(options["max-memory"], max_memory)) exit(EXIT_FAILURE);
+            merger->SetMaxMemory(max_memory);
+        }
+        TFile * out_file = new TFile(args[1].c_str(), "RECREATE");
+        if (!merger->Write(out_file)) exit(EXIT_FAILURE);
+        out_file->Close();
+
+        std::cout << "Merged histograms written to: " << args[1] << std::endl;
+
+        delete out_file;
+        delete merger;
+    }
+    else if (args.size() == 3 && args[0].compare("export") == 0) {
+        FileHandler * inputs = new FileHandler(args[1]);
+
+        // Write matrices as NumPy arrays for the python stage
+        HistogramManager * hist_man = new HistogramManager(inputs);
+        hist_man->ExportNumpy(args[2]);
+
+        delete inputs;
+        delete hist_man;
+    }
+    else if (args.size() == 1) {
+        ShardSpec shard;
+        if (options.count("shard") && !ShardSpec::Parse(options["shard"], shard)) exit(EXIT_FAILURE);
+
+        // Create basic angular histograms
+        auto build = [&](ShardSpec spec) {
+            FileHandler * inputs = new FileHandler(args[0]);
+            HistogramManager * hist_man = new HistogramManager(inputs);
+            if (options.count("cache")) hist_man->SetCacheFile(options["cache"]);
+            if (options.count("tiles")) hist_man->SetTileFile(options["tiles"]);
+            hist_man->SetShard(spec);
+            hist_man->BuildAllAngularMatrices();
+
+            delete inputs;
+            delete hist_man;
+            return true;
+        };
+        if (options.count("processes")) {
+            auto shard_file = [&](ShardSpec spec) {return HistogramManager::ShardFileName(args[0], spec);};
+            if (!ShardMerger::RunLocal(std::atoi(options["processes"].c_str()), build, shard_file, args[0])) exit(EXIT_FAILURE);
+        } else {
+            build(shard);
+        }
+
+        if (shard.IsSharded()) {
+            std::cout << "Histograms written to: " << HistogramManager::ShardFileName(args[0], shard) << std::endl;
+        } else {
+            std::cout << "Histograms written to: " << args[0] << std::endl;
+            if (options.count("npy")) {
+                FileHandler * inputs = new FileHandler(args[0]);
+                HistogramManager * hist_man = new HistogramManager(inputs);
+                hist_man->ExportNumpy(options["npy"]);
+
+                delete inputs;
+                delete hist_man;
+            }
+        }
+    }
+    else if (args.size() == 2) {
+        // makes output look nicer
+        std::cout << std::endl;
+        ShardSpec shard;
+        if (options.count("shard") && !ShardSpec::Parse(options["shard"], shard)) exit(EXIT_FAILURE);
+
+        auto subtract = [&](ShardSpec spec) {
+            // read in data files
+            // gain matching applies to runs merged on the fly, single runs included
+            FileHandler * inputs = new FileHandler(args[0], args[1], options.count("gains") > 0);
+            if (options.count("gains")) {
+                if (inputs->src_merger && !inputs->src_merger->ReadGainCorrections(options["gains"])) exit(EXIT_FAILURE);
+                if (inputs->bg_merger && !inputs->bg_merger->ReadGainCorrections(options["gains"])) exit(EXIT_FAILURE);
+            }
+            // source and background runs are merged side by side and share the memory limit
+            long long max_memory = 0;
+            if (options.count("max-memory") && !Pipeline::ParseMemorySize(options["max-memory"], max_memory)) exit(EXIT_FAILURE);
+            int num_mergers = (inputs->src_merger ? 1 : 0) + (inputs->bg_merger ? 1 : 0);
+            for (auto merger : {inputs->src_merger, inputs->bg_merger}) {
+                if (!merger) continue;
+                merger->SetReproducible(options.count("reproducible") > 0);
+                if (options.count("threads")) merger->SetThreads(std::atoi(options["threads"].c_str()));
+                merger->SetMaxMemory(max_memory / num_mergers);
+            }
+
+            // Background subtraction
+            BGUtils *bg_utils = new BGUtils(inputs);
+            //bg_utils->OptimizeBGScaling(true);
+            if (options.count("format")) bg_utils->SetStorageFormat(options["format"]);
+            if (options.count("precision")) bg_utils->SetPrecision(options["precision"]);
+            bg_utils->SetShard(spec);
+            bg_utils->SetResume(options.count("resume") > 0);
+            bg_utils->SetCheckpointing(options.count("checkpoint") > 0);
+            bg_utils->SubtractAllBackground();
+
+            // cleaning up
+            delete inputs;
+            delete bg_utils;
+            return true;
+        };
+        if (options.count("processes")) {
+            auto shard_file = [](ShardSpec spec) {return spec.FileName("outputs.root");};
+            if (!ShardMerger::RunLocal(std::atoi(options["processes"].c_str()), subtract, shard_file, "outputs.root")) exit(EXIT_FAILURE);
+        } else {
+            subtract(shard);
+        }
+
+        if (options.count("npy") && !shard.IsSharded()) {
+            FileHandler * outputs = new FileHandler("outputs.root");
+            HistogramManager * hist_man = new HistogramManager(outputs);
+            hist_man->ExportNumpy(options["npy"]);
+
+            delete outputs;
+            delete hist_man;
+        }
+    }
+    else {
+        PrintUsage(argv);
     }
 
     return 0;
 } // main()
 
-void InitGRSISort(){
-    // makes time retrival happy and loads GRSIEnv
-    grsi_path = getenv("GRSISYS");
-    if(grsi_path.length() > 0) {
-        grsi_path += "/";
+/******************************************************************************
+ * Splits command line into positional arguments and options
+ *
+ * Options are given as "--key=value", or "--flag" which is stored
+ * with the value "true".
+ *****************************************************************************/
+void ParseArguments(int argc, char **argv, std::vector<std::string> &args, std::map<std::string, std::string> &options)
+{
+    for (auto i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") == 0) {
+            size_t split = arg.find('=');
+            if (split == std::string::npos) {
+                options[arg.substr(2)] = "true";
+            } else {
+                options[arg.substr(2, split - 2)] = arg.substr(split + 1);
+            }
+        } else {
+            args.push_back(arg);
+        }
     }
-    grsi_path += ".grsirc";
-    gEnv->ReadFile(grsi_path.c_str(), kEnvChange);
-
-    TParserLibrary::Get()->Load();
-} // end InitGRSISort
+} // end ParseArguments
 
 /******************************************************************************
  * Prints usage message and version
  *****************************************************************************/
 void PrintUsage(char* argv[]){
     std::cerr << argv[0] << " Version: " << SumPeakAnalysis_VERSION_MAJOR << "." << SumPeakAnalysis_VERSION_MINOR << "\n"
+              << " --grsi: load the GRSISort component first, only needed for GRSISort objects\n"
               << "\n----- Background Subtractions ------\n"
               << "usage: " << argv[0] << " source_file background_file \n"
               << " source_file: Source histograms\n"
               << " background_file: Background histograms\n"
+              << " either file may be a list of runs (@runs.txt or a.root,b.root), merged on the fly\n"
+              << " --gains=gain_file: CSV with columns file,offset,gain to gain match the runs (single files or lists) while merging\n"
+              << " --reproducible: merge listed runs bin by bin in file order, identical for any thread count\n"
+              << " --threads=N, --max-memory=size: merge threads of listed runs and their memory limit, e.g. 16G\n"
+              << " --shard=k/N: only subtract indices i with i % N == k, written to outputs.shard_k_of_N.root\n"
+              << "   shards read an existing bg_index_scaling.csv, they never create it\n"
+              << " --processes=N: run N shards as local processes and merge them into outputs.root\n"
+              << " --format=dense|sparse|triangular: storage of the written matrices (default: dense)\n"
+              << " --precision=double|mixed: mixed writes float intermediates, double final matrices (default: double)\n"
+              << " --npy=directory: also export the written matrices as NumPy arrays\n"
+              << " --checkpoint: journal finished indices in outputs.root.checkpoint so an interrupted run can be resumed\n"
+              << " --resume: keep indices finished by an interrupted run, implies --checkpoint\n"
               << "\n----- Matrix Creation ------\n"
               << "usage: " << argv[0] << " histogram_file\n"
               << " histogram_file: ROOT file containing background subtracted histograms\n"
+              << " --tiles=tile_file: read gates from a tile file instead of whole matrices\n"
+              << " --cache=cache_file: map matrices from a native cache instead of reading them\n"
+              << " --npy=directory: also export all matrices as NumPy arrays\n"
+              << " --shard=k/N: only build indices i with i % N == k, written to histogram_file_angles.shard_k_of_N.root\n"
+              << " --processes=N: run N shards as local processes and merge them into histogram_file\n"
+              << "\n----- Tiled Matrices ------\n"
+              << "usage: " << argv[0] << " tile histogram_file tile_file\n"
+              << " histogram_file: ROOT file containing background subtracted histograms\n"
+              << " tile_file: output file of independently compressed matrix tiles\n"
+              << "\n----- Matrix Cache ------\n"
+              << "usage: " << argv[0] << " cache histogram_file cache_file\n"
+              << " histogram_file: ROOT file containing background subtracted histograms\n"
+              << " cache_file: output file of uncompressed, memory-mappable matrices\n"
+              << "\n----- Batch Background Subtractions ------\n"
+              << "usage: " << argv[0] << " batch manifest_file\n"
+              << " manifest_file: CSV with columns source,background,output and optionally scaling (default: bg_index_scaling.csv)\n"
+              << " scaling files must exist, jobs only read them\n"
+              << " --jobs=N: number of concurrent jobs (default: all cores)\n"
+              << " --format, --precision, --gains, --reproducible, --threads, --max-memory, --checkpoint and --resume apply per job as for single subtractions\n"
+              << "\n----- Pipeline ------\n"
+              << "usage: " << argv[0] << " run source_file background_file\n"
+              << " subtracts and builds the angle matrices of all indices in one pass into outputs.root\n"
+              << " bg_index_scaling.csv must exist\n"
+              << " --format, --precision, --gains, --reproducible and --shard apply as for single subtractions\n"
+              << " --threads=N: number of worker threads (default: all cores)\n"
+              << " --max-memory=size: limit matrices held at once, e.g. 16G or 800M (default: no limit)\n"
+              << "\n----- Watch Mode ------\n"
+              << "usage: " << argv[0] << " watch run_directory background_file\n"
+              << " run_directory: directory new source runs are written to, runs already there are added first\n"
+              << " background_file: Background histograms, subtracted once at start\n"
+              << " totals are kept in watch_totals.root, results refreshed in outputs.root after every run\n"
+              << "\n----- Synthetic Datasets ------\n"
+              << "usage: " << argv[0] << " generate source_file background_file\n"
+              << " writes prompt and time-random matrices of every index, truth in FILE.truth.csv\n"
+              << " --cascades=cascade_file: CSV with columns e1,e2,intensity,a2,a4 (default: 60Co)\n"
+              << " --lines=line_file: CSV with columns energy,intensity of room lines (default: 40K, 214Bi, 208Tl)\n"
+              << " --events=N: cascade events per index at W(theta) = 1 (default: 1e5)\n"
+              << " --room-events=N: room background pairs per index of the background run (default: 1e5)\n"
+              << " --random-events=N: time-random pairs per index and window (default: 1e4)\n"
+              << " --room-scale=x: room background of the source relative to the background run (default: 1)\n"
+              << " --bins=N: 1 keV bins of both energy axes (default: 3000)\n"
+              << " --indices=N, --seed=N, --threads=N: files are identical for any thread count\n"
+              << "\n----- Merging ------\n"
+              << "usage: " << argv[0] << " merge output_file input_file [input_file ...]\n"
+              << " output_file: merged histogram file\n"
+              << " input_file: per-run histogram files, or lists of them (@runs.txt or a.root,b.root)\n"
+              << " --gains=gain_file: CSV with columns file,offset,gain, E' = offset + gain * E on both axes\n"
+              << " --reproducible: sum files in file order, identical for any thread count\n"
+              << " --threads=N: number of merge threads (default: all cores)\n"
+              << " --max-memory=size: fewer threads if their matrices exceed it, e.g. 16G or 800M (default: no limit)\n"
+              << "\n----- Shard Merging ------\n"
+              << "usage: " << argv[0] << " shard-merge target_file shard_file [shard_file ...]\n"
+              << " target_file: merged file, e.g. outputs.root or the histogram file\n"
+              << " shard_file: partial outputs of all --shard=k/N runs\n"
+              << "\n----- NumPy Export ------\n"
+              << "usage: " << argv[0] << " export histogram_file npy_directory\n"
+              << " histogram_file: ROOT file containing matrices\n"
+              << " npy_directory: output directory of .npy arrays and index.csv\n"
+              << "\n----- Data Cube ------\n"
+              << "usage: " << argv[0] << " cube histogram_file cube_file [sum_low sum_high]\n"
+              << " histogram_file: ROOT file containing background subtracted histograms\n"
+              << " cube_file: binary data cube, created if it does not exist\n"
+              << " sum_low sum_high: sum energy bins kept in the cube (default: all)\n"
+              << "\n----- Angular Correlation Fits ------\n"
+              << "usage: " << argv[0] << " fit histogram_file gates_file [matrix_name]\n"
+              << " histogram_file: ROOT file containing angle matrices\n"
+              << " gates_file: CSV with columns peak_low,peak_high,bg_low,bg_high\n"
+              << " matrix_name: angle matrix to fit (default: total_gamma_angle_matrix_room_bg_subtracted)\n"
+              << "\n----- Peak Areas ------\n"
+              << "usage: " << argv[0] << " peaks histogram_file peaks_file [matrix_name ...]\n"
+              << " histogram_file: ROOT file containing angle matrices\n"
+              << " peaks_file: CSV with columns centroid,range_low,range_high\n"
+              << " matrix_name: angle matrices to fit (default: room bg subtracted single gamma matrices)\n"
+              << "\n----- Mixing Ratio Scan ------\n"
+              << "usage: " << argv[0] << " mixing histogram_file gates_file template_file coefficients_file [matrix_name]\n"
+              << " histogram_file: ROOT file containing angle matrices\n"
+              << " gates_file: CSV with columns peak_low,peak_high,bg_low,bg_high\n"
+              << " template_file: ROOT file with simulated template_p0, template_p2, template_p4 angle matrices\n"
+              << " coefficients_file: CSV with columns k,c0,c1,c2, a_k = (c0 + c1 d + c2 d^2) / (1 + d^2)\n"
+              << " matrix_name: angle matrix to scan (default: total_gamma_angle_matrix_room_bg_subtracted)\n"
               << std::endl;
 } // end PrintUsage
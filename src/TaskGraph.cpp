@@ -0,0 +1,207 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Dependency graph of tasks run by a work-stealing thread pool
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   TaskGraph graph(8);
+//   int a = graph.AddTask("read", [&]() {...});
+//   graph.AddTask("project", [&]() {...}, {a});
+//   graph.Run();
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <thread>
+#include "TaskGraph.h"
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param threads number of worker threads (0 = all cores)
+ ***************************************************************/
+TaskGraph::TaskGraph(int threads) : num_threads(threads)
+{
+    if (num_threads < 1) num_threads = std::thread::hardware_concurrency();
+    if (num_threads < 1) num_threads = 1;
+    //std::cout << "TaskGraph initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+TaskGraph::~TaskGraph(void)
+{
+    //std::cout << "TaskGraph destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Adds a task to the graph
+ *
+ * Dependencies must have been added before, so the graph is acyclic
+ * by construction.
+ *
+ * @param name shown in the progress line
+ * @param work body of the task
+ * @param dependencies tasks that must finish first
+ ***************************************************************/
+int TaskGraph::AddTask(std::string name, std::function<void()> work, std::vector<int> dependencies)
+{
+    int id = task_vec.size();
+    std::unique_ptr<Task> task(new Task());
+    task->name = name;
+    task->work = work;
+    task->remaining = dependencies.size();
+    for (auto dependency : dependencies) {
+        if (dependency < 0 || dependency >= id) {
+            std::cerr << "ERROR --- Task " << name << " depends on unknown task " << dependency << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        task_vec[dependency]->successor_vec.push_back(id);
+    }
+    task_vec.push_back(std::move(task));
+
+    return id;
+} // end AddTask()
+
+/************************************************************//**
+ * Runs all tasks and returns once the last one has finished
+ ***************************************************************/
+void TaskGraph::Run()
+{
+    queue_vec.clear();
+    for (auto t = 0; t < num_threads; t++) {
+        queue_vec.emplace_back(new WorkerQueue());
+    }
+    num_ready = 0;
+    num_done = 0;
+
+    // tasks without dependencies are dealt out round robin
+    int next_worker = 0;
+    for (size_t id = 0; id < task_vec.size(); id++) {
+        if (task_vec[id]->remaining == 0) {
+            Push(next_worker, id);
+            next_worker = (next_worker + 1) % num_threads;
+        }
+    }
+
+    std::vector<std::thread> thread_vec;
+    for (auto t = 1; t < num_threads; t++) {
+        thread_vec.emplace_back(&TaskGraph::Worker, this, t);
+    }
+    Worker(0);
+    for (auto &thread : thread_vec) {
+        thread.join();
+    }
+    std::cout << std::endl;
+} // end Run()
+
+/************************************************************//**
+ * Runs ready tasks until the whole graph has finished
+ *
+ * @param worker index of this worker
+ ***************************************************************/
+void TaskGraph::Worker(int worker)
+{
+    const int total = task_vec.size();
+    while (num_done < total) {
+        int task;
+        if (Pop(worker, task) || Steal(worker, task)) {
+            task_vec[task]->work();
+            Complete(worker, task);
+            continue;
+        }
+        // nothing ready, sleep until a task is released or all are done
+        std::unique_lock<std::mutex> lock(idle_lock);
+        idle_cv.wait(lock, [&]() {return num_ready > 0 || num_done >= total;});
+    }
+} // end Worker()
+
+/************************************************************//**
+ * Takes the newest task of the own deque
+ *
+ * @param worker index of this worker
+ * @param task id of the task taken
+ ***************************************************************/
+bool TaskGraph::Pop(int worker, int &task)
+{
+    WorkerQueue &queue = *queue_vec[worker];
+    {
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if (queue.task_deque.empty()) return false;
+        task = queue.task_deque.back();
+        queue.task_deque.pop_back();
+    }
+    std::lock_guard<std::mutex> lock(idle_lock);
+    num_ready--;
+
+    return true;
+} // end Pop()
+
+/************************************************************//**
+ * Takes the oldest task of another worker
+ *
+ * @param worker index of this worker
+ * @param task id of the task taken
+ ***************************************************************/
+bool TaskGraph::Steal(int worker, int &task)
+{
+    for (auto offset = 1; offset < num_threads; offset++) {
+        WorkerQueue &queue = *queue_vec[(worker + offset) % num_threads];
+        {
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.task_deque.empty()) continue;
+            task = queue.task_deque.front();
+            queue.task_deque.pop_front();
+        }
+        std::lock_guard<std::mutex> lock(idle_lock);
+        num_ready--;
+
+        return true;
+    }
+
+    return false;
+} // end Steal()
+
+/************************************************************//**
+ * Makes a task ready on a worker and wakes an idle worker
+ *
+ * @param worker deque the task is pushed to
+ * @param task id of the ready task
+ ***************************************************************/
+void TaskGraph::Push(int worker, int task)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_vec[worker]->lock);
+        queue_vec[worker]->task_deque.push_back(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_lock);
+        num_ready++;
+    }
+    idle_cv.notify_one();
+} // end Push()
+
+/************************************************************//**
+ * Releases the successors of a finished task
+ *
+ * @param worker index of the worker that ran the task
+ * @param task id of the finished task
+ ***************************************************************/
+void TaskGraph::Complete(int worker, int task)
+{
+    for (auto successor : task_vec[task]->successor_vec) {
+        if (--task_vec[successor]->remaining == 0) Push(worker, successor);
+    }
+
+    int done;
+    {
+        // counted under the lock so a sleeping worker cannot miss the last task
+        std::lock_guard<std::mutex> lock(idle_lock);
+        done = ++num_done;
+    }
+    if (done == (int) task_vec.size()) idle_cv.notify_all();
+
+    std::lock_guard<std::mutex> lock(print_lock);
+    std::cout << "Finished task " << done << " of " << task_vec.size() << " (" << task_vec[task]->name << ")            \r";
+    std::cout.flush();
+} // end Complete()
@@ -0,0 +1,507 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Tiled on-disk sum energy matrices with partial reads
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   TiledMatrixWriter writer;
+//   writer.Open("matrices.tiles");
+//   writer.Add(h, "room_background_subtracted/source_00");
+//   writer.SetSourceHash(Checkpoint::KeyHash({hist_file}, key_vec));
+//   writer.Close();
+//
+//   TiledMatrix tiles;
+//   tiles.Open("matrices.tiles", hist_file);
+//   tiles.Select("room_background_subtracted/source_00");
+//   tiles.ProjectY(gate_low, gate_high, content, errors2);
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "RZip.h"
+#include "Checkpoint.h"
+#include "TiledMatrix.h"
+
+const char tile_magic[8] = {'S', 'P', 'T', 'I', 'L', 'E', '0', '2'};
+
+struct TileFileHeader {
+    char magic[8];
+    unsigned long long index_offset;
+    int num_matrices;
+    int reserved;
+    char source_hash[24]; // key hash of the matrices in the histogram file
+};
+
+/************************************************************//**
+ * Constructor
+ *
+ * @param tile_x sum energy bins per tile
+ * @param tile_y gamma energy bins per tile
+ ***************************************************************/
+TiledMatrixWriter::TiledMatrixWriter(int tile_x, int tile_y) : tile_x_bins(tile_x), tile_y_bins(tile_y)
+{
+    //std::cout << "TiledMatrixWriter initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+TiledMatrixWriter::~TiledMatrixWriter(void)
+{
+    if (out.is_open()) Close();
+    //std::cout << "TiledMatrixWriter destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Creates a tile file
+ *
+ * @param filename tile file
+ ***************************************************************/
+bool TiledMatrixWriter::Open(std::string filename)
+{
+    out.open(filename, std::ios::binary | std::ios::trunc);
+    if (!out.good()) {
+        std::cerr << "ERROR --- Could not open tile file: " << filename << std::endl;
+        return false;
+    }
+
+    // header is rewritten with the index position on Close()
+    TileFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    name_vec.clear();
+    entry_vec.clear();
+
+    return out.good();
+} // end Open()
+
+/************************************************************//**
+ * Appends a matrix
+ *
+ * @param h sum energy (x) vs gamma energy (y) matrix
+ * @param name key of the matrix in the tile file
+ ***************************************************************/
+void TiledMatrixWriter::Add(TH2D *h, std::string name)
+{
+    TiledMatrixEntry entry;
+    entry.x_bins = h->GetXaxis()->GetNbins();
+    entry.x_min = h->GetXaxis()->GetXmin();
+    entry.x_max = h->GetXaxis()->GetXmax();
+    entry.y_bins = h->GetYaxis()->GetNbins();
+    entry.y_min = h->GetYaxis()->GetXmin();
+    entry.y_max = h->GetYaxis()->GetXmax();
+    entry.tile_x_bins = tile_x_bins;
+    entry.tile_y_bins = tile_y_bins;
+    entry.tiles_x = (entry.x_bins + 2 + tile_x_bins - 1) / tile_x_bins;
+    entry.tiles_y = (entry.y_bins + 2 + tile_y_bins - 1) / tile_y_bins;
+
+    const int num_tiles = entry.tiles_x * entry.tiles_y;
+    entry.offset_vec.assign(num_tiles, 0);
+    entry.stored_size_vec.assign(num_tiles, 0);
+    entry.raw_size_vec.assign(num_tiles, 0);
+
+    const int row_length = entry.x_bins + 2;
+    const double *content = h->GetArray();
+    const double *sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : content;
+
+    for (auto tx = 0; tx < entry.tiles_x; tx++) {
+        const int x0 = tx * tile_x_bins;
+        const int nx = std::min(tile_x_bins, entry.x_bins + 2 - x0);
+        for (auto ty = 0; ty < entry.tiles_y; ty++) {
+            const int y0 = ty * tile_y_bins;
+            const int ny = std::min(tile_y_bins, entry.y_bins + 2 - y0);
+
+            // tile layout is [x][y], content block then sumw2 block
+            raw_buffer.assign(2 * nx * ny, 0.);
+            bool empty = true;
+            for (auto x = 0; x < nx; x++) {
+                for (auto y = 0; y < ny; y++) {
+                    int bin = (x0 + x) + row_length * (y0 + y);
+                    raw_buffer[x * ny + y] = content[bin];
+                    raw_buffer[nx * ny + x * ny + y] = sumw2[bin];
+                    if (content[bin] != 0. || sumw2[bin] != 0.) empty = false;
+                }
+            }
+            if (empty) continue;
+
+            int raw_size = raw_buffer.size() * sizeof(double);
+            int stored_size = raw_size;
+            int compressed_size = 0;
+            if ((int) compressed_buffer.size() < raw_size) compressed_buffer.resize(raw_size);
+            R__zipMultipleAlgorithm(1, &raw_size, reinterpret_cast<char*>(raw_buffer.data()), &stored_size, compressed_buffer.data(), &compressed_size, ROOT::RCompressionSetting::EAlgorithm::kLZ4);
+
+            const int tile = tx * entry.tiles_y + ty;
+            entry.offset_vec[tile] = out.tellp();
+            entry.raw_size_vec[tile] = raw_size;
+            if (compressed_size > 0 && compressed_size < raw_size) {
+                entry.stored_size_vec[tile] = compressed_size;
+                out.write(compressed_buffer.data(), compressed_size);
+            } else {
+                // incompressible tiles are stored as they are
+                entry.stored_size_vec[tile] = raw_size;
+                out.write(reinterpret_cast<const char*>(raw_buffer.data()), raw_size);
+            }
+        }
+    }
+
+    name_vec.push_back(name);
+    entry_vec.push_back(entry);
+} // end Add()
+
+/************************************************************//**
+ * Writes the index and closes the file
+ ***************************************************************/
+bool TiledMatrixWriter::Close()
+{
+    TileFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, tile_magic, sizeof(tile_magic));
+    header.index_offset = out.tellp();
+    header.num_matrices = entry_vec.size();
+    std::strncpy(header.source_hash, source_hash.c_str(), sizeof(header.source_hash) - 1);
+
+    for (size_t m = 0; m < entry_vec.size(); m++) {
+        const TiledMatrixEntry &entry = entry_vec[m];
+        int name_length = name_vec[m].size();
+        out.write(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
+        out.write(name_vec[m].c_str(), name_length);
+        out.write(reinterpret_cast<const char*>(&entry.x_bins), sizeof(entry.x_bins));
+        out.write(reinterpret_cast<const char*>(&entry.x_min), sizeof(entry.x_min));
+        out.write(reinterpret_cast<const char*>(&entry.x_max), sizeof(entry.x_max));
+        out.write(reinterpret_cast<const char*>(&entry.y_bins), sizeof(entry.y_bins));
+        out.write(reinterpret_cast<const char*>(&entry.y_min), sizeof(entry.y_min));
+        out.write(reinterpret_cast<const char*>(&entry.y_max), sizeof(entry.y_max));
+        out.write(reinterpret_cast<const char*>(&entry.tile_x_bins), sizeof(entry.tile_x_bins));
+        out.write(reinterpret_cast<const char*>(&entry.tile_y_bins), sizeof(entry.tile_y_bins));
+        out.write(reinterpret_cast<const char*>(&entry.tiles_x), sizeof(entry.tiles_x));
+        out.write(reinterpret_cast<const char*>(&entry.tiles_y), sizeof(entry.tiles_y));
+        out.write(reinterpret_cast<const char*>(entry.offset_vec.data()), entry.offset_vec.size() * sizeof(unsigned long long));
+        out.write(reinterpret_cast<const char*>(entry.stored_size_vec.data()), entry.stored_size_vec.size() * sizeof(int));
+        out.write(reinterpret_cast<const char*>(entry.raw_size_vec.data()), entry.raw_size_vec.size() * sizeof(int));
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    bool good = out.good();
+    out.close();
+    if (!good) {
+        std::cerr << "ERROR --- Could not write tile file" << std::endl;
+    }
+
+    return good;
+} // end Close()
+
+/************************************************************//**
+ * Constructor
+ ***************************************************************/
+TiledMatrix::TiledMatrix()
+{
+    //std::cout << "TiledMatrix initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+TiledMatrix::~TiledMatrix(void)
+{
+    //std::cout << "TiledMatrix destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Opens a tile file and reads its index
+ *
+ * Sizes read from the index are checked against the file before
+ * anything is allocated, and the tiled matrices must be unchanged in
+ * the histogram file.
+ *
+ * @param filename tile file
+ * @param source_file histogram file the tiles stand in for
+ ***************************************************************/
+bool TiledMatrix::Open(std::string filename, TFile *source_file)
+{
+    Close();
+    in.open(filename, std::ios::binary | std::ios::ate);
+    if (!in.good()) {
+        std::cerr << "ERROR --- Could not open tile file: " << filename << std::endl;
+        return false;
+    }
+    const unsigned long long file_size = in.tellg();
+    in.seekg(0);
+
+    TileFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, tile_magic, sizeof(tile_magic)) != 0 || header.index_offset > file_size || header.num_matrices < 0) {
+        std::cerr << "ERROR --- Not a tile file: " << filename << std::endl;
+        in.close();
+        return false;
+    }
+    header.source_hash[sizeof(header.source_hash) - 1] = '\0';
+
+    in.seekg(header.index_offset);
+    std::vector<std::string> name_vec;
+    for (auto m = 0; m < header.num_matrices; m++) {
+        bool valid = false;
+        int name_length = 0;
+        in.read(reinterpret_cast<char*>(&name_length), sizeof(name_length));
+        std::string name;
+        TiledMatrixEntry entry;
+        if (in && name_length >= 0 && (unsigned long long) name_length <= file_size - in.tellg()) {
+            name.resize(name_length);
+            in.read(&name[0], name_length);
+            in.read(reinterpret_cast<char*>(&entry.x_bins), sizeof(entry.x_bins));
+            in.read(reinterpret_cast<char*>(&entry.x_min), sizeof(entry.x_min));
+            in.read(reinterpret_cast<char*>(&entry.x_max), sizeof(entry.x_max));
+            in.read(reinterpret_cast<char*>(&entry.y_bins), sizeof(entry.y_bins));
+            in.read(reinterpret_cast<char*>(&entry.y_min), sizeof(entry.y_min));
+            in.read(reinterpret_cast<char*>(&entry.y_max), sizeof(entry.y_max));
+            in.read(reinterpret_cast<char*>(&entry.tile_x_bins), sizeof(entry.tile_x_bins));
+            in.read(reinterpret_cast<char*>(&entry.tile_y_bins), sizeof(entry.tile_y_bins));
+            in.read(reinterpret_cast<char*>(&entry.tiles_x), sizeof(entry.tiles_x));
+            in.read(reinterpret_cast<char*>(&entry.tiles_y), sizeof(entry.tiles_y));
+        }
+        // the tile grid must cover the matrix and its table fit in the file
+        if (in && entry.x_bins > 0 && entry.y_bins > 0 && entry.tile_x_bins > 0 && entry.tile_y_bins > 0
+            && entry.tiles_x == (entry.x_bins + 2 + entry.tile_x_bins - 1) / entry.tile_x_bins
+            && entry.tiles_y == (entry.y_bins + 2 + entry.tile_y_bins - 1) / entry.tile_y_bins) {
+            const unsigned long long num_tiles = (unsigned long long) entry.tiles_x * entry.tiles_y;
+            const size_t tile_record = sizeof(unsigned long long) + 2 * sizeof(int);
+            if (num_tiles <= (file_size - in.tellg()) / tile_record) {
+                entry.offset_vec.resize(num_tiles);
+                entry.stored_size_vec.resize(num_tiles);
+                entry.raw_size_vec.resize(num_tiles);
+                in.read(reinterpret_cast<char*>(entry.offset_vec.data()), num_tiles * sizeof(unsigned long long));
+                in.read(reinterpret_cast<char*>(entry.stored_size_vec.data()), num_tiles * sizeof(int));
+                in.read(reinterpret_cast<char*>(entry.raw_size_vec.data()), num_tiles * sizeof(int));
+                valid = in && IsValidEntry(entry, header.index_offset);
+            }
+        }
+        if (!valid) {
+            std::cerr << "ERROR --- Truncated or corrupt tile file index: " << filename << std::endl;
+            Close();
+            return false;
+        }
+        index_map[name] = entry;
+        name_vec.push_back(name);
+    }
+    if (Checkpoint::KeyHash({source_file}, name_vec).compare(header.source_hash) != 0) {
+        std::cerr << "ERROR --- Matrices of " << source_file->GetName() << " changed since " << filename << " was built, rebuild the tile file" << std::endl;
+        Close();
+        return false;
+    }
+    std::cout << "Found " << index_map.size() << " tiled matrices in: " << filename << std::endl;
+
+    return true;
+} // end Open()
+
+/************************************************************//**
+ * Checks that every stored tile lies in the data part of the file
+ *
+ * @param entry matrix read from the index
+ * @param data_end start of the index
+ ***************************************************************/
+bool TiledMatrix::IsValidEntry(const TiledMatrixEntry &entry, unsigned long long data_end) const
+{
+    for (auto tx = 0; tx < entry.tiles_x; tx++) {
+        const int nx = std::min(entry.tile_x_bins, entry.x_bins + 2 - tx * entry.tile_x_bins);
+        for (auto ty = 0; ty < entry.tiles_y; ty++) {
+            const int ny = std::min(entry.tile_y_bins, entry.y_bins + 2 - ty * entry.tile_y_bins);
+            const int tile = tx * entry.tiles_y + ty;
+            const int raw_size = entry.raw_size_vec[tile];
+            const int stored_size = entry.stored_size_vec[tile];
+            // empty tiles are not stored
+            if (raw_size == 0 && stored_size == 0) continue;
+            if ((long long) raw_size != 2LL * nx * ny * (long long) sizeof(double)) return false;
+            if (stored_size <= 0 || stored_size > raw_size) return false;
+            if (entry.offset_vec[tile] > data_end || (unsigned long long) stored_size > data_end - entry.offset_vec[tile]) return false;
+        }
+    }
+
+    return true;
+} // end IsValidEntry()
+
+/************************************************************//**
+ * Closes the tile file
+ ***************************************************************/
+void TiledMatrix::Close()
+{
+    if (in.is_open()) in.close();
+    in.clear();
+    index_map.clear();
+    current = NULL;
+    tile_vec.clear();
+    tile_loaded_vec.clear();
+} // end Close()
+
+/************************************************************//**
+ * Selects the matrix that following queries refer to
+ *
+ * @param name key of the matrix
+ ***************************************************************/
+bool TiledMatrix::Select(std::string name)
+{
+    auto it = index_map.find(name);
+    if (it == index_map.end()) {
+        std::cerr << "\nERROR --- Could not find tiled matrix: " << name << std::endl;
+        current = NULL;
+        return false;
+    }
+
+    current = &it->second;
+    const int num_tiles = current->tiles_x * current->tiles_y;
+    // keeps the tile buffers allocated for the next matrix
+    if ((int) tile_vec.size() < num_tiles) tile_vec.resize(num_tiles);
+    if ((int) stored_vec.size() < num_tiles) stored_vec.resize(num_tiles);
+    tile_loaded_vec.assign(num_tiles, 0);
+
+    return true;
+} // end Select()
+
+/************************************************************//**
+ * Clamps both ends of a sum energy bin range into the matrix
+ *
+ * Returns false if no row of the matrix is left.
+ ***************************************************************/
+bool TiledMatrix::ClampRows(int &x_low, int &x_high) const
+{
+    x_low = std::min(std::max(x_low, 0), current->x_bins + 1);
+    x_high = std::min(std::max(x_high, 0), current->x_bins + 1);
+
+    return x_low <= x_high;
+} // end ClampRows()
+
+/************************************************************//**
+ * Makes sure every tile covering the sum energy rows is in memory
+ *
+ * Compressed tiles are read one after the other, then decompressed
+ * in parallel.
+ *
+ * @param x_low first sum energy bin
+ * @param x_high last sum energy bin
+ ***************************************************************/
+void TiledMatrix::LoadTiles(int x_low, int x_high)
+{
+    std::vector<int> missing_vec;
+    for (auto tx = x_low / current->tile_x_bins; tx <= x_high / current->tile_x_bins; tx++) {
+        for (auto ty = 0; ty < current->tiles_y; ty++) {
+            int tile = tx * current->tiles_y + ty;
+            if (tile_loaded_vec[tile]) continue;
+            tile_loaded_vec[tile] = 1;
+            // empty tiles are never stored
+            if (current->raw_size_vec[tile] == 0) {
+                tile_vec[tile].clear();
+                continue;
+            }
+            stored_vec[tile].resize(current->stored_size_vec[tile]);
+            in.seekg(current->offset_vec[tile]);
+            in.read(stored_vec[tile].data(), current->stored_size_vec[tile]);
+            bytes_read += current->stored_size_vec[tile];
+            missing_vec.push_back(tile);
+        }
+    }
+    if (missing_vec.empty()) return;
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        int k;
+        while ((k = next++) < (int) missing_vec.size()) {
+            int tile = missing_vec[k];
+            int raw_size = current->raw_size_vec[tile];
+            int stored_size = current->stored_size_vec[tile];
+            tile_vec[tile].resize(raw_size / sizeof(double));
+            if (stored_size == raw_size) {
+                std::memcpy(tile_vec[tile].data(), stored_vec[tile].data(), raw_size);
+                continue;
+            }
+            int n_out = 0;
+            R__unzip(&stored_size, reinterpret_cast<unsigned char*>(stored_vec[tile].data()), &raw_size, reinterpret_cast<unsigned char*>(tile_vec[tile].data()), &n_out);
+            if (n_out != raw_size) {
+                std::cerr << "\nERROR --- Could not decompress tile " << tile << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+    };
+
+    int threads = num_threads > 0 ? num_threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+    if (threads > (int) missing_vec.size()) threads = missing_vec.size();
+    std::vector<std::thread> thread_vec;
+    for (auto t = 1; t < threads; t++) {
+        thread_vec.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &t : thread_vec) {
+        t.join();
+    }
+} // end LoadTiles()
+
+/************************************************************//**
+ * Projects a sum energy window onto the sum energy axis
+ *
+ * @param x_low first sum energy bin of window
+ * @param x_high last sum energy bin of window
+ * @param content projected content per x bin (output)
+ * @param errors2 projected squared errors per x bin (output)
+ ***************************************************************/
+void TiledMatrix::ProjectX(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2)
+{
+    content.assign(current->x_bins + 2, 0.);
+    errors2.assign(current->x_bins + 2, 0.);
+    // a window outside of the matrix projects nothing
+    if (!ClampRows(x_low, x_high)) return;
+    LoadTiles(x_low, x_high);
+
+    for (auto tx = x_low / current->tile_x_bins; tx <= x_high / current->tile_x_bins; tx++) {
+        const int x0 = tx * current->tile_x_bins;
+        const int nx = std::min(current->tile_x_bins, current->x_bins + 2 - x0);
+        for (auto ty = 0; ty < current->tiles_y; ty++) {
+            const std::vector<double> &tile = tile_vec[tx * current->tiles_y + ty];
+            if (tile.empty()) continue;
+            const int ny = tile.size() / (2 * nx);
+            for (auto x = std::max(0, x_low - x0); x < std::min(nx, x_high - x0 + 1); x++) {
+                for (auto y = 0; y < ny; y++) {
+                    content[x0 + x] += tile[x * ny + y];
+                    errors2[x0 + x] += tile[nx * ny + x * ny + y];
+                }
+            }
+        }
+    }
+} // end ProjectX()
+
+/************************************************************//**
+ * Gates on sum energy and projects out the gamma energy axis
+ *
+ * @param x_low first sum energy bin of gate
+ * @param x_high last sum energy bin of gate
+ * @param content projected content per y bin (output)
+ * @param errors2 projected squared errors per y bin (output)
+ ***************************************************************/
+void TiledMatrix::ProjectY(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2)
+{
+    content.assign(current->y_bins + 2, 0.);
+    errors2.assign(current->y_bins + 2, 0.);
+    // a window outside of the matrix projects nothing
+    if (!ClampRows(x_low, x_high)) return;
+    LoadTiles(x_low, x_high);
+
+    for (auto tx = x_low / current->tile_x_bins; tx <= x_high / current->tile_x_bins; tx++) {
+        const int x0 = tx * current->tile_x_bins;
+        const int nx = std::min(current->tile_x_bins, current->x_bins + 2 - x0);
+        for (auto ty = 0; ty < current->tiles_y; ty++) {
+            const std::vector<double> &tile = tile_vec[tx * current->tiles_y + ty];
+            if (tile.empty()) continue;
+            const int y0 = ty * current->tile_y_bins;
+            const int ny = tile.size() / (2 * nx);
+            for (auto x = std::max(0, x_low - x0); x < std::min(nx, x_high - x0 + 1); x++) {
+                const double *row_content = tile.data() + x * ny;
+                const double *row_sumw2 = tile.data() + nx * ny + x * ny;
+                for (auto y = 0; y < ny; y++) {
+                    content[y0 + y] += row_content[y];
+                    errors2[y0 + y] += row_sumw2[y];
+                }
+            }
+        }
+    }
+} // end ProjectY()
@@ -0,0 +1,508 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Packed lower triangular storage for sum energy matrices
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   TriangularMatrix<float> m;
+//   m.FromHistogram(h);
+//   m.Write(dir, "index_00_sum");
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <algorithm>
+#include "TTree.h"
+#include "TKey.h"
+#include "TParameter.h"
+#include "TriangularMatrix.h"
+
+/************************************************************//**
+ * Constructor
+ ***************************************************************/
+template <typename T>
+TriangularMatrix<T>::TriangularMatrix()
+{
+    //std::cout << "TriangularMatrix initialized" << std::endl;
+} // end Constructor
+
+/************************************************************//**
+ * Destructor
+ ***************************************************************/
+template <typename T>
+TriangularMatrix<T>::~TriangularMatrix(void)
+{
+    //std::cout << "TriangularMatrix destroyed" << std::endl;
+} // end Destructor
+
+/************************************************************//**
+ * Sets the binning and lays out the packed rows
+ *
+ * Row x keeps every gamma bin whose low edge is below the upper edge
+ * of sum energy bin x, the under/overflow rows are kept in full.
+ *
+ * @param nx number of sum energy bins
+ * @param xlow sum energy axis minimum
+ * @param xhigh sum energy axis maximum
+ * @param ny number of gamma energy bins
+ * @param ylow gamma energy axis minimum
+ * @param yhigh gamma energy axis maximum
+ ***************************************************************/
+template <typename T>
+void TriangularMatrix<T>::SetBinning(int nx, double xlow, double xhigh, int ny, double ylow, double yhigh)
+{
+    // layout only depends on the binning, skip when it is unchanged
+    if (!row_ptr_vec.empty() && nx == x_bins && ny == y_bins && xlow == x_min && xhigh == x_max && ylow == y_min && yhigh == y_max) return;
+
+    x_bins = nx;
+    x_min = xlow;
+    x_max = xhigh;
+    y_bins = ny;
+    y_min = ylow;
+    y_max = yhigh;
+
+    const double x_width = (x_max - x_min) / x_bins;
+    const double y_width = (y_max - y_min) / y_bins;
+
+    row_ptr_vec.assign(x_bins + 3, 0);
+    // rows grow monotonically, so the gamma bin limit only moves forward
+    int row_length = 1;
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        if (x_bin == x_bins + 1) {
+            row_length = y_bins + 2;
+        } else {
+            double up_edge = x_min + x_bin * x_width;
+            while (row_length < y_bins + 2) {
+                double low_edge = row_length == y_bins + 1 ? y_max : y_min + (row_length - 1) * y_width;
+                if (low_edge >= up_edge) break;
+                row_length++;
+            }
+        }
+        row_ptr_vec[x_bin + 1] = row_ptr_vec[x_bin] + row_length;
+    }
+} // end SetBinning()
+
+/************************************************************//**
+ * Packs a dense matrix
+ *
+ * @param h sum energy (x) vs gamma energy (y) matrix
+ ***************************************************************/
+template <typename T>
+void TriangularMatrix<T>::FromHistogram(TH2D *h)
+{
+    SetBinning(h->GetXaxis()->GetNbins(), h->GetXaxis()->GetXmin(), h->GetXaxis()->GetXmax(), h->GetYaxis()->GetNbins(), h->GetYaxis()->GetXmin(), h->GetYaxis()->GetXmax());
+    title = h->GetTitle();
+
+    const int row_length = x_bins + 2;
+    const double *content = h->GetArray();
+    const double *sumw2 = h->GetSumw2N() > 0 ? h->GetSumw2()->GetArray() : content;
+
+    content_vec.assign(row_ptr_vec.back(), 0.);
+    sumw2_vec.assign(row_ptr_vec.back(), 0.);
+    spill_row_ptr_vec.assign(x_bins + 3, 0);
+    spill_col_vec.clear();
+    spill_content_vec.clear();
+    spill_sumw2_vec.clear();
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        const int packed = row_ptr_vec[x_bin + 1] - row_ptr_vec[x_bin];
+        for (auto y_bin = 0; y_bin < packed; y_bin++) {
+            content_vec[row_ptr_vec[x_bin] + y_bin] = StorageTraits<T>::Store(content[x_bin + row_length * y_bin]);
+            sumw2_vec[row_ptr_vec[x_bin] + y_bin] = StorageTraits<T>::Store(sumw2[x_bin + row_length * y_bin]);
+        }
+        for (auto y_bin = packed; y_bin < y_bins + 2; y_bin++) {
+            int bin = x_bin + row_length * y_bin;
+            if (content[bin] == 0. && sumw2[bin] == 0.) continue;
+            spill_col_vec.push_back(y_bin);
+            spill_content_vec.push_back(StorageTraits<T>::Store(content[bin]));
+            spill_sumw2_vec.push_back(StorageTraits<T>::Store(sumw2[bin]));
+        }
+        spill_row_ptr_vec[x_bin + 1] = spill_col_vec.size();
+    }
+} // end FromHistogram()
+
+/************************************************************//**
+ * Expands to a dense matrix
+ *
+ * @param name name of returned histogram
+ ***************************************************************/
+template <typename T>
+TH2D* TriangularMatrix<T>::ToHistogram(std::string name)
+{
+    TH2D *h = new TH2D(name.c_str(), title.c_str(), x_bins, x_min, x_max, y_bins, y_min, y_max);
+    h->Sumw2();
+
+    const int row_length = x_bins + 2;
+    double *content = h->GetArray();
+    double *sumw2 = h->GetSumw2()->GetArray();
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        const int packed = row_ptr_vec[x_bin + 1] - row_ptr_vec[x_bin];
+        for (auto y_bin = 0; y_bin < packed; y_bin++) {
+            content[x_bin + row_length * y_bin] = content_vec[row_ptr_vec[x_bin] + y_bin];
+            sumw2[x_bin + row_length * y_bin] = sumw2_vec[row_ptr_vec[x_bin] + y_bin];
+        }
+        for (auto entry = spill_row_ptr_vec[x_bin]; entry < spill_row_ptr_vec[x_bin + 1]; entry++) {
+            content[x_bin + row_length * spill_col_vec[entry]] = spill_content_vec[entry];
+            sumw2[x_bin + row_length * spill_col_vec[entry]] = spill_sumw2_vec[entry];
+        }
+    }
+    h->ResetStats();
+
+    return h;
+} // end ToHistogram()
+
+/************************************************************//**
+ * Reads a matrix written by Write()
+ *
+ * @param in_file input file
+ * @param key_name full path of the matrix
+ ***************************************************************/
+template <typename T>
+bool TriangularMatrix<T>::Read(TFile *in_file, std::string key_name)
+{
+    TTree *tree = (TTree*) in_file->Get(key_name.c_str());
+    if (!tree) {
+        std::cerr << "\nERROR --- Could not find triangular matrix: " << key_name << std::endl;
+        return false;
+    }
+
+    TList *info = tree->GetUserInfo();
+    TParameter<int> *x_bins_par = (TParameter<int>*) info->FindObject("x_bins");
+    TParameter<double> *x_min_par = (TParameter<double>*) info->FindObject("x_min");
+    TParameter<double> *x_max_par = (TParameter<double>*) info->FindObject("x_max");
+    TParameter<int> *y_bins_par = (TParameter<int>*) info->FindObject("y_bins");
+    TParameter<double> *y_min_par = (TParameter<double>*) info->FindObject("y_min");
+    TParameter<double> *y_max_par = (TParameter<double>*) info->FindObject("y_max");
+    if (!x_bins_par || !x_min_par || !x_max_par || !y_bins_par || !y_min_par || !y_max_par || x_bins_par->GetVal() <= 0 || y_bins_par->GetVal() <= 0) {
+        std::cerr << "\nERROR --- Missing binning of triangular matrix: " << key_name << std::endl;
+        delete tree;
+        return false;
+    }
+    SetBinning(x_bins_par->GetVal(), x_min_par->GetVal(), x_max_par->GetVal(),
+               y_bins_par->GetVal(), y_min_par->GetVal(), y_max_par->GetVal());
+    TNamed *title_obj = (TNamed*) info->FindObject("title");
+    title = title_obj ? title_obj->GetTitle() : "";
+
+    int row, n, ns;
+    LeafBuffer content, sumw2;
+    std::vector<int> spill_cols(y_bins + 2);
+    LeafBuffer spill_content, spill_sumw2;
+    tree->SetBranchAddress("row", &row);
+    tree->SetBranchAddress("n", &n);
+    tree->SetBranchAddress("ns", &ns);
+    tree->SetBranchAddress("spill_col", spill_cols.data());
+    if (!content.Bind(tree, "content", y_bins + 2) || !sumw2.Bind(tree, "sumw2", y_bins + 2) || !spill_content.Bind(tree, "spill_content", y_bins + 2) || !spill_sumw2.Bind(tree, "spill_sumw2", y_bins + 2)) {
+        delete tree;
+        return false;
+    }
+
+    // rows that were empty are not stored
+    content_vec.assign(row_ptr_vec.back(), 0.);
+    sumw2_vec.assign(row_ptr_vec.back(), 0.);
+    spill_row_ptr_vec.assign(x_bins + 3, 0);
+    spill_col_vec.clear();
+    spill_content_vec.clear();
+    spill_sumw2_vec.clear();
+    int last_row = -1;
+    for (Long64_t entry = 0; entry < tree->GetEntries(); entry++) {
+        tree->GetEntry(entry);
+        if (row <= last_row || row > x_bins + 1 || n < 0 || n > row_ptr_vec[row + 1] - row_ptr_vec[row] || ns < 0 || ns > y_bins + 2) {
+            std::cerr << "\nERROR --- Corrupt row " << row << " of triangular matrix: " << key_name << std::endl;
+            delete tree;
+            return false;
+        }
+        content.CopyTo(content_vec.data() + row_ptr_vec[row], n);
+        sumw2.CopyTo(sumw2_vec.data() + row_ptr_vec[row], n);
+        for (auto r = last_row + 1; r < row; r++) {
+            spill_row_ptr_vec[r + 1] = spill_col_vec.size();
+        }
+        spill_col_vec.insert(spill_col_vec.end(), spill_cols.begin(), spill_cols.begin() + ns);
+        spill_content.AppendTo(spill_content_vec, ns);
+        spill_sumw2.AppendTo(spill_sumw2_vec, ns);
+        spill_row_ptr_vec[row + 1] = spill_col_vec.size();
+        last_row = row;
+    }
+    for (auto r = last_row + 1; r < x_bins + 2; r++) {
+        spill_row_ptr_vec[r + 1] = spill_col_vec.size();
+    }
+
+    delete tree;
+    return true;
+} // end Read()
+
+/************************************************************//**
+ * Writes matrix as a tree of packed rows
+ *
+ * @param dir output directory
+ * @param name key name
+ ***************************************************************/
+template <typename T>
+void TriangularMatrix<T>::Write(TDirectory *dir, std::string name)
+{
+    dir->cd();
+    TTree *tree = new TTree(name.c_str(), "triangular");
+
+    TList *info = tree->GetUserInfo();
+    info->Add(new TParameter<int>("x_bins", x_bins));
+    info->Add(new TParameter<double>("x_min", x_min));
+    info->Add(new TParameter<double>("x_max", x_max));
+    info->Add(new TParameter<int>("y_bins", y_bins));
+    info->Add(new TParameter<double>("y_min", y_min));
+    info->Add(new TParameter<double>("y_max", y_max));
+    info->Add(new TNamed("title", title.c_str()));
+
+    int row, n, ns;
+    std::vector<T> content(y_bins + 2), sumw2(y_bins + 2);
+    std::vector<int> spill_cols(y_bins + 2);
+    std::vector<T> spill_content(y_bins + 2), spill_sumw2(y_bins + 2);
+    const char *leaf = StorageTraits<T>::Leaf();
+    tree->Branch("row", &row, "row/I");
+    tree->Branch("n", &n, "n/I");
+    tree->Branch("content", content.data(), Form("content[n]/%s", leaf));
+    tree->Branch("sumw2", sumw2.data(), Form("sumw2[n]/%s", leaf));
+    tree->Branch("ns", &ns, "ns/I");
+    tree->Branch("spill_col", spill_cols.data(), "spill_col[ns]/I");
+    tree->Branch("spill_content", spill_content.data(), Form("spill_content[ns]/%s", leaf));
+    tree->Branch("spill_sumw2", spill_sumw2.data(), Form("spill_sumw2[ns]/%s", leaf));
+
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        auto row_begin = content_vec.begin() + row_ptr_vec[x_bin];
+        auto row_end = content_vec.begin() + row_ptr_vec[x_bin + 1];
+        auto err_begin = sumw2_vec.begin() + row_ptr_vec[x_bin];
+        auto err_end = sumw2_vec.begin() + row_ptr_vec[x_bin + 1];
+        ns = spill_row_ptr_vec[x_bin + 1] - spill_row_ptr_vec[x_bin];
+        bool empty = std::all_of(row_begin, row_end, [](T v) {return v == 0;}) && std::all_of(err_begin, err_end, [](T v) {return v == 0;});
+        if (empty && ns == 0) continue;
+
+        row = x_bin;
+        n = row_ptr_vec[x_bin + 1] - row_ptr_vec[x_bin];
+        std::copy(row_begin, row_end, content.begin());
+        std::copy(err_begin, err_end, sumw2.begin());
+        std::copy(spill_col_vec.begin() + spill_row_ptr_vec[x_bin], spill_col_vec.begin() + spill_row_ptr_vec[x_bin + 1], spill_cols.begin());
+        std::copy(spill_content_vec.begin() + spill_row_ptr_vec[x_bin], spill_content_vec.begin() + spill_row_ptr_vec[x_bin + 1], spill_content.begin());
+        std::copy(spill_sumw2_vec.begin() + spill_row_ptr_vec[x_bin], spill_sumw2_vec.begin() + spill_row_ptr_vec[x_bin + 1], spill_sumw2.begin());
+        tree->Fill();
+    }
+
+    tree->Write("", TObject::kOverwrite);
+    delete tree;
+} // end Write()
+
+/************************************************************//**
+ * Copies a matrix of any storage type
+ *
+ * @param other matrix to copy
+ ***************************************************************/
+template <typename T>
+template <typename U>
+void TriangularMatrix<T>::Assign(const TriangularMatrix<U> &other)
+{
+    // the matrix itself, nothing to convert
+    if ((const void*) &other == (const void*) this) return;
+
+    SetBinning(other.x_bins, other.x_min, other.x_max, other.y_bins, other.y_min, other.y_max);
+    title = other.title;
+
+    content_vec.resize(other.content_vec.size());
+    sumw2_vec.resize(other.sumw2_vec.size());
+    for (size_t k = 0; k < content_vec.size(); k++) {
+        content_vec[k] = StorageTraits<T>::Store(other.content_vec[k]);
+        sumw2_vec[k] = StorageTraits<T>::Store(other.sumw2_vec[k]);
+    }
+    spill_row_ptr_vec = other.spill_row_ptr_vec;
+    spill_col_vec = other.spill_col_vec;
+    spill_content_vec.resize(other.spill_content_vec.size());
+    spill_sumw2_vec.resize(other.spill_sumw2_vec.size());
+    for (size_t k = 0; k < spill_content_vec.size(); k++) {
+        spill_content_vec[k] = StorageTraits<T>::Store(other.spill_content_vec[k]);
+        spill_sumw2_vec[k] = StorageTraits<T>::Store(other.spill_sumw2_vec[k]);
+    }
+} // end Assign()
+
+/************************************************************//**
+ * Adds a scaled matrix, this += scale * other
+ *
+ * Both matrices share the packed layout, so the triangle is a single
+ * flat loop. Spill rows are merged on their sorted columns.
+ *
+ * @param other matrix with identical binning, any storage type
+ * @param scale factor applied to other (-1 subtracts)
+ ***************************************************************/
+template <typename T>
+template <typename U>
+void TriangularMatrix<T>::Add(const TriangularMatrix<U> &other, double scale)
+{
+    if (!SameBinning(other)) {
+        std::cerr << "ERROR --- Cannot add triangular matrices with different binning" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    const double scale2 = scale * scale;
+    const size_t packed = content_vec.size();
+    T *content = content_vec.data();
+    T *sumw2 = sumw2_vec.data();
+    const U *other_content = other.content_vec.data();
+    const U *other_sumw2 = other.sumw2_vec.data();
+    for (size_t k = 0; k < packed; k++) {
+        content[k] = StorageTraits<T>::Store(content[k] + scale * other_content[k]);
+        sumw2[k] = StorageTraits<T>::Store(sumw2[k] + scale2 * other_sumw2[k]);
+    }
+
+    if (other.spill_col_vec.empty()) return;
+
+    scratch_row_ptr_vec.assign(x_bins + 3, 0);
+    scratch_col_vec.clear();
+    scratch_content_vec.clear();
+    scratch_sumw2_vec.clear();
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        int a = spill_row_ptr_vec[x_bin], a_end = spill_row_ptr_vec[x_bin + 1];
+        int b = other.spill_row_ptr_vec[x_bin], b_end = other.spill_row_ptr_vec[x_bin + 1];
+        while (a < a_end || b < b_end) {
+            if (b >= b_end || (a < a_end && spill_col_vec[a] < other.spill_col_vec[b])) {
+                scratch_col_vec.push_back(spill_col_vec[a]);
+                scratch_content_vec.push_back(spill_content_vec[a]);
+                scratch_sumw2_vec.push_back(spill_sumw2_vec[a]);
+                a++;
+            } else if (a >= a_end || other.spill_col_vec[b] < spill_col_vec[a]) {
+                scratch_col_vec.push_back(other.spill_col_vec[b]);
+                scratch_content_vec.push_back(StorageTraits<T>::Store(scale * other.spill_content_vec[b]));
+                scratch_sumw2_vec.push_back(StorageTraits<T>::Store(scale2 * other.spill_sumw2_vec[b]));
+                b++;
+            } else {
+                scratch_col_vec.push_back(spill_col_vec[a]);
+                scratch_content_vec.push_back(StorageTraits<T>::Store(spill_content_vec[a] + scale * other.spill_content_vec[b]));
+                scratch_sumw2_vec.push_back(StorageTraits<T>::Store(spill_sumw2_vec[a] + scale2 * other.spill_sumw2_vec[b]));
+                a++;
+                b++;
+            }
+        }
+        scratch_row_ptr_vec[x_bin + 1] = scratch_col_vec.size();
+    }
+
+    spill_row_ptr_vec.swap(scratch_row_ptr_vec);
+    spill_col_vec.swap(scratch_col_vec);
+    spill_content_vec.swap(scratch_content_vec);
+    spill_sumw2_vec.swap(scratch_sumw2_vec);
+} // end Add()
+
+/************************************************************//**
+ * Projects out X axis (sum energy), including gamma under/overflow
+ *
+ * @param content projected content per x bin (output)
+ * @param errors2 projected squared errors per x bin (output)
+ ***************************************************************/
+template <typename T>
+void TriangularMatrix<T>::ProjectX(std::vector<double> &content, std::vector<double> &errors2) const
+{
+    content.assign(x_bins + 2, 0.);
+    errors2.assign(x_bins + 2, 0.);
+    for (auto x_bin = 0; x_bin < x_bins + 2; x_bin++) {
+        for (auto k = row_ptr_vec[x_bin]; k < row_ptr_vec[x_bin + 1]; k++) {
+            content[x_bin] += content_vec[k];
+            errors2[x_bin] += sumw2_vec[k];
+        }
+        for (auto entry = spill_row_ptr_vec[x_bin]; entry < spill_row_ptr_vec[x_bin + 1]; entry++) {
+            content[x_bin] += spill_content_vec[entry];
+            errors2[x_bin] += spill_sumw2_vec[entry];
+        }
+    }
+} // end ProjectX()
+
+/************************************************************//**
+ * Gates on sum energy and projects out Y axis (gamma energy)
+ *
+ * @param x_low first sum energy bin of gate
+ * @param x_high last sum energy bin of gate
+ * @param content projected content per y bin (output)
+ * @param errors2 projected squared errors per y bin (output)
+ ***************************************************************/
+template <typename T>
+void TriangularMatrix<T>::ProjectY(int x_low, int x_high, std::vector<double> &content, std::vector<double> &errors2) const
+{
+    content.assign(y_bins + 2, 0.);
+    errors2.assign(y_bins + 2, 0.);
+    x_low = std::min(std::max(x_low, 0), x_bins + 1);
+    x_high = std::min(std::max(x_high, 0), x_bins + 1);
+    if (x_low > x_high) return;
+    for (auto x_bin = x_low; x_bin <= x_high; x_bin++) {
+        const T *row_content = content_vec.data() + row_ptr_vec[x_bin];
+        const T *row_sumw2 = sumw2_vec.data() + row_ptr_vec[x_bin];
+        const int packed = row_ptr_vec[x_bin + 1] - row_ptr_vec[x_bin];
+        for (auto y_bin = 0; y_bin < packed; y_bin++) {
+            content[y_bin] += row_content[y_bin];
+            errors2[y_bin] += row_sumw2[y_bin];
+        }
+        for (auto entry = spill_row_ptr_vec[x_bin]; entry < spill_row_ptr_vec[x_bin + 1]; entry++) {
+            content[spill_col_vec[entry]] += spill_content_vec[entry];
+            errors2[spill_col_vec[entry]] += spill_sumw2_vec[entry];
+        }
+    }
+} // end ProjectY()
+
+/************************************************************//**
+ * Unpacks one sum energy row
+ *
+ * @param x_bin sum energy bin
+ * @param content content per y bin (output)
+ * @param errors2 squared errors per y bin (output)
+ ***************************************************************/
+template <typename T>
+void TriangularMatrix<T>::GetRow(int x_bin, std::vector<double> &content, std::vector<double> &errors2) const
+{
+    ProjectY(x_bin, x_bin, content, errors2);
+} // end GetRow()
+
+/************************************************************//**
+ * Projects out X axis into a new histogram
+ *
+ * @param name name of returned histogram
+ ***************************************************************/
+template <typename T>
+TH1D* TriangularMatrix<T>::ProjectionX(std::string name) const
+{
+    std::vector<double> content, errors2;
+    ProjectX(content, errors2);
+
+    TH1D *h = new TH1D(name.c_str(), title.c_str(), x_bins, x_min, x_max);
+    h->Sumw2();
+    std::copy(content.begin(), content.end(), h->GetArray());
+    std::copy(errors2.begin(), errors2.end(), h->GetSumw2()->GetArray());
+    h->ResetStats();
+
+    return h;
+} // end ProjectionX()
+
+/************************************************************//**
+ * Checks whether a key holds a triangular matrix, without reading it
+ *
+ * @param in_file input file
+ * @param key_name full path of the matrix
+ ***************************************************************/
+template <typename T>
+bool TriangularMatrix<T>::IsTriangularKey(TFile *in_file, std::string key_name)
+{
+    size_t split = key_name.rfind('/');
+    TDirectory *dir = split == std::string::npos ? in_file : in_file->GetDirectory(key_name.substr(0, split).c_str());
+    if (!dir) return false;
+    TKey *key = dir->GetKey(split == std::string::npos ? key_name.c_str() : key_name.substr(split + 1).c_str());
+
+    return key && std::string(key->GetClassName()).compare("TTree") == 0 && std::string(key->GetTitle()).compare("triangular") == 0;
+} // end IsTriangularKey()
+
+/************************************************************//**
+ * Checks two matrices share the same binning
+ ***************************************************************/
+template <typename T>
+template <typename U>
+bool TriangularMatrix<T>::SameBinning(const TriangularMatrix<U> &other) const
+{
+    return x_bins == other.x_bins && y_bins == other.y_bins && x_min == other.x_min && x_max == other.x_max && y_min == other.y_min && y_max == other.y_max;
+} // end SameBinning()
+
+// storage types of intermediate and final products
+template class TriangularMatrix<float>;
+template class TriangularMatrix<double>;
+#define INSTANTIATE_TRIANGULAR_MIXED(T, U) \
+    template void TriangularMatrix<T>::Assign<U>(const TriangularMatrix<U> &other); \
+    template void TriangularMatrix<T>::Add<U>(const TriangularMatrix<U> &other, double scale);
+INSTANTIATE_TRIANGULAR_MIXED(float, float)
+INSTANTIATE_TRIANGULAR_MIXED(double, float)
+INSTANTIATE_TRIANGULAR_MIXED(double, double)
@@ -0,0 +1,45 @@
+//////////////////////////////////////////////////////////////////////////////////
+// Single peak fits with the GRSISort peak fitter, part of libSumPeakGRSI
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   GRSIComponent::GetPeakFitter() from the executable
+//////////////////////////////////////////////////////////////////////////////////
+#include <cmath>
+#include "TH1.h"
+#include "TF1.h"
+#include "TPeakFitter.h"
+#include "TRWPeak.h"
+#include "BatchPeakFitter.h"
+
+/************************************************************//**
+ * Fits one radware peak in a projection
+ *
+ * @param projection projection of one angular index
+ * @param fit_low low edge of the fit range
+ * @param fit_high high edge of the fit range
+ * @param centroid_guess starting centroid
+ * @param result filled with the fitted peak
+ ***************************************************************/
+extern "C" bool SumPeakGRSI_FitPeak(TH1D *projection, double fit_low, double fit_high, double centroid_guess, PeakFitResult *result)
+{
+    // the fitter keeps a pointer to the peak, so the peak is destroyed last
+    TRWPeak peak(centroid_guess);
+    TPeakFitter fitter(fit_low, fit_high);
+    fitter.AddPeak(&peak);
+    fitter.Fit(projection, "Q");
+
+    TF1 *fit_function = fitter.GetFitFunction();
+    result->centroid = peak.Centroid();
+    result->centroid_err = peak.CentroidErr();
+    result->area = peak.Area();
+    result->area_err = peak.AreaErr();
+    result->fwhm = peak.FWHM();
+    result->chi2 = fit_function ? fit_function->GetChisquare() : 0.;
+    result->ndf = fit_function ? fit_function->GetNDF() : 0;
+    result->valid = std::isfinite(result->area) && std::isfinite(result->area_err) && result->ndf > 0;
+
+    return result->valid;
+} // end SumPeakGRSI_FitPeak()
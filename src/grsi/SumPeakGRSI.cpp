@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////////////
+// GRSISort dependent parts, built as libSumPeakGRSI and loaded on demand
+//
+// Author:        Connor Natzke (cnatzke@triumf.ca)
+// Creation Date: 19-10-2026
+// Last Update:   19-10-2026
+// Usage:
+//   GRSIComponent::Load() from the executable
+//////////////////////////////////////////////////////////////////////////////////
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+#include "TGRSIUtilities.h"
+#include "TParserLibrary.h"
+#include "TEnv.h"
+#include "TGriffin.h"
+#include "TGriffinBgo.h"
+
+/************************************************************//**
+ * Keeps the GRSIData libraries linked into the component
+ *
+ * Without a reference the linker drops them and their dictionaries
+ * are missing once the component is loaded.
+ ***************************************************************/
+extern "C" int SumPeakGRSI_SuppressedMultiplicity(TGriffin *grif, TGriffinBgo *bgo)
+{
+    return grif->GetSuppressedMultiplicity(bgo);
+} // end SumPeakGRSI_SuppressedMultiplicity()
+
+/************************************************************//**
+ * Reads .grsirc and loads the parser library
+ ***************************************************************/
+extern "C" bool SumPeakGRSI_Init()
+{
+    // makes time retrival happy and loads GRSIEnv
+    std::string grsi_path = getenv("GRSISYS") ? getenv("GRSISYS") : "";
+    if(grsi_path.length() > 0) {
+        grsi_path += "/";
+    }
+    grsi_path += ".grsirc";
+    gEnv->ReadFile(grsi_path.c_str(), kEnvChange);
+
+    TParserLibrary::Get()->Load();
+
+    return true;
+} // end SumPeakGRSI_Init()